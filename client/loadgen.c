@@ -3,10 +3,37 @@
  * - Spawns <connections> worker threads.
  * - Each worker opens a TCP connection per request, sends one JSON, reads a tiny response.
  * - Measures per-request latency (connect + send + recv) and prints summary stats (RPS, p50/p95/p99).
+ * - Options (after or before the positional args):
+ *     -k      keep-alive: each worker sends all its requests on one connection
+ *     -i N    hold N extra idle connections open for the whole run (POS terminals)
+ *     -t MS   client timeout: give up on a response after MS (SO_RCVTIMEO);
+ *             give-ups count as sent_err and timeouts; in-time APPROVED answers
+ *             are counted as approved
+ *     -d      with -t: also send "deadline_ms":MS so the server can skip late work
+ *     -u      unique "request_id" per request (otherwise every request has none)
+ *     -r PCT  with -u: PCT% of requests are retries that resend the request_id
+ *             of the worker's previous request (idempotency: answered from the
+ *             server's cache or as a DB duplicate, never a second payment)
+ *     -S      with -u: every worker sends the same request_id sequence, so
+ *             request #i arrives on all connections at about the same time
+ *             (duplicate storm: one payment per id, the rest coalesced)
+ *     -H      HTTP/1.1: POST /secure/tx with the JSON as body (keep-alive with -k,
+ *             otherwise "Connection: close" per request); needs -a TOKEN (API_TOKEN)
+ *     -a TOK  Bearer token for -H
+ *     -I      ISO 8583: binary 0200 messages (2-byte length prefix, unique RRN
+ *             in DE37) to the server's ISO8583_PORT; APPROVED = response code 00
+ *     -p N    pipelining: send N requests in one write, then read the N responses
+ *             (latency counts from that write); a new connection per batch without -k
+ *     -b N    batch authorization: each request is a JSON array of N payments
+ *             (line or -H body) answered by one {"status":"BATCH",...} line;
+ *             counts, RPS and approved are payments, latency is per batch.
+ *             Implies -u (batch items need a request_id). Not with -I: pipeline
+ *             ISO 8583 with -p against a server started with ISO8583_BATCH=1
  *
  * VN (Phỏng vấn):
  * - Công cụ bắn tải đơn giản để đo tổng quan: bao nhiêu yêu cầu/giây, độ trễ p50/p95/p99.
- * - Mỗi request dùng 1 kết nối cho dễ minh hoạ; có thể tối ưu tái sử dụng kết nối/keep-alive.
+ * - Mặc định mỗi request 1 kết nối; -k tái sử dụng kết nối, -H dùng HTTP/1.1, -I dùng ISO 8583 nhị phân,
+ *   -p N gửi dồn N request (pipelining), -b N gửi lô N giao dịch trong một request.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +46,8 @@
 #include <pthread.h>
 #include <time.h>
 #include <stdint.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 
 // Open one TCP connection to localhost:port (mở một kết nối TCP tới localhost)
 static int connect_once(int port) {
@@ -31,73 +60,338 @@ static int connect_once(int port) {
     return fd;
 }
 
+// Request/response framing (-H, -I)
+enum { PROTO_LINE = 0, PROTO_HTTP, PROTO_ISO };
+
+// Response code (DE39) of an ISO 8583 response m[0..n) (after the length prefix):
+// the fields before it are skipped using their sizes. Returns 0, or -1 if malformed.
+static int iso_response_code(const unsigned char *m, size_t n, char rc[3]) {
+    static const signed char k_len[40] = {[2] = -2, [3] = 6, [4] = 12, [7] = 10, [11] = 6, [12] = 6,
+                                          [13] = 4, [37] = 12, [38] = 6, [39] = 2}; // -2 = LLVAR
+    if (n < 12) return -1;
+    size_t pos = 4 + ((m[4] & 0x80) ? 16 : 8);
+    for (int f = 2; f <= 39; ++f) {
+        if (!(m[4 + (f - 1) / 8] & (0x80 >> ((f - 1) % 8)))) continue;
+        if (k_len[f] == 0) return -1;
+        size_t l = (size_t)k_len[f];
+        if (k_len[f] < 0) {
+            if (pos + 2 > n) return -1;
+            l = (size_t)(m[pos] - '0') * 10 + (size_t)(m[pos + 1] - '0');
+            pos += 2;
+        }
+        if (pos + l > n) return -1;
+        if (f == 39) { memcpy(rc, m + pos, 2); rc[2] = '\0'; return 0; }
+        pos += l;
+    }
+    return -1;
+}
+
+// Buffered response reader: one connection may carry several pipelined answers
+typedef struct {
+    char buf[16384]; // a 64-item batch answer is ~7 KB
+    size_t used;
+} resp_reader;
+
+// Next response (a JSON line, with PROTO_HTTP an HTTP/1.1 response whose body
+// is returned, with PROTO_ISO "APPROVED" or "DECLINED rc=NN") into out;
+// *server_close = 1 when the server announced "Connection: close".
+// Returns 0, or -1 on EOF/error/timeout.
+static int read_response(int fd, resp_reader *rd, int proto, char *out, size_t outsz, int *server_close) {
+    for (;;) {
+        size_t frame = 0, body_off = 0, body_len = 0;
+        if (proto == PROTO_LINE) {
+            char *nl = memchr(rd->buf, '\n', rd->used);
+            if (nl) { frame = (size_t)(nl - rd->buf) + 1; body_len = frame; }
+        } else if (proto == PROTO_ISO) {
+            const unsigned char *u = (const unsigned char *)rd->buf;
+            if (rd->used >= 2) {
+                size_t n = ((size_t)u[0] << 8) | u[1];
+                if (n + 2 > sizeof(rd->buf) - 1) return -1;
+                if (rd->used >= n + 2) {
+                    char rc[3];
+                    if (iso_response_code(u + 2, n, rc) != 0) return -1;
+                    snprintf(out, outsz, strcmp(rc, "00") == 0 ? "APPROVED" : "DECLINED rc=%s", rc);
+                    rd->used -= n + 2;
+                    memmove(rd->buf, rd->buf + n + 2, rd->used);
+                    return 0;
+                }
+            }
+        } else {
+            rd->buf[rd->used] = '\0';
+            char *hend = strstr(rd->buf, "\r\n\r\n");
+            if (hend) {
+                *hend = '\0';
+                const char *cl = strstr(rd->buf, "Content-Length:");
+                body_off = (size_t)(hend - rd->buf) + 4;
+                body_len = cl ? (size_t)strtoul(cl + 15, NULL, 10) : 0;
+                if (strstr(rd->buf, "Connection: close")) *server_close = 1;
+                *hend = '\r';
+                if (body_off + body_len > sizeof(rd->buf) - 1) return -1;
+                if (rd->used >= body_off + body_len) frame = body_off + body_len;
+            }
+        }
+        if (frame) {
+            size_t n = body_len < outsz - 1 ? body_len : outsz - 1;
+            memcpy(out, rd->buf + body_off, n);
+            out[n] = '\0';
+            rd->used -= frame;
+            memmove(rd->buf, rd->buf + frame, rd->used);
+            return 0;
+        }
+        if (rd->used + 1 >= sizeof(rd->buf)) return -1;
+        ssize_t n = recv(fd, rd->buf + rd->used, sizeof(rd->buf) - 1 - rd->used, 0);
+        if (n <= 0) return -1;
+        rd->used += (size_t)n;
+    }
+}
+
 // Per-worker parameters and latency buffer (tham số và bộ đệm độ trễ theo worker)
 typedef struct {
     int port;
     int reqs;
+    int keepalive;
+    int proto;                  // PROTO_LINE, -H: POST /secure/tx over HTTP/1.1, -I: ISO 8583
+    const char *token;          // -a: Bearer token for -H
+    int depth;                  // -p: requests in flight per connection (pipelining)
+    int deadline_ms;            // -t (0 = wait forever)
+    int send_deadline;          // -d: put deadline_ms in the payload
+    int unique_ids;             // -u
+    int dup_pct;                // -r: share of requests that retry the previous request_id
+    int shared_ids;             // -S: request_ids shared by all workers
+    int batch_items;            // -b: payments per request (1 = plain request)
+    int id;                     // worker index (for request_id)
     volatile unsigned long *ok;
+    volatile unsigned long *timeouts;
+    volatile unsigned long *approved;   // with -t: answers that arrived in time and APPROVED
     volatile unsigned long *err;
     struct { uint64_t *a; size_t n, cap; } lat;
 } worker_arg;
 
-// Worker: send <reqs> requests sequentially; record latency for each
-// VN: Mỗi vòng lặp mở kết nối → gửi JSON → đọc phản hồi → đo thời gian.
+// ISO 8583 0200 (purchase) for request #i: DE2 3 4 7 11 37 41 49, binary bitmap
+static size_t format_iso_request(const worker_arg *w, int i, char *out, size_t cap) {
+    static const char k_b36[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const int k_fields[] = {2, 3, 4, 7, 11, 37, 41, 49};
+    char rrn[13], fields[128];
+    // RRN: pid, worker, request (base 36) → unique per run
+    snprintf(rrn, sizeof(rrn), "%04d%03d", (int)getpid() % 10000, w->id % 1000);
+    for (int k = 11, x = i; k >= 7; --k, x /= 36) rrn[k] = k_b36[x % 36];
+    rrn[12] = '\0';
+    int fl = snprintf(fields, sizeof(fields), "16%s%s%s%s%06d%sLG%06d%s", "4111111111111111", "000000",
+                      "000000001000", "0101120000", i % 1000000, rrn, w->id % 1000000, "840");
+    size_t n = 4 + 8 + (size_t)fl;
+    if (fl <= 0 || n + 2 > cap) return 0;
+    unsigned char *p = (unsigned char *)out;
+    p[0] = (unsigned char)(n >> 8);
+    p[1] = (unsigned char)n;
+    memcpy(p + 2, "0200", 4);
+    memset(p + 6, 0, 8);
+    for (size_t k = 0; k < sizeof(k_fields) / sizeof(k_fields[0]); ++k)
+        p[6 + (k_fields[k] - 1) / 8] |= (unsigned char)(0x80 >> ((k_fields[k] - 1) % 8));
+    memcpy(p + 14, fields, (size_t)fl);
+    return n + 2;
+}
+
+// -r: request #i is a retry for a fixed dup_pct% of i (hash of i, so pipelined
+// and sequential runs send the same ids); a retry reuses the id of request i-1,
+// itself possibly a retry of an earlier one
+static int request_index(const worker_arg *w, int i) {
+    while (i > 0 && (int)(((uint32_t)i * 2654435761u) >> 16) % 100 < w->dup_pct) i--;
+    return i;
+}
+
+// One payment object (no newline); item k of a -b batch gets its own request_id
+static int format_payment(const worker_arg *w, int i, int k, char *out, size_t cap) {
+    char extra[96];
+    size_t xl = 0;
+    extra[0] = '\0';
+    if (w->send_deadline && w->deadline_ms > 0) xl += (size_t)snprintf(extra + xl, sizeof(extra) - xl, ",\"deadline_ms\":%d", w->deadline_ms);
+    if (w->batch_items > 1) snprintf(extra + xl, sizeof(extra) - xl, ",\"request_id\":\"lg%d-%d-%d-%d\"", (int)getpid(), w->id, i, k);
+    else if (w->unique_ids) snprintf(extra + xl, sizeof(extra) - xl, ",\"request_id\":\"lg%d-%d-%d\"", (int)getpid(),
+                                     w->shared_ids ? -1 : w->id, request_index(w, i));
+    return snprintf(out, cap, "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\"%s}", extra);
+}
+
+// Append request #i (JSON line, an HTTP request around it, or ISO 8583) to out
+static size_t format_request(const worker_arg *w, int i, int last_on_conn, char *out, size_t cap) {
+    if (w->proto == PROTO_ISO) return format_iso_request(w, i, out, cap);
+    char json[8192]; // server line cap (HANDLER_BUF_SIZE)
+    int jl = 0;
+    if (w->batch_items > 1) json[jl++] = '[';
+    for (int k = 0; k < w->batch_items; ++k) {
+        if (k) json[jl++] = ',';
+        int pl = format_payment(w, i, k, json + jl, sizeof(json) - (size_t)jl - 3);
+        if (pl <= 0 || (size_t)(jl + pl) >= sizeof(json) - 3) return 0;
+        jl += pl;
+    }
+    if (w->batch_items > 1) json[jl++] = ']';
+    json[jl++] = '\n';
+    json[jl] = '\0';
+    int n;
+    if (w->proto != PROTO_HTTP) {
+        n = snprintf(out, cap, "%s", json);
+    } else {
+        n = snprintf(out, cap,
+                     "POST /secure/tx HTTP/1.1\r\nHost: localhost\r\nAuthorization: Bearer %s\r\n"
+                     "Content-Type: application/json\r\nContent-Length: %d\r\n%s\r\n%s",
+                     w->token ? w->token : "", jl,
+                     last_on_conn && !w->keepalive ? "Connection: close\r\n" : "", json);
+    }
+    return n > 0 && (size_t)n < cap ? (size_t)n : 0;
+}
+
+static void record_latency(worker_arg *w, uint64_t us) {
+    if (w->lat.n == w->lat.cap) {
+        size_t nc = w->lat.cap ? w->lat.cap * 2 : 1024;
+        uint64_t *na = (uint64_t *)realloc(w->lat.a, nc * sizeof(uint64_t));
+        if (na) { w->lat.a = na; w->lat.cap = nc; }
+    }
+    if (w->lat.n < w->lat.cap) w->lat.a[w->lat.n++] = us;
+}
+
+// Worker: send <reqs> requests in batches of <depth> (one send per batch);
+// latency of each response is measured from its batch's send
+// VN: Mỗi lô: (mở kết nối) → gửi depth request một lần → đọc lần lượt depth phản hồi.
 static void *worker_main(void *p) {
     worker_arg *w = (worker_arg *)p;
-    const char *payload = "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\"}\n";
-    char resp[256];
-    for (int i = 0; i < w->reqs; ++i) {
-        int fd = connect_once(w->port);
-        if (fd < 0) { __sync_fetch_and_add(w->err, 1); continue; }
+    struct timeval rcv_to = { .tv_sec = w->deadline_ms / 1000, .tv_usec = (w->deadline_ms % 1000) * 1000 };
+    char resp[1024];
+    size_t send_cap = (size_t)w->depth * 512 * (size_t)w->batch_items;
+    char *sendbuf = (char *)malloc(send_cap);
+    resp_reader *rd = (resp_reader *)malloc(sizeof(*rd));
+    if (!sendbuf || !rd) { free(sendbuf); free(rd); return NULL; }
+    int kfd = -1; // keep-alive connection (-k)
+    for (int i = 0; i < w->reqs; ) {
+        int batch = w->reqs - i < w->depth ? w->reqs - i : w->depth;
+        size_t len = 0;
+        for (int j = 0; j < batch; ++j) {
+            len += format_request(w, i + j, j == batch - 1, sendbuf + len, send_cap - len);
+        }
+        int fd = kfd;
+        if (fd < 0) {
+            fd = connect_once(w->port);
+            rd->used = 0;
+        }
+        if (fd < 0) { __sync_fetch_and_add(w->err, (unsigned long)batch * (unsigned long)w->batch_items); i += batch; continue; }
+        if (w->deadline_ms > 0 && fd != kfd) (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_to, sizeof(rcv_to));
         struct timespec t0, t1; clock_gettime(CLOCK_MONOTONIC, &t0);
-        ssize_t n = send(fd, payload, strlen(payload), 0);
-        if (n < 0) { close(fd); __sync_fetch_and_add(w->err, 1); continue; }
-        (void)recv(fd, resp, sizeof(resp), 0);
-        clock_gettime(CLOCK_MONOTONIC, &t1);
-        close(fd);
-        __sync_fetch_and_add(w->ok, 1);
-        uint64_t us = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000ULL + (uint64_t)((t1.tv_nsec - t0.tv_nsec) / 1000);
-        // push latency
-        if (w->lat.n == w->lat.cap) {
-            size_t nc = w->lat.cap ? w->lat.cap * 2 : 1024;
-            uint64_t *na = (uint64_t *)realloc(w->lat.a, nc * sizeof(uint64_t));
-            if (na) { w->lat.a = na; w->lat.cap = nc; }
+        ssize_t n = send(fd, sendbuf, len, MSG_NOSIGNAL);
+        if (n < 0) { close(fd); kfd = -1; __sync_fetch_and_add(w->err, (unsigned long)batch * (unsigned long)w->batch_items); i += batch; continue; }
+        int done = 0, server_close = 0, failed = 0;
+        for (; done < batch; ++done) {
+            errno = 0;
+            if (read_response(fd, rd, w->proto, resp, sizeof(resp), &server_close) < 0 || strstr(resp, "server_busy")) {
+                // server closed (idle timeout / busy / -t give-up): reconnect on the next batch
+                if (errno == EAGAIN || errno == EWOULDBLOCK) __sync_fetch_and_add(w->timeouts, 1);
+                failed = 1;
+                break;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            __sync_fetch_and_add(w->ok, (unsigned long)w->batch_items);
+            if (w->deadline_ms > 0 && w->batch_items > 1) {
+                const char *a = strstr(resp, "\"approved\":");
+                if (a) __sync_fetch_and_add(w->approved, strtoul(a + 11, NULL, 10));
+            } else if (w->deadline_ms > 0 && strstr(resp, "APPROVED")) {
+                __sync_fetch_and_add(w->approved, 1);
+            }
+            record_latency(w, (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000ULL + (uint64_t)((t1.tv_nsec - t0.tv_nsec) / 1000));
+            if (server_close && done + 1 < batch) { ++done; failed = 1; break; }
         }
-        if (w->lat.n < w->lat.cap) w->lat.a[w->lat.n++] = us;
+        if (failed) __sync_fetch_and_add(w->err, (unsigned long)(batch - done) * (unsigned long)w->batch_items);
+        i += batch;
+        if (failed || server_close || !w->keepalive) { close(fd); kfd = -1; }
+        else kfd = fd;
     }
+    if (kfd >= 0) close(kfd);
+    free(sendbuf);
+    free(rd);
     return NULL;
 }
 
+// Open <n> idle connections that never send (ulimit -n must allow it)
+static int *open_idle(int port, int n, int *opened) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)n + 1024) {
+        rl.rlim_cur = rl.rlim_max < (rlim_t)n + 1024 ? rl.rlim_max : (rlim_t)n + 1024;
+        (void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    int *fds = (int *)calloc((size_t)n, sizeof(int));
+    *opened = 0;
+    if (!fds) return NULL;
+    for (int i = 0; i < n; ++i) {
+        int fd = connect_once(port);
+        if (fd < 0) break;
+        fds[(*opened)++] = fd;
+    }
+    return fds;
+}
+
 /*
  * Simple load generator skeleton.
  *
- * Usage: ./loadgen <connections> <requests_per_connection> <port>
+ * Usage: ./loadgen [-k] [-u [-r dup_pct] [-S]] [-H -a token | -I] [-p depth] [-b items] [-i idle_conns] [-t timeout_ms [-d]] <connections> <requests_per_connection> <port>
  *
  * This program is intended to create the specified number of concurrent
  * connections to localhost on the given port and send a fixed number of
  * transaction requests per connection. Each request is a simple JSON
- * string (e.g. {"pan":"4111111111111111","amount":"10.00"}). Responses
- * are ignored.
+ * string (e.g. {"pan":"4111111111111111","amount":"10.00"}), either as a
+ * line or (-H) as the body of POST /secure/tx, or (-I) the same purchase as
+ * a binary ISO 8583 0200 message. With -b each request carries N payments
+ * and requests_per_connection counts those batch requests.
  */
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <connections> <requests_per_conn> <port>\n", argv[0]);
+    int keepalive = 0, idle = 0, deadline_ms = 0, send_deadline = 0, unique_ids = 0, dup_pct = 0, shared_ids = 0, proto = PROTO_LINE, depth = 1, batch_items = 1, opt;
+    const char *token = NULL;
+    while ((opt = getopt(argc, argv, "kudSHIa:p:b:i:r:t:")) != -1) {
+        switch (opt) {
+        case 'k': keepalive = 1; break;
+        case 'H': proto = PROTO_HTTP; break;
+        case 'I': proto = PROTO_ISO; break;
+        case 'a': token = optarg; break;
+        case 'p': depth = atoi(optarg); break;
+        case 'b': batch_items = atoi(optarg); break;
+        case 'u': unique_ids = 1; break;
+        case 'r': dup_pct = atoi(optarg); break;
+        case 'S': shared_ids = 1; break;
+        case 'd': send_deadline = 1; break;
+        case 'i': idle = atoi(optarg); break;
+        case 't': deadline_ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-k] [-u [-r dup_pct] [-S]] [-H -a token | -I] [-p depth] [-b items] [-i idle_conns] [-t timeout_ms [-d]] <connections> <requests_per_conn> <port>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 3) {
+        fprintf(stderr, "Usage: %s [-k] [-u [-r dup_pct] [-S]] [-H -a token | -I] [-p depth] [-b items] [-i idle_conns] [-t timeout_ms [-d]] <connections> <requests_per_conn> <port>\n", argv[0]);
         return 1;
     }
-    int conns = atoi(argv[1]);
-    int reqs = atoi(argv[2]);
-    int port = atoi(argv[3]);
-    if (conns <= 0 || reqs <= 0 || port <= 0) {
+    int conns = atoi(argv[optind]);
+    int reqs = atoi(argv[optind + 1]);
+    int port = atoi(argv[optind + 2]);
+    if (conns <= 0 || reqs <= 0 || port <= 0 || idle < 0 || deadline_ms < 0 || depth <= 0 || depth > 1024 ||
+        batch_items <= 0 || batch_items > 64 || (batch_items > 1 && proto == PROTO_ISO) || dup_pct < 0 || dup_pct > 99) {
         fprintf(stderr, "Invalid arguments\n");
         return 1;
     }
-    fprintf(stderr, "loadgen: %d workers x %d reqs, port %d\n", conns, reqs, port);
+    int idle_open = 0;
+    int *idle_fds = idle > 0 ? open_idle(port, idle, &idle_open) : NULL;
+    fprintf(stderr, "loadgen: %d workers x %d reqs, port %d%s%s, depth=%d, batch=%d, idle=%d, timeout_ms=%d%s\n",
+            conns, reqs, port, proto == PROTO_HTTP ? " HTTP" : proto == PROTO_ISO ? " ISO8583" : "", keepalive ? " (keep-alive)" : "", depth, batch_items, idle_open, deadline_ms,
+            send_deadline && deadline_ms > 0 ? " (deadline_ms sent)" : "");
     pthread_t *ths = calloc((size_t)conns, sizeof(pthread_t));
     worker_arg *args = calloc((size_t)conns, sizeof(worker_arg));
-    volatile unsigned long ok = 0, err = 0;
+    volatile unsigned long ok = 0, err = 0, timeouts = 0, approved = 0;
     struct timespec T0, T1; clock_gettime(CLOCK_MONOTONIC, &T0);
     for (int i = 0; i < conns; ++i) {
-        args[i].port = port; args[i].reqs = reqs; args[i].ok = &ok; args[i].err = &err;
+        args[i].port = port; args[i].reqs = reqs; args[i].keepalive = keepalive;
+        args[i].proto = proto; args[i].token = token; args[i].depth = depth;
+        args[i].deadline_ms = deadline_ms;
+        args[i].send_deadline = send_deadline;
+        args[i].unique_ids = unique_ids;
+        args[i].dup_pct = dup_pct;
+        args[i].shared_ids = shared_ids;
+        args[i].batch_items = batch_items;
+        args[i].id = i;
+        args[i].ok = &ok; args[i].err = &err; args[i].timeouts = &timeouts; args[i].approved = &approved;
         pthread_create(&ths[i], NULL, worker_main, &args[i]);
     }
     for (int i = 0; i < conns; ++i) pthread_join(ths[i], NULL);
@@ -127,8 +421,12 @@ int main(int argc, char *argv[]) {
         p95 = all[(size_t)((total-1)*0.95)];
         p99 = all[(size_t)((total-1)*0.99)];
     }
-    printf("sent_ok=%lu, sent_err=%lu, wall=%.3fs, RPS=%.2f, p50=%luus, p95=%luus, p99=%luus\n",
+    printf("sent_ok=%lu, sent_err=%lu, wall=%.3fs, RPS=%.2f, p50=%luus, p95=%luus, p99=%luus",
            ok, err, wall_s, rps, (unsigned long)p50, (unsigned long)p95, (unsigned long)p99);
+    if (deadline_ms > 0) printf(", timeouts=%lu, approved=%lu", timeouts, approved);
+    printf("\n");
+    for (int i = 0; i < idle_open; ++i) close(idle_fds[i]);
+    free(idle_fds);
     free(ths); free(args); free(all);
     return 0;
 }
@@ -4,6 +4,10 @@
 # - Varies THREADS and QUEUE_CAP
 # - Starts server per configuration, runs loadgen, captures RPS/p95 and /metrics
 # - Writes CSV results for easy comparison
+# - CPU_SET / NUMA_NODE / CPU_PIN are passed to the server and recorded per row,
+#   so a pinned run can be compared with an unpinned one (before/after p99):
+#     DB_URI=... ./scripts/bench_matrix.sh
+#     DB_URI=... CPU_SET=0-15 NUMA_NODE=0 CSV_OUT=logs/pinned.csv ./scripts/bench_matrix.sh
 
 set -euo pipefail
 
@@ -14,6 +18,9 @@ REQS="${REQS:-200}"
 THREADS_SET_CSV="${THREADS_SET:-1,2,4,8}"
 QUEUE_CAP_SET_CSV="${QUEUE_CAP_SET:-1,32,1024}"
 ROUNDS="${ROUNDS:-1}"
+CPU_SET="${CPU_SET:-}"
+NUMA_NODE="${NUMA_NODE:-}"
+CPU_PIN="${CPU_PIN:-spread}"
 OUT="${CSV_OUT:-logs/bench-matrix-$(date +%Y%m%d-%H%M%S).csv}"
 
 if [[ -z "$DB_URI" ]]; then
@@ -31,7 +38,7 @@ IFS=',' read -r -a queue_arr <<< "$QUEUE_CAP_SET_CSV"
 
 echo "Writing results to: $OUT"
 if [[ ! -f "$OUT" ]]; then
-  echo "timestamp,threads,queue_cap,conns,reqs,port,rps,p95_us,total,approved,declined,server_busy" > "$OUT"
+  echo "timestamp,threads,queue_cap,conns,reqs,port,rps,p95_us,total,approved,declined,server_busy,p99_us,cpu_set,numa_node,cpu_pin" > "$OUT"
 fi
 
 build() {
@@ -40,8 +47,9 @@ build() {
 
 start_server() {
   local threads="$1" qcap="$2"
-  echo "-- Starting server THREADS=$threads QUEUE_CAP=$qcap PORT=$PORT"
+  echo "-- Starting server THREADS=$threads QUEUE_CAP=$qcap PORT=$PORT CPU_SET=${CPU_SET:-any} NUMA_NODE=${NUMA_NODE:-any}"
   DB_URI="$DB_URI" THREADS="$threads" QUEUE_CAP="$qcap" PORT="$PORT" \
+    CPU_SET="$CPU_SET" NUMA_NODE="$NUMA_NODE" CPU_PIN="$CPU_PIN" \
     "$ROOT_DIR/scripts/run.sh" 2>"$ROOT_DIR/server.err" & echo $! >"$ROOT_DIR/server.pid"
   for i in {1..50}; do
     if printf 'GET /healthz\r\n' | nc -w 1 127.0.0.1 "$PORT" 2>/dev/null | grep -q '^OK'; then
@@ -84,18 +92,22 @@ for t in "${threads_arr[@]}"; do
     start_server "$t" "$q"
     rps_acc=0
     p95_acc=0
+    p99_acc=0
     for ((r=1; r<=ROUNDS; r++)); do
       out=$("$ROOT_DIR/build/loadgen" "$CONNS" "$REQS" "$PORT" 2>/dev/null || true)
       rps=$(sed -n 's/.*RPS=\([0-9.][0-9.]*\).*/\1/p' <<<"$out")
       p95=$(sed -n 's/.*p95=\([0-9][0-9]*\)us.*/\1/p' <<<"$out")
+      p99=$(sed -n 's/.*p99=\([0-9][0-9]*\)us.*/\1/p' <<<"$out")
       rps_acc=$(awk -v a="$rps_acc" -v b="${rps:-0}" 'BEGIN{printf "%.3f", a + b}')
       p95_acc=$(( p95_acc + ${p95:-0} ))
+      p99_acc=$(( p99_acc + ${p99:-0} ))
     done
     # averages
     rps_avg=$(awk -v sum="$rps_acc" -v n="$ROUNDS" 'BEGIN{ if (n==0) n=1; printf "%.3f", sum/n }')
     if [[ "$ROUNDS" -gt 0 ]]; then p95_avg=$(( p95_acc / ROUNDS )); else p95_avg=$p95_acc; fi
+    if [[ "$ROUNDS" -gt 0 ]]; then p99_avg=$(( p99_acc / ROUNDS )); else p99_avg=$p99_acc; fi
     IFS=',' read -r total approved declined busy <<< "$(metrics)"
-    echo "$(date +%F\ %T),$t,$q,$CONNS,$REQS,$PORT,$rps_avg,$p95_avg,$total,$approved,$declined,$busy" | tee -a "$OUT"
+    echo "$(date +%F\ %T),$t,$q,$CONNS,$REQS,$PORT,$rps_avg,$p95_avg,$total,$approved,$declined,$busy,$p99_avg,\"${CPU_SET:-any}\",${NUMA_NODE:-any},$CPU_PIN" | tee -a "$OUT"
     stop_server
   done
 done
@@ -0,0 +1,160 @@
+/*
+ * CPU affinity / NUMA placement (EN + VN)
+ *
+ *   CPU_SET=0-15  ∩  NUMA_NODE=0 cpulist  ∩  sched_getaffinity()  = allowed set
+ *
+ *   CPU_PIN=spread (default)          CPU_PIN=set
+ *     acceptor/worker k → cpus[k]       every thread → allowed set
+ *     reversal          → allowed set
+ *
+ *  EN: Per-thread state (db_thread_get connection, per-thread coordinator,
+ *      SCHED=steal deque) is created lazily by the thread that uses it, so a
+ *      thread pinned at start first-touches that memory on its own node.
+ *      Threads pick CPUs round-robin in start order (workers are created
+ *      before the acceptors), wrapping when there are more threads than CPUs.
+ *  VN: Tập CPU cho phép = CPU_SET ∩ CPU của NUMA_NODE ∩ mask hiện tại. Mỗi
+ *      luồng ghim ngay khi bắt đầu, trước khi cấp phát DB conn/coordinator
+ *      riêng → bộ nhớ nằm trên node của chính nó.
+ */
+#define _GNU_SOURCE // CPU_SET, pthread_setaffinity_np
+#include "affinity.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define AFFINITY_MAX_NODES 1024
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static int g_enabled;
+static AffinityPolicy g_policy;
+static cpu_set_t g_allowed;
+static int g_cpus[CPU_SETSIZE]; // allowed CPUs in ascending order
+static int g_ncpus;
+static unsigned int g_next;     // round-robin cursor (atomic)
+
+// Parse "0-3,8,10-11" into *set; -1 on syntax error or out-of-range CPU
+static int parse_cpu_list(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s) {
+        while (*s == ',' || isspace((unsigned char)*s)) ++s;
+        if (!*s) break;
+        if (!isdigit((unsigned char)*s)) return -1;
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        s = end;
+        if (*s == '-') {
+            ++s;
+            if (!isdigit((unsigned char)*s)) return -1;
+            hi = strtol(s, &end, 10);
+            s = end;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) return -1;
+        for (long c = lo; c <= hi; ++c) CPU_SET((int)c, set);
+        while (isspace((unsigned char)*s)) ++s;
+        if (*s && *s != ',') return -1;
+    }
+    return 0;
+}
+
+// CPUs of a NUMA node from sysfs (no libnuma dependency)
+static int node_cpus(int node, cpu_set_t *set) {
+    char path[96], buf[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    return parse_cpu_list(buf, set);
+}
+
+// Prefer (not bind) the node's memory so allocations still succeed when it is full
+static void prefer_node_memory(int node) {
+    unsigned long mask[AFFINITY_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)AFFINITY_MAX_NODES) != 0) {
+        fprintf(stderr, "affinity: set_mempolicy(node %d): %s\n", node, strerror(errno));
+    }
+}
+
+int affinity_init(const char *cpu_list, int numa_node, AffinityPolicy policy) {
+    g_enabled = 0;
+    if ((!cpu_list || !*cpu_list) && numa_node < 0) return 0;
+    if (sched_getaffinity(0, sizeof(g_allowed), &g_allowed) != 0) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    cpu_set_t tmp;
+    if (cpu_list && *cpu_list) {
+        if (parse_cpu_list(cpu_list, &tmp) != 0) {
+            fprintf(stderr, "Error: invalid CPU_SET '%s' (expected e.g. 0-15,32-47)\n", cpu_list);
+            return -1;
+        }
+        CPU_AND(&g_allowed, &g_allowed, &tmp);
+    }
+    if (numa_node >= 0) {
+        if (numa_node >= AFFINITY_MAX_NODES || node_cpus(numa_node, &tmp) != 0) {
+            fprintf(stderr, "Error: NUMA_NODE %d not found in /sys/devices/system/node\n", numa_node);
+            return -1;
+        }
+        CPU_AND(&g_allowed, &g_allowed, &tmp);
+    }
+    g_ncpus = 0;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &g_allowed)) g_cpus[g_ncpus++] = c;
+    }
+    if (g_ncpus == 0) {
+        fprintf(stderr, "Error: CPU_SET/NUMA_NODE leave no usable CPU\n");
+        return -1;
+    }
+    // Everything started from here on (pool, acceptors, clearing...) inherits the set
+    if (pthread_setaffinity_np(pthread_self(), sizeof(g_allowed), &g_allowed) != 0) {
+        fprintf(stderr, "Error: cannot restrict threads to CPU_SET/NUMA_NODE\n");
+        return -1;
+    }
+    if (numa_node >= 0) prefer_node_memory(numa_node);
+    g_policy = policy;
+    g_next = 0;
+    g_enabled = 1;
+    char node[32] = "";
+    if (numa_node >= 0) snprintf(node, sizeof(node), ", NUMA node %d", numa_node);
+    fprintf(stderr, "CPU affinity: %d cpus%s, %s\n", g_ncpus, node,
+            policy == AFFINITY_PIN_SET ? "threads share the set" : "one cpu per thread");
+    return 0;
+}
+
+int affinity_enabled(void) {
+    return g_enabled;
+}
+
+int affinity_pin_self(AffinityRole role, int index) {
+    if (!g_enabled) return -1;
+    // Threads already inherit the whole set from affinity_init()
+    if (g_policy == AFFINITY_PIN_SET || role == AFFINITY_ROLE_BACKGROUND) return -1;
+    unsigned int slot = __sync_fetch_and_add(&g_next, 1);
+    int cpu = g_cpus[slot % (unsigned int)g_ncpus];
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+    if (rc != 0) {
+        fprintf(stderr, "affinity: %s %d → cpu %d: %s\n",
+                role == AFFINITY_ROLE_ACCEPTOR ? "acceptor" : "worker", index, cpu, strerror(rc));
+        return -1;
+    }
+    return cpu;
+}
+
+void affinity_pool_thread_start(int index, void *arg) {
+    (void)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_WORKER, index);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// CPU pinning for server threads (CPU_SET, NUMA_NODE, CPU_PIN)
+// VN: Ghim luồng (acceptor/worker/reversal) vào CPU được phép để DB conn và
+//     coordinator theo từng luồng không bị chuyển qua lại giữa các socket.
+
+typedef enum {
+    AFFINITY_PIN_SPREAD = 0, ///< each acceptor/worker gets one CPU of the set, round-robin (default)
+    AFFINITY_PIN_SET = 1     ///< every thread may run on the whole set (keeps threads on the node)
+} AffinityPolicy;
+
+typedef enum {
+    AFFINITY_ROLE_ACCEPTOR = 0,  ///< accept loop / epoll reactor
+    AFFINITY_ROLE_WORKER = 1,    ///< thread pool worker
+    AFFINITY_ROLE_BACKGROUND = 2 ///< reversal thread: always the whole set (mostly asleep)
+} AffinityRole;
+
+// Build the allowed set from cpu_list ("0-15,32-47", NULL = any) intersected
+// with the CPUs of numa_node (< 0 = any) and the current process mask, then
+// restrict the calling thread to it (threads created later inherit it) and,
+// with a NUMA node, prefer that node's memory. Without either option this is
+// a no-op. Returns 0 on success, -1 on a bad list or an empty set.
+int affinity_init(const char *cpu_list, int numa_node, AffinityPolicy policy);
+
+// 1 once affinity_init() set up pinning
+int affinity_enabled(void);
+
+// Pin the calling thread for its role; index is only used for the log line.
+// Call at thread start, before the thread allocates its own state, so that
+// memory is first touched on the right node. Returns the CPU (spread), -1 for
+// the whole set or when pinning is off.
+int affinity_pin_self(AffinityRole role, int index);
+
+// ThreadPoolOptions.on_thread_start hook: pins a pool worker
+void affinity_pool_thread_start(int index, void *arg);
@@ -0,0 +1,116 @@
+/*
+ * Request arena (EN + VN)
+ *
+ *   worker thread:  [ Transaction | DBParticipantContext | ClearingParticipantContext | ... free ]
+ *                   ^ base                                                            ^ used
+ *   arena_scope_end() → used = 0 (one store, no free per object)
+ *
+ *  EN: A payment used to malloc its Transaction and both participant contexts
+ *      and free them again a few milliseconds later, on every request. They
+ *      never outlive the request (txn_commit/txn_abort always remove the
+ *      Transaction), so each worker bumps them out of one block it keeps for
+ *      its lifetime. Allocations outside a scope (unit tests, the reversal
+ *      worker) and those that do not fit go to malloc; arena_release() tells
+ *      the two apart by address.
+ *  VN: Mỗi worker giữ một khối nhớ; đối tượng của request được cắt ra từ khối
+ *      này và cả khối được "trả lại" một lần khi request kết thúc.
+ */
+#include "arena.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16
+
+typedef struct {
+    char *base;                // NULL until the thread's first scope (or arena off)
+    size_t cap;
+    size_t used;
+    int in_scope;
+    unsigned long allocs;      // this request
+    unsigned long heap_allocs; // this request
+} Arena;
+
+static __thread Arena t_arena;
+
+static size_t g_arena_bytes = ARENA_DEFAULT_BYTES;
+static ArenaHook g_hook = NULL;
+static volatile unsigned long g_scopes = 0;
+static volatile unsigned long g_allocs = 0;
+static volatile unsigned long g_heap_allocs = 0;
+static volatile size_t g_high_water = 0;
+
+// The block is freed when the worker exits (elastic pool retiring a thread)
+static pthread_key_t arena_tls_key;
+static pthread_once_t arena_tls_once = PTHREAD_ONCE_INIT;
+
+static void arena_tls_destructor(void *ptr) {
+    // base/cap stay set: arena_release() from later destructors only compares addresses
+    free(ptr);
+}
+
+static void arena_tls_init_key(void) {
+    (void)pthread_key_create(&arena_tls_key, arena_tls_destructor);
+}
+
+void arena_set_hook(ArenaHook hook) { g_hook = hook; }
+
+void arena_configure(size_t bytes) {
+    g_arena_bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void arena_scope_begin(void) {
+    Arena *a = &t_arena;
+    if (!a->base && g_arena_bytes > 0 && a->cap == 0) {
+        pthread_once(&arena_tls_once, arena_tls_init_key);
+        a->base = (char *)aligned_alloc(ARENA_ALIGN, g_arena_bytes);
+        if (a->base) {
+            a->cap = g_arena_bytes;
+            pthread_setspecific(arena_tls_key, a->base);
+        }
+    }
+    a->used = 0;
+    a->allocs = a->heap_allocs = 0;
+    a->in_scope = 1;
+}
+
+void arena_scope_end(void) {
+    Arena *a = &t_arena;
+    if (!a->in_scope) return;
+    if (g_hook) g_hook(a->allocs, a->heap_allocs, a->used);
+    __sync_fetch_and_add(&g_scopes, 1);
+    if (a->allocs) __sync_fetch_and_add(&g_allocs, a->allocs);
+    if (a->heap_allocs) __sync_fetch_and_add(&g_heap_allocs, a->heap_allocs);
+    size_t hw = g_high_water;
+    while (a->used > hw && !__sync_bool_compare_and_swap(&g_high_water, hw, a->used)) hw = g_high_water;
+    a->used = 0;
+    a->in_scope = 0;
+}
+
+void *arena_alloc(size_t size) {
+    Arena *a = &t_arena;
+    if (a->in_scope) {
+        size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (a->base && need >= size && need <= a->cap - a->used) {
+            void *p = a->base + a->used;
+            a->used += need;
+            a->allocs++;
+            return p;
+        }
+        a->heap_allocs++;
+    }
+    return malloc(size);
+}
+
+void arena_release(void *p) {
+    const Arena *a = &t_arena;
+    if ((uintptr_t)p >= (uintptr_t)a->base && (uintptr_t)p < (uintptr_t)a->base + a->cap) return;
+    free(p);
+}
+
+void arena_stats(ArenaStats *out) {
+    out->scopes = g_scopes;
+    out->allocs = g_allocs;
+    out->heap_allocs = g_heap_allocs;
+    out->high_water = g_high_water;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+
+// Per-worker request arena for the objects a payment lives with (Transaction,
+// DB/clearing participant contexts)
+// VN: Mỗi worker có một vùng nhớ cấp phát kiểu "bump" (tăng con trỏ); handler mở
+//     một phạm vi (scope) cho mỗi request và đặt lại con trỏ khi xong, nên đường
+//     nóng không gọi malloc/free cho các đối tượng 2PC.
+
+/// Default arena size per worker thread (REQUEST_ARENA_KB)
+#define ARENA_DEFAULT_BYTES (16u * 1024u)
+
+/// Totals over all threads since start (GET /metrics)
+typedef struct {
+    unsigned long scopes;      ///< requests run inside arena_scope_begin/end
+    unsigned long allocs;      ///< allocations served from an arena
+    unsigned long heap_allocs; ///< allocations inside a scope that fell back to malloc (arena off or full)
+    size_t high_water;         ///< most arena bytes one request used
+} ArenaStats;
+
+/**
+ * Instrumentation hook, called by arena_scope_end() on the worker thread with
+ * what that request allocated: arena allocations, malloc fallbacks and arena
+ * bytes. NULL (default) = off. Set it before workers start.
+ */
+typedef void (*ArenaHook)(unsigned long allocs, unsigned long heap_allocs, size_t bytes);
+void arena_set_hook(ArenaHook hook);
+
+// Arena size for threads that have not allocated theirs yet (0 = off, every
+// allocation goes to malloc). Call once at startup.
+void arena_configure(size_t bytes);
+
+// Start / end one request on the calling thread. Ending rewinds the arena:
+// everything arena_alloc() returned inside the scope is invalid afterwards.
+// The arena itself is malloc'd on the first scope of a thread and freed at
+// thread exit.
+void arena_scope_begin(void);
+void arena_scope_end(void);
+
+/**
+ * size bytes, 16-byte aligned: from the thread's arena inside a scope while it
+ * has room, otherwise from malloc (outside a scope: tests, the reversal
+ * worker). Release with arena_release(), never free().
+ */
+void *arena_alloc(size_t size);
+
+// Free p if it came from malloc; arena memory is reclaimed by arena_scope_end()
+void arena_release(void *p);
+
+void arena_stats(ArenaStats *out);
@@ -7,21 +7,20 @@
 #include <time.h>
 #include <pthread.h>
 #include "metrics.h"
+#include "iso8583.h"
+#include "arena.h"
+#include "timer.h"
 
-/**
- * Simulate HTTP request to external clearing service
- * In production, this would use libcurl or similar
- */
-static int simulate_clearing_request(const char *url, 
-                                   const char *method,
-                                   const char *payload,
-                                   char *response,
-                                   size_t response_size,
-                                   int timeout_seconds) {
-    
-    // Simulate network delay
-    usleep(50000 + (rand() % 100000));  // 50-150ms
-    
+// Simulated network delay of one clearing call
+static long long simulate_clearing_latency_us(void) {
+    return 50000 + (rand() % 100000);  // 50-150ms
+}
+
+// Simulated answer of the clearing service, once its delay has passed
+static int simulate_clearing_response(const char *method,
+                                      const char *payload,
+                                      char *response,
+                                      size_t response_size) {
     // Simulate occasional failures (5% failure rate)
     if (rand() % 100 < 5) {
         snprintf(response, response_size, "{\"status\":\"ERROR\",\"reason\":\"network_timeout\"}");
@@ -47,6 +46,22 @@ static int simulate_clearing_request(const char *url,
     return 0;
 }
 
+/**
+ * Simulate HTTP request to external clearing service
+ * In production, this would use libcurl or similar
+ */
+static int simulate_clearing_request(const char *url, 
+                                   const char *method,
+                                   const char *payload,
+                                   char *response,
+                                   size_t response_size,
+                                   int timeout_seconds) {
+    
+    // Simulate network delay
+    usleep((useconds_t)simulate_clearing_latency_us());
+    return simulate_clearing_response(method, payload, response, response_size);
+}
+
 // --- Simple global circuit breaker for the clearing service (process-wide) ---
 typedef struct {
     pthread_mutex_t mu;
@@ -141,25 +156,24 @@ static void cb_on_result(int ok) {
 }
 
 ClearingParticipantContext *clearing_participant_init(const char *service_url, int timeout_seconds) {
-    ClearingParticipantContext *ctx = malloc(sizeof(ClearingParticipantContext));
+    ClearingParticipantContext *ctx = arena_alloc(sizeof(ClearingParticipantContext));
     if (!ctx) return NULL;
     
-    if (service_url) {
-        strncpy(ctx->service_url, service_url, sizeof(ctx->service_url) - 1);
-        ctx->service_url[sizeof(ctx->service_url) - 1] = '\0';
-    } else {
-        strcpy(ctx->service_url, "http://clearing.example.com/api");
-    }
+    ctx->service_url = service_url ? service_url : "http://clearing.example.com/api";
     
     cb_load_env_defaults();
     int def_timeout = timeout_seconds > 0 ? timeout_seconds : 30;
     int env_timeout = env_get_int("CLEARING_TIMEOUT", def_timeout);
     ctx->timeout_seconds = env_timeout > 0 ? env_timeout : def_timeout;
     ctx->has_hold = false;
-    memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
-    memset(ctx->pan_masked, 0, sizeof(ctx->pan_masked));
-    memset(ctx->amount, 0, sizeof(ctx->amount));
-    memset(ctx->merchant_id, 0, sizeof(ctx->merchant_id));
+    ctx->current_txn_id = "";
+    ctx->pan_masked = "";
+    ctx->amount_minor = 0;
+    ctx->amount_exp = 2;
+    ctx->merchant_id = "";
+    ctx->item_count = 1;
+    ctx->step_done = NULL;
+    ctx->step_arg = NULL;
     
     srand((unsigned int)time(NULL));  // Initialize random seed for simulation
     
@@ -174,37 +188,70 @@ void clearing_participant_destroy(ClearingParticipantContext *ctx) {
         clearing_participant_abort(ctx, ctx->current_txn_id);
     }
     
-    free(ctx);
+    arena_release(ctx);
 }
 
 int clearing_participant_set_transaction(ClearingParticipantContext *ctx,
                                        const char *txn_id,
                                        const char *pan_masked,
-                                       const char *amount,
+                                       int64_t amount_minor,
+                                       int amount_exp,
                                        const char *merchant_id) {
-    if (!ctx || !txn_id || !pan_masked || !amount) return -1;
-    
-    strncpy(ctx->current_txn_id, txn_id, MAX_TRANSACTION_ID_LEN - 1);
-    ctx->current_txn_id[MAX_TRANSACTION_ID_LEN - 1] = '\0';
+    if (!ctx || !txn_id || !pan_masked || !iso_amount_scale(amount_exp)) return -1;
     
-    strncpy(ctx->pan_masked, pan_masked, sizeof(ctx->pan_masked) - 1);
-    ctx->pan_masked[sizeof(ctx->pan_masked) - 1] = '\0';
-    
-    strncpy(ctx->amount, amount, sizeof(ctx->amount) - 1);
-    ctx->amount[sizeof(ctx->amount) - 1] = '\0';
-    
-    if (merchant_id) {
-        strncpy(ctx->merchant_id, merchant_id, sizeof(ctx->merchant_id) - 1);
-        ctx->merchant_id[sizeof(ctx->merchant_id) - 1] = '\0';
-    } else {
-        strcpy(ctx->merchant_id, "MERCHANT001");
-    }
+    // Borrowed: the handler's request outlives this context (no copies per request)
+    ctx->current_txn_id = txn_id;
+    ctx->pan_masked = pan_masked;
+    ctx->amount_minor = amount_minor;
+    ctx->amount_exp = amount_exp;
+    ctx->merchant_id = merchant_id ? merchant_id : "MERCHANT001";
+    ctx->item_count = 1;
     
     log_message_json("INFO", "clearing_participant", txn_id, 
                     "Transaction details set", -1);
     return 0;
 }
 
+int clearing_participant_set_batch(ClearingParticipantContext *ctx,
+                                   const char *txn_id,
+                                   int item_count,
+                                   int64_t total_minor,
+                                   int amount_exp,
+                                   const char *merchant_id) {
+    if (!ctx || !txn_id || item_count <= 0 || !iso_amount_scale(amount_exp)) return -1;
+    ctx->current_txn_id = txn_id;
+    ctx->pan_masked = "";
+    ctx->amount_minor = total_minor;
+    ctx->amount_exp = amount_exp;
+    ctx->merchant_id = merchant_id ? merchant_id : "MERCHANT001";
+    ctx->item_count = item_count;
+    log_message_json("INFO", "clearing_participant", txn_id, "Batch details set", -1);
+    return 0;
+}
+
+// Request body for the clearing service; a batch carries its item count
+// and total instead of one PAN
+static void format_payload(const ClearingParticipantContext *ctx, const char *action, const char *txn_id,
+                           char *payload, size_t cap) {
+    char amount[32];
+    (void)iso_amount_format(ctx->amount_minor, ctx->amount_exp, amount, sizeof(amount));
+    if (ctx->item_count > 1) {
+        snprintf(payload, cap,
+                "{\"action\":\"%s\",\"transaction_id\":\"%s\",\"items\":%d,\"amount\":\"%s\",\"merchant_id\":\"%s\"}",
+                action, txn_id, ctx->item_count, amount, ctx->merchant_id);
+        return;
+    }
+    snprintf(payload, cap,
+            "{"
+            "\"action\":\"%s\","
+            "\"transaction_id\":\"%s\","
+            "\"pan\":\"%s\","
+            "\"amount\":\"%s\","
+            "\"merchant_id\":\"%s\""
+            "}",
+            action, txn_id, ctx->pan_masked, amount, ctx->merchant_id);
+}
+
 int clearing_participant_prepare(void *context, const char *txn_id) {
     ClearingParticipantContext *ctx = (ClearingParticipantContext *)context;
     if (!ctx || !txn_id) return -1;
@@ -217,15 +264,7 @@ int clearing_participant_prepare(void *context, const char *txn_id) {
     
     // Prepare request payload
     char payload[512];
-    snprintf(payload, sizeof(payload),
-            "{"
-            "\"action\":\"prepare\","
-            "\"transaction_id\":\"%s\","
-            "\"pan\":\"%s\","
-            "\"amount\":\"%s\","
-            "\"merchant_id\":\"%s\""
-            "}",
-            txn_id, ctx->pan_masked, ctx->amount, ctx->merchant_id);
+    format_payload(ctx, "prepare", txn_id, payload, sizeof(payload));
     
     cb_load_env_defaults();
     if (cb_should_short_circuit()) {
@@ -276,15 +315,7 @@ int clearing_participant_commit(void *context, const char *txn_id) {
     
     // Commit request payload
     char payload[512];
-    snprintf(payload, sizeof(payload),
-            "{"
-            "\"action\":\"commit\","
-            "\"transaction_id\":\"%s\","
-            "\"pan\":\"%s\","
-            "\"amount\":\"%s\","
-            "\"merchant_id\":\"%s\""
-            "}",
-            txn_id, ctx->pan_masked, ctx->amount, ctx->merchant_id);
+    format_payload(ctx, "commit", txn_id, payload, sizeof(payload));
     
     cb_load_env_defaults();
     if (cb_should_short_circuit()) {
@@ -311,7 +342,7 @@ int clearing_participant_commit(void *context, const char *txn_id) {
     // Parse response (simplified)
     if (strstr(response, "\"status\":\"OK\"")) {
         ctx->has_hold = false;
-        memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
+        ctx->current_txn_id = "";
         log_message_json("INFO", "clearing_participant", txn_id, 
                         "Transaction settled", -1);
         return 0;
@@ -334,15 +365,7 @@ int clearing_participant_abort(void *context, const char *txn_id) {
     
     // Abort request payload
     char payload[512];
-    snprintf(payload, sizeof(payload),
-            "{"
-            "\"action\":\"abort\","
-            "\"transaction_id\":\"%s\","
-            "\"pan\":\"%s\","
-            "\"amount\":\"%s\","
-            "\"merchant_id\":\"%s\""
-            "}",
-            txn_id, ctx->pan_masked, ctx->amount, ctx->merchant_id);
+    format_payload(ctx, "abort", txn_id, payload, sizeof(payload));
     
     char response[256];
     int result = simulate_clearing_request(ctx->service_url, "POST", payload,
@@ -360,7 +383,129 @@ int clearing_participant_abort(void *context, const char *txn_id) {
     
     // Always clear our state
     ctx->has_hold = false;
-    memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
+    ctx->current_txn_id = "";
     
     return 0;  // Always return success for abort
 }
+
+// [ANCHOR:CLEARING_ASYNC]
+// EN: The asynchronous steps run the same attempts as the blocking ones, but
+//     each simulated call is a timer: clearing_step_fire() runs when the
+//     call's delay has passed, draws its outcome and either reports, or
+//     schedules the next attempt after the back-off. With a real clearing
+//     service this is where a non-blocking HTTP client would sit.
+// VN: Bước clearing bất đồng bộ: độ trễ mạng mô phỏng và backoff là hẹn giờ,
+//     không có luồng nào ngủ chờ.
+enum { CLEARING_STEP_PREPARE = 0, CLEARING_STEP_COMMIT = 1, CLEARING_STEP_ABORT = 2 };
+
+static void clearing_step_report(ClearingParticipantContext *ctx, int rc) {
+    TxnStepDone done = ctx->step_done;
+    void *arg = ctx->step_arg;
+    ctx->step_done = NULL;
+    done(arg, rc);
+}
+
+static void clearing_step_fire(void *arg) {
+    ClearingParticipantContext *ctx = (ClearingParticipantContext *)arg;
+    const char *txn_id = ctx->step_txn_id;
+    char response[256];
+    int result = simulate_clearing_response("POST", ctx->step_payload, response, sizeof(response));
+    if (ctx->step_action == CLEARING_STEP_ABORT) {
+        // Best effort - don't fail if abort fails (idempotent)
+        if (result == 0 && strstr(response, "\"status\":\"OK\"")) {
+            log_message_json("INFO", "clearing_participant", txn_id, "Authorization hold released", -1);
+        } else {
+            log_message_json("WARN", "clearing_participant", txn_id, "Hold release failed (may timeout naturally)", -1);
+        }
+        ctx->has_hold = false;
+        ctx->current_txn_id = "";
+        clearing_step_report(ctx, 0);
+        return;
+    }
+    if (result != 0 && ctx->step_attempt < g_cb.max_retries) {
+        // exponential backoff: 100ms, 200ms, 400ms... then the next call's delay
+        long long backoff_us = 100000LL * (1 << ctx->step_attempt);
+        ctx->step_attempt++;
+        if (timer_after(backoff_us + simulate_clearing_latency_us(), clearing_step_fire, ctx) == 0) return;
+    }
+    int prepare = ctx->step_action == CLEARING_STEP_PREPARE;
+    cb_on_result(result == 0);
+    if (result != 0) {
+        log_message_json("ERROR", "clearing_participant", txn_id,
+                        prepare ? "Clearing PREPARE failed" : "Clearing COMMIT failed", -1);
+        clearing_step_report(ctx, -1);
+        return;
+    }
+    if (!strstr(response, "\"status\":\"OK\"")) {
+        log_message_json("ERROR", "clearing_participant", txn_id,
+                        prepare ? "Clearing service declined" : "Clearing service commit failed", -1);
+        clearing_step_report(ctx, -1);
+        return;
+    }
+    if (prepare) {
+        ctx->has_hold = true;
+        log_message_json("INFO", "clearing_participant", txn_id, "Authorization hold placed", -1);
+    } else {
+        ctx->has_hold = false;
+        ctx->current_txn_id = "";
+        log_message_json("INFO", "clearing_participant", txn_id, "Transaction settled", -1);
+    }
+    clearing_step_report(ctx, 0);
+}
+
+static int clearing_step_start(ClearingParticipantContext *ctx, int action, const char *txn_id,
+                               TxnStepDone done, void *step_arg) {
+    static const char *const k_actions[] = {"prepare", "commit", "abort"};
+    if (action != CLEARING_STEP_ABORT) {
+        cb_load_env_defaults();
+        if (cb_should_short_circuit()) {
+            log_message_json("WARN", "clearing_participant", txn_id,
+                            action == CLEARING_STEP_PREPARE ? "Circuit open: short-circuit PREPARE"
+                                                            : "Circuit open: short-circuit COMMIT", -1);
+            metrics_inc_cb_short_circuit();
+            return -1;
+        }
+    }
+    format_payload(ctx, k_actions[action], txn_id, ctx->step_payload, sizeof(ctx->step_payload));
+    ctx->step_txn_id = txn_id;
+    ctx->step_action = action;
+    ctx->step_attempt = 0;
+    ctx->step_done = done;
+    ctx->step_arg = step_arg;
+    if (timer_after(simulate_clearing_latency_us(), clearing_step_fire, ctx) != 0) {
+        ctx->step_done = NULL;
+        log_message_json("ERROR", "clearing_participant", txn_id, "Clearing call not scheduled", -1);
+        return -1;
+    }
+    return 0;
+}
+
+int clearing_participant_prepare_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    ClearingParticipantContext *ctx = (ClearingParticipantContext *)context;
+    if (!ctx || !txn_id || !done) return -1;
+    if (strcmp(ctx->current_txn_id, txn_id) != 0) {
+        log_message_json("ERROR", "clearing_participant", txn_id, "Transaction ID mismatch", -1);
+        return -1;
+    }
+    return clearing_step_start(ctx, CLEARING_STEP_PREPARE, txn_id, done, step_arg);
+}
+
+int clearing_participant_commit_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    ClearingParticipantContext *ctx = (ClearingParticipantContext *)context;
+    if (!ctx || !txn_id || !done) return -1;
+    if (strcmp(ctx->current_txn_id, txn_id) != 0 || !ctx->has_hold) {
+        log_message_json("ERROR", "clearing_participant", txn_id, "No prepared transaction to commit", -1);
+        return -1;
+    }
+    return clearing_step_start(ctx, CLEARING_STEP_COMMIT, txn_id, done, step_arg);
+}
+
+int clearing_participant_abort_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    ClearingParticipantContext *ctx = (ClearingParticipantContext *)context;
+    if (!ctx || !txn_id || !done) return -1;
+    // Proceed even if we think no hold exists (idempotent best-effort abort)
+    if (!ctx->has_hold || strcmp(ctx->current_txn_id, txn_id) != 0) {
+        log_message_json("INFO", "clearing_participant", txn_id, "No local hold; sending idempotent abort", -1);
+    }
+    return clearing_step_start(ctx, CLEARING_STEP_ABORT, txn_id, done, step_arg);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "transaction_coordinator.h"
+#include <stdint.h>
 
 /**
  * Clearing participant for 2-phase commit
@@ -10,21 +11,33 @@
  */
 
 typedef struct {
-    char service_url[256];
+    const char *service_url;
     int timeout_seconds;
     
-    // State tracking for current transaction
-    char current_txn_id[MAX_TRANSACTION_ID_LEN];
+    // State tracking for current transaction ("" = none)
+    const char *current_txn_id;
     bool has_hold;
     
-    // Transaction details (stored during prepare phase)
-    char pan_masked[32];
-    char amount[16];
-    char merchant_id[32];
+    // Transaction details (borrowed from the request, not copied)
+    const char *pan_masked;
+    int64_t amount_minor; // minor units; text only in the outgoing payload
+    int amount_exp;
+    const char *merchant_id;
+    int item_count;       // payments behind this hold (> 1: batch, amount is their total)
+
+    // Asynchronous step in flight (txn_commit_async())
+    TxnStepDone step_done;
+    void *step_arg;
+    const char *step_txn_id; // the coordinator's, valid until the step reported
+    int step_action;      // 0 prepare, 1 commit, 2 abort
+    int step_attempt;
+    char step_payload[512];
 } ClearingParticipantContext;
 
 /**
  * Initialize clearing participant context
+ * (from the request arena inside a handler scope; release with the destroy call)
+ * service_url is borrowed (NULL = built-in URL) and must outlive the context
  */
 ClearingParticipantContext *clearing_participant_init(const char *service_url, int timeout_seconds);
 
@@ -35,14 +48,27 @@ void clearing_participant_destroy(ClearingParticipantContext *ctx);
 
 /**
  * Set transaction details for the clearing operation
- * Must be called before prepare
+ * Must be called before prepare. The strings are borrowed, not copied: they
+ * must stay valid until clearing_participant_destroy()
  */
 int clearing_participant_set_transaction(ClearingParticipantContext *ctx,
                                        const char *txn_id,
                                        const char *pan_masked,
-                                       const char *amount,
+                                       int64_t amount_minor,
+                                       int amount_exp,
                                        const char *merchant_id);
 
+/**
+ * Set a batch instead of one payment: a single hold for item_count payments
+ * whose total is total_minor at amount_exp (same borrowing rules)
+ */
+int clearing_participant_set_batch(ClearingParticipantContext *ctx,
+                                   const char *txn_id,
+                                   int item_count,
+                                   int64_t total_minor,
+                                   int amount_exp,
+                                   const char *merchant_id);
+
 /**
  * 2PC Participant Interface Functions
  */
@@ -69,4 +95,14 @@ int clearing_participant_commit(void *context, const char *txn_id);
  * - Cancel settlement reservation
  * - Clean up transaction state
  */
-int clearing_participant_abort(void *context, const char *txn_id);
\ No newline at end of file
+int clearing_participant_abort(void *context, const char *txn_id);
+
+/**
+ * Asynchronous steps for txn_commit_async() (TxnAsyncStep): the same
+ * requests, retries, circuit breaker and outcome as the steps above, but the
+ * simulated network delay and retry back-off are timers (timer.h) instead of
+ * a sleeping thread; done runs on the timer thread. abort always reports 0.
+ */
+int clearing_participant_prepare_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
+int clearing_participant_commit_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
+int clearing_participant_abort_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
@@ -1,10 +1,29 @@
 /*
  * VN (Phỏng vấn – Cấu hình):
- * - Sử dụng biến môi trường để cấu hình nhanh: DB_URI, PORT, THREADS, QUEUE_CAP.
+ * - Sử dụng biến môi trường để cấu hình nhanh: DB_URI, PORT, THREADS, QUEUE_CAP,
+ *   NET_MODE (epoll|blocking), CONN_IDLE_TIMEOUT_MS, ACCEPTORS, ACCEPTOR_POOL_SHARDS,
+ *   SCHED (fifo|steal), CODEL_TARGET_MS, CODEL_INTERVAL_MS, REQUEST_BUDGET_MS,
+ *   CONTROL_WORKERS, CONTROL_QUEUE_CAP, BACKGROUND_QUEUE_CAP, SIMD_SCAN (auto|avx2|sse2|scalar),
+ *   ISO8583_PORT (cổng ISO 8583 nhị phân; 0 = tắt), REQUEST_ARENA_KB (arena mỗi worker; 0 = tắt),
+ *   BATCH_MAX (số giao dịch tối đa trong một lô; 0 = tắt), ISO8583_BATCH (gộp lô ISO 8583),
+ *   IDEM_CACHE_KB (cache idempotency theo request_id; 0 = tắt), IDEM_CACHE_TTL_S,
+ *   SINGLEFLIGHT_WAIT_MS (bản trùng chờ kết quả bản đang chạy; 0 = tắt),
+ *   DB_PREPARED (1 = prepared statement cho mỗi kết nối DB; 0 = gửi SQL mỗi lần),
+ *   DB_PIPELINE (1 = BEGIN + INSERT + PREPARE TRANSACTION trong một round trip),
+ *   GROUP_COMMIT_WINDOW_US (gom giao dịch của mọi worker, commit theo nhóm; 0 = tắt), GROUP_COMMIT_MAX_ROWS,
+ *   DB_POOL_SIZE (pool kết nối DB dùng chung; 0 = mỗi worker một kết nối), DB_POOL_WAIT_MS,
+ *   DB_POOL_HEALTH_IDLE_S, DB_ASYNC (1 = câu lệnh 2PC chạy bất đồng bộ trên vài kết nối dùng chung,
+ *   điều khiển bởi epoll), DB_ASYNC_CONNS.
  * - Lợi ích: không phải sửa code khi đổi tham số; phù hợp Docker/k8s/CI.
  * - Nâng cấp sau: hỗ trợ getopt để override qua CLI; validate giá trị hợp lệ.
  */
 #include "config.h"
+#include "arena.h"
+#include "idem.h"
+#include "singleflight.h"
+#include "groupcommit.h"
+#include "dbasync.h"
+#include "iso8583.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,18 +47,164 @@ int config_init(Config *cfg, int argc, char *argv[]) {
     cfg->db_uri = db_uri_env;
     const char *port_env = getenv("PORT");      // Tuỳ chọn: cổng lắng nghe
     cfg->listen_port = port_env ? atoi(port_env) : 9090;
+    // Optional second listener speaking binary ISO 8583 instead of JSON lines/HTTP
+    const char *iso_env = getenv("ISO8583_PORT");
+    cfg->iso8583_port = iso_env ? atoi(iso_env) : 0;
+    if (cfg->iso8583_port < 0) cfg->iso8583_port = 0;
+    if (cfg->iso8583_port == cfg->listen_port) {
+        fprintf(stderr, "Error: ISO8583_PORT must differ from PORT (%d)\n", cfg->listen_port);
+        return -1;
+    }
     const char *threads_env = getenv("THREADS"); // Tuỳ chọn: số worker threads
     if (!threads_env) threads_env = getenv("NUM_THREADS");
     cfg->num_threads = threads_env ? atoi(threads_env) : 4;
     if (cfg->num_threads <= 0) cfg->num_threads = 4;
+    // Elastic pool: grow from THREADS up to THREADS_MAX when jobs wait, shrink when idle
+    const char *tmax_env = getenv("THREADS_MAX");
+    cfg->max_threads = tmax_env ? atoi(tmax_env) : 0;
+    if (cfg->max_threads <= cfg->num_threads) cfg->max_threads = 0;
+    const char *gw_env = getenv("ELASTIC_GROW_WAIT_MS");
+    cfg->grow_wait_ms = gw_env ? atoi(gw_env) : 2;
+    if (cfg->grow_wait_ms < 0) cfg->grow_wait_ms = 2;
+    const char *ir_env = getenv("ELASTIC_IDLE_MS");
+    cfg->idle_retire_ms = ir_env ? atoi(ir_env) : 10000;
+    if (cfg->idle_retire_ms <= 0) cfg->idle_retire_ms = 10000;
     const char *qcap_env = getenv("QUEUE_CAP");  // Tuỳ chọn: sức chứa hàng đợi job
     cfg->queue_cap = qcap_env ? atoi(qcap_env) : 1024;
     if (cfg->queue_cap <= 0) cfg->queue_cap = 1024;
     // Optional API token for secure HTTP-ish endpoints
     cfg->api_token = getenv("API_TOKEN");
+    // Front-end model: epoll reactor (default) or legacy blocking accept-per-job
+    const char *mode_env = getenv("NET_MODE");
+    cfg->net_mode = (mode_env && strcmp(mode_env, "blocking") == 0) ? NET_MODE_BLOCKING : NET_MODE_EPOLL;
+    // Idle keep-alive connections are closed by the reactor (same 5s as SO_RCVTIMEO)
+    const char *idle_env = getenv("CONN_IDLE_TIMEOUT_MS");
+    cfg->idle_timeout_ms = idle_env ? atoi(idle_env) : 5000;
+    if (cfg->idle_timeout_ms < 0) cfg->idle_timeout_ms = 0;
+    // N SO_REUSEPORT listeners (kernel spreads connects across accept threads)
+    const char *acc_env = getenv("ACCEPTORS");
+    cfg->acceptors = acc_env ? atoi(acc_env) : 1;
+    if (cfg->acceptors <= 0) cfg->acceptors = 1;
+    if (cfg->acceptors > 64) cfg->acceptors = 64;
+    // Optional: split THREADS/QUEUE_CAP into one pool shard per acceptor
+    const char *shard_env = getenv("ACCEPTOR_POOL_SHARDS");
+    cfg->acceptor_pool_shards = (shard_env && atoi(shard_env) > 0 && cfg->acceptors > 1) ? 1 : 0;
+    // Pool scheduler: shared FIFO ring (default) or per-worker deques + stealing
+    const char *sched_env = getenv("SCHED");
+    cfg->sched = (sched_env && strcmp(sched_env, "steal") == 0) ? THREADPOOL_SCHED_STEAL : THREADPOOL_SCHED_FIFO;
+    // Queue-wait admission (CoDel): shed once jobs wait > target for a whole interval
+    const char *ct_env = getenv("CODEL_TARGET_MS");
+    cfg->codel_target_ms = ct_env ? atoi(ct_env) : 5;
+    if (cfg->codel_target_ms < 0) cfg->codel_target_ms = 0;
+    const char *ci_env = getenv("CODEL_INTERVAL_MS");
+    cfg->codel_interval_ms = ci_env ? atoi(ci_env) : 100;
+    if (cfg->codel_interval_ms <= 0) cfg->codel_interval_ms = 100;
+    // Request deadline: jobs still queued this long after receipt are declined as timeout
+    const char *rb_env = getenv("REQUEST_BUDGET_MS");
+    cfg->request_budget_ms = rb_env ? atoi(rb_env) : 0;
+    if (cfg->request_budget_ms < 0) cfg->request_budget_ms = 0;
+    // Priority lanes: probes get their own ring + reserved workers, reversals a background ring
+    const char *cw_env = getenv("CONTROL_WORKERS");
+    cfg->control_workers = cw_env ? atoi(cw_env) : 1;
+    if (cfg->control_workers < 0) cfg->control_workers = 0;
+    const char *cq_env = getenv("CONTROL_QUEUE_CAP");
+    cfg->control_queue_cap = cq_env ? atoi(cq_env) : 64;
+    if (cfg->control_queue_cap <= 0) cfg->control_queue_cap = 64;
+    const char *bq_env = getenv("BACKGROUND_QUEUE_CAP");
+    cfg->background_queue_cap = bq_env ? atoi(bq_env) : 256;
+    if (cfg->background_queue_cap <= 0) cfg->background_queue_cap = 256;
+    // CPU placement: allowed CPUs (list and/or NUMA node), one CPU per thread or the whole set
+    const char *cpus_env = getenv("CPU_SET");
+    cfg->cpu_set = (cpus_env && *cpus_env) ? cpus_env : NULL;
+    const char *node_env = getenv("NUMA_NODE");
+    cfg->numa_node = (node_env && *node_env) ? atoi(node_env) : -1;
+    if (cfg->numa_node < 0) cfg->numa_node = -1;
+    const char *pin_env = getenv("CPU_PIN");
+    cfg->cpu_pin = (pin_env && strcmp(pin_env, "set") == 0) ? AFFINITY_PIN_SET : AFFINITY_PIN_SPREAD;
+    // Per-worker request arena for the 2PC objects of one payment (0 = malloc each)
+    const char *arena_env = getenv("REQUEST_ARENA_KB");
+    cfg->request_arena_kb = arena_env ? atoi(arena_env) : (int)(ARENA_DEFAULT_BYTES / 1024);
+    if (cfg->request_arena_kb < 0) cfg->request_arena_kb = 0;
+    if (cfg->request_arena_kb > 65536) cfg->request_arena_kb = 65536;
+    // Batch authorization: items per JSON batch, and whether pipelined ISO 8583 requests batch
+    const char *bm_env = getenv("BATCH_MAX");
+    cfg->batch_max = bm_env ? atoi(bm_env) : ISO_BATCH_MAX;
+    if (cfg->batch_max < 0) cfg->batch_max = 0;
+    if (cfg->batch_max > ISO_BATCH_MAX) cfg->batch_max = ISO_BATCH_MAX;
+    const char *ib_env = getenv("ISO8583_BATCH");
+    cfg->iso8583_batch = (ib_env && atoi(ib_env) > 0) ? 1 : 0;
+    // Idempotency cache in front of the DB: memory budget and TTL of cached approvals
+    const char *ic_env = getenv("IDEM_CACHE_KB");
+    cfg->idem_cache_kb = ic_env ? atoi(ic_env) : IDEM_DEFAULT_KB;
+    if (cfg->idem_cache_kb < 0) cfg->idem_cache_kb = 0;
+    if (cfg->idem_cache_kb > 1048576) cfg->idem_cache_kb = 1048576;
+    const char *it_env = getenv("IDEM_CACHE_TTL_S");
+    cfg->idem_cache_ttl_s = it_env ? atoi(it_env) : IDEM_DEFAULT_TTL_S;
+    if (cfg->idem_cache_ttl_s <= 0) cfg->idem_cache_ttl_s = IDEM_DEFAULT_TTL_S;
+    // Duplicates of a request still in 2PC wait this long for its result
+    const char *sf_env = getenv("SINGLEFLIGHT_WAIT_MS");
+    cfg->singleflight_wait_ms = sf_env ? atoi(sf_env) : SINGLEFLIGHT_DEFAULT_WAIT_MS;
+    if (cfg->singleflight_wait_ms < 0) cfg->singleflight_wait_ms = 0;
+    // Prepared statements per DB connection (0 = send the SQL text every time)
+    const char *dp_env = getenv("DB_PREPARED");
+    cfg->db_prepared = dp_env ? (atoi(dp_env) != 0) : 1;
+    // 2PC participant: BEGIN + insert + PREPARE TRANSACTION pipelined in one round trip
+    const char *pl_env = getenv("DB_PIPELINE");
+    cfg->db_pipeline = pl_env ? (atoi(pl_env) != 0) : 1;
+    // Group commit: one DB transaction for the approvals of a short window (0 = off)
+    const char *gcw_env = getenv("GROUP_COMMIT_WINDOW_US");
+    cfg->group_commit_window_us = gcw_env ? atoi(gcw_env) : 0;
+    if (cfg->group_commit_window_us < 0) cfg->group_commit_window_us = 0;
+    const char *gcr_env = getenv("GROUP_COMMIT_MAX_ROWS");
+    cfg->group_commit_max_rows = gcr_env ? atoi(gcr_env) : GROUPCOMMIT_DEFAULT_MAX_ROWS;
+    if (cfg->group_commit_max_rows < 1 || cfg->group_commit_max_rows > DB_BATCH_MAX) {
+        fprintf(stderr, "Error: GROUP_COMMIT_MAX_ROWS must be 1..%d\n", DB_BATCH_MAX);
+        return -1;
+    }
+    // Shared DB connection pool, sized independently of THREADS (0 = one per worker)
+    const char *ps_env = getenv("DB_POOL_SIZE");
+    cfg->db_pool_size = ps_env ? atoi(ps_env) : 0;
+    if (cfg->db_pool_size < 0) cfg->db_pool_size = 0;
+    const char *pw_env = getenv("DB_POOL_WAIT_MS");
+    cfg->db_pool_wait_ms = pw_env ? atoi(pw_env) : 1000;
+    if (cfg->db_pool_wait_ms < 0) cfg->db_pool_wait_ms = 0;
+    const char *ph_env = getenv("DB_POOL_HEALTH_IDLE_S");
+    cfg->db_pool_health_idle_s = ph_env ? atoi(ph_env) : 30;
+    if (cfg->db_pool_health_idle_s < 0) cfg->db_pool_health_idle_s = 0;
+    // Async DB layer: 2PC flights of every worker pipelined on a few non-blocking connections
+    const char *da_env = getenv("DB_ASYNC");
+    cfg->db_async = da_env ? (atoi(da_env) != 0) : 0;
+    const char *dac_env = getenv("DB_ASYNC_CONNS");
+    cfg->db_async_conns = dac_env ? atoi(dac_env) : DBASYNC_DEFAULT_CONNS;
+    if (cfg->db_async_conns < 2 || cfg->db_async_conns > DBASYNC_MAX_CONNS) {
+        fprintf(stderr, "Error: DB_ASYNC_CONNS must be 2..%d\n", DBASYNC_MAX_CONNS);
+        return -1;
+    }
+    // Structural scanning for framing/JSON: best SIMD the CPU has, or forced for A/B runs
+    const char *scan_env = getenv("SIMD_SCAN");
+    if (simdscan_parse_name(scan_env, &cfg->simd_scan) != 0) {
+        fprintf(stderr, "Error: invalid SIMD_SCAN '%s' (auto|avx2|sse2|scalar)\n", scan_env);
+        return -1;
+    }
     return 0;
 }
 
+void config_pool_options(const Config *cfg, ThreadPoolOptions *opts) {
+    threadpool_options_init(opts);
+    opts->num_threads = cfg->num_threads;
+    opts->max_threads = cfg->max_threads;
+    opts->grow_wait_us = (long)cfg->grow_wait_ms * 1000L;
+    opts->idle_timeout_us = (long)cfg->idle_retire_ms * 1000L;
+    opts->queue_cap = cfg->queue_cap;
+    opts->sched = cfg->sched;
+    opts->codel_target_us = (long)cfg->codel_target_ms * 1000L;
+    opts->codel_interval_us = (long)cfg->codel_interval_ms * 1000L;
+    opts->control_workers = cfg->control_workers;
+    opts->control_queue_cap = cfg->control_queue_cap;
+    opts->background_queue_cap = cfg->background_queue_cap;
+    if (affinity_enabled()) opts->on_thread_start = affinity_pool_thread_start;
+}
+
 void config_free(Config *cfg) {
     // Nothing to free currently because we point into environment variables
     (void)cfg;
@@ -1,5 +1,17 @@
 #pragma once
 
+#include "threadpool.h"
+#include "affinity.h"
+#include "simdscan.h"
+
+/**
+ * Front-end I/O model selected with NET_MODE.
+ */
+typedef enum {
+    NET_MODE_EPOLL = 0,    ///< epoll reactor owns sockets, submits complete frames (default)
+    NET_MODE_BLOCKING = 1  ///< legacy: accept + one blocking handler_job per connection
+} NetMode;
+
 /**
  * Configuration structure for the mini‑visa server.
  *
@@ -9,9 +21,43 @@
 typedef struct Config {
     const char *db_uri;  ///< PostgreSQL connection URI
     int listen_port;     ///< TCP port to listen on
-    int num_threads;     ///< number of worker threads in the thread pool
+    int iso8583_port;    ///< binary ISO 8583 listener (ISO8583_PORT; 0 = off)
+    int num_threads;     ///< number of worker threads in the thread pool (minimum when elastic)
+    int max_threads;     ///< elastic pool ceiling (THREADS_MAX; 0 = fixed at num_threads)
+    int grow_wait_ms;    ///< elastic: add a worker once a queued job waited this long (ELASTIC_GROW_WAIT_MS)
+    int idle_retire_ms;  ///< elastic: extra workers exit after idling this long (ELASTIC_IDLE_MS)
     int queue_cap;       ///< max pending jobs in the thread pool
     const char *api_token; ///< optional bearer token for secure endpoints
+    NetMode net_mode;    ///< front-end I/O model (NET_MODE=epoll|blocking)
+    int idle_timeout_ms; ///< close idle keep-alive connections after this (0 = never)
+    int acceptors;       ///< SO_REUSEPORT listeners, one accept thread each (ACCEPTORS)
+    int acceptor_pool_shards; ///< 1 = each acceptor gets its own ThreadPool shard
+    ThreadPoolSched sched; ///< pool scheduling policy (SCHED=fifo|steal)
+    int codel_target_ms;   ///< CoDel admission target queue wait (0 = queue-length fast-fail only)
+    int codel_interval_ms; ///< CoDel interval the wait must stay above target before shedding
+    int request_budget_ms; ///< per-request deadline from receipt; expired → DECLINED/timeout (0 = off)
+    int control_workers;   ///< reserved workers for /healthz,/readyz,/metrics,/version (CONTROL_WORKERS)
+    int control_queue_cap; ///< control lane capacity (CONTROL_QUEUE_CAP)
+    int background_queue_cap; ///< background lane capacity, reversal retries (BACKGROUND_QUEUE_CAP)
+    const char *cpu_set;   ///< CPUs server threads may use, e.g. "0-15" (CPU_SET; NULL = any)
+    int numa_node;         ///< restrict to this node's CPUs and prefer its memory (NUMA_NODE; -1 = any)
+    AffinityPolicy cpu_pin; ///< CPU_PIN=spread (one CPU per acceptor/worker) | set
+    int request_arena_kb;  ///< per-worker arena for Transaction + participant contexts (REQUEST_ARENA_KB; 0 = malloc)
+    int batch_max;         ///< most payments in one batch request line/body (BATCH_MAX, <= ISO_BATCH_MAX; 0 = off)
+    int iso8583_batch;     ///< 1 = requests pipelined on ISO8583_PORT are authorised as one batch (ISO8583_BATCH)
+    int idem_cache_kb;     ///< memory budget of the request_id → outcome cache (IDEM_CACHE_KB; 0 = off)
+    int idem_cache_ttl_s;  ///< seconds an approved outcome stays cached (IDEM_CACHE_TTL_S)
+    int singleflight_wait_ms; ///< longest a duplicate waits for the in-flight first copy (SINGLEFLIGHT_WAIT_MS; 0 = off)
+    int db_prepared;       ///< 1 = prepared statements per DB connection, 0 = SQL text per request (DB_PREPARED)
+    int db_pipeline;       ///< 1 = BEGIN + insert + PREPARE TRANSACTION in one pipelined round trip (DB_PIPELINE)
+    int group_commit_window_us; ///< collect approvals this long into one DB transaction (GROUP_COMMIT_WINDOW_US; 0 = off)
+    int group_commit_max_rows;  ///< commit a group early once it has this many rows (GROUP_COMMIT_MAX_ROWS, 1..64)
+    int db_pool_size;      ///< shared DB connections for all workers (DB_POOL_SIZE; 0 = one per worker thread)
+    int db_pool_wait_ms;   ///< longest wait for a pooled connection (DB_POOL_WAIT_MS)
+    int db_pool_health_idle_s; ///< ping a pooled connection idle this long before lending it (DB_POOL_HEALTH_IDLE_S; 0 = off)
+    int db_async;          ///< 1 = 2PC DB steps run on shared non-blocking connections driven by epoll (DB_ASYNC)
+    int db_async_conns;    ///< connections of the async layer, 2..64; a quarter finish prepared transactions (DB_ASYNC_CONNS)
+    SimdScanImpl simd_scan; ///< request scanning: SIMD_SCAN=auto (best CPUID) | avx2 | sse2 | scalar
 } Config;
 
 /**
@@ -24,6 +70,13 @@ typedef struct Config {
  */
 int config_init(Config *cfg, int argc, char *argv[]);
 
+/**
+ * Fill pool options from the configuration (THREADS, THREADS_MAX, QUEUE_CAP,
+ * SCHED, CODEL_*, lane settings, worker pinning). Callers may then override
+ * num_threads/max_threads/queue_cap (acceptor shards).
+ */
+void config_pool_options(const Config *cfg, ThreadPoolOptions *opts);
+
 /**
  * Release resources associated with the configuration, if any.
  */
@@ -1,8 +1,14 @@
 #include "db.h"
+#include "metrics.h"
+#include "dbasync.h"
+#include "pgnumeric.h"
 #include <pthread.h>
 #include <stdio.h>
+#include <errno.h>
+#include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <pthread.h>
 
 /*
@@ -17,8 +23,140 @@ struct DBConnection {
     PGconn *conn;       // libpq connection handle
     pthread_mutex_t mu; // guard connection for thread safety when shared
     char *uri;          // saved connection URI (used for per-thread clones)
+    int prepared;       // statement set prepared on this session (lost on reset)
+    long long idle_since_ns; // pool: returned at (health check after DB_POOL_HEALTH_IDLE_S)
+    long long leased_at_ns;  // pool: lent out at (busy time)
 };
 
+static int g_db_prepared = 1; // DB_PREPARED
+static int g_db_pipeline = 1; // DB_PIPELINE
+
+void db_configure(int prepared, int pipeline) {
+    g_db_prepared = prepared ? 1 : 0;
+#ifdef LIBPQ_HAS_PIPELINING
+    g_db_pipeline = pipeline ? 1 : 0;
+#else
+    (void)pipeline;
+    g_db_pipeline = 0; // libpq < 14
+#endif
+}
+
+int db_pipeline_enabled(void) {
+    return g_db_pipeline;
+}
+
+#define DB_NUMERICOID 1700 // pg_type.oid of numeric
+#define DB_TEXTOID 25
+#define DB_TEXTARRAYOID 1009
+#define DB_NUMERICARRAYOID 1231
+
+// [ANCHOR:DB_PREPARED_STATEMENTS]
+// EN: Every statement the request path sends, prepared once per session
+//     (PQprepare on connect, again after a reset) and run with
+//     PQexecPrepared, so PostgreSQL parses and plans each one once per
+//     connection instead of once per request. Parameter types are fixed at
+//     prepare time (binary numeric / arrays need their OIDs).
+// VN: Câu lệnh được PREPARE một lần cho mỗi kết nối; mỗi request chỉ gửi
+//     tên + tham số, PostgreSQL không phải parse/plan lại.
+enum {
+    DB_STMT_INSERT,        // db_insert_transaction
+    DB_STMT_INSERT_REQID,  // db_insert_or_get_by_reqid
+    DB_STMT_STATUS_REQID,  // ... its SELECT after a conflict
+    DB_STMT_INSERT_BATCH,  // db_insert_batch_by_reqid
+    DB_STMT_GET_TX,        // db_get_tx_by_request_id (GET /tx)
+    DB_STMT_SET_STATUS,    // db_set_status_by_reqid
+    DB_STMT_COUNT
+};
+
+static const struct {
+    const char *name;
+    const char *sql;
+    int nparams;
+    Oid types[4];
+} k_db_stmts[DB_STMT_COUNT] = {
+    [DB_STMT_INSERT] = {"mv_insert",
+        "INSERT INTO transactions (pan_masked, amount, status) VALUES ($1, $2, $3)",
+        3, {0, DB_NUMERICOID, 0, 0}},
+    [DB_STMT_INSERT_REQID] = {"mv_insert_reqid",
+        "INSERT INTO transactions (request_id, pan_masked, amount, status) "
+        "VALUES ($1, $2, $3, $4) "
+        "ON CONFLICT (request_id) DO NOTHING RETURNING status",
+        4, {0, 0, DB_NUMERICOID, 0}},
+    [DB_STMT_STATUS_REQID] = {"mv_status_reqid",
+        "SELECT status FROM transactions WHERE request_id = $1",
+        1, {0, 0, 0, 0}},
+    // ins only sees rows this statement inserted; the others already existed,
+    // and their status comes from the table (the statement's snapshot)
+    [DB_STMT_INSERT_BATCH] = {"mv_insert_batch",
+        "WITH v AS (SELECT * FROM unnest($1::text[], $2::text[], $3::numeric[]) "
+        "           WITH ORDINALITY AS v(request_id, pan_masked, amount, idx)), "
+        "ins AS (INSERT INTO transactions (request_id, pan_masked, amount, status) "
+        "        SELECT request_id, pan_masked, amount, $4 FROM v ORDER BY idx "
+        "        ON CONFLICT (request_id) DO NOTHING RETURNING request_id, status) "
+        "SELECT v.idx, ins.request_id IS NULL, COALESCE(ins.status, t.status, '') "
+        "FROM v LEFT JOIN ins ON ins.request_id = v.request_id "
+        "LEFT JOIN transactions t ON ins.request_id IS NULL AND t.request_id = v.request_id "
+        "ORDER BY v.idx",
+        4, {DB_TEXTARRAYOID, DB_TEXTARRAYOID, DB_NUMERICARRAYOID, 0}},
+    [DB_STMT_GET_TX] = {"mv_get_tx",
+        "SELECT request_id, amount::text, status FROM transactions WHERE request_id=$1 LIMIT 1",
+        1, {0, 0, 0, 0}},
+    [DB_STMT_SET_STATUS] = {"mv_set_status",
+        "UPDATE transactions SET status = $3 WHERE request_id = $1 AND status = $2",
+        3, {0, 0, 0, 0}},
+};
+
+// Prepare the whole set on dbc's session; 0 when all succeeded. A failure
+// leaves dbc->prepared at 0: db_exec() runs the SQL text meanwhile, and the
+// next db_thread_get() / statement outside a transaction tries again.
+static int db_prepare_all(DBConnection *dbc) {
+    for (int i = 0; i < DB_STMT_COUNT; ++i) {
+        metrics_inc_db_round_trip();
+        PGresult *res = PQprepare(dbc->conn, k_db_stmts[i].name, k_db_stmts[i].sql,
+                                  k_db_stmts[i].nparams, k_db_stmts[i].types);
+        // 42P05: already prepared on this session (an earlier partial attempt)
+        const char *state = res ? PQresultErrorField(res, PG_DIAG_SQLSTATE) : NULL;
+        int ok = (res && PQresultStatus(res) == PGRES_COMMAND_OK) || (state && strcmp(state, "42P05") == 0);
+        if (!ok) fprintf(stderr, "DB prepare %s failed: %s\n", k_db_stmts[i].name, PQerrorMessage(dbc->conn));
+        PQclear(res);
+        if (!ok) return -1;
+    }
+    dbc->prepared = 1;
+    return 0;
+}
+
+// Run statement id with the given parameters (caller holds dbc->mu); text
+// results. PQexecPrepared when DB_PREPARED=1 and the set is prepared, the
+// full SQL text otherwise.
+static PGresult *db_exec(DBConnection *dbc, int id, const char *const *values, const int *lengths,
+                         const int *formats) {
+    // A failed PQprepare would abort the surrounding transaction block
+    if (g_db_prepared && !dbc->prepared && PQtransactionStatus(dbc->conn) == PQTRANS_IDLE) {
+        (void)db_prepare_all(dbc);
+    }
+    metrics_inc_db_round_trip();
+    if (!g_db_prepared || !dbc->prepared) {
+        return PQexecParams(dbc->conn, k_db_stmts[id].sql, k_db_stmts[id].nparams, k_db_stmts[id].types,
+                            values, lengths, formats, 0);
+    }
+    PGresult *res = PQexecPrepared(dbc->conn, k_db_stmts[id].name, k_db_stmts[id].nparams, values, lengths,
+                                   formats, 0);
+    // 26000: the session lost its statements (e.g. DISCARD ALL by a pooler).
+    // Prepare again; inside a transaction block the error already aborted it,
+    // so only a statement outside one is retried.
+    const char *state = res ? PQresultErrorField(res, PG_DIAG_SQLSTATE) : NULL;
+    if (state && strcmp(state, "26000") == 0) {
+        dbc->prepared = 0;
+        if (PQtransactionStatus(dbc->conn) == PQTRANS_IDLE && db_prepare_all(dbc) == 0) {
+            PQclear(res);
+            metrics_inc_db_round_trip();
+            res = PQexecPrepared(dbc->conn, k_db_stmts[id].name, k_db_stmts[id].nparams, values, lengths,
+                                 formats, 0);
+        }
+    }
+    return res;
+}
+
 // Thread-local storage for per-thread DB connections
 static pthread_key_t db_tls_key;
 static pthread_once_t db_tls_once = PTHREAD_ONCE_INIT;
@@ -50,32 +188,29 @@ DBConnection *db_connect(const char *uri) {
     }
     pthread_mutex_init(&dbc->mu, NULL);
     dbc->uri = strdup(uri);
+    dbc->prepared = 0;
+    dbc->idle_since_ns = 0;
+    dbc->leased_at_ns = 0;
+    if (g_db_prepared) (void)db_prepare_all(dbc);
     fprintf(stderr, "db_connect ok\n"); // keep a simple stderr log for the demo
     return dbc;
 }
 
-// Insert one transaction; amount is text cast to numeric in SQL
-// VN: Chuyển amount từ chuỗi sang numeric trong câu lệnh để đơn giản hóa tham số hoá.
-int db_insert_transaction(DBConnection *dbc, const char *pan_masked, const char *amount, const char *status) {
+// Insert one transaction; the amount goes as binary numeric (no text cast in SQL)
+// VN: amount là số nguyên đơn vị nhỏ + số mũ, gửi dạng NUMERIC nhị phân.
+int db_insert_transaction(DBConnection *dbc, const char *pan_masked, int64_t amount_minor, int amount_exp,
+                          const char *status) {
     if (!dbc || !dbc->conn) return -1;
+    unsigned char num[DB_NUMERIC_MAX];
     const char *paramValues[3];
-    int paramLengths[3] = {0};
-    int paramFormats[3] = {0};
+    int paramLengths[3] = {0, numeric_binary(amount_minor, amount_exp, num), 0};
+    int paramFormats[3] = {0, 1, 0};
     paramValues[0] = pan_masked;
-    paramValues[1] = amount;   // numeric accepted as text
+    paramValues[1] = (const char *)num;
     paramValues[2] = status;
 
     pthread_mutex_lock(&dbc->mu);
-    PGresult *res = PQexecParams(
-        dbc->conn,
-        "INSERT INTO transactions (pan_masked, amount, status) VALUES ($1, $2::numeric, $3)",
-        3,
-        NULL,
-        paramValues,
-        paramLengths,
-        paramFormats,
-        0
-    );
+    PGresult *res = db_exec(dbc, DB_STMT_INSERT, paramValues, paramLengths, paramFormats);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "DB insert failed: %s\n", PQerrorMessage(dbc->conn));
         PQclear(res);
@@ -98,13 +233,292 @@ void db_disconnect(DBConnection *dbc) {
     free(dbc);
 }
 
+PGconn *db_pgconn(DBConnection *dbc) {
+    return dbc ? dbc->conn : NULL;
+}
+
+static long long db_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Make a session usable before a request: reconnect a dropped one, then
+// prepare the statements again. Runs outside any transaction block.
+static void db_session_check(DBConnection *dbc) {
+    pthread_mutex_lock(&dbc->mu);
+    if (PQstatus(dbc->conn) == CONNECTION_BAD) {
+        fprintf(stderr, "db: connection lost, resetting\n");
+        PQreset(dbc->conn);
+        dbc->prepared = 0;
+    }
+    if (g_db_prepared && !dbc->prepared && PQstatus(dbc->conn) == CONNECTION_OK &&
+        PQtransactionStatus(dbc->conn) == PQTRANS_IDLE) {
+        (void)db_prepare_all(dbc);
+    }
+    pthread_mutex_unlock(&dbc->mu);
+}
+
+// [ANCHOR:DB_POOL]
+// EN: DB_POOL_SIZE > 0 replaces the connection per worker thread with a
+//     bounded pool shared by all of them, so THREADS can grow (for clearing
+//     I/O) without adding PostgreSQL backends. A thread leases a connection
+//     on its first db_thread_get() and keeps it until db_thread_release()
+//     (end of request, and the 2PC participant between its phases, since a
+//     prepared transaction is not tied to a session). Waiters queue FIFO and
+//     a returned connection goes straight to the oldest one; a waiter gives
+//     up after DB_POOL_WAIT_MS. Connections open lazily up to the size, keep
+//     their prepared statements, are reset when dropped, pinged with SELECT 1
+//     after DB_POOL_HEALTH_IDLE_S idle, and rolled back if returned inside a
+//     transaction block.
+// VN: Pool kết nối dùng chung, kích thước độc lập với số worker; chờ theo
+//     thứ tự FIFO có timeout; kiểm tra sức khỏe kết nối khi cho mượn / trả.
+typedef struct DBPoolWaiter {
+    struct DBPoolWaiter *next;
+    pthread_cond_t cv;
+    DBConnection *got;          // handed over by db_pool_put()
+    int retry;                  // an open failed: this waiter may open one itself
+} DBPoolWaiter;
+
+static struct {
+    pthread_mutex_t mu;
+    int size;                   // 0 = pool off
+    int opened;                 // connections opened or being opened
+    int nall;                   // opened: all[0..nall)
+    int in_use;
+    int wait_ms;
+    int health_idle_s;
+    char *uri;
+    DBConnection **idle;        // LIFO: the most recently used first
+    int nidle;
+    DBConnection **all;
+    DBPoolWaiter *head;
+    DBPoolWaiter **tail;
+    unsigned long acquires, waits, timeouts, resets;
+    unsigned long long wait_us, busy_us;
+} g_pool = { .mu = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread DBConnection *t_lease;     // this thread's pooled connection
+static __thread int t_dedicated;           // db_thread_dedicated(): own connection
+
+int db_pool_init(DBConnection *bootstrap, int size, int wait_ms, int health_idle_s) {
+    if (size <= 0) return 0;
+    if (!bootstrap || !bootstrap->uri || g_pool.size) return -1;
+    g_pool.all = calloc((size_t)size, sizeof(*g_pool.all));
+    g_pool.idle = calloc((size_t)size, sizeof(*g_pool.idle));
+    g_pool.uri = strdup(bootstrap->uri);
+    if (!g_pool.all || !g_pool.idle || !g_pool.uri) {
+        free(g_pool.all);
+        free(g_pool.idle);
+        free(g_pool.uri);
+        return -1;
+    }
+    g_pool.wait_ms = wait_ms > 0 ? wait_ms : 0;
+    g_pool.health_idle_s = health_idle_s > 0 ? health_idle_s : 0;
+    g_pool.head = NULL;
+    g_pool.tail = &g_pool.head;
+    g_pool.size = size;
+    return 0;
+}
+
+void db_pool_shutdown(void) {
+    if (!g_pool.size) return;
+    pthread_mutex_lock(&g_pool.mu);
+    for (int i = 0; i < g_pool.nall; ++i) db_disconnect(g_pool.all[i]);
+    free(g_pool.all);
+    free(g_pool.idle);
+    free(g_pool.uri);
+    g_pool.all = g_pool.idle = NULL;
+    g_pool.uri = NULL;
+    g_pool.size = g_pool.opened = g_pool.nall = g_pool.nidle = g_pool.in_use = 0;
+    pthread_mutex_unlock(&g_pool.mu);
+}
+
+void db_pool_stats(DBPoolStats *out) {
+    pthread_mutex_lock(&g_pool.mu);
+    out->size = g_pool.size;
+    out->opened = g_pool.opened;
+    out->in_use = g_pool.in_use;
+    out->acquires = g_pool.acquires;
+    out->waits = g_pool.waits;
+    out->timeouts = g_pool.timeouts;
+    out->resets = g_pool.resets;
+    out->wait_us = g_pool.wait_us;
+    out->busy_us = g_pool.busy_us;
+    pthread_mutex_unlock(&g_pool.mu);
+}
+
+// Lent connection is about to be used: reset a dropped one, ping one that
+// sat idle past DB_POOL_HEALTH_IDLE_S (a server-side timeout may have cut it)
+static void db_pool_check(DBConnection *dbc, long long now) {
+    int reset = PQstatus(dbc->conn) == CONNECTION_BAD;
+    if (!reset && g_pool.health_idle_s && dbc->idle_since_ns &&
+        now - dbc->idle_since_ns >= (long long)g_pool.health_idle_s * 1000000000LL) {
+        pthread_mutex_lock(&dbc->mu);
+        metrics_inc_db_round_trip();
+        PGresult *res = PQexec(dbc->conn, "SELECT 1");
+        reset = PQresultStatus(res) != PGRES_TUPLES_OK;
+        PQclear(res);
+        pthread_mutex_unlock(&dbc->mu);
+    }
+    if (reset) {
+        pthread_mutex_lock(&g_pool.mu);
+        g_pool.resets++;
+        pthread_mutex_unlock(&g_pool.mu);
+        pthread_mutex_lock(&dbc->mu);
+        PQreset(dbc->conn);
+        dbc->prepared = 0;
+        pthread_mutex_unlock(&dbc->mu);
+    }
+    db_session_check(dbc);
+}
+
+// Give dbc to the oldest waiter, else back to the idle stack (holds g_pool.mu)
+static void db_pool_put_locked(DBConnection *dbc, long long now) {
+    DBPoolWaiter *w = g_pool.head;
+    if (w) {
+        g_pool.head = w->next;
+        if (!g_pool.head) g_pool.tail = &g_pool.head;
+        dbc->leased_at_ns = now;
+        w->got = dbc;
+        pthread_cond_signal(&w->cv);
+        return;
+    }
+    g_pool.in_use--;
+    g_pool.idle[g_pool.nidle++] = dbc;
+}
+
+// Wake the oldest waiter to open the connection a failed open gave back
+// (holds g_pool.mu)
+static void db_pool_retry_locked(void) {
+    DBPoolWaiter *w = g_pool.head;
+    if (!w) return;
+    g_pool.head = w->next;
+    if (!g_pool.head) g_pool.tail = &g_pool.head;
+    w->retry = 1;
+    pthread_cond_signal(&w->cv);
+}
+
+// Lease a connection, queueing at most wait_ms (< 0: as long as it takes).
+// Every connection counts from the moment its open is reserved: once size
+// are open or opening, callers queue (a startup burst waits for the first
+// opens instead of failing), and an open that fails passes its reservation
+// to the oldest waiter.
+static DBConnection *db_pool_get(int wait_ms) {
+    long long t0 = db_mono_ns();
+    long long until = t0 + (long long)wait_ms * 1000000LL;
+    struct timespec ts = { .tv_sec = (time_t)(until / 1000000000LL), .tv_nsec = (long)(until % 1000000000LL) };
+    DBConnection *dbc = NULL;
+    int waited = 0;
+    pthread_mutex_lock(&g_pool.mu);
+    g_pool.acquires++;
+    for (;;) {
+        if (g_pool.nidle > 0) {
+            dbc = g_pool.idle[--g_pool.nidle];
+            g_pool.in_use++;
+            dbc->leased_at_ns = t0;
+            break;
+        }
+        if (g_pool.opened < g_pool.size) {
+            g_pool.opened++; // reserve, connect without the lock
+            g_pool.in_use++;
+            pthread_mutex_unlock(&g_pool.mu);
+            dbc = db_connect(g_pool.uri);
+            pthread_mutex_lock(&g_pool.mu);
+            if (dbc) {
+                g_pool.all[g_pool.nall++] = dbc;
+                dbc->leased_at_ns = t0;
+            } else {
+                g_pool.opened--;
+                g_pool.in_use--;
+                db_pool_retry_locked();
+            }
+            break;
+        }
+        // Queue behind earlier waiters until a connection is handed over
+        DBPoolWaiter w = { .next = NULL, .got = NULL, .retry = 0 };
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&w.cv, &attr);
+        pthread_condattr_destroy(&attr);
+        *g_pool.tail = &w;
+        g_pool.tail = &w.next;
+        if (!waited++) g_pool.waits++;
+        int timed_out = 0;
+        while (!w.got && !w.retry && !timed_out) {
+            if (wait_ms < 0) pthread_cond_wait(&w.cv, &g_pool.mu);
+            else timed_out = pthread_cond_timedwait(&w.cv, &g_pool.mu, &ts) == ETIMEDOUT;
+        }
+        pthread_cond_destroy(&w.cv);
+        dbc = w.got;
+        if (dbc) break;
+        if (w.retry) continue; // dequeued by db_pool_retry_locked(): open it
+        DBPoolWaiter **link = &g_pool.head;
+        while (*link && *link != &w) link = &(*link)->next;
+        if (*link) *link = w.next;
+        g_pool.tail = &g_pool.head;
+        while (*g_pool.tail) g_pool.tail = &(*g_pool.tail)->next;
+        g_pool.timeouts++;
+        break;
+    }
+    if (waited) g_pool.wait_us += (unsigned long long)((db_mono_ns() - t0) / 1000);
+    pthread_mutex_unlock(&g_pool.mu);
+    if (dbc) db_pool_check(dbc, t0);
+    return dbc;
+}
+
+void db_thread_release(void) {
+    DBConnection *dbc = t_lease;
+    if (!dbc) return;
+    t_lease = NULL;
+    // A request that failed mid-transaction must not hand its block on
+    pthread_mutex_lock(&dbc->mu);
+    PGTransactionStatusType ts = PQtransactionStatus(dbc->conn);
+    if (ts == PQTRANS_INTRANS || ts == PQTRANS_INERROR) {
+        metrics_inc_db_round_trip();
+        PQclear(PQexec(dbc->conn, "ROLLBACK"));
+    } else if (ts != PQTRANS_IDLE) {
+        PQreset(dbc->conn); // busy or unknown state
+        dbc->prepared = 0;
+    }
+    pthread_mutex_unlock(&dbc->mu);
+    long long now = db_mono_ns();
+    pthread_mutex_lock(&g_pool.mu);
+    g_pool.busy_us += (unsigned long long)((now - dbc->leased_at_ns) / 1000);
+    dbc->idle_since_ns = now;
+    db_pool_put_locked(dbc, now);
+    pthread_mutex_unlock(&g_pool.mu);
+}
+
+DBConnection *db_thread_get_wait(DBConnection *bootstrap) {
+    if (g_pool.size && !t_dedicated && bootstrap && bootstrap->uri && !t_lease) {
+        t_lease = db_pool_get(-1);
+        if (t_lease) return t_lease;
+    }
+    return db_thread_get(bootstrap);
+}
+
+void db_thread_dedicated(void) {
+    t_dedicated = 1;
+}
+
 // Get (or create) a per-thread DB connection based on a bootstrap URI.
 // VN: Lấy kết nối DB riêng cho từng luồng (tạo 1 lần/lưu TLS) để tăng thông lượng.
 DBConnection *db_thread_get(DBConnection *bootstrap) {
     if (!bootstrap || !bootstrap->uri) return bootstrap;
+    if (g_pool.size && !t_dedicated) {
+        if (!t_lease) t_lease = db_pool_get(g_pool.wait_ms);
+        return t_lease; // NULL: no connection within DB_POOL_WAIT_MS
+    }
     pthread_once(&db_tls_once, db_tls_init_key);
     DBConnection *local = (DBConnection *)pthread_getspecific(db_tls_key);
-    if (local) return local;
+    if (local) {
+        // Dropped session: reconnect, then prepare the statements again. Done
+        // here, at the start of a request and outside its transaction block.
+        db_session_check(local);
+        return local;
+    }
     local = db_connect(bootstrap->uri);
     if (!local) return bootstrap; // fallback to shared (still safe due to mutex)
     pthread_setspecific(db_tls_key, local);
@@ -116,7 +530,8 @@ DBConnection *db_thread_get(DBConnection *bootstrap) {
 int db_insert_or_get_by_reqid(DBConnection *dbc,
                               const char *request_id,
                               const char *pan_masked,
-                              const char *amount,
+                              int64_t amount_minor,
+                              int amount_exp,
                               const char *status,
                               int *out_is_dup,
                               char *out_status,
@@ -127,35 +542,25 @@ int db_insert_or_get_by_reqid(DBConnection *dbc,
 
     // If no request_id provided, fallback to simple insert
     if (!request_id || request_id[0] == '\0') {
-        int rc = db_insert_transaction(dbc, pan_masked, amount, status);
+        int rc = db_insert_transaction(dbc, pan_masked, amount_minor, amount_exp, status);
         if (rc == 0 && out_status && out_status_sz) {
             snprintf(out_status, out_status_sz, "%s", status);
         }
         return rc;
     }
 
+    unsigned char num[DB_NUMERIC_MAX];
     const char *paramValuesIns[4];
-    int paramLengthsIns[4] = {0};
-    int paramFormatsIns[4] = {0};
+    int paramLengthsIns[4] = {0, 0, numeric_binary(amount_minor, amount_exp, num), 0};
+    int paramFormatsIns[4] = {0, 0, 1, 0};
     paramValuesIns[0] = request_id;
     paramValuesIns[1] = pan_masked;
-    paramValuesIns[2] = amount;
+    paramValuesIns[2] = (const char *)num;
     paramValuesIns[3] = status;
 
     // Try insert; if duplicate, do SELECT existing
     pthread_mutex_lock(&dbc->mu);
-    PGresult *res = PQexecParams(
-        dbc->conn,
-        "INSERT INTO transactions (request_id, pan_masked, amount, status) "
-        "VALUES ($1, $2, $3::numeric, $4) "
-        "ON CONFLICT (request_id) DO NOTHING RETURNING status",
-        4,
-        NULL,
-        paramValuesIns,
-        paramLengthsIns,
-        paramFormatsIns,
-        0
-    );
+    PGresult *res = db_exec(dbc, DB_STMT_INSERT_REQID, paramValuesIns, paramLengthsIns, paramFormatsIns);
     if (!res) {
         pthread_mutex_unlock(&dbc->mu);
         return -1;
@@ -183,16 +588,7 @@ int db_insert_or_get_by_reqid(DBConnection *dbc,
     int paramLengthsSel[1] = {0};
     int paramFormatsSel[1] = {0};
     paramValuesSel[0] = request_id;
-    res = PQexecParams(
-        dbc->conn,
-        "SELECT status FROM transactions WHERE request_id = $1",
-        1,
-        NULL,
-        paramValuesSel,
-        paramLengthsSel,
-        paramFormatsSel,
-        0
-    );
+    res = db_exec(dbc, DB_STMT_STATUS_REQID, paramValuesSel, paramLengthsSel, paramFormatsSel);
     if (!res) {
         pthread_mutex_unlock(&dbc->mu);
         return -1;
@@ -213,6 +609,337 @@ int db_insert_or_get_by_reqid(DBConnection *dbc,
     return 0;
 }
 
+// Compensation of a committed row: only a row still in status "from" changes
+int db_set_status_by_reqid(DBConnection *dbc, const char *request_id, const char *from, const char *to) {
+    if (!dbc || !dbc->conn || !request_id || !request_id[0] || !from || !to) return -1;
+    const char *values[3] = {request_id, from, to};
+    int lengths[3] = {0, 0, 0};
+    int formats[3] = {0, 0, 0};
+    pthread_mutex_lock(&dbc->mu);
+    PGresult *res = db_exec(dbc, DB_STMT_SET_STATUS, values, lengths, formats);
+    int rc = (res && PQresultStatus(res) == PGRES_COMMAND_OK) ? 0 : -1;
+    if (rc != 0) fprintf(stderr, "DB status update failed: %s\n", PQerrorMessage(dbc->conn));
+    PQclear(res);
+    pthread_mutex_unlock(&dbc->mu);
+    return rc;
+}
+
+#define DB_BATCH_ID_MAX 127
+#define DB_BATCH_PAN_MAX 63
+
+static unsigned char *put_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+    return p + 4;
+}
+
+// Header of a one-dimensional binary array (array_send): ndim, has-null
+// flag, element type, then the dimension's size and lower bound
+static unsigned char *array_header(unsigned char *p, uint32_t elem_oid, size_t n) {
+    p = put_be32(p, 1);
+    p = put_be32(p, 0);
+    p = put_be32(p, elem_oid);
+    p = put_be32(p, (uint32_t)n);
+    return put_be32(p, 1);
+}
+
+static unsigned char *array_text(unsigned char *p, const char *s, size_t cap) {
+    size_t n = strnlen(s, cap);
+    p = put_be32(p, (uint32_t)n);
+    memcpy(p, s, n);
+    return p + n;
+}
+
+// Batch insert: one statement whatever the batch size; the binary arrays
+// save PostgreSQL from parsing array literals (and us from escaping them).
+// VN: Ghi cả lô trong một lần round-trip: mảng nhị phân + unnest.
+// Parameters of DB_STMT_INSERT_BATCH: binary text[] / numeric[] arrays
+typedef struct {
+    unsigned char ids[20 + DB_BATCH_MAX * (4 + DB_BATCH_ID_MAX)];
+    unsigned char pans[20 + DB_BATCH_MAX * (4 + DB_BATCH_PAN_MAX)];
+    unsigned char amounts[20 + DB_BATCH_MAX * (4 + DB_NUMERIC_MAX)];
+    const char *values[4];
+    int lengths[4];
+    int formats[4];
+} DBBatchParams;
+
+static int batch_params(DBBatchParams *bp, const DBBatchRow *rows, size_t n, const char *status) {
+    unsigned char *pi = array_header(bp->ids, DB_TEXTOID, n);
+    unsigned char *pp = array_header(bp->pans, DB_TEXTOID, n);
+    unsigned char *pa = array_header(bp->amounts, DB_NUMERICOID, n);
+    for (size_t i = 0; i < n; ++i) {
+        if (!rows[i].request_id || !rows[i].request_id[0] || !rows[i].pan_masked) return -1;
+        pi = array_text(pi, rows[i].request_id, DB_BATCH_ID_MAX);
+        pp = array_text(pp, rows[i].pan_masked, DB_BATCH_PAN_MAX);
+        int len = numeric_binary(rows[i].amount_minor, rows[i].amount_exp, pa + 4);
+        pa = put_be32(pa, (uint32_t)len) + len;
+    }
+    bp->values[0] = (const char *)bp->ids;
+    bp->values[1] = (const char *)bp->pans;
+    bp->values[2] = (const char *)bp->amounts;
+    bp->values[3] = status;
+    bp->lengths[0] = (int)(pi - bp->ids);
+    bp->lengths[1] = (int)(pp - bp->pans);
+    bp->lengths[2] = (int)(pa - bp->amounts);
+    bp->lengths[3] = 0;
+    bp->formats[0] = bp->formats[1] = bp->formats[2] = 1;
+    bp->formats[3] = 0;
+    return 0;
+}
+
+// One result row per item: (idx, is_dup, status)
+static int batch_results(PGresult *res, DBBatchRow *rows, size_t n) {
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || (size_t)PQntuples(res) != n) return -1;
+    for (size_t i = 0; i < n; ++i) {
+        long idx = strtol(PQgetvalue(res, (int)i, 0), NULL, 10);
+        DBBatchRow *r = (idx >= 1 && (size_t)idx <= n) ? &rows[idx - 1] : &rows[i];
+        r->is_dup = PQgetvalue(res, (int)i, 1)[0] == 't';
+        snprintf(r->status, sizeof(r->status), "%s", PQgetvalue(res, (int)i, 2));
+    }
+    return 0;
+}
+
+int db_insert_batch_by_reqid(DBConnection *dbc, DBBatchRow *rows, size_t n, const char *status) {
+    if (!dbc || !dbc->conn || !rows || n == 0 || n > DB_BATCH_MAX || !status) return -1;
+    DBBatchParams bp;
+    if (batch_params(&bp, rows, n, status) != 0) return -1;
+
+    pthread_mutex_lock(&dbc->mu);
+    PGresult *res = db_exec(dbc, DB_STMT_INSERT_BATCH, bp.values, bp.lengths, bp.formats);
+    if (!res) {
+        pthread_mutex_unlock(&dbc->mu);
+        return -1;
+    }
+    if (batch_results(res, rows, n) != 0) {
+        fprintf(stderr, "DB batch insert failed: %s\n", PQerrorMessage(dbc->conn));
+        PQclear(res);
+        pthread_mutex_unlock(&dbc->mu);
+        return -1;
+    }
+    PQclear(res);
+    pthread_mutex_unlock(&dbc->mu);
+    return 0;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// Queue statement id in the pipeline (caller holds dbc->mu): by name when
+// the set is prepared, else as SQL text. No PQprepare here: the flight runs
+// inside BEGIN, and db_thread_get() already prepared an idle session.
+static int db_send(DBConnection *dbc, int id, const char *const *values, const int *lengths, const int *formats) {
+    if (g_db_prepared && dbc->prepared) {
+        return PQsendQueryPrepared(dbc->conn, k_db_stmts[id].name, k_db_stmts[id].nparams, values, lengths,
+                                   formats, 0);
+    }
+    return PQsendQueryParams(dbc->conn, k_db_stmts[id].sql, k_db_stmts[id].nparams, k_db_stmts[id].types,
+                             values, lengths, formats, 0);
+}
+#endif
+
+// Insert parameters of a 2PC flight: one row without request_id is a plain
+// insert (*plain = 1, as db_insert_or_get_by_reqid), anything else the batch
+static int flight_params(DBBatchParams *bp, unsigned char *num, const DBBatchRow *rows, size_t n,
+                         const char *status, int *plain) {
+    *plain = n == 1 && (!rows[0].request_id || !rows[0].request_id[0]);
+    if (!*plain) return n ? batch_params(bp, rows, n, status) : 0;
+    if (!rows[0].pan_masked) return -1;
+    bp->values[0] = rows[0].pan_masked;
+    bp->values[1] = (const char *)num;
+    bp->values[2] = status;
+    bp->lengths[0] = 0;
+    bp->lengths[1] = numeric_binary(rows[0].amount_minor, rows[0].amount_exp, num);
+    bp->lengths[2] = 0;
+    bp->formats[0] = 0;
+    bp->formats[1] = 1;
+    bp->formats[2] = 0;
+    return 0;
+}
+
+// Check the flight's results (BEGIN [, insert], PREPARE) and fill rows;
+// conn (may be NULL) only for the error message of a missing result
+static int flight_results(PGresult *const *res, int nq, DBBatchRow *rows, size_t n, int plain,
+                          const char *status, PGconn *conn) {
+    int ok = 1;
+    for (int i = 0; ok && i < nq; ++i) {
+        if (!res[i]) ok = 0;
+        else if (i == 1 && n) ok = plain ? PQresultStatus(res[i]) == PGRES_COMMAND_OK
+                                         : batch_results(res[i], rows, n) == 0;
+        else ok = PQresultStatus(res[i]) == PGRES_COMMAND_OK;
+        if (!ok) {
+            fprintf(stderr, "DB pipelined 2PC statement %d failed: %s\n", i,
+                    res[i] ? PQresultErrorMessage(res[i]) : conn ? PQerrorMessage(conn) : "no result");
+        }
+    }
+    if (ok && plain) {
+        rows[0].is_dup = 0;
+        snprintf(rows[0].status, sizeof(rows[0].status), "%s", status);
+    }
+    return ok ? 0 : -1;
+}
+
+// [ANCHOR:DB_PIPELINE_2PC]
+// EN: BEGIN, the insert and PREPARE TRANSACTION go out together in pipeline
+//     mode, closed by one Sync, and their results are read back in order:
+//     one network round trip where there were three (four with the SELECT
+//     after a conflict, which DB_STMT_INSERT_BATCH makes unnecessary). If a
+//     statement fails PostgreSQL skips the rest up to the Sync
+//     (PGRES_PIPELINE_ABORTED), so nothing is prepared after a failed insert;
+//     the open transaction block is left for the caller's ROLLBACK.
+// VN: Gửi BEGIN + INSERT + PREPARE TRANSACTION trong một lượt (pipeline),
+//     đọc kết quả một lần → 1 round trip thay vì 3-4.
+int db_begin_insert_prepare(DBConnection *dbc, DBBatchRow *rows, size_t n, const char *status,
+                            const char *prepare_cmd) {
+#ifdef LIBPQ_HAS_PIPELINING
+    if (!dbc || !dbc->conn || n > DB_BATCH_MAX || (n && (!rows || !status)) || !prepare_cmd) return -1;
+    int plain;
+    DBBatchParams bp;
+    unsigned char num[DB_NUMERIC_MAX];
+    if (flight_params(&bp, num, rows, n, status, &plain) != 0) return -1;
+
+    pthread_mutex_lock(&dbc->mu);
+    PGconn *conn = dbc->conn;
+    if (!PQenterPipelineMode(conn)) {
+        fprintf(stderr, "DB pipeline mode failed: %s\n", PQerrorMessage(conn));
+        pthread_mutex_unlock(&dbc->mu);
+        return -1;
+    }
+    int nq = 0; // statements queued: BEGIN [, insert], PREPARE
+    int sent = PQsendQueryParams(conn, "BEGIN", 0, NULL, NULL, NULL, NULL, 0) && ++nq;
+    if (sent && n) {
+        sent = db_send(dbc, plain ? DB_STMT_INSERT : DB_STMT_INSERT_BATCH, bp.values, bp.lengths, bp.formats) &&
+               ++nq;
+    }
+    if (sent) sent = PQsendQueryParams(conn, prepare_cmd, 0, NULL, NULL, NULL, NULL, 0) && ++nq;
+    // The Sync also flushes: the whole flight is one write
+    metrics_inc_db_round_trip();
+    int synced = PQpipelineSync(conn);
+
+    // Results come in queue order, each followed by a NULL, then the Sync's.
+    // Two NULLs in a row: nothing more is coming (connection lost). Drained
+    // to the end even when a statement failed, so the pipeline is empty.
+    PGresult *res[3] = {NULL, NULL, NULL};
+    int q = 0, nulls = 0;
+    while (synced && nulls < 2) {
+        PGresult *r = PQgetResult(conn);
+        if (!r) {
+            nulls++;
+            q++;
+            continue;
+        }
+        nulls = 0;
+        if (PQresultStatus(r) == PGRES_PIPELINE_SYNC) {
+            PQclear(r);
+            break;
+        }
+        if (q < nq && !res[q]) res[q] = r;
+        else PQclear(r);
+    }
+    // Back to normal mode, or the next PQexec on this session fails. A flight
+    // whose Sync never went out cannot be drained (no result would come);
+    // a session that will not leave pipeline mode is reset and re-prepared.
+    if (!synced || !PQexitPipelineMode(conn)) {
+        fprintf(stderr, "DB pipeline mode not left (%s): resetting the connection\n", PQerrorMessage(conn));
+        PQreset(conn);
+        dbc->prepared = 0;
+        if (g_db_prepared && PQstatus(conn) == CONNECTION_OK) (void)db_prepare_all(dbc);
+    }
+
+    int ok = sent && synced && nq == (n ? 3 : 2);
+    if (!ok) fprintf(stderr, "DB pipelined 2PC send failed: %s\n", PQerrorMessage(conn));
+    else ok = flight_results(res, nq, rows, n, plain, status, conn) == 0;
+    for (int i = 0; i < 3; ++i) PQclear(res[i]);
+    pthread_mutex_unlock(&dbc->mu);
+    return ok ? 0 : -1;
+#else
+    (void)dbc; (void)rows; (void)n; (void)status; (void)prepare_cmd;
+    return -1;
+#endif
+}
+
+// [ANCHOR:DB_ASYNC_2PC]
+// EN: The same flight through dbasync.c: no connection of the caller's, the
+//     flight shares one of DB_ASYNC_CONNS with every other request in flight.
+//     DBASYNC_CLEANUP follows it with a ROLLBACK, so a failed insert never
+//     leaves its aborted transaction block to the next request's flight.
+// VN: Cùng lượt BEGIN/INSERT/PREPARE nhưng chạy trên kết nối async dùng chung.
+typedef struct {
+    DBBatchParams bp;               // what the queries point to, until completion
+    unsigned char num[DB_NUMERIC_MAX];
+    DbAsyncQuery q[3];
+    int nq;
+    int plain;
+    DBBatchRow *rows;
+    size_t n;
+    const char *status;
+    void (*done)(void *arg, int rc);
+    void *arg;
+    char prepare_cmd[];
+} DbAsyncPrepare;
+
+static DbAsyncPrepare *async_prepare_new(DBBatchRow *rows, size_t n, const char *status, const char *prepare_cmd) {
+    if (n > DB_BATCH_MAX || (n && (!rows || !status)) || !prepare_cmd) return NULL;
+    size_t cl = strlen(prepare_cmd) + 1;
+    DbAsyncPrepare *f = malloc(sizeof(*f) + cl);
+    if (!f) return NULL;
+    memcpy(f->prepare_cmd, prepare_cmd, cl);
+    if (flight_params(&f->bp, f->num, rows, n, status, &f->plain) != 0) {
+        free(f);
+        return NULL;
+    }
+    int id = f->plain ? DB_STMT_INSERT : DB_STMT_INSERT_BATCH;
+    f->nq = 0;
+    f->q[f->nq++] = (DbAsyncQuery){ .sql = "BEGIN" };
+    if (n) {
+        f->q[f->nq++] = (DbAsyncQuery){ .sql = k_db_stmts[id].sql, .stmt = g_db_prepared ? k_db_stmts[id].name : NULL,
+                                        .nparams = k_db_stmts[id].nparams, .types = k_db_stmts[id].types,
+                                        .values = f->bp.values, .lengths = f->bp.lengths, .formats = f->bp.formats };
+    }
+    f->q[f->nq++] = (DbAsyncQuery){ .sql = f->prepare_cmd };
+    f->rows = rows;
+    f->n = n;
+    f->status = status;
+    return f;
+}
+
+int db_async_begin_insert_prepare(DBBatchRow *rows, size_t n, const char *status, const char *prepare_cmd) {
+    DbAsyncPrepare *f = async_prepare_new(rows, n, status, prepare_cmd);
+    if (!f) return -1;
+    PGresult *res[3] = {NULL, NULL, NULL};
+    int ok = dbasync_run(DBASYNC_LANE_WORK, f->q, f->nq, DBASYNC_CLEANUP, res) >= 0 &&
+             flight_results(res, f->nq, rows, n, f->plain, status, NULL) == 0;
+    for (int i = 0; i < 3; ++i) PQclear(res[i]);
+    free(f);
+    return ok ? 0 : -1;
+}
+
+// Completion on the dbasync loop thread: fill the rows, hand over the outcome
+static void async_prepare_done(void *arg, PGresult **results, int n, int ok) {
+    (void)ok; // flight_results() checks every statement
+    DbAsyncPrepare *f = arg;
+    int rc = flight_results(results, n, f->rows, f->n, f->plain, f->status, NULL);
+    f->done(f->arg, rc);
+    free(f);
+}
+
+int db_async_submit_begin_insert_prepare(DBBatchRow *rows, size_t n, const char *status, const char *prepare_cmd,
+                                         void (*done)(void *arg, int rc), void *arg) {
+    if (!done) return -1;
+    DbAsyncPrepare *f = async_prepare_new(rows, n, status, prepare_cmd);
+    if (!f) return -1;
+    f->done = done;
+    f->arg = arg;
+    if (dbasync_submit(DBASYNC_LANE_WORK, f->q, f->nq, DBASYNC_CLEANUP, async_prepare_done, f) != 0) {
+        free(f);
+        return -1;
+    }
+    return 0;
+}
+
+int db_is_prepared(DBConnection *dbc) {
+    return dbc && dbc->prepared;
+}
+
 int db_is_ready(DBConnection *dbc) {
     if (!dbc || !dbc->conn) return 0;
     return PQstatus(dbc->conn) == CONNECTION_OK;
@@ -231,16 +958,7 @@ int db_get_tx_by_request_id(DBConnection *dbc,
     int paramFormats[1] = { 0 };
 
     pthread_mutex_lock(&dbc->mu);
-    PGresult *res = PQexecParams(
-        dbc->conn,
-        "SELECT request_id, amount::text, status FROM transactions WHERE request_id=$1 LIMIT 1",
-        1,
-        NULL,
-        paramValues,
-        paramLengths,
-        paramFormats,
-        0
-    );
+    PGresult *res = db_exec(dbc, DB_STMT_GET_TX, paramValues, paramLengths, paramFormats);
     if (!res) {
         pthread_mutex_unlock(&dbc->mu);
         return -1;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <libpq-fe.h>
+#include <stdint.h>
 
 typedef struct DBConnection DBConnection;
 
@@ -12,6 +13,22 @@ typedef struct DBConnection DBConnection;
  */
 DBConnection *db_connect(const char *uri);
 
+/**
+ * prepared: 1 (default): every connection prepares the request-path
+ * statements once (on connect and again after a reset) and runs them with
+ * PQexecPrepared; 0: send the SQL text with PQexecParams each time
+ * (DB_PREPARED=0).
+ * pipeline: 1 (default): the 2PC participant sends BEGIN, its insert and
+ * PREPARE TRANSACTION in one pipelined round trip
+ * (db_begin_insert_prepare()); 0: one synchronous round trip each
+ * (DB_PIPELINE=0). Always 0 when libpq has no pipeline mode (< 14).
+ * Call once at startup, before the first db_connect().
+ */
+void db_configure(int prepared, int pipeline);
+
+/// 1 when db_begin_insert_prepare() is in use (DB_PIPELINE)
+int db_pipeline_enabled(void);
+
 /**
  * Insert a new transaction into the database.
  *
@@ -21,11 +38,13 @@ DBConnection *db_connect(const char *uri);
  *
  * @param dbc Database connection
  * @param pan_masked Masked PAN (primary account number)
- * @param amount Transaction amount as text
+ * @param amount_minor Transaction amount in minor units (sent as binary numeric)
+ * @param amount_exp Minor-unit exponent of the currency (1000, 2 → 10.00)
  * @param status Transaction status (e.g. "OK" or "ERROR")
  * @return 0 on success, non‑zero on error
  */
-int db_insert_transaction(DBConnection *dbc, const char *pan_masked, const char *amount, const char *status);
+int db_insert_transaction(DBConnection *dbc, const char *pan_masked, int64_t amount_minor, int amount_exp,
+                          const char *status);
 
 /**
  * Close the database connection and free resources.
@@ -34,14 +53,73 @@ int db_insert_transaction(DBConnection *dbc, const char *pan_masked, const char
  */
 void db_disconnect(DBConnection *dbc);
 
+/**
+ * Underlying libpq connection (for callers that issue their own commands,
+ * e.g. the 2PC participant's BEGIN / PREPARE TRANSACTION).
+ */
+PGconn *db_pgconn(DBConnection *dbc);
+
 /**
  * Get a thread-local DB connection based on a bootstrap connection.
  * The first time this is called in a thread, a new connection will be
  * created using the same URI as the bootstrap. Subsequent calls return
- * the same connection for that thread.
+ * the same connection for that thread. A thread connection that was lost
+ * is reset here, and its statements are prepared again (db_configure()).
+ * With the pool on (db_pool_init()) it returns the thread's lease instead,
+ * taking one first if needed: NULL when none came within DB_POOL_WAIT_MS.
  */
 DBConnection *db_thread_get(DBConnection *bootstrap);
 
+/**
+ * Shared connection pool (DB_POOL_SIZE > 0; 0 = one connection per worker
+ * thread, as db_thread_get() always did). Connections open lazily, up to
+ * size, from bootstrap's URI. A thread leases one on its first
+ * db_thread_get() and gives it back with db_thread_release(); waiters are
+ * served first come, first served and get NULL after wait_ms. A connection
+ * idle for health_idle_s or more is pinged (SELECT 1) before it is lent
+ * (0 = only reset dropped ones). Call once at startup, before the workers.
+ */
+int db_pool_init(DBConnection *bootstrap, int size, int wait_ms, int health_idle_s);
+
+// Close the pool's connections (no thread may hold a lease)
+void db_pool_shutdown(void);
+
+/// Pool counters since start (GET /metrics)
+typedef struct {
+    int size;                  ///< DB_POOL_SIZE (0 = off)
+    int opened;                ///< connections opened so far
+    int in_use;                ///< connections lent out now
+    unsigned long acquires;    ///< leases requested
+    unsigned long waits;       ///< requests that queued for a connection
+    unsigned long timeouts;    ///< ... and got none within DB_POOL_WAIT_MS
+    unsigned long resets;      ///< dropped or unhealthy connections reset on lease
+    unsigned long long wait_us;  ///< total queueing time
+    unsigned long long busy_us;  ///< total time connections were lent out
+} DBPoolStats;
+
+void db_pool_stats(DBPoolStats *out);
+
+/**
+ * db_thread_get() that waits for a pool connection without DB_POOL_WAIT_MS:
+ * for COMMIT / ROLLBACK PREPARED, which must not be given up (the prepared
+ * transaction would keep its locks). Call it holding no other lease.
+ */
+DBConnection *db_thread_get_wait(DBConnection *bootstrap);
+
+/**
+ * Return the calling thread's leased pool connection (rolled back first if
+ * left inside a transaction block). No-op without a pool or lease. The
+ * connection db_thread_get() returned must not be used afterwards.
+ */
+void db_thread_release(void);
+
+/**
+ * The calling thread keeps a connection of its own even with the pool on
+ * (long-lived writers such as the group commit thread). Call before its
+ * first db_thread_get().
+ */
+void db_thread_dedicated(void);
+
 /**
  * Idempotent insert based on request_id. If request_id already exists,
  * no new row is created and the existing status is returned via out_status.
@@ -50,7 +128,8 @@ DBConnection *db_thread_get(DBConnection *bootstrap);
  * @param dbc Database connection
  * @param request_id Optional unique request id
  * @param pan_masked Masked PAN
- * @param amount Amount as text
+ * @param amount_minor Amount in minor units
+ * @param amount_exp Minor-unit exponent of the currency
  * @param status Desired status to set on new insert
  * @param out_is_dup Optional; set to 1 if duplicate id encountered, else 0
  * @param out_status Buffer to receive resulting status (existing or inserted)
@@ -60,12 +139,80 @@ DBConnection *db_thread_get(DBConnection *bootstrap);
 int db_insert_or_get_by_reqid(DBConnection *dbc,
                               const char *request_id,
                               const char *pan_masked,
-                              const char *amount,
+                              int64_t amount_minor,
+                              int amount_exp,
                               const char *status,
                               int *out_is_dup,
                               char *out_status,
                               size_t out_status_sz);
 
+/**
+ * Set the status of request_id's row to `to` if it still is `from` (e.g. an
+ * APPROVED row whose payment failed after it was committed). Returns 0 when
+ * the statement ran (whether or not a row matched), non-zero on error.
+ */
+int db_set_status_by_reqid(DBConnection *dbc, const char *request_id, const char *from, const char *to);
+
+/// Most rows db_insert_batch_by_reqid() writes in one statement
+#define DB_BATCH_MAX 64
+
+/**
+ * One item of a batch insert: request_id (required, unique within the
+ * batch; at most 127 bytes), pan_masked (at most 63 bytes) and amount are
+ * inputs, is_dup / status are filled in like db_insert_or_get_by_reqid()'s
+ * out_is_dup / out_status.
+ */
+typedef struct DBBatchRow {
+    const char *request_id;
+    const char *pan_masked;
+    int64_t amount_minor;
+    int amount_exp;
+    int is_dup;
+    char status[32];
+} DBBatchRow;
+
+/**
+ * Idempotent insert of n rows (1..DB_BATCH_MAX) in one round trip: the
+ * columns go as binary text[] / numeric[] arrays to a single
+ * INSERT ... SELECT FROM unnest(...) ON CONFLICT (request_id) DO NOTHING,
+ * and one result row per item says whether it was new or which status the
+ * existing row has. Returns 0 on success, non-zero on error (nothing filled).
+ */
+int db_insert_batch_by_reqid(DBConnection *dbc, DBBatchRow *rows, size_t n, const char *status);
+
+/**
+ * BEGIN; idempotent insert of rows; prepare_cmd (PREPARE TRANSACTION '...')
+ * sent in one libpq pipeline and read back together: one round trip. rows
+ * are filled in like db_insert_batch_by_reqid(); one row without request_id
+ * is a plain insert (is_dup 0, status = status); n = 0 inserts nothing.
+ * Returns 0 when all three succeeded. On error the session may be left in
+ * an open (failed) transaction block: the caller issues ROLLBACK.
+ */
+int db_begin_insert_prepare(DBConnection *dbc, DBBatchRow *rows, size_t n, const char *status,
+                            const char *prepare_cmd);
+
+/**
+ * db_begin_insert_prepare() on the shared asynchronous connections
+ * (DB_ASYNC, dbasync.c): the caller waits for the flight without holding a
+ * connection. A failed flight is rolled back by the layer, so there is no
+ * open transaction block to clean up; if the connection was lost the
+ * PREPARE may still have run, so the caller's abort issues ROLLBACK PREPARED.
+ */
+int db_async_begin_insert_prepare(DBBatchRow *rows, size_t n, const char *status, const char *prepare_cmd);
+
+/**
+ * db_async_begin_insert_prepare() without the wait: the parameters and
+ * prepare_cmd are copied, rows and status must stay valid until
+ * done(arg, rc) ran on the dbasync loop thread with the result (0 = all
+ * three succeeded, rows filled in). Returns 0 when the flight was queued
+ * (done will be called), non-zero otherwise.
+ */
+int db_async_submit_begin_insert_prepare(DBBatchRow *rows, size_t n, const char *status, const char *prepare_cmd,
+                                         void (*done)(void *arg, int rc), void *arg);
+
+/// 1 when dbc's session has the request-path statements prepared
+int db_is_prepared(DBConnection *dbc);
+
 /**
  * Check if the DB connection is ready (CONNECTION_OK).
  */
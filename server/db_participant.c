@@ -1,5 +1,9 @@
 #include "db_participant.h"
 #include "log.h"
+#include "metrics.h"
+#include "arena.h"
+#include "groupcommit.h"
+#include "dbasync.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,12 +12,19 @@
 DBParticipantContext *db_participant_init(DBConnection *dbc) {
     if (!dbc) return NULL;
     
-    DBParticipantContext *ctx = malloc(sizeof(DBParticipantContext));
+    DBParticipantContext *ctx = arena_alloc(sizeof(DBParticipantContext));
     if (!ctx) return NULL;
     
     ctx->dbc = dbc;
-    memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
+    ctx->current_txn_id = "";
     ctx->in_transaction = false;
+    ctx->deferred = false;
+    ctx->group = false;
+    ctx->written = false;
+    ctx->rows = NULL;
+    ctx->nrows = 0;
+    ctx->step_done = NULL;
+    ctx->step_arg = NULL;
     
     return ctx;
 }
@@ -26,7 +37,7 @@ void db_participant_destroy(DBParticipantContext *ctx) {
         db_participant_abort(ctx, ctx->current_txn_id);
     }
     
-    free(ctx);
+    arena_release(ctx);
 }
 
 int db_participant_begin(DBParticipantContext *ctx, const char *txn_id) {
@@ -38,8 +49,19 @@ int db_participant_begin(DBParticipantContext *ctx, const char *txn_id) {
         return -1;
     }
     
+    if (db_pipeline_enabled() || dbasync_enabled()) {
+        // [ANCHOR:DB_PARTICIPANT_PIPELINE] BEGIN goes out with PREPARE
+        ctx->current_txn_id = txn_id;
+        ctx->in_transaction = true;
+        ctx->deferred = true;
+        ctx->rows = NULL;
+        ctx->nrows = 0;
+        return 0;
+    }
+
     // Start PostgreSQL transaction
-    PGconn *conn = (PGconn *)ctx->dbc;  // Assuming DBConnection wraps PGconn
+    PGconn *conn = db_pgconn(db_thread_get(ctx->dbc)); // same connection the inserts run on
+    metrics_inc_db_round_trip();
     PGresult *res = PQexec(conn, "BEGIN");
     
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -50,18 +72,45 @@ int db_participant_begin(DBParticipantContext *ctx, const char *txn_id) {
     }
     PQclear(res);
     
-    strncpy(ctx->current_txn_id, txn_id, MAX_TRANSACTION_ID_LEN - 1);
-    ctx->current_txn_id[MAX_TRANSACTION_ID_LEN - 1] = '\0';
+    ctx->current_txn_id = txn_id;
     ctx->in_transaction = true;
     
     log_message_json("INFO", "db_participant", txn_id, "Transaction started", -1);
     return 0;
 }
 
+int db_participant_begin_group(DBParticipantContext *ctx, const char *txn_id) {
+    if (!ctx || !txn_id || ctx->in_transaction || !groupcommit_enabled()) return -1;
+    ctx->current_txn_id = txn_id;
+    ctx->in_transaction = true;
+    ctx->deferred = true; // the insert is recorded like a pipelined one
+    ctx->group = true;
+    ctx->written = false;
+    ctx->rows = NULL;
+    ctx->nrows = 0;
+    return 0;
+}
+
+int db_participant_compensate(DBParticipantContext *ctx, const char *status) {
+    if (!ctx || !status) return -1;
+    if (!ctx->group || !ctx->written) return 0;
+    // Must run: the row would keep answering retries as approved
+    int rc = db_set_status_by_reqid(db_thread_get_wait(ctx->dbc), ctx->one.request_id, ctx->status, status);
+    db_thread_release();
+    if (rc != 0) {
+        log_message_json("ERROR", "db_participant", ctx->one.request_id, "Compensating update failed", -1);
+        return -1;
+    }
+    ctx->written = false;
+    log_message_json("WARN", "db_participant", ctx->one.request_id, "Committed row compensated", -1);
+    return 0;
+}
+
 int db_participant_insert_transaction(DBParticipantContext *ctx,
                                     const char *request_id,
                                     const char *pan_masked,
-                                    const char *amount,
+                                    int64_t amount_minor,
+                                    int amount_exp,
                                     const char *status,
                                     int *out_is_dup,
                                     char *out_status,
@@ -73,12 +122,50 @@ int db_participant_insert_transaction(DBParticipantContext *ctx,
         return -1;
     }
     
+    if (ctx->deferred) {
+        if (ctx->rows) return -1; // one insert per transaction
+        ctx->one.request_id = request_id;
+        ctx->one.pan_masked = pan_masked;
+        ctx->one.amount_minor = amount_minor;
+        ctx->one.amount_exp = amount_exp;
+        ctx->rows = &ctx->one;
+        ctx->nrows = 1;
+        ctx->status = status;
+        ctx->out_is_dup = out_is_dup;
+        ctx->out_status = out_status;
+        ctx->out_status_sz = out_status_sz;
+        return 0;
+    }
+
     // Use the existing db function but ensure we're in the current transaction
     // This assumes the underlying db functions respect the current transaction context
-    return db_insert_or_get_by_reqid(ctx->dbc, request_id, pan_masked, amount, 
+    return db_insert_or_get_by_reqid(db_thread_get(ctx->dbc), request_id, pan_masked, amount_minor, amount_exp,
                                    status, out_is_dup, out_status, out_status_sz);
 }
 
+int db_participant_insert_batch(DBParticipantContext *ctx, DBBatchRow *rows, size_t n, const char *status) {
+    if (!ctx || !ctx->in_transaction) {
+        log_message_json("ERROR", "db_participant", ctx ? ctx->current_txn_id : NULL,
+                        "Not in transaction", -1);
+        return -1;
+    }
+    if (ctx->group) {
+        log_message_json("ERROR", "db_participant", ctx->current_txn_id,
+                        "Batch insert not supported with group commit", -1);
+        return -1;
+    }
+    if (ctx->deferred) {
+        if (ctx->rows || !rows || n == 0 || n > DB_BATCH_MAX || !status) return -1;
+        ctx->rows = rows;
+        ctx->nrows = n;
+        ctx->status = status;
+        ctx->out_is_dup = NULL;
+        ctx->out_status = NULL;
+        return 0;
+    }
+    return db_insert_batch_by_reqid(db_thread_get(ctx->dbc), rows, n, status);
+}
+
 int db_participant_prepare(void *context, const char *txn_id) {
     DBParticipantContext *ctx = (DBParticipantContext *)context;
     if (!ctx || !txn_id) return -1;
@@ -89,25 +176,81 @@ int db_participant_prepare(void *context, const char *txn_id) {
         return -1;
     }
     
-    PGconn *conn = (PGconn *)ctx->dbc;
-    
+    if (ctx->group) {
+        // [ANCHOR:DB_PARTICIPANT_GROUP_COMMIT] Last resource: the group's
+        // commit is this participant's one phase. A failed group wrote nothing.
+        ctx->deferred = false;
+        ctx->in_transaction = false;
+        if (!ctx->rows) return 0;
+        if (groupcommit_submit(&ctx->one, ctx->status) != 0) {
+            log_message_json("ERROR", "db_participant", txn_id, "Group commit failed", -1);
+            return -1;
+        }
+        ctx->written = !ctx->one.is_dup;
+        if (ctx->one.is_dup && strcmp(ctx->one.status, ctx->status) != 0) {
+            // An earlier attempt was compensated (db_participant_compensate()):
+            // no vote for the others to commit a payment that was undone
+            log_message_json("WARN", "db_participant", txn_id, "Request already compensated", -1);
+            return -1;
+        }
+        if (ctx->out_is_dup) *ctx->out_is_dup = ctx->one.is_dup;
+        if (ctx->out_status && ctx->out_status_sz) {
+            snprintf(ctx->out_status, ctx->out_status_sz, "%s", ctx->one.status);
+        }
+        log_message_json("INFO", "db_participant", txn_id, "Group commit durable", -1);
+        return 0;
+    }
+
     // Create prepared transaction name (PostgreSQL requirement)
     char prepare_cmd[256];
     snprintf(prepare_cmd, sizeof(prepare_cmd), "PREPARE TRANSACTION 'visa_%s'", txn_id);
     
-    PGresult *res = PQexec(conn, prepare_cmd);
-    
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        const char *error = PQerrorMessage(conn);
-        log_message_json("ERROR", "db_participant", txn_id, 
-                        "PREPARE failed", -1);
+    if (ctx->deferred) {
+        // BEGIN + insert + PREPARE TRANSACTION in one flight. On failure the
+        // BEGIN may have run: in_transaction stays set so abort rolls back.
+        ctx->deferred = false;
+        if (dbasync_enabled()) {
+            // [ANCHOR:DB_PARTICIPANT_ASYNC] Shared async connections (DB_ASYNC):
+            // a failed flight rolled itself back, so abort goes straight to
+            // ROLLBACK PREPARED (needed if the connection died after PREPARE)
+            if (db_async_begin_insert_prepare(ctx->rows, ctx->nrows, ctx->status, prepare_cmd) != 0) {
+                ctx->in_transaction = false;
+                log_message_json("ERROR", "db_participant", txn_id,
+                                "Async BEGIN/INSERT/PREPARE failed", -1);
+                return -1;
+            }
+        } else if (db_begin_insert_prepare(db_thread_get(ctx->dbc), ctx->rows, ctx->nrows, ctx->status,
+                                           prepare_cmd) != 0) {
+            log_message_json("ERROR", "db_participant", txn_id,
+                            "Pipelined BEGIN/INSERT/PREPARE failed", -1);
+            return -1;
+        }
+        if (ctx->rows == &ctx->one) {
+            if (ctx->out_is_dup) *ctx->out_is_dup = ctx->one.is_dup;
+            if (ctx->out_status && ctx->out_status_sz) {
+                snprintf(ctx->out_status, ctx->out_status_sz, "%s", ctx->one.status);
+            }
+        }
+    } else {
+        PGconn *conn = db_pgconn(db_thread_get(ctx->dbc));
+        metrics_inc_db_round_trip();
+        PGresult *res = PQexec(conn, prepare_cmd);
+
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            const char *error = PQerrorMessage(conn);
+            log_message_json("ERROR", "db_participant", txn_id,
+                            "PREPARE failed", -1);
+            PQclear(res);
+            return -1;
+        }
         PQclear(res);
-        return -1;
     }
-    PQclear(res);
     
     // Transaction is now prepared, no longer "active" but not yet committed
     ctx->in_transaction = false;
+    // A prepared transaction outlives its session: with DB_POOL_SIZE the
+    // connection goes back to the pool while the other participants prepare
+    db_thread_release();
     
     log_message_json("INFO", "db_participant", txn_id, "PREPARE successful", -1);
     return 0;
@@ -117,12 +260,29 @@ int db_participant_commit(void *context, const char *txn_id) {
     DBParticipantContext *ctx = (DBParticipantContext *)context;
     if (!ctx || !txn_id) return -1;
     
-    PGconn *conn = (PGconn *)ctx->dbc;
-    
+    if (ctx->group) {
+        ctx->current_txn_id = ""; // committed with its group in prepare
+        return 0;
+    }
+
     // Commit the prepared transaction
     char commit_cmd[256];
     snprintf(commit_cmd, sizeof(commit_cmd), "COMMIT PREPARED 'visa_%s'", txn_id);
     
+    if (dbasync_enabled()) {
+        // FINISH lane: never queued behind an insert waiting on this transaction
+        if (dbasync_command(DBASYNC_LANE_FINISH, commit_cmd) != 0) {
+            log_message_json("ERROR", "db_participant", txn_id,
+                            "COMMIT PREPARED failed", -1);
+            return -1;
+        }
+        ctx->current_txn_id = "";
+        log_message_json("INFO", "db_participant", txn_id, "COMMIT successful", -1);
+        return 0;
+    }
+
+    PGconn *conn = db_pgconn(db_thread_get_wait(ctx->dbc)); // any session can finish it
+    metrics_inc_db_round_trip();
     PGresult *res = PQexec(conn, commit_cmd);
     
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -130,12 +290,14 @@ int db_participant_commit(void *context, const char *txn_id) {
         log_message_json("ERROR", "db_participant", txn_id, 
                         "COMMIT PREPARED failed", -1);
         PQclear(res);
+        db_thread_release();
         return -1;
     }
     PQclear(res);
+    db_thread_release();
     
     // Clear transaction state
-    memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
+    ctx->current_txn_id = "";
     
     log_message_json("INFO", "db_participant", txn_id, "COMMIT successful", -1);
     return 0;
@@ -145,17 +307,52 @@ int db_participant_abort(void *context, const char *txn_id) {
     DBParticipantContext *ctx = (DBParticipantContext *)context;
     if (!ctx || !txn_id) return -1;
     
-    PGconn *conn = (PGconn *)ctx->dbc;
-    PGresult *res;
+    if (ctx->group) {
+        // Not written yet, or its group failed: nothing to undo (a written
+        // row is only possible once every other participant prepared)
+        ctx->deferred = false;
+        ctx->in_transaction = false;
+        ctx->current_txn_id = "";
+        return 0;
+    }
+    if (ctx->deferred && strcmp(ctx->current_txn_id, txn_id) == 0) {
+        // Nothing was sent yet (DB_PIPELINE): nothing to roll back
+        ctx->deferred = false;
+        ctx->in_transaction = false;
+        ctx->current_txn_id = "";
+        return 0;
+    }
     
+    if (dbasync_enabled() && !ctx->in_transaction) {
+        char rollback_cmd[256];
+        snprintf(rollback_cmd, sizeof(rollback_cmd), "ROLLBACK PREPARED 'visa_%s'", txn_id);
+        if (dbasync_command(DBASYNC_LANE_FINISH, rollback_cmd) != 0) {
+            log_message_json("WARN", "db_participant", txn_id,
+                            "ROLLBACK failed (may be OK if already rolled back)", -1);
+        } else {
+            log_message_json("INFO", "db_participant", txn_id, "ROLLBACK successful", -1);
+        }
+        ctx->current_txn_id = "";
+        return 0;
+    }
+
+    PGconn *conn;
+    PGresult *res;
+
     if (ctx->in_transaction && strcmp(ctx->current_txn_id, txn_id) == 0) {
-        // Transaction not yet prepared, use normal ROLLBACK
+        // Transaction not yet prepared, use normal ROLLBACK (still the
+        // session of BEGIN: its lease is only given back after PREPARE)
+        conn = db_pgconn(db_thread_get(ctx->dbc));
+        metrics_inc_db_round_trip();
         res = PQexec(conn, "ROLLBACK");
         ctx->in_transaction = false;
     } else {
-        // Transaction was prepared, use ROLLBACK PREPARED
+        // Transaction was prepared, use ROLLBACK PREPARED (on any session,
+        // but it must run: wait for one without DB_POOL_WAIT_MS)
+        conn = db_pgconn(db_thread_get_wait(ctx->dbc));
         char rollback_cmd[256];
         snprintf(rollback_cmd, sizeof(rollback_cmd), "ROLLBACK PREPARED 'visa_%s'", txn_id);
+        metrics_inc_db_round_trip();
         res = PQexec(conn, rollback_cmd);
     }
     
@@ -169,9 +366,128 @@ int db_participant_abort(void *context, const char *txn_id) {
         PQclear(res);
         log_message_json("INFO", "db_participant", txn_id, "ROLLBACK successful", -1);
     }
+    db_thread_release();
     
     // Clear transaction state
-    memset(ctx->current_txn_id, 0, sizeof(ctx->current_txn_id));
+    ctx->current_txn_id = "";
     
     return 0;
-}
\ No newline at end of file
+}
+
+// [ANCHOR:DB_PARTICIPANT_ASYNC_STEPS]
+// EN: The DB_ASYNC steps without a waiting thread: each one queues its flight
+//     and returns; the flight's completion (dbasync loop thread) updates the
+//     context like the synchronous step and reports to the coordinator.
+// VN: Bước 2PC bất đồng bộ: gửi flight rồi trả về ngay, kết quả báo qua callback.
+static void step_report(DBParticipantContext *ctx, int rc) {
+    TxnStepDone done = ctx->step_done;
+    void *arg = ctx->step_arg;
+    ctx->step_done = NULL;
+    done(arg, rc);
+}
+
+static void prepare_flight_done(void *arg, int rc) {
+    DBParticipantContext *ctx = (DBParticipantContext *)arg;
+    const char *txn_id = ctx->current_txn_id;
+    // Either way the flight left no open block: abort goes to ROLLBACK PREPARED
+    ctx->in_transaction = false;
+    if (rc != 0) {
+        log_message_json("ERROR", "db_participant", txn_id, "Async BEGIN/INSERT/PREPARE failed", -1);
+        step_report(ctx, -1);
+        return;
+    }
+    if (ctx->rows == &ctx->one) {
+        if (ctx->out_is_dup) *ctx->out_is_dup = ctx->one.is_dup;
+        if (ctx->out_status && ctx->out_status_sz) {
+            snprintf(ctx->out_status, ctx->out_status_sz, "%s", ctx->one.status);
+        }
+    }
+    log_message_json("INFO", "db_participant", txn_id, "PREPARE successful", -1);
+    step_report(ctx, 0);
+}
+
+int db_participant_prepare_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    DBParticipantContext *ctx = (DBParticipantContext *)context;
+    if (!ctx || !txn_id || !done) return -1;
+    if (!ctx->in_transaction || !ctx->deferred || ctx->group || !dbasync_enabled() ||
+        strcmp(ctx->current_txn_id, txn_id) != 0) {
+        log_message_json("ERROR", "db_participant", txn_id, "No deferred async transaction to prepare", -1);
+        return -1;
+    }
+    char prepare_cmd[256];
+    snprintf(prepare_cmd, sizeof(prepare_cmd), "PREPARE TRANSACTION 'visa_%s'", txn_id);
+    ctx->deferred = false;
+    ctx->step_done = done;
+    ctx->step_arg = step_arg;
+    if (db_async_submit_begin_insert_prepare(ctx->rows, ctx->nrows, ctx->status, prepare_cmd,
+                                             prepare_flight_done, ctx) != 0) {
+        ctx->step_done = NULL;
+        ctx->in_transaction = false; // nothing was sent
+        log_message_json("ERROR", "db_participant", txn_id, "Async PREPARE not queued", -1);
+        return -1;
+    }
+    return 0;
+}
+
+static void commit_flight_done(void *arg, int ok) {
+    DBParticipantContext *ctx = (DBParticipantContext *)arg;
+    if (!ok) {
+        log_message_json("ERROR", "db_participant", ctx->current_txn_id, "COMMIT PREPARED failed", -1);
+        step_report(ctx, -1);
+        return;
+    }
+    log_message_json("INFO", "db_participant", ctx->current_txn_id, "COMMIT successful", -1);
+    ctx->current_txn_id = "";
+    step_report(ctx, 0);
+}
+
+int db_participant_commit_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    DBParticipantContext *ctx = (DBParticipantContext *)context;
+    if (!ctx || !txn_id || !done || ctx->group || !dbasync_enabled()) return -1;
+    char commit_cmd[256];
+    snprintf(commit_cmd, sizeof(commit_cmd), "COMMIT PREPARED 'visa_%s'", txn_id);
+    ctx->step_done = done;
+    ctx->step_arg = step_arg;
+    // FINISH lane: never queued behind an insert waiting on this transaction
+    if (dbasync_command_async(DBASYNC_LANE_FINISH, commit_cmd, commit_flight_done, ctx) != 0) {
+        ctx->step_done = NULL;
+        log_message_json("ERROR", "db_participant", txn_id, "COMMIT PREPARED not queued", -1);
+        return -1;
+    }
+    return 0;
+}
+
+static void rollback_flight_done(void *arg, int ok) {
+    DBParticipantContext *ctx = (DBParticipantContext *)arg;
+    if (!ok) {
+        log_message_json("WARN", "db_participant", ctx->current_txn_id,
+                        "ROLLBACK failed (may be OK if already rolled back)", -1);
+    } else {
+        log_message_json("INFO", "db_participant", ctx->current_txn_id, "ROLLBACK successful", -1);
+    }
+    ctx->current_txn_id = "";
+    step_report(ctx, 0); // like db_participant_abort(): never an error
+}
+
+int db_participant_abort_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg) {
+    DBParticipantContext *ctx = (DBParticipantContext *)context;
+    if (!ctx || !txn_id || !done || ctx->group || !dbasync_enabled()) return -1;
+    if (ctx->in_transaction) {
+        // Nothing was sent yet: nothing to roll back
+        ctx->deferred = false;
+        ctx->in_transaction = false;
+        ctx->current_txn_id = "";
+        done(step_arg, 0);
+        return 0;
+    }
+    char rollback_cmd[256];
+    snprintf(rollback_cmd, sizeof(rollback_cmd), "ROLLBACK PREPARED 'visa_%s'", txn_id);
+    ctx->step_done = done;
+    ctx->step_arg = step_arg;
+    if (dbasync_command_async(DBASYNC_LANE_FINISH, rollback_cmd, rollback_flight_done, ctx) != 0) {
+        ctx->step_done = NULL;
+        log_message_json("WARN", "db_participant", txn_id, "ROLLBACK PREPARED not queued", -1);
+        return -1;
+    }
+    return 0;
+}
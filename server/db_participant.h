@@ -12,12 +12,34 @@
 
 typedef struct {
     DBConnection *dbc;
-    char current_txn_id[MAX_TRANSACTION_ID_LEN];
+    const char *current_txn_id; // borrowed from db_participant_begin() ("" = none)
     bool in_transaction;
+    // DB_PIPELINE: BEGIN and the insert wait here and go out with PREPARE
+    // TRANSACTION in one flight (db_begin_insert_prepare())
+    bool deferred;              // BEGIN not sent yet
+    bool group;                 // last resource: prepare = group commit (groupcommit.c)
+    bool written;               // group: prepare committed a new row
+    DBBatchRow one;             // single insert as a one-row batch
+    DBBatchRow *rows;           // borrowed (batch) or &one; NULL = no insert
+    size_t nrows;
+    const char *status;
+    int *out_is_dup;            // single insert's outputs, filled by prepare
+    char *out_status;
+    size_t out_status_sz;
+    TxnStepDone step_done;      // asynchronous step in flight (txn_commit_async())
+    void *step_arg;
 } DBParticipantContext;
 
 /**
  * Initialize database participant context
+ * (from the request arena inside a handler scope; release with the destroy call)
+ * Each step runs on db_thread_get(dbc). With DB_POOL_SIZE the lease is given
+ * back once the transaction is prepared and again after commit / abort, so
+ * no pool connection is held while the other participants do their I/O.
+ * With DB_ASYNC no step holds a connection at all: the flights go through
+ * dbasync.c (prepare on its WORK lane, commit / abort on its FINISH lane).
+ * The synchronous steps wait for their flight; the _async ones below return
+ * at once and report from the flight's completion.
  */
 DBParticipantContext *db_participant_init(DBConnection *dbc);
 
@@ -29,22 +51,56 @@ void db_participant_destroy(DBParticipantContext *ctx);
 /**
  * Begin a database transaction for the given transaction ID
  * This should be called before any DB operations within the transaction
+ * txn_id is borrowed and must stay valid until db_participant_destroy()
+ * With DB_PIPELINE the BEGIN is only recorded here; it is sent by
+ * db_participant_prepare() together with the insert.
  */
 int db_participant_begin(DBParticipantContext *ctx, const char *txn_id);
 
+/**
+ * Begin as the last resource of a 2PC (GROUP_COMMIT_WINDOW_US > 0): no
+ * PostgreSQL transaction of its own. Register this participant after every
+ * other one: its prepare writes the single insert through the group commit
+ * writer, and once that returned the row is committed, so the coordinator's
+ * decision is made. Commit and abort then have nothing left to do. The
+ * insert needs a request_id; batches are not supported in this mode.
+ */
+int db_participant_begin_group(DBParticipantContext *ctx, const char *txn_id);
+
+/**
+ * Group commit only: after a participant registered before this one failed
+ * to commit, the row this transaction committed in prepare is still
+ * APPROVED. Mark it status (e.g. "REVERSED") so a retry of the request_id
+ * is not answered as approved. No-op when prepare wrote no new row.
+ * Returns 0 when there was nothing to do or the row was updated.
+ */
+int db_participant_compensate(DBParticipantContext *ctx, const char *status);
+
 /**
  * Execute a transactional database operation
  * (wrapper around existing db operations to ensure they're in the current transaction)
+ * The amount is minor units + currency exponent, as in db_insert_or_get_by_reqid()
+ * With DB_PIPELINE the insert is deferred to db_participant_prepare(): the
+ * strings and out pointers must stay valid until then, and the outputs are
+ * only set once it succeeded (one insert per transaction).
  */
 int db_participant_insert_transaction(DBParticipantContext *ctx,
                                     const char *request_id,
                                     const char *pan_masked,
-                                    const char *amount,
+                                    int64_t amount_minor,
+                                    int amount_exp,
                                     const char *status,
                                     int *out_is_dup,
                                     char *out_status,
                                     size_t out_status_sz);
 
+/**
+ * Insert a whole batch within the current transaction in one round trip
+ * (db_insert_batch_by_reqid()); deferred like the single insert with
+ * DB_PIPELINE (rows filled in by db_participant_prepare())
+ */
+int db_participant_insert_batch(DBParticipantContext *ctx, DBBatchRow *rows, size_t n, const char *status);
+
 /**
  * 2PC Participant Interface Functions
  * These are called by the transaction coordinator
@@ -52,7 +108,8 @@ int db_participant_insert_transaction(DBParticipantContext *ctx,
 
 /**
  * Phase 1: PREPARE
- * Issues PREPARE TRANSACTION to PostgreSQL
+ * Issues PREPARE TRANSACTION to PostgreSQL (with DB_PIPELINE preceded by
+ * the deferred BEGIN and insert, in the same round trip)
  */
 int db_participant_prepare(void *context, const char *txn_id);
 
@@ -66,4 +123,16 @@ int db_participant_commit(void *context, const char *txn_id);
  * ABORT
  * Issues ROLLBACK PREPARED to PostgreSQL (or ROLLBACK if not prepared)
  */
-int db_participant_abort(void *context, const char *txn_id);
\ No newline at end of file
+int db_participant_abort(void *context, const char *txn_id);
+
+/**
+ * Asynchronous steps for txn_commit_async() (TxnAsyncStep), DB_ASYNC only:
+ * prepare sends the deferred BEGIN + insert + PREPARE TRANSACTION flight,
+ * commit / abort their COMMIT / ROLLBACK PREPARED, and done runs on the
+ * dbasync loop thread with the outcome the synchronous step would return.
+ * Prepare needs db_participant_begin() and no group commit; a step that
+ * cannot be sent returns -1.
+ */
+int db_participant_prepare_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
+int db_participant_commit_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
+int db_participant_abort_async(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
\ No newline at end of file
@@ -0,0 +1,514 @@
+/*
+ * Asynchronous DB execution (EN + VN)
+ *
+ *   worker A ─ submit(flight) ─┐                      ┌─► conn 0 ─ BEGIN;INSERT;PREPARE⏎ BEGIN;INSERT;PREPARE⏎ ...
+ *   worker B ─ submit(flight) ─┼─► queue ─► loop ─────┼─► conn 1 ─ ...                            (WORK lane)
+ *   worker C ─ submit(flight) ─┘   (eventfd)  (epoll) └─► conn 2 ─ COMMIT PREPARED⏎ ...           (FINISH lane)
+ *                ◄──────────── done(arg, results) as each flight's Sync comes back ◄──────────────┘
+ *
+ *  EN: One thread owns a few connections in non-blocking pipeline mode. A
+ *      flight (the statements of one step, closed by a Sync) is written to
+ *      the lane's least loaded connection as soon as it is queued, without
+ *      waiting for the flights before it, so a connection carries any number
+ *      of requests in flight and the network delay is paid concurrently.
+ *      epoll reports the sockets readable / writable; PQconsumeInput and
+ *      PQisBusy let the loop read exactly the results that arrived, hand
+ *      each completed flight to its callback, and never block.
+ *      PostgreSQL runs one connection's flights in order, so a statement
+ *      waiting on a row lock holds up the flights behind it: statements that
+ *      can wait (BEGIN / INSERT / PREPARE) and the ones that release locks
+ *      (COMMIT / ROLLBACK PREPARED) use separate connections.
+ *  VN: Một luồng epoll giữ vài kết nối non-blocking ở chế độ pipeline; các
+ *      lượt câu lệnh của nhiều request được gửi nối đuôi, kết quả về đến đâu
+ *      gọi callback đến đó. Worker không giữ kết nối DB nào khi chờ.
+ */
+#include "dbasync.h"
+#include "db.h"
+#include "affinity.h"
+#include "metrics.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DBASYNC_REOPEN_NS 1000000000LL // a lost connection is reopened at most once a second
+
+typedef struct DbAsyncFlight {
+    struct DbAsyncFlight *next;
+    int lane;
+    const DbAsyncQuery *queries;
+    int n;
+    int flags;
+    DbAsyncDone done;
+    void *arg;
+    PGresult *results[DBASYNC_MAX_QUERIES];
+    int q;     // statement whose results come next
+    int syncs; // Syncs still to come (2 with DBASYNC_CLEANUP)
+} DbAsyncFlight;
+
+typedef struct {
+    DBConnection *dbc;       // NULL while lost
+    PGconn *conn;
+    int fd;
+    int lane;
+    int named;               // send prepared statements by name
+    int want_out;            // EPOLLOUT armed: libpq still has output to flush
+    DbAsyncFlight *head;     // sent, results pending (in send order)
+    DbAsyncFlight **tail;
+    unsigned long inflight;
+    int nulls;               // result reader: NULLs in a row
+    int after_result;        // ... the last thing read was a result
+    long long reopen_ns;     // lost: try to reopen after this
+} DbAsyncConn;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static DbAsyncFlight *g_sub_head = NULL;                     // submitted, not sent yet
+static DbAsyncFlight **g_sub_tail = &g_sub_head;
+static int g_shutdown = 0;
+static DbAsyncStats g_stats;                                 // guarded by g_mu
+static int g_running = 0;
+static char *g_uri = NULL;
+static DbAsyncConn g_conns[DBASYNC_MAX_CONNS];               // owned by the loop thread
+static int g_nconns = 0;
+static int g_epfd = -1;
+static int g_wakefd = -1;
+static pthread_t g_thread;
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int conn_pipeline_on(PGconn *conn) {
+#ifdef LIBPQ_HAS_PIPELINING
+    return PQenterPipelineMode(conn);
+#else
+    (void)conn;
+    return 0;
+#endif
+}
+
+static int conn_sync(PGconn *conn) {
+#ifdef LIBPQ_HAS_PIPELINING
+    return PQpipelineSync(conn);
+#else
+    (void)conn;
+    return 0;
+#endif
+}
+
+static int is_sync(const PGresult *r) {
+#ifdef LIBPQ_HAS_PIPELINING
+    return PQresultStatus(r) == PGRES_PIPELINE_SYNC;
+#else
+    (void)r;
+    return 0;
+#endif
+}
+
+static void set_want_out(DbAsyncConn *c, int on) {
+    if (c->want_out == on) return;
+    struct epoll_event ev = { .events = EPOLLIN | (on ? EPOLLOUT : 0), .data.ptr = c };
+    if (epoll_ctl(g_epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->want_out = on;
+}
+
+// Hand a finished flight to its callback, then free it and what it left
+static void complete(DbAsyncFlight *f, int sent) {
+    int ok = 1;
+    for (int i = 0; i < f->n; ++i) {
+        ExecStatusType st = f->results[i] ? PQresultStatus(f->results[i]) : PGRES_FATAL_ERROR;
+        if (st != PGRES_COMMAND_OK && st != PGRES_TUPLES_OK) ok = 0;
+    }
+    f->done(f->arg, f->results, f->n, ok);
+    for (int i = 0; i < f->n; ++i) PQclear(f->results[i]);
+    pthread_mutex_lock(&g_mu);
+    if (sent) g_stats.inflight--;
+    g_stats.flights++;
+    if (!ok) g_stats.failed++;
+    pthread_mutex_unlock(&g_mu);
+    free(f);
+}
+
+static int conn_open(DbAsyncConn *c) {
+    DBConnection *dbc = db_connect(g_uri); // prepares the statement set (blocking, before pipeline mode)
+    if (!dbc) return -1;
+    PGconn *conn = db_pgconn(dbc);
+    c->fd = PQsocket(conn);
+    if (c->fd < 0 || PQsetnonblocking(conn, 1) != 0 || !conn_pipeline_on(conn)) {
+        fprintf(stderr, "DB async connection setup failed: %s\n", PQerrorMessage(conn));
+        db_disconnect(dbc);
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, c->fd, &ev) != 0) {
+        perror("epoll_ctl");
+        db_disconnect(dbc);
+        return -1;
+    }
+    c->dbc = dbc;
+    c->conn = conn;
+    c->named = db_is_prepared(dbc);
+    c->want_out = 0;
+    c->nulls = 0;
+    c->after_result = 0;
+    return 0;
+}
+
+// Close c and fail the flights it carried
+static void conn_close(DbAsyncConn *c) {
+    if (!c->dbc) return;
+    (void)epoll_ctl(g_epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    DbAsyncFlight *f = c->head;
+    c->head = NULL;
+    c->tail = &c->head;
+    c->inflight = 0;
+    db_disconnect(c->dbc);
+    c->dbc = NULL;
+    c->conn = NULL;
+    while (f) {
+        DbAsyncFlight *next = f->next;
+        complete(f, 1);
+        f = next;
+    }
+}
+
+// Connection lost (or out of step): close it, reopen it later
+static void conn_fail(DbAsyncConn *c) {
+    fprintf(stderr, "DB async connection lost: %s\n", PQerrorMessage(c->conn));
+    c->reopen_ns = mono_ns() + DBASYNC_REOPEN_NS;
+    pthread_mutex_lock(&g_mu);
+    g_stats.resets++;
+    pthread_mutex_unlock(&g_mu);
+    conn_close(c);
+}
+
+// Lane's connection with the fewest flights in flight (reopening lost ones
+// whose back-off passed); NULL when none is up
+static DbAsyncConn *pick(int lane) {
+    DbAsyncConn *best = NULL;
+    long long now = 0;
+    for (int i = 0; i < g_nconns; ++i) {
+        DbAsyncConn *c = &g_conns[i];
+        if (c->lane != lane) continue;
+        if (!c->dbc) {
+            if (!now) now = mono_ns();
+            if (now < c->reopen_ns) continue;
+            if (conn_open(c) != 0) {
+                c->reopen_ns = now + DBASYNC_REOPEN_NS;
+                continue;
+            }
+        }
+        if (!best || c->inflight < best->inflight) best = c;
+    }
+    return best;
+}
+
+// Write one flight: its statements, a Sync (and the cleanup ROLLBACK + Sync)
+static void send_flight(DbAsyncFlight *f) {
+    DbAsyncConn *c = pick(f->lane);
+    if (!c) {
+        complete(f, 0);
+        return;
+    }
+    f->next = NULL;
+    *c->tail = f;
+    c->tail = &f->next;
+    c->inflight++;
+    pthread_mutex_lock(&g_mu);
+    if (++g_stats.inflight > g_stats.inflight_max) g_stats.inflight_max = g_stats.inflight;
+    pthread_mutex_unlock(&g_mu);
+
+    int ok = 1;
+    for (int i = 0; ok && i < f->n; ++i) {
+        const DbAsyncQuery *q = &f->queries[i];
+        if (q->stmt && c->named) {
+            ok = PQsendQueryPrepared(c->conn, q->stmt, q->nparams, q->values, q->lengths, q->formats, 0);
+        } else {
+            ok = PQsendQueryParams(c->conn, q->sql, q->nparams, q->types, q->values, q->lengths, q->formats, 0);
+        }
+    }
+    ok = ok && conn_sync(c->conn);
+    f->syncs = 1;
+    if (ok && (f->flags & DBASYNC_CLEANUP)) {
+        ok = PQsendQueryParams(c->conn, "ROLLBACK", 0, NULL, NULL, NULL, NULL, 0) && conn_sync(c->conn);
+        f->syncs = 2;
+    }
+    metrics_inc_db_round_trip(); // the whole flight is one round trip
+    int fl = ok ? PQflush(c->conn) : -1;
+    // A half-written flight leaves the pipeline out of step: start over
+    if (fl < 0) conn_fail(c);
+    else set_want_out(c, fl == 1);
+}
+
+// Read every result that has arrived; complete flights at their last Sync
+static void read_results(DbAsyncConn *c) {
+    if (!PQconsumeInput(c->conn) || PQstatus(c->conn) != CONNECTION_OK) {
+        conn_fail(c);
+        return;
+    }
+    // Each statement's results end with a NULL, each Sync gives one
+    // PGRES_PIPELINE_SYNC; two NULLs in a row: nothing more has come
+    while (c->head && !PQisBusy(c->conn)) {
+        DbAsyncFlight *f = c->head;
+        PGresult *r = PQgetResult(c->conn);
+        if (!r) {
+            if (c->after_result) f->q++;
+            c->after_result = 0;
+            if (++c->nulls >= 2) break;
+            continue;
+        }
+        c->nulls = 0;
+        if (is_sync(r)) {
+            PQclear(r);
+            c->after_result = 0;
+            if (--f->syncs > 0) continue;
+            c->head = f->next;
+            if (!c->head) c->tail = &c->head;
+            c->inflight--;
+            complete(f, 1);
+            continue;
+        }
+        c->after_result = 1;
+        // 26000: the session lost its prepared statements; send SQL text from now on
+        const char *state = PQresultErrorField(r, PG_DIAG_SQLSTATE);
+        if (state && strcmp(state, "26000") == 0) c->named = 0;
+        if (f->q < f->n && !f->results[f->q]) f->results[f->q] = r; // past n: the cleanup ROLLBACK
+        else PQclear(r);
+    }
+}
+
+static void *dbasync_loop(void *arg) {
+    (void)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_BACKGROUND, 0);
+    struct epoll_event evs[DBASYNC_MAX_CONNS + 1];
+    int stop = 0;
+    while (!stop) {
+        int ne = epoll_wait(g_epfd, evs, DBASYNC_MAX_CONNS + 1, -1);
+        if (ne < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ne; ++i) {
+            DbAsyncConn *c = evs[i].data.ptr;
+            if (!c) {
+                uint64_t v;
+                (void)!read(g_wakefd, &v, sizeof(v));
+                pthread_mutex_lock(&g_mu);
+                DbAsyncFlight *f = g_sub_head;
+                g_sub_head = NULL;
+                g_sub_tail = &g_sub_head;
+                stop = g_shutdown;
+                pthread_mutex_unlock(&g_mu);
+                while (f) {
+                    DbAsyncFlight *next = f->next;
+                    if (stop) complete(f, 0);
+                    else send_flight(f);
+                    f = next;
+                }
+                continue;
+            }
+            if (!c->dbc) continue; // lost earlier in this round
+            if (evs[i].events & EPOLLOUT) {
+                int fl = PQflush(c->conn);
+                if (fl < 0) {
+                    conn_fail(c);
+                    continue;
+                }
+                set_want_out(c, fl == 1);
+            }
+            if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) read_results(c);
+        }
+    }
+    for (int i = 0; i < g_nconns; ++i) conn_close(&g_conns[i]); // fails anything still in flight
+    return NULL;
+}
+
+int dbasync_start(const char *uri, int nconns) {
+    if (nconns <= 0) return 0;
+#ifndef LIBPQ_HAS_PIPELINING
+    fprintf(stderr, "Error: DB_ASYNC needs libpq 14+ (pipeline mode)\n");
+    (void)uri;
+    return -1;
+#else
+    if (!uri || g_running || nconns < 2 || nconns > DBASYNC_MAX_CONNS) return -1;
+    g_uri = strdup(uri);
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    g_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (!g_uri || g_epfd < 0 || g_wakefd < 0 || epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_wakefd, &ev) != 0) {
+        perror("dbasync_start");
+        goto fail;
+    }
+    // A quarter (at least one) finish prepared transactions, the rest do the work
+    int nfinish = nconns / 4 > 0 ? nconns / 4 : 1;
+    for (int i = 0; i < nconns; ++i) {
+        DbAsyncConn *c = &g_conns[i];
+        memset(c, 0, sizeof(*c));
+        c->lane = i < nconns - nfinish ? DBASYNC_LANE_WORK : DBASYNC_LANE_FINISH;
+        c->tail = &c->head;
+        g_nconns = i + 1;
+        if (conn_open(c) != 0) goto fail;
+    }
+    g_shutdown = 0;
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.conns = nconns;
+    if (pthread_create(&g_thread, NULL, dbasync_loop, NULL) != 0) goto fail;
+    g_running = 1;
+    return 0;
+fail:
+    for (int i = 0; i < g_nconns; ++i) conn_close(&g_conns[i]);
+    g_nconns = 0;
+    if (g_wakefd >= 0) close(g_wakefd);
+    if (g_epfd >= 0) close(g_epfd);
+    g_wakefd = g_epfd = -1;
+    free(g_uri);
+    g_uri = NULL;
+    return -1;
+#endif
+}
+
+int dbasync_enabled(void) {
+    return g_running;
+}
+
+int dbasync_submit(int lane, const DbAsyncQuery *queries, int n, int flags, DbAsyncDone done, void *arg) {
+    if (!g_running || (lane != DBASYNC_LANE_WORK && lane != DBASYNC_LANE_FINISH) || !queries || n < 1 ||
+        n > DBASYNC_MAX_QUERIES || !done) {
+        return -1;
+    }
+    DbAsyncFlight *f = calloc(1, sizeof(*f));
+    if (!f) return -1;
+    f->lane = lane;
+    f->queries = queries;
+    f->n = n;
+    f->flags = flags;
+    f->done = done;
+    f->arg = arg;
+    pthread_mutex_lock(&g_mu);
+    if (g_shutdown) {
+        pthread_mutex_unlock(&g_mu);
+        free(f);
+        return -1;
+    }
+    // The loop takes the whole queue per wake-up: only the first needs one
+    int wake = g_sub_head == NULL;
+    *g_sub_tail = f;
+    g_sub_tail = &f->next;
+    pthread_mutex_unlock(&g_mu);
+    if (wake) {
+        uint64_t one = 1;
+        (void)!write(g_wakefd, &one, sizeof(one));
+    }
+    return 0;
+}
+
+typedef struct {
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    int done;
+    int ok;
+    PGresult **results;
+} DbAsyncWait;
+
+static void run_done(void *arg, PGresult **results, int n, int ok) {
+    DbAsyncWait *w = arg;
+    for (int i = 0; i < n; ++i) {
+        w->results[i] = results[i];
+        results[i] = NULL;
+    }
+    pthread_mutex_lock(&w->mu);
+    w->ok = ok;
+    w->done = 1;
+    pthread_cond_signal(&w->cv);
+    pthread_mutex_unlock(&w->mu);
+}
+
+int dbasync_run(int lane, const DbAsyncQuery *queries, int n, int flags, PGresult **results) {
+    if (!results) return -1;
+    DbAsyncWait w = { .mu = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER, .results = results };
+    for (int i = 0; i < n && i < DBASYNC_MAX_QUERIES; ++i) results[i] = NULL;
+    if (dbasync_submit(lane, queries, n, flags, run_done, &w) != 0) return -1;
+    pthread_mutex_lock(&w.mu);
+    while (!w.done) pthread_cond_wait(&w.cv, &w.mu);
+    pthread_mutex_unlock(&w.mu);
+    pthread_cond_destroy(&w.cv);
+    pthread_mutex_destroy(&w.mu);
+    return w.ok;
+}
+
+int dbasync_command(int lane, const char *sql) {
+    if (!sql) return -1;
+    DbAsyncQuery q = { .sql = sql };
+    PGresult *res = NULL;
+    int rc = dbasync_run(lane, &q, 1, 0, &res);
+    if (rc != 1) {
+        fprintf(stderr, "DB async \"%s\" failed: %s\n", sql, res ? PQresultErrorMessage(res) : "no result");
+    }
+    PQclear(res);
+    return rc == 1 ? 0 : -1;
+}
+
+typedef struct {
+    DbAsyncQuery q;
+    void (*done)(void *arg, int ok);
+    void *arg;
+    char sql[];
+} DbAsyncCommand;
+
+static void command_done(void *arg, PGresult **results, int n, int ok) {
+    (void)n;
+    DbAsyncCommand *c = arg;
+    if (!ok) {
+        fprintf(stderr, "DB async \"%s\" failed: %s\n", c->sql,
+                results[0] ? PQresultErrorMessage(results[0]) : "no result");
+    }
+    c->done(c->arg, ok);
+    free(c);
+}
+
+int dbasync_command_async(int lane, const char *sql, void (*done)(void *arg, int ok), void *arg) {
+    if (!sql || !done) return -1;
+    size_t len = strlen(sql) + 1;
+    DbAsyncCommand *c = malloc(sizeof(*c) + len);
+    if (!c) return -1;
+    memcpy(c->sql, sql, len);
+    c->q = (DbAsyncQuery){ .sql = c->sql };
+    c->done = done;
+    c->arg = arg;
+    if (dbasync_submit(lane, &c->q, 1, 0, command_done, c) != 0) {
+        free(c);
+        return -1;
+    }
+    return 0;
+}
+
+void dbasync_stats(DbAsyncStats *out) {
+    pthread_mutex_lock(&g_mu);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_mu);
+}
+
+void dbasync_shutdown(void) {
+    if (!g_running) return;
+    pthread_mutex_lock(&g_mu);
+    g_shutdown = 1;
+    pthread_mutex_unlock(&g_mu);
+    uint64_t one = 1;
+    (void)!write(g_wakefd, &one, sizeof(one));
+    pthread_join(g_thread, NULL);
+    g_running = 0;
+    g_nconns = 0;
+    close(g_wakefd);
+    close(g_epfd);
+    g_wakefd = g_epfd = -1;
+    free(g_uri);
+    g_uri = NULL;
+}
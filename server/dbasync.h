@@ -0,0 +1,104 @@
+#pragma once
+
+#include <libpq-fe.h>
+
+// Asynchronous PostgreSQL execution on a few shared connections
+// VN: Một luồng epoll điều khiển vài kết nối libpq non-blocking ở chế độ
+//     pipeline; mỗi lượt câu lệnh ("flight") của nhiều request được gửi nối
+//     đuôi trên cùng kết nối, kết quả trả về qua callback.
+
+/// Most statements in one flight
+#define DBASYNC_MAX_QUERIES 4
+/// Default / most connections (DB_ASYNC_CONNS)
+#define DBASYNC_DEFAULT_CONNS 4
+#define DBASYNC_MAX_CONNS 64
+
+/// Connection sets: statements that may wait on row locks go to WORK;
+/// COMMIT / ROLLBACK PREPARED (which never do) to FINISH, so a flight stuck
+/// behind a prepared transaction can never hold up the commit that frees it
+enum { DBASYNC_LANE_WORK = 0, DBASYNC_LANE_FINISH = 1 };
+
+/// Flight flags
+enum {
+    /// After the flight's Sync, also send ROLLBACK (+ Sync; result dropped):
+    /// a flight that opened a transaction block and failed inside it leaves
+    /// the shared session clean for the flights queued behind it
+    DBASYNC_CLEANUP = 1
+};
+
+/**
+ * One statement: with stmt set and the connection's statement set prepared
+ * it is sent with PQsendQueryPrepared, else sql with PQsendQueryParams.
+ * Everything it points to must stay valid until the flight completed.
+ */
+typedef struct {
+    const char *sql;
+    const char *stmt;        ///< prepared statement name (NULL = always sql)
+    int nparams;
+    const Oid *types;
+    const char *const *values;
+    const int *lengths;
+    const int *formats;
+} DbAsyncQuery;
+
+/**
+ * Completion of a flight, called on the event loop thread (keep it short).
+ * results[i] is statement i's result, NULL when it never ran (connection
+ * lost); ok = every statement returned COMMAND_OK / TUPLES_OK. The results
+ * are cleared after the callback returns, except the ones it took over by
+ * setting results[i] = NULL.
+ */
+typedef void (*DbAsyncDone)(void *arg, PGresult **results, int n, int ok);
+
+/// Totals since start (GET /metrics)
+typedef struct {
+    int conns;                    ///< connections (both lanes)
+    unsigned long inflight;       ///< flights sent and not completed now
+    unsigned long inflight_max;   ///< highest inflight seen
+    unsigned long flights;        ///< flights completed
+    unsigned long failed;         ///< ... with ok = 0
+    unsigned long resets;         ///< connections lost and reopened
+} DbAsyncStats;
+
+/**
+ * Open nconns (>= 2; a quarter, at least one, serve DBASYNC_LANE_FINISH)
+ * non-blocking pipelined connections to uri and start the event loop
+ * thread. nconns <= 0 leaves the layer off. Returns 0 on success.
+ */
+int dbasync_start(const char *uri, int nconns);
+
+/// 1 when the layer runs (DB_ASYNC=1)
+int dbasync_enabled(void);
+
+/**
+ * Queue a flight of n (1..DBASYNC_MAX_QUERIES) statements on lane: they go
+ * out back to back in pipeline mode, closed by one Sync, on the lane's
+ * connection with the fewest flights in flight, and done(arg, ...) runs
+ * once their results are in. Returns 0 when queued (done will be called),
+ * non-zero otherwise.
+ */
+int dbasync_submit(int lane, const DbAsyncQuery *queries, int n, int flags, DbAsyncDone done, void *arg);
+
+/**
+ * dbasync_submit() and wait for the completion: results[0..n) receive the
+ * results (caller PQclear()s them). The caller's thread parks until then,
+ * so the payment path only uses it where a worker waits anyway (batches,
+ * NET_MODE=blocking); single payments use the callbacks. Returns 1 when ok, 0 when a statement
+ * failed, -1 when the flight could not be queued.
+ */
+int dbasync_run(int lane, const DbAsyncQuery *queries, int n, int flags, PGresult **results);
+
+/// One parameterless command (e.g. COMMIT PREPARED '...') on lane; 0 = COMMAND_OK
+int dbasync_command(int lane, const char *sql);
+
+/**
+ * dbasync_command() without the wait: sql is copied, done(arg, ok) runs on
+ * the event loop thread once it completed (ok = COMMAND_OK). Returns 0 when
+ * queued (done will be called), non-zero otherwise.
+ */
+int dbasync_command_async(int lane, const char *sql, void (*done)(void *arg, int ok), void *arg);
+
+void dbasync_stats(DbAsyncStats *out);
+
+// Stop the loop (failing what is still in flight) and close the connections
+void dbasync_shutdown(void);
@@ -0,0 +1,207 @@
+/*
+ * Group commit of approvals (EN + VN)
+ *
+ *   worker A ─ submit(row) ─┐
+ *   worker B ─ submit(row) ─┼─► queue ─► writer: window / max rows ─► INSERT ... unnest (one txn, one WAL flush)
+ *   worker C ─ submit(row) ─┘                                              │
+ *            ◄──────────── every submitter of the group released ◄─────────┘
+ *
+ *  EN: With one transaction per approval PostgreSQL flushes WAL once per
+ *      payment (synchronous_commit=on), and that flush bounds throughput. The
+ *      writer thread collects rows from every worker for GROUP_COMMIT_WINDOW_US
+ *      after the first one arrived (or until GROUP_COMMIT_MAX_ROWS), writes
+ *      them with the batch statement as one autocommit transaction, and
+ *      releases each waiting worker once that commit returned: the row is
+ *      durable. A group never holds two rows with the same request_id, so
+ *      ON CONFLICT still resolves retries row by row.
+ *  VN: Gom giao dịch từ mọi worker trong cửa sổ ngắn, một transaction + một
+ *      lần flush WAL cho cả nhóm; worker chờ đến khi nhóm đã commit.
+ */
+#include "groupcommit.h"
+#include "affinity.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct GcItem {
+    struct GcItem *next;
+    DBBatchRow *row;         // the submitter's (on its stack while it waits)
+    const char *status;
+    long long enq_ns;
+    int done;
+    int rc;
+} GcItem;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cv;                                   // writer: rows queued / shutdown
+static pthread_cond_t g_done_cv = PTHREAD_COND_INITIALIZER;   // submitters: a group finished
+static GcItem *g_head = NULL;
+static GcItem **g_tail = &g_head;
+static size_t g_queued = 0;
+static int g_running = 0;
+static int g_shutdown = 0;
+static int g_window_us = 0;
+static int g_max_rows = GROUPCOMMIT_DEFAULT_MAX_ROWS;
+static DBConnection *g_bootstrap = NULL;
+static pthread_t g_thread;
+static GroupCommitStats g_stats;                              // guarded by g_mu
+
+static const unsigned long k_size_le[GROUPCOMMIT_HIST_BUCKETS - 1] = {1, 2, 4, 8, 16, 32, 64};
+static const unsigned long k_wait_le_us[GROUPCOMMIT_HIST_BUCKETS - 1] = {100, 250, 500, 1000, 2000, 5000, 10000};
+
+static int hist_bucket(unsigned long v, const unsigned long *le) {
+    int b = 0;
+    while (b < GROUPCOMMIT_HIST_BUCKETS - 1 && v > le[b]) b++;
+    return b;
+}
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Unlink the next group (caller holds g_mu): rows in queue order with the
+// first row's status and distinct request_ids; the others wait for a later one
+static size_t gc_take(GcItem **group) {
+    size_t n = 0;
+    const char *status = g_head->status;
+    GcItem **link = &g_head;
+    while (*link && n < (size_t)g_max_rows) {
+        GcItem *it = *link;
+        int take = strcmp(it->status, status) == 0;
+        for (size_t k = 0; take && k < n; ++k) {
+            if (strcmp(group[k]->row->request_id, it->row->request_id) == 0) take = 0;
+        }
+        if (!take) {
+            link = &it->next;
+            continue;
+        }
+        *link = it->next;
+        group[n++] = it;
+    }
+    g_tail = &g_head;
+    while (*g_tail) g_tail = &(*g_tail)->next;
+    g_queued -= n;
+    return n;
+}
+
+static void *gc_loop(void *arg) {
+    (void)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_BACKGROUND, 0);
+    db_thread_dedicated(); // never waits on the pool its submitters may hold
+    GcItem *group[DB_BATCH_MAX];
+    DBBatchRow rows[DB_BATCH_MAX];
+    pthread_mutex_lock(&g_mu);
+    for (;;) {
+        while (!g_shutdown && !g_head) pthread_cond_wait(&g_cv, &g_mu);
+        if (!g_head) break; // shutdown and drained
+
+        // [ANCHOR:GROUPCOMMIT_WINDOW] Hold the group open for the window
+        // (counted from its oldest row) unless it is full already
+        long long until = g_head->enq_ns + (long long)g_window_us * 1000LL;
+        while (!g_shutdown && g_queued < (size_t)g_max_rows && mono_ns() < until) {
+            struct timespec ts = { .tv_sec = (time_t)(until / 1000000000LL), .tv_nsec = (long)(until % 1000000000LL) };
+            pthread_cond_timedwait(&g_cv, &g_mu, &ts);
+        }
+        size_t n = gc_take(group);
+        pthread_mutex_unlock(&g_mu);
+
+        for (size_t i = 0; i < n; ++i) rows[i] = *group[i]->row;
+        // Outside BEGIN the INSERT is its own transaction: it returns once
+        // the whole group is committed (durable with synchronous_commit=on)
+        DBConnection *dbc = db_thread_get(g_bootstrap);
+        int rc = dbc ? db_insert_batch_by_reqid(dbc, rows, n, group[0]->status) : -1;
+        int rcs[DB_BATCH_MAX];
+        unsigned long row_failed = 0;
+        for (size_t i = 0; i < n; ++i) rcs[i] = rc;
+        if (rc != 0) {
+            log_message_json("ERROR", "groupcommit", NULL, "Group transaction failed", -1);
+            // [ANCHOR:GROUPCOMMIT_SPLIT] One bad row (or a lost connection)
+            // must not fail its neighbours: each row again in its own
+            // transaction, so only the rows that fail on their own fail
+            for (size_t i = 0; n > 1 && i < n; ++i) {
+                dbc = db_thread_get(g_bootstrap); // reset if the connection dropped
+                rcs[i] = dbc ? db_insert_batch_by_reqid(dbc, &rows[i], 1, group[0]->status) : -1;
+            }
+            for (size_t i = 0; i < n; ++i) row_failed += rcs[i] != 0;
+        }
+        long long now = mono_ns();
+
+        pthread_mutex_lock(&g_mu);
+        g_stats.batches++;
+        g_stats.rows += n;
+        if (rc != 0) g_stats.failed++;
+        g_stats.rows_failed += row_failed;
+        g_stats.size_hist[hist_bucket(n, k_size_le)]++;
+        for (size_t i = 0; i < n; ++i) {
+            GcItem *it = group[i];
+            if (rcs[i] == 0) {
+                it->row->is_dup = rows[i].is_dup;
+                memcpy(it->row->status, rows[i].status, sizeof(it->row->status));
+            }
+            g_stats.wait_hist[hist_bucket((unsigned long)((now - it->enq_ns) / 1000), k_wait_le_us)]++;
+            it->rc = rcs[i];
+            it->done = 1;
+        }
+        pthread_cond_broadcast(&g_done_cv);
+    }
+    pthread_mutex_unlock(&g_mu);
+    return NULL;
+}
+
+int groupcommit_start(DBConnection *bootstrap, int window_us, int max_rows) {
+    if (window_us <= 0) return 0;
+    if (!bootstrap || g_running) return -1;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_cv, &attr);
+    pthread_condattr_destroy(&attr);
+    g_bootstrap = bootstrap;
+    g_window_us = window_us;
+    g_max_rows = (max_rows >= 1 && max_rows <= DB_BATCH_MAX) ? max_rows : GROUPCOMMIT_DEFAULT_MAX_ROWS;
+    g_shutdown = 0;
+    if (pthread_create(&g_thread, NULL, gc_loop, NULL) != 0) return -1;
+    g_running = 1;
+    return 0;
+}
+
+int groupcommit_enabled(void) {
+    return g_running;
+}
+
+int groupcommit_submit(DBBatchRow *row, const char *status) {
+    if (!g_running || !row || !row->request_id || !row->request_id[0] || !row->pan_masked || !status) return -1;
+    GcItem it = { .next = NULL, .row = row, .status = status, .enq_ns = mono_ns(), .done = 0, .rc = -1 };
+    pthread_mutex_lock(&g_mu);
+    if (g_shutdown) {
+        pthread_mutex_unlock(&g_mu);
+        return -1;
+    }
+    *g_tail = &it;
+    g_tail = &it.next;
+    // Wake the writer for a new group, or to close a full one early
+    if (++g_queued == 1 || g_queued >= (size_t)g_max_rows) pthread_cond_signal(&g_cv);
+    while (!it.done) pthread_cond_wait(&g_done_cv, &g_mu);
+    pthread_mutex_unlock(&g_mu);
+    return it.rc;
+}
+
+void groupcommit_stats(GroupCommitStats *out) {
+    pthread_mutex_lock(&g_mu);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_mu);
+}
+
+void groupcommit_shutdown(void) {
+    if (!g_running) return;
+    pthread_mutex_lock(&g_mu);
+    g_shutdown = 1;
+    pthread_cond_signal(&g_cv);
+    pthread_mutex_unlock(&g_mu);
+    pthread_join(g_thread, NULL);
+    g_running = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "db.h"
+
+// Group commit: approvals from every worker share one PostgreSQL transaction
+// VN: Một luồng ghi DB gom các giao dịch được duyệt từ mọi worker trong một
+//     cửa sổ ngắn rồi commit chung một lần (một lần flush WAL cho cả nhóm).
+
+/// Default most rows per group transaction (GROUP_COMMIT_MAX_ROWS)
+#define GROUPCOMMIT_DEFAULT_MAX_ROWS DB_BATCH_MAX
+/// Buckets of both histograms in GroupCommitStats
+#define GROUPCOMMIT_HIST_BUCKETS 8
+
+/// Totals since start (GET /metrics)
+typedef struct {
+    unsigned long batches;  ///< group transactions run
+    unsigned long rows;     ///< rows they carried
+    unsigned long failed;   ///< groups whose transaction failed (then retried row by row)
+    unsigned long rows_failed; ///< rows that also failed on their own
+    /// rows per group: <=1, <=2, <=4, <=8, <=16, <=32, <=64, more
+    unsigned long size_hist[GROUPCOMMIT_HIST_BUCKETS];
+    /// µs from groupcommit_submit() to durable: <=100, <=250, <=500, <=1000,
+    /// <=2000, <=5000, <=10000, more
+    unsigned long wait_hist[GROUPCOMMIT_HIST_BUCKETS];
+} GroupCommitStats;
+
+/**
+ * Start the writer thread (with its own connection cloned from bootstrap)
+ * when window_us > 0: a group is committed window_us after its first row
+ * arrived, or as soon as it holds max_rows (1..DB_BATCH_MAX) rows.
+ * window_us = 0 leaves group commit off. Returns 0 on success.
+ */
+int groupcommit_start(DBConnection *bootstrap, int window_us, int max_rows);
+
+/// 1 when the writer runs (GROUP_COMMIT_WINDOW_US > 0)
+int groupcommit_enabled(void);
+
+/**
+ * Insert row (request_id required) with status as part of the next group
+ * and wait until that group's transaction committed. Fills row->is_dup /
+ * row->status like db_insert_batch_by_reqid(). Returns 0 once the row is
+ * durable, non-zero when it could not be written or group commit is off.
+ *
+ * Blast radius: a group is one transaction, so one bad row fails the whole
+ * INSERT; the writer then retries each row of that group alone, and only
+ * the rows that fail again report failure (their neighbours pay one extra
+ * round trip each). A row returned as durable is committed before the
+ * caller's other 2PC participants commit: if one of them then fails, the
+ * caller has to compensate the row (db_participant_compensate()).
+ */
+int groupcommit_submit(DBBatchRow *row, const char *status);
+
+void groupcommit_stats(GroupCommitStats *out);
+
+// Commit what is queued, stop the writer and close its connection
+void groupcommit_shutdown(void);
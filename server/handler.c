@@ -1,18 +1,35 @@
 /* [ANCHOR:HANDLER_OVERVIEW]
- * Connection handler: reads one request, validates, writes one response.
+ * Connection handler: consumes framed requests, validates, writes responses.
  *
- * Processing flow (single request per TCP connection):
- * 1) Set socket timeouts to avoid hanging forever on slow/broken clients.
- * 2) Read JSON payload into a buffer.
+ * Processing flow (newline-delimited, many requests per TCP connection):
+ * 1) Bytes arrive either from the blocking read loop (handler_job) or from the
+ *    epoll reactor in net.c, which only hands over buffers holding a full frame.
+ * 2) handler_consume() splits complete lines / HTTP bodies out of the buffer.
  * 3) Parse minimal fields (pan, amount) with a tiny extractor (not a full JSON parser).
  * 4) Validate: PAN must pass Luhn; amount must be > 0 and <= 10000.
- * 5) Mask PAN (first 6 + last 4), then INSERT into DB using a per-thread connection.
+ *    Past the request deadline → DECLINED/timeout before any DB or clearing work.
+ * 5) A request_id already approved is answered from the idempotency cache
+ *    (idem.c); otherwise mask PAN (first 6 + last 4), then INSERT into DB using
+ *    a per-thread connection and cache the committed outcome.
  * 6) Write JSON response: {"status":"APPROVED"} or DECLINED with a reason.
- * 7) Close the socket and free the context.
+ * 7) The owner of the connection (handler_job or the reactor) closes the socket.
+ *
+ * HTTP/1.x: every route also answers "METHOD /path HTTP/1.1" requests. HTTP/1.1
+ * connections stay open (keep-alive) unless the client sends "Connection: close";
+ * pipelined requests are answered strictly in order. All responses to the
+ * frames of one handler_consume() call leave in a single writev (reply.c).
+ *
+ * ISO 8583: connections from ISO8583_PORT carry binary messages instead
+ * (iso8583_wire.c); they skip JSON entirely and share steps 4-7.
  *
  * Notes:
  * - The tiny parser keeps the demo simple; replace with a real JSON library for production.
  * - db_thread_get() gives each worker thread its own PG connection for better concurrency.
+ * - All protocol state lives in HandlerContext, so consecutive frames of one
+ *   connection may be processed by different workers.
+ * - DB_ASYNC on an epoll connection: a single payment gives its worker back
+ *   once its 2PC is set up; the participants' completions drive the commit
+ *   and a resume job writes the answer ([ANCHOR:HANDLER_SUSPEND]).
  */
 #include "handler.h"
 #include "log.h"
@@ -20,31 +37,33 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include "metrics.h"
 #include "iso8583.h"
+#include "iso8583_wire.h"
 #include "risk.h"
 #include "ledger.h"
 #include "version.h"
 #include "reversal.h"
+#include "simdscan.h"
+#include "threadpool.h"
 #include "transaction_coordinator.h"
 #include "db_participant.h"
+#include "groupcommit.h"
+#include "dbasync.h"
 #include "clearing_participant.h"
 #include "db.h"
+#include "arena.h"
+#include "reply.h"
+#include "idem.h"
+#include "singleflight.h"
+#include "timer.h"
 
-/*
- * Simple connection handler stub.
- *
- * In a full implementation you would read from the client_fd, parse
- * JSON or another protocol, validate fields (e.g. amount, PAN), mask
- * the PAN, begin a DB transaction, insert the row, commit or rollback
- * as appropriate, and write a response to the client. You would also
- * handle timeouts, retries, and logging. This stub simply logs a
- * message and closes the socket.
- */
 // Luhn checksum for card number validity (returns 1 if valid, 0 otherwise)
 static int luhn_check(const char *digits) {
     int sum = 0, alt = 0;
@@ -79,7 +98,8 @@ static void mask_pan(const char *pan, char *out, size_t outsz) {
     size_t stars = n - prefix - suffix;
     if (outsz < n + 1) {
         // truncate if needed
-        snprintf(out, outsz, "%s", pan);
+        memcpy(out, pan, outsz - 1);
+        out[outsz - 1] = '\0';
         return;
     }
     memcpy(out, pan, prefix);
@@ -90,582 +110,1550 @@ static void mask_pan(const char *pan, char *out, size_t outsz) {
 
 // Note: JSON field extraction moved to iso8583.c for normalization
 
-// [ANCHOR:HANDLER_WRITE_ALL]
-// Write the whole buffer, handling partial writes and EINTR
-static int write_all(int fd, const char *buf, size_t len) {
-    size_t off = 0;
-    while (off < len) {
-        ssize_t n = write(fd, buf + off, len - off);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            if (errno == EAGAIN || errno == EWOULDBLOCK) { continue; }
-            return -1;
-        }
-        if (n == 0) return -1;
-        off += (size_t)n;
-    }
-    return 0;
+// Per-thread 2PC coordinator (created on first payment handled by this worker).
+// Kept in a TLS key like db_thread_get() so a worker retired by the elastic
+// pool frees its coordinator (and closes its log) on exit.
+static pthread_key_t coord_tls_key;
+static pthread_once_t coord_tls_once = PTHREAD_ONCE_INIT;
+
+static void coord_tls_destructor(void *ptr) {
+    txn_coordinator_destroy((TransactionCoordinator *)ptr);
 }
 
-void handler_job(void *arg) {
-    HandlerContext *ctx = (HandlerContext *)arg;
-    if (!ctx) return;
-    int fd = ctx->client_fd;
-    
-    // Initialize 2PC coordinator for this handler
-    static __thread TransactionCoordinator *coordinator = NULL;
+static void coord_tls_init_key(void) {
+    (void)pthread_key_create(&coord_tls_key, coord_tls_destructor);
+}
+
+static TransactionCoordinator *handler_coordinator(void) {
+    pthread_once(&coord_tls_once, coord_tls_init_key);
+    TransactionCoordinator *coordinator = (TransactionCoordinator *)pthread_getspecific(coord_tls_key);
     if (!coordinator) {
         coordinator = txn_coordinator_init();
         if (!coordinator) {
             log_message_json("ERROR", "handler", NULL, "Failed to init 2PC coordinator", -1);
-            close(fd);
-            free(ctx);
+        } else {
+            pthread_setspecific(coord_tls_key, coordinator);
+        }
+    }
+    return coordinator;
+}
+
+// DB_ASYNC: coordinator of suspended payments. Their steps complete on the
+// dbasync and timer threads, so no worker's coordinator can own them.
+static TransactionCoordinator *g_async_coordinator;
+static pthread_once_t async_coord_once = PTHREAD_ONCE_INIT;
+
+static void async_coord_init(void) {
+    g_async_coordinator = txn_coordinator_init();
+    if (!g_async_coordinator) log_message_json("ERROR", "handler", NULL, "Failed to init async 2PC coordinator", -1);
+}
+
+static TransactionCoordinator *handler_async_coordinator(void) {
+    pthread_once(&async_coord_once, async_coord_init);
+    return g_async_coordinator;
+}
+
+void handler_context_init(HandlerContext *ctx, int fd, DBConnection *db,
+                          const char *api_token, ThreadPool *pool) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->batch_max = ISO_BATCH_MAX;
+    ctx->client_fd = fd;
+    ctx->db = db;
+    ctx->api_token = api_token;
+    ctx->pool = pool;
+    ctx->http_content_length = -1;
+    ctx->lane = THREADPOOL_LANE_DEFAULT;
+}
+
+void handler_mark_received(HandlerContext *ctx, long long now_ns) {
+    ctx->recv_ns = now_ns;
+    ctx->deadline_ns = ctx->budget_ms > 0 ? now_ns + (long long)ctx->budget_ms * 1000000LL : 0;
+}
+
+void handler_context_release(HandlerContext *ctx) {
+    if (!ctx) return;
+    free(ctx->http_body);
+    ctx->http_body = NULL;
+}
+
+// Outcome of the payment pipeline, shared by the line protocol, HTTP and ISO 8583.
+// The JSON body is not formatted here: payment_body() gives it as fragments.
+typedef struct PaymentResult {
+    int http_code;
+    int idempotent;       // approved earlier under the same request_id
+    char reason[64];      // decline reason ("" = approved)
+    char txn_id[MAX_TRANSACTION_ID_LEN]; // approved: the 2PC transaction id
+} PaymentResult;
+_Static_assert(sizeof(PaymentResult) <= SINGLEFLIGHT_RESULT_MAX, "PaymentResult is handed to singleflight waiters");
+
+static void payment_decline(PaymentResult *out, int http_code, const char *reason,
+                            const char *level, const char *request_id) {
+    out->http_code = http_code;
+    snprintf(out->reason, sizeof(out->reason), "%s", reason);
+    metrics_inc_declined();
+    log_message_json(level, "tx", request_id, "DECLINED", -1);
+}
+
+// [ANCHOR:HANDLER_REPLY_TEMPLATES]
+// Fixed text of the payment bodies: only the txn_id / reason between head and
+// tail is copied per response (reply.h).
+static const char k_body_approved[] = "{\"status\":\"APPROVED\",\"txn_id\":\"";
+static const char k_body_idempotent[] = "{\"status\":\"APPROVED\",\"idempotent\":true,\"txn_id\":\"";
+static const char k_body_declined[] = "{\"status\":\"DECLINED\",\"reason\":\"";
+static const char k_body_tail[] = "\"}\n";
+
+// Body of res as head, variable part and tail; returns its length (newline included)
+static size_t payment_body(const PaymentResult *res, struct iovec part[3]) {
+    if (res->reason[0]) {
+        part[0] = (struct iovec){ (void *)k_body_declined, sizeof(k_body_declined) - 1 };
+        part[1] = (struct iovec){ (void *)res->reason, strlen(res->reason) };
+    } else if (res->idempotent) {
+        part[0] = (struct iovec){ (void *)k_body_idempotent, sizeof(k_body_idempotent) - 1 };
+        part[1] = (struct iovec){ (void *)res->txn_id, strlen(res->txn_id) };
+    } else {
+        part[0] = (struct iovec){ (void *)k_body_approved, sizeof(k_body_approved) - 1 };
+        part[1] = (struct iovec){ (void *)res->txn_id, strlen(res->txn_id) };
+    }
+    part[2] = (struct iovec){ (void *)k_body_tail, sizeof(k_body_tail) - 1 };
+    return part[0].iov_len + part[1].iov_len + part[2].iov_len;
+}
+
+// Queue the body: static head and tail by reference, the variable part copied
+static void reply_payment_body(ReplyBuf *rb, struct iovec part[3]) {
+    reply_static(rb, part[0].iov_base, part[0].iov_len);
+    reply_copy(rb, part[1].iov_base, part[1].iov_len);
+    reply_static(rb, part[2].iov_base, part[2].iov_len);
+}
+
+// [ANCHOR:HANDLER_DEADLINE]
+// EN: 1 when the client has given up: the job expired in the queue, or the
+//     tighter of REQUEST_BUDGET_MS and the request's own deadline_ms passed.
+// VN: Quá hạn (chờ trong hàng đợi quá lâu hoặc vượt deadline_ms của client)
+//     → không làm 2PC nữa, vì client đã bỏ đi.
+// Absolute deadline of req (threadpool_now_ns clock), 0 = none
+static long long payment_deadline_ns(const HandlerContext *ctx, const IsoRequestView *req) {
+    long long deadline = ctx->deadline_ns;
+    if (req->deadline_ms > 0 && ctx->recv_ns > 0) {
+        long long d = ctx->recv_ns + (long long)req->deadline_ms * 1000000LL;
+        if (deadline == 0 || d < deadline) deadline = d;
+    }
+    return deadline;
+}
+
+static int payment_deadline_passed(const HandlerContext *ctx, const IsoRequestView *req) {
+    if (ctx->expired) return 1;
+    long long deadline = payment_deadline_ns(ctx, req);
+    return deadline > 0 && threadpool_now_ns() >= deadline;
+}
+
+// [ANCHOR:HANDLER_PARSE_VALIDATE] Checks before any DB or clearing work (single and
+// batch requests): 0 = go on, -1 = declined into out
+static int payment_precheck(HandlerContext *ctx, const IsoRequestView *req, PaymentResult *out) {
+    const char *request_id = req->request_id.p;
+
+    // [ANCHOR:HANDLER_LUHN]
+    if (!luhn_check(req->pan.p)) {
+        metrics_inc_risk_declined();
+        payment_decline(out, 400, "luhn_failed", "WARN", request_id);
+        return -1;
+    }
+    // [ANCHOR:HANDLER_AMOUNT] Parsed once into minor units: 0 < amount <= 10000 currency units
+    if (req->amount_minor <= 0 || req->amount_minor > 10000 * iso_amount_scale(req->amount_exp)) {
+        payment_decline(out, 400, "amount_invalid", "WARN", request_id);
+        return -1;
+    }
+    if (payment_deadline_passed(ctx, req)) {
+        metrics_inc_deadline_expired();
+        payment_decline(out, 504, "timeout", "WARN", request_id);
+        return -1;
+    }
+
+    // [ANCHOR:HANDLER_RISK] Risk engine (stub): currently always allow; placeholder for future rules
+    RiskDecision rdec; risk_evaluate(req, &rdec);
+    if (!rdec.allow) {
+        payment_decline(out, 402, rdec.reason[0] ? rdec.reason : "risk_decline", "WARN", request_id);
+        return -1;
+    }
+    return 0;
+}
+
+// [ANCHOR:HANDLER_MSG_TYPE]
+// EN: Only purchases (authorization, capture) are implemented. A reversal
+//     (ISO 0400, JSON "REVERSAL") or refund (processing code 20xxxx,
+//     "REFUND") would otherwise run as a new purchase and, keyed by the
+//     original request_id, be answered "approved" from the cache or the DB
+//     duplicate path although nothing was reversed. They are declined
+//     first (ISO 8583: DE39 12, invalid transaction). 1 = declined into out.
+// VN: Chưa hỗ trợ reversal/refund → từ chối ngay, không coi như giao dịch mua mới.
+static int payment_type_unsupported(const IsoRequestView *req, PaymentResult *out) {
+    if (req->type != ISO_MSG_REVERSAL && req->type != ISO_MSG_REFUND) return 0;
+    payment_decline(out, 400, "unsupported_type", "WARN", req->request_id.p);
+    return 1;
+}
+
+// [ANCHOR:HANDLER_IDEMPOTENCY_CACHE]
+// EN: A request_id whose approval is cached is answered like the DB path
+//     answers a duplicate (APPROVED, idempotent) with the cached txn_id,
+//     before risk and 2PC: a retry must not be declined by rules the first
+//     attempt already passed. That txn_id is the one of the attempt that
+//     filled the cache: the original one when that attempt inserted the row,
+//     otherwise that of a later attempt which found the row already there
+//     (the table keeps no txn_id, and the DB path answers with its own).
+//     Returns 1 when out was filled.
+// VN: Retry có request_id đã duyệt → trả lời từ cache, không xuống DB.
+static int payment_cached(const char *request_id, PaymentResult *out) {
+    char status[IDEM_TXN_MAX];
+    if (!idem_get(request_id, status, out->txn_id, sizeof(out->txn_id))) return 0;
+    if (strcmp(status, "APPROVED") != 0) return 0;
+    out->idempotent = 1;
+    metrics_inc_approved();
+    log_message_json("INFO", "tx", request_id, "APPROVED", -1);
+    return 1;
+}
+
+// One payment's 2PC between payment_begin() and payment_end(): on the stack
+// of run_payment(), or in a HandlerPending while the payment is suspended.
+// The participants borrow request_id, masked and txn_id from here.
+typedef struct PaymentTxn {
+    TransactionCoordinator *coordinator;
+    Transaction *txn;
+    DBParticipantContext *db_ctx;
+    ClearingParticipantContext *clearing_ctx;
+    const char *request_id;
+    int64_t amount_minor;
+    int amount_exp;
+    int db_last;          // group commit: database registered last
+    int async;            // txn_commit_async() steps registered
+    int is_dup;
+    char db_status[32];
+    char masked[64];
+    char txn_id[MAX_TRANSACTION_ID_LEN];
+    struct timeval t0;
+} PaymentTxn;
+
+// Validate, begin the 2PC and stage the insert: 0 = ready to commit, -1 =
+// declined into out. async asks for a transaction txn_commit_async() can
+// drive; pt->async says whether it got one (else commit with txn_commit()).
+static int payment_begin(HandlerContext *ctx, const IsoRequestView *req, const char *request_id,
+                         int async, PaymentTxn *pt, PaymentResult *out) {
+    gettimeofday(&pt->t0, NULL);
+    pt->request_id = request_id;
+    pt->amount_minor = req->amount_minor;
+    pt->amount_exp = req->amount_exp;
+    pt->async = 0;
+    pt->is_dup = 0;
+    pt->db_status[0] = '\0';
+    if (payment_precheck(ctx, req, out) != 0) return -1;
+
+    mask_pan(req->pan.p, pt->masked, sizeof(pt->masked));
+
+    // [ANCHOR:HANDLER_2PC] Use 2-Phase Commit for distributed transaction
+    // Generate unique transaction ID
+    // request_id capped at 38 chars so the timestamp always fits (5 + 38 + 1 + 20 < 64)
+    snprintf(pt->txn_id, sizeof(pt->txn_id), "visa_%.38s_%ld", request_id, time(NULL));
+    const char *txn_id = pt->txn_id;
+
+    // Begin distributed transaction: on the shared coordinator when it will be
+    // committed asynchronously; should that one be full, on the worker's own
+    pt->txn = NULL;
+    if (async) {
+        pt->coordinator = handler_async_coordinator();
+        pt->txn = pt->coordinator ? txn_begin(pt->coordinator, txn_id) : NULL;
+        pt->async = pt->txn != NULL;
+    }
+    if (!pt->txn) {
+        pt->coordinator = handler_coordinator();
+        pt->txn = pt->coordinator ? txn_begin(pt->coordinator, txn_id) : NULL;
+    }
+    if (!pt->txn) {
+        payment_decline(out, 500, "txn_init_failed", "ERROR", request_id);
+        return -1;
+    }
+    Transaction *txn = pt->txn;
+
+    // Initialize participants (the DB one takes its connection per step)
+    DBParticipantContext *db_ctx = pt->db_ctx = db_participant_init(ctx->db);
+    ClearingParticipantContext *clearing_ctx = pt->clearing_ctx = clearing_participant_init(NULL, 30);
+
+    // [ANCHOR:HANDLER_GROUP_COMMIT] With GROUP_COMMIT_WINDOW_US the database
+    // goes last, as the one-phase last resource: clearing prepares its hold,
+    // then the row is committed with a group of approvals (groupcommit.c),
+    // which decides the outcome before clearing commits. Should clearing then
+    // fail to commit, the durable row is compensated (marked REVERSED).
+    // VN: Bật group commit → DB đăng ký sau clearing, commit theo nhóm.
+    const int db_last = pt->db_last = groupcommit_enabled() && request_id[0];
+    int http_code = 500;
+    const char *fail = NULL;
+    if (!db_ctx || !clearing_ctx) {
+        fail = "participant_init_failed";
+    } else if ((!db_last && txn_register_participant(txn, "database", db_ctx,
+                                                     db_participant_prepare,
+                                                     db_participant_commit,
+                                                     db_participant_abort) != 0) ||
+               txn_register_participant(txn, "clearing", clearing_ctx,
+                                        clearing_participant_prepare,
+                                        clearing_participant_commit,
+                                        clearing_participant_abort) != 0 ||
+               (db_last && txn_register_participant(txn, "database", db_ctx,
+                                                    db_participant_prepare,
+                                                    db_participant_commit,
+                                                    db_participant_abort) != 0)) {
+        fail = "participant_registration_failed";
+    } else if (pt->async &&
+               (txn_participant_async(txn, "database", db_participant_prepare_async,
+                                      db_participant_commit_async, db_participant_abort_async) != 0 ||
+                txn_participant_async(txn, "clearing", clearing_participant_prepare_async,
+                                      clearing_participant_commit_async, clearing_participant_abort_async) != 0)) {
+        fail = "participant_registration_failed";
+    } else if ((db_last ? db_participant_begin_group(db_ctx, txn_id) : db_participant_begin(db_ctx, txn_id)) != 0) {
+        fail = "db_begin_failed";
+    } else if (clearing_participant_set_transaction(clearing_ctx, txn_id, pt->masked,
+                                                    req->amount_minor, req->amount_exp, "MERCHANT001") != 0) {
+        fail = "clearing_setup_failed";
+        http_code = 502;
+    } else if (db_participant_insert_transaction(db_ctx, request_id, pt->masked,
+                                                 req->amount_minor, req->amount_exp, "APPROVED",
+                                                 &pt->is_dup, pt->db_status, sizeof(pt->db_status)) != 0) {
+        // Execute database operations within transaction
+        fail = "db_error";
+    }
+    if (fail) {
+        // Abort first: txn_abort() calls into the registered participant contexts
+        txn_abort(pt->coordinator, txn);
+        if (db_ctx) db_participant_destroy(db_ctx);
+        if (clearing_ctx) clearing_participant_destroy(clearing_ctx);
+        payment_decline(out, http_code, fail, "ERROR", request_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Outcome of the 2PC: release the participants and fill out
+static void payment_end(PaymentTxn *pt, int commit_result, PaymentResult *out) {
+    const char *request_id = pt->request_id;
+    // Group commit: the row may already be durable although clearing failed
+    // to commit; it must not keep answering retries as approved
+    if (commit_result != 0 && pt->db_last) (void)db_participant_compensate(pt->db_ctx, "REVERSED");
+
+    // Cleanup participants
+    db_participant_destroy(pt->db_ctx);
+    clearing_participant_destroy(pt->clearing_ctx);
+
+    if (commit_result != 0) {
+        // 2PC failed
+        // Best-effort enqueue reversal to clear any external holds/charges
+        (void)reversal_enqueue(pt->txn_id, pt->masked, pt->amount_minor, pt->amount_exp, "MERCHANT001");
+        payment_decline(out, 500, "commit_failed", "ERROR", request_id);
+        return;
+    }
+    out->idempotent = pt->is_dup;
+    memcpy(out->txn_id, pt->txn_id, sizeof(out->txn_id));
+    idem_put(request_id, pt->db_status[0] ? pt->db_status : "APPROVED", pt->txn_id);
+    metrics_inc_approved();
+
+    // [ANCHOR:HANDLER_LATENCY_LOG] Tính latency và log JSON một dòng
+    struct timeval t1; gettimeofday(&t1, NULL);
+    long latency_us = (t1.tv_sec - pt->t0.tv_sec) * 1000000L + (t1.tv_usec - pt->t0.tv_usec);
+    log_message_json("INFO", "tx", request_id, "APPROVED", latency_us);
+}
+
+// Validate and run one decoded request through risk and 2PC
+static void run_payment(HandlerContext *ctx, const IsoRequestView *req, PaymentResult *out) {
+    PaymentTxn pt;
+    if (payment_begin(ctx, req, req->request_id.p, 0, &pt, out) != 0) return;
+    // Execute 2-Phase Commit
+    payment_end(&pt, txn_commit(pt.coordinator, pt.txn), out);
+}
+
+// Where the answer to one payment goes: the protocol it arrived on and, for
+// ISO 8583, the request its response echoes
+typedef enum { PAYMENT_REPLY_LINE = 0, PAYMENT_REPLY_HTTP, PAYMENT_REPLY_ISO } PaymentReplyKind;
+
+typedef struct PaymentReply {
+    int kind;                 // PaymentReplyKind
+    const IsoWireMsg *iso;    // ISO: the decoded request (fields point into its frame)
+    size_t iso_len;           // ISO: frame length, without the length prefix
+} PaymentReply;
+
+static void write_payment_reply(HandlerContext *ctx, const PaymentReply *to, const PaymentResult *res);
+
+// A payment waiting on txn_commit_async() (ctx->pending). The request's
+// buffer is reused meanwhile, so what the answer needs is copied here.
+typedef struct HandlerPending {
+    HandlerContext *ctx;
+    PaymentReply to;          // to.iso points at msg
+    int lead;                 // 1: led a singleflight call, ended once answered
+    int follow;               // 1: no txn, answered with a leader's result
+    int gate;                 // follow: handler_suspend() and the result, both count down
+    int rc;                   // txn_commit_async() outcome
+    PaymentResult res;
+    PaymentTxn pt;
+    IsoWireMsg msg;
+    char *request_id;
+    unsigned char data[];     // request_id, then the ISO 8583 frame
+} HandlerPending;
+
+static HandlerPending *pending_new(const IsoRequestView *req, const PaymentReply *to) {
+    size_t rl = req->request_id.n;
+    size_t fl = to->kind == PAYMENT_REPLY_ISO ? to->iso_len : 0;
+    HandlerPending *p = (HandlerPending *)malloc(sizeof(*p) + rl + 1 + fl);
+    if (!p) return NULL;
+    p->to = *to;
+    p->lead = 0;
+    p->follow = 0;
+    p->request_id = (char *)p->data;
+    memcpy(p->request_id, req->request_id.p, rl);
+    p->request_id[rl] = '\0';
+    if (fl) {
+        unsigned char *frame = p->data + rl + 1;
+        memcpy(frame, to->iso->base, fl);
+        p->msg = *to->iso;
+        p->msg.base = frame; // off[] is relative to base
+        p->to.iso = &p->msg;
+    }
+    return p;
+}
+
+// DB_ASYNC on an epoll connection: single payments may suspend (batches and
+// group commit stay synchronous)
+static int payment_can_suspend(const HandlerContext *ctx) {
+    return ctx->resume && dbasync_enabled() && !groupcommit_enabled();
+}
+
+// [ANCHOR:HANDLER_SINGLEFLIGHT]
+// EN: Cached approval → answer at once. Otherwise the first copy of a
+//     request_id in flight runs the payment and every copy that arrives
+//     meanwhile gets its result (singleflight.c): a duplicate of an approval
+//     is marked idempotent like the DB path marks it, a decline is repeated.
+//     A copy that gives up waiting runs on its own and meets ON CONFLICT.
+//     A copy that may suspend does not wait on its worker: it subscribes to
+//     the call and is answered like a suspended payment once the leader ends.
+// VN: Bản trùng đến khi bản đầu còn chạy 2PC → chờ và dùng lại kết quả.
+// Returns 1 when the payment was suspended instead (ctx->pending)
+
+// A copy answered with its leader's result
+static void payment_followed(const char *request_id, PaymentResult *out) {
+    if (out->reason[0]) {
+        metrics_inc_declined();
+        log_message_json("WARN", "tx", request_id, "DECLINED", -1);
+    } else {
+        out->idempotent = 1;
+        metrics_inc_approved();
+        log_message_json("INFO", "tx", request_id, "APPROVED", -1);
+    }
+}
+
+static void payment_follow_done(void *arg, const void *result, size_t size);
+
+static int run_request(HandlerContext *ctx, const IsoRequestView *req, PaymentResult *out,
+                       const PaymentReply *to, int async) {
+    const char *request_id = req->request_id.p;
+    if (payment_type_unsupported(req, out)) return 0;
+    if (payment_cached(request_id, out)) return 0;
+    HandlerPending *p = async ? pending_new(req, to) : NULL;
+    int lead;
+    if (p) {
+        p->ctx = ctx;
+        p->gate = 2;
+        lead = singleflight_subscribe(p->request_id, payment_follow_done, p);
+        if (lead == 0) {
+            // handler_suspend() parks the connection, the leader's end answers it
+            p->follow = 1;
+            ctx->pending = p;
+            return 1;
+        }
+    } else {
+        lead = singleflight_join(request_id, out, sizeof(*out), payment_deadline_ns(ctx, req));
+        if (lead == 0) {
+            payment_followed(request_id, out);
+            return 0;
+        }
+    }
+    if (p) {
+        if (payment_begin(ctx, req, p->request_id, 1, &p->pt, out) == 0) {
+            if (p->pt.async) {
+                // handler_suspend() starts the commit, handler_resume_job() answers
+                p->lead = lead;
+                p->res = *out;
+                ctx->pending = p;
+                return 1;
+            }
+            payment_end(&p->pt, txn_commit(p->pt.coordinator, p->pt.txn), out);
+        }
+        free(p);
+    } else {
+        run_payment(ctx, req, out);
+    }
+    if (lead == 1) singleflight_end(request_id, out, sizeof(*out));
+    return 0;
+}
+
+// [ANCHOR:HANDLER_ARENA] One request arena scope per decoded request (JSON or ISO 8583):
+// the Transaction and participant contexts come from the worker's arena and are
+// dropped together here. The caller has counted the request in metrics_inc_total().
+// A payment that may suspend outlives this call, so it runs without a scope
+// (arena_alloc() falls back to malloc). Returns 1 when it was suspended.
+// VN: Đối tượng 2PC cấp phát từ arena của worker, giải phóng một lần khi xong request.
+static int process_request(HandlerContext *ctx, const IsoRequestView *req, PaymentResult *out,
+                           const PaymentReply *to) {
+    const int async = payment_can_suspend(ctx);
+    if (!async) arena_scope_begin();
+    int suspended = run_request(ctx, req, out, to, async);
+    if (!async) arena_scope_end();
+    db_thread_release(); // DB_POOL_SIZE: no lease outlives its request
+    return suspended;
+}
+
+static void payment_result_init(PaymentResult *out) {
+    out->http_code = 200; out->idempotent = 0; out->reason[0] = '\0';
+    out->txn_id[0] = '\0';
+}
+
+// Process one JSON request (line or HTTP body); the fields are parsed in
+// place, so json must stay untouched until the response is written.
+// Returns 1 when the payment was suspended (answered by handler_resume_job())
+static int process_payment(HandlerContext *ctx, char *json, PaymentResult *out, const PaymentReply *to) {
+    metrics_inc_total();
+    payment_result_init(out);
+    IsoRequestView req;
+    char perr[64] = {0};
+    if (iso_parse_request_insitu(json, &req, perr, sizeof(perr)) != 0) {
+        payment_decline(out, 400, "bad_request", "WARN", NULL);
+        return 0;
+    }
+    return process_request(ctx, &req, out, to);
+}
+
+// [ANCHOR:HANDLER_BATCH]
+// EN: A batch (JSON array or {"batch":[...]} on PORT; pipelined ISO 8583
+//     requests with ISO8583_BATCH=1) is one unit of work: each item is
+//     validated and risk-checked on its own, then the valid ones share one 2PC
+//     transaction, one multi-row INSERT and one clearing hold for their total.
+//     The hold has one currency, so an item whose currency differs from the
+//     first valid item's is declined (batch_mixed_currency).
+//     An item declined before 2PC keeps its own reason; when the 2PC fails,
+//     every item that reached it is declined with the failure reason.
+// VN: Lô giao dịch: kiểm tra từng item, rồi một 2PC + một câu INSERT nhiều dòng
+//     + một hold clearing cho cả lô thay vì mỗi item một vòng.
+#define HANDLER_BATCH_REPLY_MAX (ISO_BATCH_MAX * 112 + 64)
+
+// Items whose item_rc[i] != 0 were already declined into res[i] by the caller;
+// every other res[i] is initialised here. The caller counted each item in
+// metrics_inc_total().
+static void run_batch(HandlerContext *ctx, const IsoRequestView *items, const int *item_rc, size_t n,
+                      PaymentResult *res) {
+    struct timeval t0, t1; gettimeofday(&t0, NULL);
+    char masked[ISO_BATCH_MAX][64];
+    DBBatchRow rows[ISO_BATCH_MAX];
+    size_t owner[ISO_BATCH_MAX]; // rows[k] is items[owner[k]]
+    size_t m = 0;
+    IsoStr currency = {"", 0}; // of rows[0]; every row has it
+    for (size_t i = 0; i < n && i < ISO_BATCH_MAX; ++i) {
+        if (item_rc[i] != 0) continue;
+        payment_result_init(&res[i]);
+        const char *request_id = items[i].request_id.p;
+        // Results are matched to rows by request_id, so each item needs its own
+        if (!request_id[0]) {
+            payment_decline(&res[i], 400, "request_id_required", "WARN", NULL);
+            continue;
+        }
+        size_t k = 0;
+        while (k < m && strcmp(rows[k].request_id, request_id) != 0) k++;
+        if (k < m) {
+            payment_decline(&res[i], 400, "duplicate_in_batch", "WARN", request_id);
+            continue;
+        }
+        if (payment_type_unsupported(&items[i], &res[i])) continue;
+        if (payment_cached(request_id, &res[i])) continue;
+        if (payment_precheck(ctx, &items[i], &res[i]) != 0) continue;
+        if (m == 0) {
+            currency = items[i].currency;
+        } else if (items[i].currency.n != currency.n ||
+                   memcmp(items[i].currency.p, currency.p, currency.n) != 0) {
+            payment_decline(&res[i], 400, "batch_mixed_currency", "WARN", request_id);
+            continue;
+        }
+        mask_pan(items[i].pan.p, masked[m], sizeof(masked[m]));
+        rows[m].request_id = request_id;
+        rows[m].pan_masked = masked[m];
+        rows[m].amount_minor = items[i].amount_minor;
+        rows[m].amount_exp = items[i].amount_exp;
+        rows[m].is_dup = 0;
+        rows[m].status[0] = '\0';
+        owner[m++] = i;
+    }
+    if (m == 0) return;
+    metrics_inc_batch();
+
+    // One clearing hold for the total, in the batch's currency
+    const int exp = rows[0].amount_exp;
+    int64_t total = 0;
+    for (size_t k = 0; k < m; ++k) total += rows[k].amount_minor;
+
+    TransactionCoordinator *coordinator = handler_coordinator();
+    char txn_id[MAX_TRANSACTION_ID_LEN];
+    // 11 + 31 + 1 + 20 < 64, like the single-payment id
+    snprintf(txn_id, sizeof(txn_id), "visa_batch_%.31s_%ld", rows[0].request_id, time(NULL));
+    Transaction *txn = coordinator ? txn_begin(coordinator, txn_id) : NULL;
+
+    DBParticipantContext *db_ctx = NULL;
+    ClearingParticipantContext *clearing_ctx = NULL;
+    int http_code = 500;
+    const char *fail = NULL;
+    if (!txn) {
+        fail = "txn_init_failed";
+    } else if (!(db_ctx = db_participant_init(ctx->db)) ||
+               !(clearing_ctx = clearing_participant_init(NULL, 30))) {
+        fail = "participant_init_failed";
+    } else if (txn_register_participant(txn, "database", db_ctx,
+                                        db_participant_prepare,
+                                        db_participant_commit,
+                                        db_participant_abort) != 0 ||
+               txn_register_participant(txn, "clearing", clearing_ctx,
+                                        clearing_participant_prepare,
+                                        clearing_participant_commit,
+                                        clearing_participant_abort) != 0) {
+        fail = "participant_registration_failed";
+    } else if (db_participant_begin(db_ctx, txn_id) != 0) {
+        fail = "db_begin_failed";
+    } else if (clearing_participant_set_batch(clearing_ctx, txn_id, (int)m, total, exp, "MERCHANT001") != 0) {
+        fail = "clearing_setup_failed";
+        http_code = 502;
+    } else if (db_participant_insert_batch(db_ctx, rows, m, "APPROVED") != 0) {
+        fail = "db_error";
+    } else if (txn_commit(coordinator, txn) != 0) {
+        txn = NULL; // txn_commit() removed it
+        (void)reversal_enqueue_batch(txn_id, (int)m, total, exp, "MERCHANT001");
+        fail = "commit_failed";
+    } else {
+        txn = NULL;
+    }
+    if (txn) txn_abort(coordinator, txn);
+    if (db_ctx) db_participant_destroy(db_ctx);
+    if (clearing_ctx) clearing_participant_destroy(clearing_ctx);
+    db_thread_release();
+
+    for (size_t k = 0; k < m; ++k) {
+        PaymentResult *out = &res[owner[k]];
+        if (fail) {
+            payment_decline(out, http_code, fail, "ERROR", rows[k].request_id);
+            continue;
+        }
+        out->idempotent = rows[k].is_dup;
+        memcpy(out->txn_id, txn_id, sizeof(out->txn_id));
+        idem_put(rows[k].request_id, rows[k].status[0] ? rows[k].status : "APPROVED", txn_id);
+        metrics_inc_approved();
+    }
+    gettimeofday(&t1, NULL);
+    long latency_us = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_usec - t0.tv_usec);
+    log_message_json(fail ? "ERROR" : "INFO", "batch", rows[0].request_id, fail ? "DECLINED" : "APPROVED", latency_us);
+}
+
+// JSON batch line / POST /secure/tx body: the response is one JSON object
+// with a result per item, in request order. Returns the HTTP status.
+static int process_batch(HandlerContext *ctx, char *json, char *out, size_t cap) {
+    IsoRequestView items[ISO_BATCH_MAX];
+    int item_rc[ISO_BATCH_MAX];
+    PaymentResult res[ISO_BATCH_MAX];
+    char err[32] = "batch_disabled";
+    int n = ctx->batch_max > 0
+                ? iso_parse_batch_insitu(json, items, item_rc, (size_t)ctx->batch_max, err, sizeof(err))
+                : -1;
+    if (n <= 0) {
+        metrics_inc_total();
+        payment_decline(&res[0], 400, err, "WARN", NULL);
+        snprintf(out, cap, "{\"status\":\"DECLINED\",\"reason\":\"%s\"}\n", err);
+        return 400;
+    }
+    for (int i = 0; i < n; ++i) {
+        metrics_inc_total();
+        if (item_rc[i] != 0) {
+            payment_result_init(&res[i]);
+            payment_decline(&res[i], 400, "bad_request", "WARN", NULL);
+        }
+    }
+    arena_scope_begin();
+    run_batch(ctx, items, item_rc, (size_t)n, res);
+    arena_scope_end();
+
+    int approved = 0;
+    for (int i = 0; i < n; ++i) approved += res[i].reason[0] == '\0';
+    size_t len = (size_t)snprintf(out, cap, "{\"status\":\"BATCH\",\"count\":%d,\"approved\":%d,\"results\":[", n, approved);
+    for (int i = 0; i < n && len < cap; ++i) {
+        struct iovec part[3];
+        size_t bl = payment_body(&res[i], part) - 1; // items without the newline
+        if (len + bl + 4 >= cap) break;
+        if (i) out[len++] = ',';
+        for (int k = 0; k < 3; ++k) {
+            size_t pl = k == 2 ? part[k].iov_len - 1 : part[k].iov_len;
+            memcpy(out + len, part[k].iov_base, pl);
+            len += pl;
+        }
+    }
+    if (len + 4 <= cap) memcpy(out + len, "]}\n", 4);
+    return 200;
+}
+
+// [ANCHOR:HANDLER_ROUTES]
+// Routes served by both protocols: newline lines ("GET /metrics") and
+// HTTP/1.x requests ("GET /metrics HTTP/1.1" + headers), kept alive and
+// answered in request order.
+typedef enum {
+    HTTP_ROUTE_NONE = 0,
+    HTTP_ROUTE_HEALTHZ,
+    HTTP_ROUTE_READYZ,
+    HTTP_ROUTE_METRICS,
+    HTTP_ROUTE_VERSION,
+    HTTP_ROUTE_TX_QUERY,    // GET /tx?request_id=...
+    HTTP_ROUTE_SECURE_PING, // GET /secure/ping (Bearer token)
+    HTTP_ROUTE_SECURE_TX,   // POST /secure/tx (Bearer token, JSON body)
+    HTTP_ROUTE_NOT_FOUND,
+    HTTP_ROUTE_BAD_METHOD
+} HttpRoute;
+
+// GET /metrics is the longest: ~1 KB of names plus 70 counters, which
+// can grow to 20 digits each (~2.4 KB); a body that does not fit is a 500
+#define ROUTE_BODY_MAX 4096
+
+// Body (and HTTP status) of a read-only route
+static int route_reply(HandlerContext *ctx, int route, const char *target, char *out, size_t outsz) {
+    out[0] = '\0';
+    if (route == HTTP_ROUTE_HEALTHZ) {
+        snprintf(out, outsz, "OK\n");
+        log_message_json("INFO", "healthz", NULL, "OK", -1);
+        return 200;
+    }
+    if (route == HTTP_ROUTE_READYZ) {
+        DBConnection *dbc_ready = db_thread_get(ctx->db);
+        const int ready = db_is_ready(dbc_ready);
+        db_thread_release();
+        snprintf(out, outsz, "%s", ready ? "OK\n" : "NOT_READY\n");
+        log_message_json("INFO", "readyz", NULL, ready ? "OK" : "NOT_READY", -1);
+        return ready ? 200 : 503;
+    }
+    if (route == HTTP_ROUTE_METRICS) {
+        unsigned long t=0,a=0,d=0,b=0; metrics_snapshot(&t,&a,&d,&b);
+        unsigned long rd = metrics_get_risk_declined();
+        unsigned long cmt = metrics_get_2pc_committed();
+        unsigned long abt = metrics_get_2pc_aborted();
+        unsigned long cbsc = metrics_get_cb_short_circuit();
+        unsigned long renq = metrics_get_reversal_enqueued();
+        unsigned long rokn = metrics_get_reversal_succeeded();
+        unsigned long rfail = metrics_get_reversal_failed();
+        unsigned long copen = metrics_get_conns_open();
+        ThreadPoolStats ps = {0};
+        threadpool_stats(ctx->pool, &ps);
+        ArenaStats as;
+        arena_stats(&as);
+        ReplyStats rs;
+        reply_stats(&rs);
+        IdemStats is;
+        idem_stats(&is);
+        SingleflightStats sfs;
+        singleflight_stats(&sfs);
+        GroupCommitStats gcs;
+        groupcommit_stats(&gcs);
+        const unsigned long *gh = gcs.size_hist, *gw = gcs.wait_hist;
+        DBPoolStats dps;
+        db_pool_stats(&dps);
+        DbAsyncStats das;
+        dbasync_stats(&das);
+        int mlen = snprintf(out, outsz,
+                            "{\"total\":%lu,\"approved\":%lu,\"declined\":%lu,\"server_busy\":%lu,\"risk_declined\":%lu,\"twopc_committed\":%lu,\"twopc_aborted\":%lu,\"clearing_cb_short_circuit\":%lu,\"reversal_enqueued\":%lu,\"reversal_succeeded\":%lu,\"reversal_failed\":%lu,"
+                            "\"conns_open\":%lu,\"workers\":%d,\"workers_min\":%d,\"workers_max\":%d,\"workers_busy\":%d,\"queue_depth\":%zu,\"queue_shed\":%lu,\"queue_dropping\":%d,"
+                            "\"queue_depth_control\":%zu,\"queue_depth_background\":%zu,\"jobs_expired\":%lu,\"deadline_expired\":%lu,\"batches\":%lu,"
+                            "\"reply_responses\":%lu,\"reply_writes\":%lu,\"db_round_trips\":%lu,"
+                            "\"idem_hits\":%lu,\"idem_misses\":%lu,\"idem_entries\":%lu,\"idem_evictions\":%lu,"
+                            "\"singleflight_coalesced\":%lu,\"singleflight_timeouts\":%lu,"
+                            "\"group_commit_batches\":%lu,\"group_commit_rows\":%lu,\"group_commit_failed\":%lu,\"group_commit_rows_failed\":%lu,"
+                            "\"group_commit_size_hist\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu],"
+                            "\"group_commit_wait_us_hist\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu],"
+                            "\"db_pool_size\":%d,\"db_pool_open\":%d,\"db_pool_in_use\":%d,\"db_pool_acquires\":%lu,"
+                            "\"db_pool_waits\":%lu,\"db_pool_timeouts\":%lu,\"db_pool_resets\":%lu,"
+                            "\"db_pool_wait_us\":%llu,\"db_pool_busy_us\":%llu,"
+                            "\"db_async_conns\":%d,\"db_async_inflight\":%lu,\"db_async_inflight_max\":%lu,"
+                            "\"db_async_flights\":%lu,\"db_async_failed\":%lu,\"db_async_resets\":%lu,"
+                            "\"payments_async\":%lu,\"payments_async_max\":%lu,"
+                            "\"arena_requests\":%lu,\"arena_allocs\":%lu,\"arena_heap_allocs\":%lu,\"arena_high_water\":%zu}\n",
+                            t,a,d,b,rd,cmt,abt,cbsc,renq,rokn,rfail,
+                            copen,ps.threads,ps.threads_min,ps.threads_max,ps.busy,ps.queued,ps.shed,ps.dropping,
+                            ps.queued_lane[THREADPOOL_LANE_CONTROL],ps.queued_lane[THREADPOOL_LANE_BACKGROUND],
+                            ps.expired,metrics_get_deadline_expired(),metrics_get_batches(),
+                            rs.responses,rs.writes,metrics_get_db_round_trips(),
+                            is.hits,is.misses,is.entries,is.evictions,
+                            sfs.coalesced,sfs.timeouts,
+                            gcs.batches,gcs.rows,gcs.failed,gcs.rows_failed,
+                            gh[0],gh[1],gh[2],gh[3],gh[4],gh[5],gh[6],gh[7],
+                            gw[0],gw[1],gw[2],gw[3],gw[4],gw[5],gw[6],gw[7],
+                            dps.size,dps.opened,dps.in_use,dps.acquires,
+                            dps.waits,dps.timeouts,dps.resets,
+                            dps.wait_us,dps.busy_us,
+                            das.conns,das.inflight,das.inflight_max,
+                            das.flights,das.failed,das.resets,
+                            metrics_get_payments_async(),metrics_get_payments_async_max(),
+                            as.scopes,as.allocs,as.heap_allocs,as.high_water);
+        if (mlen <= 0 || (size_t)mlen >= outsz) {
+            snprintf(out, outsz, "{\"error\":\"metrics_truncated\"}\n");
+            log_message_json("ERROR", "metrics", NULL, "Snapshot larger than ROUTE_BODY_MAX", -1);
+            return 500;
+        }
+        log_message_json("INFO", "metrics", NULL, "SNAPSHOT", -1);
+        return 200;
+    }
+    if (route == HTTP_ROUTE_VERSION) {
+        int n = snprintf(out, outsz, "{\"version\":\"%s\",\"schema\":%d}\n",
+                         MINI_VISA_VERSION, MINI_VISA_SCHEMA_VERSION);
+        if (n <= 0 || (size_t)n >= outsz) out[0] = '\0';
+        log_message_json("INFO", "version", NULL, MINI_VISA_VERSION, -1);
+        return 200;
+    }
+    if (route == HTTP_ROUTE_TX_QUERY) {
+        // Very simple query parser: expect request_id in query string
+        const char *q = strstr(target, "request_id=");
+        char rid[128] = {0};
+        if (q) {
+            q += strlen("request_id=");
+            size_t i = 0;
+            while (*q && *q != ' ' && *q != '\r' && *q != '\n' && *q != '&' && i + 1 < sizeof(rid)) {
+                rid[i++] = *q++;
+            }
+            rid[i] = '\0';
+        }
+        if (rid[0] == '\0') {
+            snprintf(out, outsz, "{\"error\":\"missing_request_id\"}\n");
+            return 400;
+        }
+        DBConnection *dbc_q = db_thread_get(ctx->db);
+        int found = db_get_tx_by_request_id(dbc_q, rid, out, outsz) == 0;
+        db_thread_release();
+        if (found) return 200;
+        snprintf(out, outsz, "{\"status\":\"NOT_FOUND\"}\n");
+        return 404;
+    }
+    return 404;
+}
+
+// Line protocol: "GET /healthz" ... prefixes (anything else is a payment)
+static int line_route(const char *line) {
+    if (strncmp(line, "GET /healthz", 12) == 0) return HTTP_ROUTE_HEALTHZ;
+    if (strncmp(line, "GET /readyz", 11) == 0) return HTTP_ROUTE_READYZ;
+    if (strncmp(line, "GET /metrics", 12) == 0) return HTTP_ROUTE_METRICS;
+    if (strncmp(line, "GET /tx?", 8) == 0) return HTTP_ROUTE_TX_QUERY;
+    if (strncmp(line, "GET /version", 12) == 0) return HTTP_ROUTE_VERSION;
+    return HTTP_ROUTE_NONE;
+}
+
+// HTTP: exact path (query stripped) and method
+static int http_route_of(const char *method, const char *target) {
+    static const struct { const char *method, *path; int route; } k_routes[] = {
+        {"GET", "/healthz", HTTP_ROUTE_HEALTHZ},
+        {"GET", "/readyz", HTTP_ROUTE_READYZ},
+        {"GET", "/metrics", HTTP_ROUTE_METRICS},
+        {"GET", "/version", HTTP_ROUTE_VERSION},
+        {"GET", "/tx", HTTP_ROUTE_TX_QUERY},
+        {"GET", "/secure/ping", HTTP_ROUTE_SECURE_PING},
+        {"POST", "/secure/tx", HTTP_ROUTE_SECURE_TX},
+    };
+    size_t plen = strcspn(target, "?");
+    int path_known = 0;
+    for (size_t i = 0; i < sizeof(k_routes) / sizeof(k_routes[0]); ++i) {
+        if (strlen(k_routes[i].path) != plen || strncmp(target, k_routes[i].path, plen) != 0) continue;
+        if (strcmp(method, k_routes[i].method) == 0) return k_routes[i].route;
+        path_known = 1;
+    }
+    return path_known ? HTTP_ROUTE_BAD_METHOD : HTTP_ROUTE_NOT_FOUND;
+}
+
+// [ANCHOR:HANDLER_HTTP_TEMPLATES] Precomputed status lines; unknown codes answer 500
+#define HTTP_STATUS(code, text) { code, "HTTP/1.1 " #code " " text "\r\n", sizeof("HTTP/1.1 " #code " " text "\r\n") - 1 }
+static const struct { int code; const char *line; size_t len; } k_http_status[] = {
+    HTTP_STATUS(200, "OK"),
+    HTTP_STATUS(400, "Bad Request"),
+    HTTP_STATUS(401, "Unauthorized"),
+    HTTP_STATUS(402, "Payment Required"),
+    HTTP_STATUS(404, "Not Found"),
+    HTTP_STATUS(405, "Method Not Allowed"),
+    HTTP_STATUS(413, "Payload Too Large"),
+    HTTP_STATUS(500, "Internal Server Error"),
+    HTTP_STATUS(501, "Not Implemented"),
+    HTTP_STATUS(502, "Bad Gateway"),
+    HTTP_STATUS(503, "Service Unavailable"),
+    HTTP_STATUS(504, "Gateway Timeout"),
+};
+static const char k_http_json[] = "Content-Type: application/json\r\nContent-Length: ";
+static const char k_http_text[] = "Content-Type: text/plain\r\nContent-Length: ";
+static const char k_http_keep_alive[] = "\r\nConnection: keep-alive\r\n\r\n";
+static const char k_http_close[] = "\r\nConnection: close\r\n\r\n";
+
+// Queue the header of one HTTP/1.1 response: status line and fixed headers
+// by reference, only the Content-Length digits are formatted.
+// VN: Header dựng sẵn; chỉ Content-Length thay đổi. "Connection: close" → chủ kết nối đóng socket.
+static void http_head(HandlerContext *ctx, int code, int json, size_t body_len) {
+    ReplyBuf *rb = ctx->reply;
+    size_t i = 0, n = sizeof(k_http_status) / sizeof(k_http_status[0]);
+    while (i < n && k_http_status[i].code != code) i++;
+    if (i == n) while (k_http_status[--i].code != 500) {}
+    reply_static(rb, k_http_status[i].line, k_http_status[i].len);
+    if (json) REPLY_LIT(rb, k_http_json);
+    else REPLY_LIT(rb, k_http_text);
+    char digits[24];
+    size_t d = sizeof(digits);
+    do { digits[--d] = (char)('0' + body_len % 10); body_len /= 10; } while (body_len);
+    reply_copy(rb, digits + d, sizeof(digits) - d);
+    if (ctx->http_keep_alive) REPLY_LIT(rb, k_http_keep_alive);
+    else REPLY_LIT(rb, k_http_close);
+}
+
+// Queue one HTTP/1.1 response with a formatted body. Header and body leave in
+// the same writev: two small writes on a kept-alive connection stall on
+// Nagle + delayed ACK.
+static void write_http(HandlerContext *ctx, int code, const char *body) {
+    size_t bl = strlen(body);
+    http_head(ctx, code, body[0] == '{', bl);
+    reply_copy(ctx->reply, body, bl);
+    reply_end(ctx->reply);
+    if (!ctx->http_keep_alive) ctx->want_close = 1;
+}
+
+// POST /secure/tx answer: header and body built from templates only
+static void write_http_payment(HandlerContext *ctx, const PaymentResult *res) {
+    struct iovec part[3];
+    size_t bl = payment_body(res, part);
+    http_head(ctx, res->http_code, 1, bl);
+    reply_payment_body(ctx->reply, part);
+    reply_end(ctx->reply);
+    if (!ctx->http_keep_alive) ctx->want_close = 1;
+}
+
+static void http_reset(HandlerContext *ctx) {
+    ctx->http_collecting = 0;
+    ctx->http_route = HTTP_ROUTE_NONE;
+    ctx->http_chunked = 0;
+    ctx->http_authz[0] = '\0';
+    ctx->http_content_length = -1;
+    ctx->http_body_remaining = 0;
+    ctx->http_body_used = 0;
+}
+
+// Request framing cannot be trusted any more (no/oversized body length):
+// answer and close the connection
+static void http_fail(HandlerContext *ctx, int code, const char *body) {
+    ctx->http_keep_alive = 0;
+    write_http(ctx, code, body);
+    http_reset(ctx);
+}
+
+static int http_authorized(const HandlerContext *ctx) {
+    if (!ctx->api_token || !*ctx->api_token) return 0;
+    // Expect: Authorization: Bearer <token>
+    const char *p = strstr(ctx->http_authz, "Bearer ");
+    if (!p) return 0;
+    p += 7; // after 'Bearer '
+    while (*p == ' ') p++;
+    return strcmp(p, ctx->api_token) == 0;
+}
+
+// Complete request (headers + body, if any): route it and answer
+static void http_dispatch(HandlerContext *ctx, char *body) {
+    char out[ROUTE_BODY_MAX];
+    int code;
+    int route = ctx->http_route;
+    if (route == HTTP_ROUTE_SECURE_PING || route == HTTP_ROUTE_SECURE_TX) {
+        if (!http_authorized(ctx)) {
+            code = 401;
+            snprintf(out, sizeof(out), "{\"error\":\"unauthorized\"}\n");
+        } else if (route == HTTP_ROUTE_SECURE_PING) {
+            code = 200;
+            snprintf(out, sizeof(out), "{\"ok\":true}\n");
+        } else if (!body) {
+            code = 400;
+            snprintf(out, sizeof(out), "{\"error\":\"bad_content_length\"}\n");
+        } else if (iso_is_batch(body)) {
+            char batch_out[HANDLER_BATCH_REPLY_MAX];
+            code = process_batch(ctx, body, batch_out, sizeof(batch_out));
+            write_http(ctx, code, batch_out);
+            http_reset(ctx);
+            return;
+        } else {
+            static const PaymentReply to = { PAYMENT_REPLY_HTTP, NULL, 0 };
+            PaymentResult res;
+            // Suspended: the answer is written when the 2PC completes
+            if (process_payment(ctx, body, &res, &to) == 0) write_payment_reply(ctx, &to, &res);
+            http_reset(ctx);
             return;
         }
+    } else if (route == HTTP_ROUTE_NOT_FOUND) {
+        code = 404;
+        snprintf(out, sizeof(out), "{\"error\":\"not_found\"}\n");
+    } else if (route == HTTP_ROUTE_BAD_METHOD) {
+        code = 405;
+        snprintf(out, sizeof(out), "{\"error\":\"method_not_allowed\"}\n");
+    } else {
+        code = route_reply(ctx, route, ctx->http_target, out, sizeof(out));
     }
-    // [ANCHOR:HANDLER_TIMEOUTS]
-    // 1) Set simple read/write timeouts to avoid hanging forever (keep-alive friendly)
-    struct timeval tv;
-    tv.tv_sec = 5; tv.tv_usec = 0;
-    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-    // [ANCHOR:HANDLER_BUFFER]
-    // VN: Bộ đệm đọc theo dòng (newline-delimited). 8192 là giới hạn để chống DoS dòng quá dài.
-    char buf[8192];
-    size_t used = 0;
+    write_http(ctx, code, out);
+    http_reset(ctx);
+}
 
-    // [ANCHOR:HANDLER_READ_LOOP]
-    // Minimal HTTP request state for secure endpoint(s)
-    int http_collecting = 0;           // inside HTTP header collection
-    int http_is_secure_ping = 0;       // target path is /secure/ping
-    int http_is_secure_tx = 0;         // target path is /secure/tx (POST JSON)
-    char http_authz[256]; http_authz[0] = '\0';
-    long http_content_length = -1;     // Content-Length for POST
-    long http_body_remaining = 0;      // remaining bytes to read for body
-    size_t http_body_used = 0;         // collected body bytes
-    char http_body[8192];              // body buffer cap
+// End of HTTP headers: answer now, or enter body mode first
+static void http_end_of_headers(HandlerContext *ctx) {
+    ctx->http_collecting = 0;
+    if (ctx->http_chunked) {
+        http_fail(ctx, 501, "{\"error\":\"chunked_not_supported\"}\n");
+        return;
+    }
+    if (ctx->http_content_length < -1 || ctx->http_content_length >= HANDLER_BUF_SIZE) {
+        http_fail(ctx, ctx->http_content_length < -1 ? 400 : 413, "{\"error\":\"bad_content_length\"}\n");
+        return;
+    }
+    if (ctx->http_content_length > 0) {
+        // Every route consumes its body, so the next pipelined request stays framed
+        if (!ctx->http_body && (ctx->http_body = (char *)malloc(HANDLER_BUF_SIZE)) == NULL) {
+            http_fail(ctx, 500, "{\"error\":\"oom\"}\n");
+            return;
+        }
+        ctx->http_body_remaining = ctx->http_content_length; // begin body mode
+        ctx->http_body_used = 0;
+        return;
+    }
+    http_dispatch(ctx, NULL);
+}
 
-    for (;;) {
-        // Read more data
-        ssize_t n = read(fd, buf + used, sizeof(buf) - 1 - used);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            // timeout or error: close connection
-            break;
+// Complete HTTP body: dispatch the request it belongs to
+static void http_body_complete(HandlerContext *ctx) {
+    ctx->http_body[ctx->http_body_used] = '\0';
+    http_dispatch(ctx, ctx->http_body);
+}
+
+static int header_has_token(const char *v, const char *tok) {
+    size_t tl = strlen(tok);
+    for (const char *p = v; *p; ++p) {
+        if (strncasecmp(p, tok, tl) == 0) return 1;
+    }
+    return 0;
+}
+
+// One header line of the request being collected
+static void http_header(HandlerContext *ctx, const char *line) {
+    const char *colon = strchr(line, ':');
+    if (!colon) return;
+    const char *v = colon + 1;
+    while (*v == ' ' || *v == '\t') v++;
+    size_t nl = (size_t)(colon - line);
+    if (nl == 13 && strncasecmp(line, "Authorization", 13) == 0) {
+        snprintf(ctx->http_authz, sizeof(ctx->http_authz), "%s", v);
+    } else if (nl == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+        char *e = NULL;
+        long n = strtol(v, &e, 10);
+        ctx->http_content_length = (e == v || n < 0) ? -2 : n; // -2 = invalid
+    } else if (nl == 10 && strncasecmp(line, "Connection", 10) == 0) {
+        if (header_has_token(v, "close")) ctx->http_keep_alive = 0;
+        else if (header_has_token(v, "keep-alive")) ctx->http_keep_alive = 1;
+    } else if (nl == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+        if (!header_has_token(v, "identity")) ctx->http_chunked = 1;
+    }
+}
+
+// "METHOD SP target SP HTTP/1.x" (line already trimmed); 1 = request line
+static int http_request_line(const char *line, char *method, size_t msz, char *target, size_t tsz, int *minor) {
+    size_t len = strlen(line);
+    if (len < 10 || memcmp(line + len - 9, " HTTP/1.", 8) != 0 || !isdigit((unsigned char)line[len - 1])) return 0;
+    size_t ml = 0;
+    while (line[ml] >= 'A' && line[ml] <= 'Z') ml++;
+    if (ml == 0 || ml >= msz || line[ml] != ' ') return 0;
+    const char *t = line + ml + 1, *tend = line + len - 9;
+    if (tend <= t || *t == ' ') return 0;
+    memcpy(method, line, ml);
+    method[ml] = '\0';
+    size_t tl = (size_t)(tend - t);
+    if (tl >= tsz) tl = tsz - 1;
+    memcpy(target, t, tl);
+    target[tl] = '\0';
+    *minor = line[len - 1] - '0';
+    return 1;
+}
+
+static int is_control_line(const char *p, size_t n);
+
+// Handle one complete line (NUL-terminated, newline stripped)
+static void handle_line(HandlerContext *ctx, char *raw) {
+    // Trim both ends: CRLF clients leave '\r' behind ("Bearer <token>\r" never matched)
+    char *line = raw;
+    while (*line && isspace((unsigned char)*line)) line++;
+    size_t len = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len - 1])) line[--len] = '\0';
+    if (*line == '\0') {
+        // Blank line ends HTTP headers; otherwise skipped
+        if (ctx->http_collecting) http_end_of_headers(ctx);
+        return;
+    }
+    if (ctx->http_collecting) {
+        http_header(ctx, line);
+        return;
+    }
+    // [ANCHOR:HANDLER_CONTROL_LANE]
+    // EN: A job on the control lane serves probes only. NET_MODE=blocking
+    //     picks the lane once per connection from its first bytes, so a client
+    //     that opened with GET /healthz would otherwise keep a reserved control
+    //     worker for payments, past CoDel and the default lane's capacity. Its
+    //     first other frame closes the connection instead (epoll mode picks the
+    //     lane per dispatch and never gets here).
+    // VN: Kết nối trên lane control chỉ phục vụ probe; frame khác → đóng.
+    if (ctx->lane == THREADPOOL_LANE_CONTROL && !is_control_line(line, len)) {
+        ctx->want_close = 1;
+        return;
+    }
+
+    // [ANCHOR:HANDLER_HTTP] HTTP/1.x request line → collect headers (any route)
+    char method[8];
+    int minor = 0;
+    if (http_request_line(line, method, sizeof(method), ctx->http_target, sizeof(ctx->http_target), &minor)) {
+        http_reset(ctx);
+        ctx->http_collecting = 1;
+        ctx->http_route = http_route_of(method, ctx->http_target);
+        ctx->http_keep_alive = minor >= 1; // HTTP/1.0 closes unless "Connection: keep-alive"
+        return;
+    }
+
+    // [ANCHOR:HANDLER_HEALTH_READY_METRICS]
+    // Health/Ready/Metrics simple GET handling per line
+    int route = line_route(line);
+    if (route != HTTP_ROUTE_NONE) {
+        char out[ROUTE_BODY_MAX];
+        (void)route_reply(ctx, route, line + 4, out, sizeof(out));
+        reply_copy(ctx->reply, out, strlen(out));
+        reply_end(ctx->reply);
+        return;
+    }
+
+    if (iso_is_batch(line)) {
+        char out[HANDLER_BATCH_REPLY_MAX];
+        (void)process_batch(ctx, line, out, sizeof(out));
+        reply_copy(ctx->reply, out, strlen(out));
+        reply_end(ctx->reply);
+        return;
+    }
+    static const PaymentReply to = { PAYMENT_REPLY_LINE, NULL, 0 };
+    PaymentResult res;
+    if (process_payment(ctx, line, &res, &to) == 0) write_payment_reply(ctx, &to, &res);
+}
+
+// [ANCHOR:HANDLER_ISO8583]
+// Binary ISO 8583 (ISO8583_PORT): each length-prefixed message is decoded
+// straight into an IsoRequestView, runs the same pipeline as a JSON request and is
+// answered with MTI + 10 carrying the outcome as response code (DE39).
+static const char *iso_response_code(const PaymentResult *res) {
+    if (!res->reason[0]) return "00";                              // approved
+    if (strcmp(res->reason, "luhn_failed") == 0) return "14";      // invalid card number
+    if (strcmp(res->reason, "amount_invalid") == 0) return "13";   // invalid amount
+    if (strcmp(res->reason, "unsupported_mti") == 0 ||
+        strcmp(res->reason, "unsupported_type") == 0) return "12"; // invalid transaction
+    if (strcmp(res->reason, "duplicate_in_batch") == 0) return "94"; // duplicate transmission
+    switch (res->http_code) {
+    case 400: return "30";           // format error
+    case 402: return "05";           // do not honour (risk)
+    case 502: case 503: return "91"; // issuer or switch inoperative
+    case 504: return "68";           // response received too late
+    default: return "96";            // system malfunction
+    }
+}
+
+// DE38 approval code: six digits derived from the 2PC transaction id (FNV-1a)
+static void iso_auth_code(const char *txn_id, char out[7]) {
+    unsigned h = 2166136261u;
+    for (const char *p = txn_id; *p; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+    snprintf(out, 7, "%06u", h % 1000000u);
+}
+
+static void handle_iso_message(HandlerContext *ctx, const unsigned char *msg, size_t len) {
+    IsoWireMsg m;
+    IsoRequestView req;
+    PaymentResult res;
+    char err[32];
+    int rc = iso_wire_decode(msg, len, &m, &req, err, sizeof(err));
+    if (rc != 0 && (m.mti < 0 || m.mti % 100 != 0)) {
+        // Not a request message: there is nothing to answer, drop the link
+        log_message_json("WARN", "iso8583", NULL, err, -1);
+        ctx->want_close = 1;
+        return;
+    }
+    metrics_inc_total();
+    payment_result_init(&res);
+    const PaymentReply to = { PAYMENT_REPLY_ISO, &m, len };
+    if (rc != 0) {
+        payment_decline(&res, 400, strcmp(err, "unsupported_mti") == 0 ? "unsupported_mti" : "bad_request",
+                        "WARN", NULL);
+    } else if (process_request(ctx, &req, &res, &to)) {
+        return;
+    }
+    write_payment_reply(ctx, &to, &res);
+}
+
+// Queue the answer to one payment in the form its protocol expects
+static void write_payment_reply(HandlerContext *ctx, const PaymentReply *to, const PaymentResult *res) {
+    if (to->kind == PAYMENT_REPLY_HTTP) {
+        write_http_payment(ctx, res);
+        return;
+    }
+    if (to->kind == PAYMENT_REPLY_LINE) {
+        struct iovec part[3];
+        (void)payment_body(res, part);
+        reply_payment_body(ctx->reply, part);
+        reply_end(ctx->reply);
+        return;
+    }
+    char auth[7];
+    if (!res->reason[0]) iso_auth_code(res->txn_id, auth);
+    // Encoded straight into the reply scratch
+    unsigned char *out = (unsigned char *)reply_reserve(ctx->reply, HANDLER_BUSY_REPLY_MAX);
+    size_t n = out ? iso_wire_encode_response(to->iso, iso_response_code(res), res->reason[0] ? NULL : auth,
+                                              out, HANDLER_BUSY_REPLY_MAX) : 0;
+    if (n == 0) { ctx->want_close = 1; return; }
+    reply_commit(ctx->reply, n);
+    reply_end(ctx->reply);
+}
+
+// ISO8583_BATCH=1: n (>= 2) complete request frames that arrived together are
+// authorised as one batch and answered in order. Returns 0,
+// or -1 when a frame is not a request message (the caller answers the frames
+// one by one instead, which closes the link at that frame).
+static int handle_iso_batch(HandlerContext *ctx, const unsigned char *const *msgs, const size_t *lens, size_t n) {
+    IsoWireMsg m[ISO_BATCH_MAX];
+    IsoRequestView req[ISO_BATCH_MAX];
+    int item_rc[ISO_BATCH_MAX] = {0};
+    PaymentResult res[ISO_BATCH_MAX];
+    char err[32];
+    for (size_t i = 0; i < n; ++i) {
+        item_rc[i] = iso_wire_decode(msgs[i], lens[i], &m[i], &req[i], err, sizeof(err));
+        if (item_rc[i] != 0 && (m[i].mti < 0 || m[i].mti % 100 != 0)) return -1;
+        if (item_rc[i] != 0) {
+            payment_result_init(&res[i]);
+            payment_decline(&res[i], 400, strcmp(err, "unsupported_mti") == 0 ? "unsupported_mti" : "bad_request",
+                            "WARN", NULL);
         }
-        if (n == 0) {
-            // client closed
+    }
+    for (size_t i = 0; i < n; ++i) metrics_inc_total();
+    arena_scope_begin();
+    run_batch(ctx, req, item_rc, n, res);
+    arena_scope_end();
+
+    for (size_t i = 0; i < n; ++i) {
+        // Items share the batch txn_id: salt the approval code with the position
+        char auth[7], salted[MAX_TRANSACTION_ID_LEN + 8];
+        if (!res[i].reason[0]) {
+            snprintf(salted, sizeof(salted), "%s#%zu", res[i].txn_id, i);
+            iso_auth_code(salted, auth);
+        }
+        unsigned char *out = (unsigned char *)reply_reserve(ctx->reply, HANDLER_BUSY_REPLY_MAX);
+        size_t k = out ? iso_wire_encode_response(&m[i], iso_response_code(&res[i]), res[i].reason[0] ? NULL : auth,
+                                                  out, HANDLER_BUSY_REPLY_MAX) : 0;
+        if (k == 0) { ctx->want_close = 1; break; }
+        reply_commit(ctx->reply, k);
+        reply_end(ctx->reply);
+    }
+    return 0;
+}
+
+// [ANCHOR:HANDLER_CLASSIFY] Control-plane routes (answered without DB writes)
+static int is_control_line(const char *p, size_t n) {
+    static const char *const k_routes[] = {"GET /healthz", "GET /readyz", "GET /metrics", "GET /version"};
+    for (size_t i = 0; i < sizeof(k_routes) / sizeof(k_routes[0]); ++i) {
+        size_t rl = strlen(k_routes[i]);
+        if (n >= rl && memcmp(p, k_routes[i], rl) == 0) return 1;
+    }
+    return 0;
+}
+
+// Control HTTP request: "GET /healthz HTTP/1.1" etc. (headers follow)
+static int is_control_http(const char *p, size_t n) {
+    while (n > 0 && (p[n - 1] == '\r' || p[n - 1] == ' ')) n--;
+    return n > 9 && memcmp(p + n - 9, " HTTP/1.", 8) == 0 && is_control_line(p, n);
+}
+
+int handler_frame_lane(const HandlerContext *ctx, const char *buf, size_t used, int allow_partial) {
+    if (ctx->proto == HANDLER_PROTO_ISO8583) return THREADPOOL_LANE_DEFAULT;
+    if (ctx->http_collecting || ctx->http_body_remaining > 0) return THREADPOOL_LANE_DEFAULT;
+    const char *p = buf, *end = buf + used;
+    int lines = 0, headers = 0;
+    while (p < end) {
+        const char *nl = simdscan_newline(p, (size_t)(end - p));
+        if (!nl) {
+            if (!allow_partial || headers) return THREADPOOL_LANE_DEFAULT;
             break;
         }
-        used += (size_t)n;
-        buf[used] = '\0';
+        size_t n = (size_t)(nl - p);
+        if (headers) {
+            // Header block of a control request: a body makes it payment traffic
+            if (n == 0 || (n == 1 && p[0] == '\r')) headers = 0;
+            else if (n >= 15 && strncasecmp(p, "Content-Length:", 15) == 0) return THREADPOOL_LANE_DEFAULT;
+        } else if (is_control_http(p, n)) {
+            headers = 1;
+            lines++;
+        } else if (is_control_line(p, n)) {
+            lines++;
+        } else {
+            return THREADPOOL_LANE_DEFAULT;
+        }
+        p = nl + 1;
+    }
+    return lines > 0 ? THREADPOOL_LANE_CONTROL : THREADPOOL_LANE_DEFAULT;
+}
 
-        // [ANCHOR:HANDLER_FRAMING]
-        // Process complete lines (newline-delimited framing)
-        char *start = buf;
-        for (;;) {
-            char *nl = memchr(start, '\n', (buf + used) - start);
-            if (!nl) break;
-            *nl = '\0';
-            // Skip empty lines unless we are collecting HTTP headers
-            const char *line = start;
-            while (*line && isspace((unsigned char)*line)) line++;
-            if (*line == '\0') {
-                if (http_collecting) {
-                    // End of headers: validate Authorization
-                    int authorized = 0;
-                    if (ctx->api_token && *ctx->api_token) {
-                        const char *p = NULL;
-                        // Expect: Authorization: Bearer <token>
-                        if (http_authz[0] != '\0' && (p = strstr(http_authz, "Bearer ")) != NULL) {
-                            p += 7; // after 'Bearer '
-                            while (*p == ' ') p++;
-                            if (strcmp(p, ctx->api_token) == 0) authorized = 1;
-                        }
-                    }
-                    if (authorized && http_is_secure_ping) {
-                        const char *body = "{\"ok\":true}\n";
-                        char resp[256];
-                        int blen = (int)strlen(body);
-                        int m = snprintf(resp, sizeof(resp),
-                                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s",
-                                         blen, body);
-                        if (m > 0 && (size_t)m < sizeof(resp)) (void)write_all(fd, resp, (size_t)m);
-                    } else if (!authorized && (http_is_secure_ping || http_is_secure_tx)) {
-                        const char *body = "{\"error\":\"unauthorized\"}\n";
-                        char resp[256];
-                        int blen = (int)strlen(body);
-                        int m = snprintf(resp, sizeof(resp),
-                                         "HTTP/1.1 401 Unauthorized\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s",
-                                         blen, body);
-                        if (m > 0 && (size_t)m < sizeof(resp)) (void)write_all(fd, resp, (size_t)m);
-                    } else if (authorized && http_is_secure_tx) {
-                        // Prepare to read body
-                        if (http_content_length >= 0 && http_content_length <= (long)sizeof(http_body)) {
-                            http_body_remaining = http_content_length; // begin body mode
-                        } else {
-                            const char *body = "{\"error\":\"bad_content_length\"}\n";
-                            char resp[256];
-                            int blen = (int)strlen(body);
-                            int m = snprintf(resp, sizeof(resp),
-                                             "HTTP/1.1 400 Bad Request\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s",
-                                             blen, body);
-                            if (m > 0 && (size_t)m < sizeof(resp)) (void)write_all(fd, resp, (size_t)m);
-                            http_is_secure_tx = 0; // abort
-                        }
-                    }
-                    http_collecting = 0; http_is_secure_ping = 0; http_authz[0] = '\0';
-                }
-                start = nl + 1;
-                continue;
-            }
+// [ANCHOR:HANDLER_BUSY_REPLY]
+static const char k_busy_line[] = "{\"status\":\"DECLINED\",\"reason\":\"server_busy\"}\n";
+static const char k_busy_http[] =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Type: application/json\r\nContent-Length: 45\r\n"
+    "Connection: close\r\n\r\n{\"status\":\"DECLINED\",\"reason\":\"server_busy\"}\n";
 
-            // Minimal HTTP secure endpoint parsing before other routes
-            if (strncmp(line, "GET ", 4) == 0 && strstr(line, "HTTP/1.1") != NULL) {
-                const char *p = line + 4;
-                char path[128] = {0}; size_t i = 0;
-                while (*p && *p != ' ' && i + 1 < sizeof(path)) path[i++] = *p++;
-                path[i] = '\0';
-                if (strcmp(path, "/secure/ping") == 0) {
-                    http_collecting = 1; http_is_secure_ping = 1; http_is_secure_tx = 0; http_authz[0] = '\0'; http_content_length = -1;
-                    start = nl + 1;
-                    continue;
-                }
+static size_t busy_copy(const char *reply, size_t n, char *out, size_t cap) {
+    if (n > cap) return 0;
+    memcpy(out, reply, n);
+    return n;
+}
+
+size_t handler_busy_reply(const HandlerContext *ctx, const char *buf, size_t used, char *out, size_t cap) {
+    if (ctx->proto == HANDLER_PROTO_ISO8583) {
+        // Answer the first message with 91 (issuer or switch inoperative)
+        const unsigned char *ub = (const unsigned char *)buf;
+        long fl = iso_wire_frame_len(ub, used, HANDLER_BUF_SIZE - 1);
+        if (fl <= 0) return 0;
+        IsoWireMsg m;
+        IsoRequestView req;
+        (void)iso_wire_decode(ub + 2, (size_t)fl - 2, &m, &req, NULL, 0);
+        if (m.mti < 0 || m.mti % 100 != 0) return 0;
+        return iso_wire_encode_response(&m, "91", NULL, (unsigned char *)out, cap);
+    }
+    if (ctx->http_collecting || ctx->http_body_remaining > 0) return busy_copy(k_busy_http, sizeof(k_busy_http) - 1, out, cap);
+    const char *nl = memchr(buf, '\n', used);
+    size_t n = nl ? (size_t)(nl - buf) : used;
+    while (n > 0 && (buf[n - 1] == '\r' || buf[n - 1] == ' ')) n--;
+    if (n > 9 && memcmp(buf + n - 9, " HTTP/1.", 8) == 0) return busy_copy(k_busy_http, sizeof(k_busy_http) - 1, out, cap);
+    return busy_copy(k_busy_line, sizeof(k_busy_line) - 1, out, cap);
+}
+
+int handler_has_frame(const HandlerContext *ctx, const char *buf, size_t used) {
+    if (used == 0) return 0;
+    if (ctx->proto == HANDLER_PROTO_ISO8583) {
+        return iso_wire_frame_len((const unsigned char *)buf, used, HANDLER_BUF_SIZE - 1) != 0;
+    }
+    if (ctx->http_body_remaining > 0) {
+        // Body bytes carry no newline; any progress on the body is a frame
+        return 1;
+    }
+    return simdscan_newline(buf, used) != NULL;
+}
+
+size_t handler_consume(HandlerContext *ctx, char *buf, size_t used) {
+    char *start = buf;
+    char *end = buf + used;
+    *end = '\0';
+    // [ANCHOR:HANDLER_REPLY] Responses queue here and leave together below
+    ReplyBuf rb;
+    reply_init(&rb, ctx->client_fd);
+    ctx->reply = &rb;
+    for (;;) {
+        // "Connection: close" was answered: nothing after it is processed
+        if (ctx->want_close) {
+            start = end;
+            break;
+        }
+        // A suspended payment is answered first: later frames wait for its resume
+        if (ctx->pending) break;
+        // ISO8583_PORT: 2-byte length-prefixed binary messages, no lines
+        if (ctx->proto == HANDLER_PROTO_ISO8583) {
+            long fl = iso_wire_frame_len((const unsigned char *)start, (size_t)(end - start), HANDLER_BUF_SIZE - 1);
+            if (fl == 0) break;
+            if (fl < 0) {
+                // Bad length prefix: the stream cannot be resynchronised
+                ctx->want_close = 1;
+                start = end;
+                break;
             }
-            if (strncmp(line, "POST ", 5) == 0 && strstr(line, "HTTP/1.1") != NULL) {
-                const char *p = line + 5;
-                char path[128] = {0}; size_t i = 0;
-                while (*p && *p != ' ' && i + 1 < sizeof(path)) path[i++] = *p++;
-                path[i] = '\0';
-                if (strcmp(path, "/secure/tx") == 0) {
-                    http_collecting = 1; http_is_secure_ping = 0; http_is_secure_tx = 1; http_authz[0] = '\0';
-                    http_content_length = -1; http_body_remaining = 0; http_body_used = 0;
-                    start = nl + 1;
+            if (ctx->iso_batch && ctx->batch_max > 1) {
+                // Coalesce the complete frames that follow (cut at a bad prefix)
+                const unsigned char *msgs[ISO_BATCH_MAX];
+                size_t lens[ISO_BATCH_MAX], n = 0;
+                char *p = start;
+                for (; n < (size_t)ctx->batch_max; ++n) {
+                    long l = iso_wire_frame_len((const unsigned char *)p, (size_t)(end - p), HANDLER_BUF_SIZE - 1);
+                    if (l <= 0) break;
+                    msgs[n] = (const unsigned char *)p + 2;
+                    lens[n] = (size_t)l - 2;
+                    p += l;
+                }
+                if (n >= 2 && handle_iso_batch(ctx, msgs, lens, n) == 0) {
+                    start = p;
                     continue;
                 }
             }
-            if (http_collecting) {
-                // Header line parsing; look for Authorization
-                if (strncasecmp(line, "Authorization:", 14) == 0) {
-                    const char *v = line + 14;
-                    while (*v == ' ' || *v == '\t') v++;
-                    snprintf(http_authz, sizeof(http_authz), "%s", v);
-                } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
-                    const char *v = line + 15;
-                    while (*v == ' ' || *v == '\t') v++;
-                    http_content_length = strtol(v, NULL, 10);
-                }
-                start = nl + 1;
+            handle_iso_message(ctx, (const unsigned char *)start + 2, (size_t)fl - 2);
+            start += fl;
+            continue;
+        }
+        // If collecting an HTTP body, consume raw bytes before line framing
+        if (ctx->http_body_remaining > 0) {
+            // A request body is payment traffic (see HANDLER_CONTROL_LANE)
+            if (ctx->lane == THREADPOOL_LANE_CONTROL) {
+                ctx->want_close = 1;
                 continue;
             }
+            size_t avail = (size_t)(end - start);
+            if (avail == 0) break;
+            size_t take = avail;
+            if ((long)take > ctx->http_body_remaining) take = (size_t)ctx->http_body_remaining;
+            memcpy(ctx->http_body + ctx->http_body_used, start, take);
+            ctx->http_body_used += take;
+            ctx->http_body_remaining -= (long)take;
+            start += take;
+            if (ctx->http_body_remaining > 0) break;
+            http_body_complete(ctx);
+            continue;
+        }
+        // [ANCHOR:HANDLER_FRAMING]
+        // Process complete lines (newline-delimited framing)
+        char *nl = (char *)simdscan_newline(start, (size_t)(end - start));
+        if (!nl) break;
+        *nl = '\0';
+        handle_line(ctx, start);
+        start = nl + 1;
+    }
 
-            // [ANCHOR:HANDLER_HEALTH_READY_METRICS]
-            // Health/Ready/Metrics simple GET handling per line
-            if (strncmp(line, "GET /healthz", 12) == 0) {
-                const char *ok = "OK\n";
-                (void)write_all(fd, ok, strlen(ok));
-                log_message_json("INFO", "healthz", NULL, "OK", -1);
-                start = nl + 1;
-                continue;
-            }
-            if (strncmp(line, "GET /readyz", 11) == 0) {
-                DBConnection *dbc_ready = db_thread_get(ctx->db);
-                const int ready = db_is_ready(dbc_ready);
-                const char *r = ready ? "OK\n" : "NOT_READY\n";
-                (void)write_all(fd, r, strlen(r));
-                log_message_json("INFO", "readyz", NULL, ready ? "OK" : "NOT_READY", -1);
-                start = nl + 1;
-                continue;
-            }
-            if (strncmp(line, "GET /metrics", 12) == 0) {
-                unsigned long t=0,a=0,d=0,b=0; metrics_snapshot(&t,&a,&d,&b);
-                unsigned long rd = metrics_get_risk_declined();
-                unsigned long cmt = metrics_get_2pc_committed();
-                unsigned long abt = metrics_get_2pc_aborted();
-                unsigned long cbsc = metrics_get_cb_short_circuit();
-                unsigned long renq = metrics_get_reversal_enqueued();
-                unsigned long rokn = metrics_get_reversal_succeeded();
-                unsigned long rfail = metrics_get_reversal_failed();
-                char m[640];
-                int mlen = snprintf(m, sizeof(m),
-                                    "{\"total\":%lu,\"approved\":%lu,\"declined\":%lu,\"server_busy\":%lu,\"risk_declined\":%lu,\"twopc_committed\":%lu,\"twopc_aborted\":%lu,\"clearing_cb_short_circuit\":%lu,\"reversal_enqueued\":%lu,\"reversal_succeeded\":%lu,\"reversal_failed\":%lu}\n",
-                                    t,a,d,b,rd,cmt,abt,cbsc,renq,rokn,rfail);
-                if (mlen > 0 && (size_t)mlen < sizeof(m)) (void)write_all(fd, m, (size_t)mlen);
-                log_message_json("INFO", "metrics", NULL, "SNAPSHOT", -1);
-                start = nl + 1;
-                continue;
-            }
-            if (strncmp(line, "GET /tx?", 8) == 0) {
-                // Very simple query parser: expect request_id in query string
-                const char *q = strstr(line, "request_id=");
-                char rid[128] = {0};
-                if (q) {
-                    q += strlen("request_id=");
-                    size_t i = 0;
-                    while (*q && *q != ' ' && *q != '\r' && *q != '\n' && *q != '&' && i + 1 < sizeof(rid)) {
-                        rid[i++] = *q++;
-                    }
-                    rid[i] = '\0';
-                }
+    // A failed write means the peer is gone: the owner closes the connection
+    if (reply_flush(&rb) != 0) ctx->want_close = 1;
+    ctx->reply = NULL;
 
-                if (rid[0] == '\0') {
-                    const char *resp = "{\"error\":\"missing_request_id\"}\n";
-                    (void)write_all(fd, resp, strlen(resp));
-                    start = nl + 1;
-                    continue;
-                }
+    // [ANCHOR:HANDLER_PARTIAL_REMAINDER]
+    // Move remaining partial data to the front (giữ phần chưa hoàn thành ở đầu buffer)
+    size_t remain = (size_t)(end - start);
+    if (remain > 0 && start != buf) memmove(buf, start, remain);
+    if (remain >= HANDLER_BUF_SIZE - 1) {
+        // Too long line; reset buffer to avoid overflow
+        remain = 0;
+    }
+    return remain;
+}
 
-                DBConnection *dbc_q = db_thread_get(ctx->db);
-                char json[256];
-                if (db_get_tx_by_request_id(dbc_q, rid, json, sizeof(json)) == 0) {
-                    (void)write_all(fd, json, strlen(json));
-                } else {
-                    const char *nf = "{\"status\":\"NOT_FOUND\"}\n";
-                    (void)write_all(fd, nf, strlen(nf));
-                }
-                start = nl + 1;
-                continue;
-            }
-            if (strncmp(line, "GET /version", 12) == 0) {
-                char body[128];
-                int n = snprintf(body, sizeof(body),
-                                 "{\"version\":\"%s\",\"schema\":%d}\n",
-                                 MINI_VISA_VERSION, MINI_VISA_SCHEMA_VERSION);
-                if (n > 0 && (size_t)n < sizeof(body)) (void)write_all(fd, body, (size_t)n);
-                log_message_json("INFO", "version", NULL, MINI_VISA_VERSION, -1);
-                start = nl + 1;
-                continue;
-            }
+// [ANCHOR:HANDLER_SUSPEND]
+// EN: A suspended payment holds no worker: handler_suspend() starts its
+//     txn_commit_async(), whose steps run on the dbasync loop and timer
+//     threads. The last step's completion queues handler_resume_job(), which
+//     settles the payment, writes its answer and gives the connection back to
+//     its owner (ctx->resume), who processes what arrived meanwhile. So
+//     payments in flight are bounded by the coordinator, not by THREADS. A
+//     duplicate that follows an in-flight copy suspends the same way, with no
+//     2PC: the leader's singleflight_end() queues its handler_resume_job().
+// VN: Payment treo không giữ worker; khi 2PC xong, một job trên pool ghi phản
+//     hồi rồi trả kết nối cho reactor.
+static void handler_resume_job(void *arg);
 
-            // [ANCHOR:HANDLER_PARSE_VALIDATE] Process one JSON request in 'line'
-            struct timeval t0, t1; gettimeofday(&t0, NULL);
-            metrics_inc_total();
-            IsoRequest req;
-            char perr[64] = {0};
-            if (iso_parse_request_line(line, &req, perr, sizeof(perr)) != 0) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"bad_request\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("WARN", "tx", NULL, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
-            const char *request_id = req.request_id;
-
-            // [ANCHOR:HANDLER_LUHN]
-            if (!luhn_check(req.pan)) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"luhn_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                metrics_inc_risk_declined();
-                log_message_json("WARN", "tx", request_id, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
-            // [ANCHOR:HANDLER_AMOUNT]
-            double amt = atof(req.amount_text);
-            if (!(amt > 0.0) || amt > 10000.0) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"amount_invalid\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("WARN", "tx", request_id, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
+static void resume_submit(void *arg) {
+    HandlerPending *p = (HandlerPending *)arg;
+    // The outcome is decided: no deadline, only the answer is left
+    if (threadpool_submit_lane(p->ctx->pool, THREADPOOL_LANE_DEFAULT, handler_resume_job, handler_resume_job,
+                               p, 0) == 0) return;
+    // Lane full or shedding: try again shortly rather than lose the answer
+    if (timer_after(1000, resume_submit, p) == 0) return;
+    handler_resume_job(p);
+}
 
-            // [ANCHOR:HANDLER_RISK] Risk engine (stub): currently always allow; placeholder for future rules
-            RiskDecision rdec; risk_evaluate(&req, &rdec);
-            if (!rdec.allow) {
-                char body[128];
-                int n = snprintf(body, sizeof(body),
-                                 "{\"status\":\"DECLINED\",\"reason\":\"%s\"}\n",
-                                 rdec.reason[0] ? rdec.reason : "risk_decline");
-                if (n > 0 && (size_t)n < sizeof(body)) (void)write_all(fd, body, (size_t)n);
-                metrics_inc_declined();
-                log_message_json("WARN", "tx", request_id, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
+static void payment_async_done(void *arg, int rc) {
+    HandlerPending *p = (HandlerPending *)arg;
+    p->rc = rc;
+    resume_submit(p);
+}
 
-            char masked[64];
-            mask_pan(req.pan, masked, sizeof(masked));
-            
-            // [ANCHOR:HANDLER_2PC] Use 2-Phase Commit for distributed transaction
-            
-            // Generate unique transaction ID
-            char txn_id[MAX_TRANSACTION_ID_LEN];
-            snprintf(txn_id, sizeof(txn_id), "visa_%s_%ld", request_id, time(NULL));
-            
-            // Begin distributed transaction
-            Transaction *txn = txn_begin(coordinator, txn_id);
-            if (!txn) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"txn_init_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
-            
-            // Initialize participants
-            DBConnection *dbc = db_thread_get(ctx->db);
-            DBParticipantContext *db_ctx = db_participant_init(dbc);
-            ClearingParticipantContext *clearing_ctx = clearing_participant_init(NULL, 30);
-            
-            if (!db_ctx || !clearing_ctx) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"participant_init_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                
-                if (db_ctx) db_participant_destroy(db_ctx);
-                if (clearing_ctx) clearing_participant_destroy(clearing_ctx);
-                txn_abort(coordinator, txn);
-                start = nl + 1;
-                continue;
-            }
-            
-            // Register participants in transaction
-            if (txn_register_participant(txn, "database", db_ctx,
-                                       db_participant_prepare,
-                                       db_participant_commit,
-                                       db_participant_abort) != 0 ||
-                txn_register_participant(txn, "clearing", clearing_ctx,
-                                       clearing_participant_prepare,
-                                       clearing_participant_commit,
-                                       clearing_participant_abort) != 0) {
-                
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"participant_registration_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                
-                db_participant_destroy(db_ctx);
-                clearing_participant_destroy(clearing_ctx);
-                txn_abort(coordinator, txn);
-                start = nl + 1;
-                continue;
-            }
-            
-            // Prepare transaction data
-            if (db_participant_begin(db_ctx, txn_id) != 0) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"db_begin_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                
-                db_participant_destroy(db_ctx);
-                clearing_participant_destroy(clearing_ctx);
-                txn_abort(coordinator, txn);
-                start = nl + 1;
-                continue;
-            }
-            
-            if (clearing_participant_set_transaction(clearing_ctx, txn_id, masked, 
-                                                    req.amount_text, "MERCHANT001") != 0) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"clearing_setup_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                
-                db_participant_destroy(db_ctx);
-                clearing_participant_destroy(clearing_ctx);
-                txn_abort(coordinator, txn);
-                start = nl + 1;
-                continue;
-            }
-            
-            // Execute database operations within transaction
-            int is_dup = 0;
-            char db_status[32] = {0};
-            if (db_participant_insert_transaction(db_ctx, request_id, masked, 
-                                                req.amount_text, "APPROVED", 
-                                                &is_dup, db_status, sizeof(db_status)) != 0) {
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"db_error\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                
-                db_participant_destroy(db_ctx);
-                clearing_participant_destroy(clearing_ctx);
-                txn_abort(coordinator, txn);
-                start = nl + 1;
-                continue;
-            }
-            
-            // Execute 2-Phase Commit
-            int commit_result = txn_commit(coordinator, txn);
-            
-            // Cleanup participants
-            db_participant_destroy(db_ctx);
-            clearing_participant_destroy(clearing_ctx);
-            
-            if (commit_result == 0) {
-                // Success
-                const char *ok_body = is_dup
-                    ? "{\"status\":\"APPROVED\",\"idempotent\":true,\"txn_id\":\"%s\"}\n"
-                    : "{\"status\":\"APPROVED\",\"txn_id\":\"%s\"}\n";
-                char response[256];
-                snprintf(response, sizeof(response), ok_body, txn_id);
-                (void)write_all(fd, response, strlen(response));
-                metrics_inc_approved();
-            } else {
-                // 2PC failed
-                // Best-effort enqueue reversal to clear any external holds/charges
-                (void)reversal_enqueue(txn_id, masked, req.amount_text, "MERCHANT001");
-                const char *resp = "{\"status\":\"DECLINED\",\"reason\":\"commit_failed\"}\n";
-                (void)write_all(fd, resp, strlen(resp));
-                metrics_inc_declined();
-                log_message_json("ERROR", "tx", request_id, "DECLINED", -1);
-                start = nl + 1;
-                continue;
-            }
-            // [ANCHOR:HANDLER_LATENCY_LOG] Tính latency và log JSON một dòng
-            gettimeofday(&t1, NULL);
-            long latency_us = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_usec - t0.tv_usec);
-            log_message_json("INFO", "tx", request_id, "APPROVED", latency_us);
+// A following copy resumes only once it is both parked and answered: the
+// leader may end before this worker has handed the connection back
+static void follow_gate(HandlerPending *p) {
+    if (__atomic_sub_fetch(&p->gate, 1, __ATOMIC_ACQ_REL) == 0) resume_submit(p);
+}
 
-            start = nl + 1;
-        }
-        // If collecting HTTP POST body, consume raw bytes before normal framing move
-        if (http_body_remaining > 0) {
-            // 'start' points to the first unprocessed byte
-            char *raw_start = start;
-            size_t avail = (size_t)((buf + used) - raw_start);
-            if (avail > 0) {
-                size_t take = avail;
-                if ((long)take > http_body_remaining) take = (size_t)http_body_remaining;
-                if (http_body_used + take <= sizeof(http_body)) {
-                    memcpy(http_body + http_body_used, raw_start, take);
-                    http_body_used += take;
-                    http_body_remaining -= (long)take;
-                } else {
-                    // overflow safeguard, drop
-                    http_body_remaining = 0;
-                }
-                raw_start += take;
-                // Shift remainder down into buffer
-                size_t remain2 = (buf + used) - raw_start;
-                if (remain2 > 0 && raw_start != buf) memmove(buf, raw_start, remain2);
-                used = remain2;
-            }
-            if (http_body_remaining == 0 && http_is_secure_tx) {
-                // NUL-terminate body
-                size_t body_len = http_body_used < sizeof(http_body) ? http_body_used : sizeof(http_body) - 1;
-                http_body[body_len] = '\0';
-
-                // Process JSON body with existing transaction pipeline (inline)
-                struct timeval t0, t1; gettimeofday(&t0, NULL);
-                metrics_inc_total();
-                IsoRequest req;
-                char perr[64] = {0};
-                char body_json[512]; body_json[0] = '\0';
-                int http_code = 200; const char *http_reason = "OK";
-                if (iso_parse_request_line(http_body, &req, perr, sizeof(perr)) != 0) {
-                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"bad_request\"}\n");
-                    metrics_inc_declined(); http_code = 400; http_reason = "Bad Request";
-                } else if (!luhn_check(req.pan)) {
-                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"luhn_failed\"}\n");
-                    metrics_inc_declined(); metrics_inc_risk_declined(); http_code = 400; http_reason = "Bad Request";
-                } else {
-                    double amt = atof(req.amount_text);
-                    if (!(amt > 0.0) || amt > 10000.0) {
-                        snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"amount_invalid\"}\n");
-                        metrics_inc_declined(); http_code = 400; http_reason = "Bad Request";
-                    } else {
-                        RiskDecision rdec; risk_evaluate(&req, &rdec);
-                        if (!rdec.allow) {
-                            snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"%s\"}\n", rdec.reason[0] ? rdec.reason : "risk_decline");
-                            metrics_inc_declined(); http_code = 402; http_reason = "Payment Required";
-                        } else {
-                            char masked[64]; mask_pan(req.pan, masked, sizeof(masked));
-                            char txn_id[MAX_TRANSACTION_ID_LEN]; snprintf(txn_id, sizeof(txn_id), "visa_%s_%ld", req.request_id, time(NULL));
-                            Transaction *txn = txn_begin(coordinator, txn_id);
-                            if (!txn) {
-                                snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"txn_init_failed\"}\n");
-                                metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                            } else {
-                                DBConnection *dbc = db_thread_get(ctx->db);
-                                DBParticipantContext *db_ctx = db_participant_init(dbc);
-                                ClearingParticipantContext *clearing_ctx = clearing_participant_init(NULL, 30);
-                                if (!db_ctx || !clearing_ctx) {
-                                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"participant_init_failed\"}\n");
-                                    metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                                    if (db_ctx) db_participant_destroy(db_ctx);
-                                    if (clearing_ctx) clearing_participant_destroy(clearing_ctx);
-                                    txn_abort(coordinator, txn);
-                                } else if (txn_register_participant(txn, "database", db_ctx, db_participant_prepare, db_participant_commit, db_participant_abort) != 0 ||
-                                           txn_register_participant(txn, "clearing", clearing_ctx, clearing_participant_prepare, clearing_participant_commit, clearing_participant_abort) != 0) {
-                                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"participant_registration_failed\"}\n");
-                                    metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                                    db_participant_destroy(db_ctx); clearing_participant_destroy(clearing_ctx); txn_abort(coordinator, txn);
-                                } else if (db_participant_begin(db_ctx, txn_id) != 0) {
-                                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"db_begin_failed\"}\n");
-                                    metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                                    db_participant_destroy(db_ctx); clearing_participant_destroy(clearing_ctx); txn_abort(coordinator, txn);
-                                } else if (clearing_participant_set_transaction(clearing_ctx, txn_id, masked, req.amount_text, "MERCHANT001") != 0) {
-                                    snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"clearing_setup_failed\"}\n");
-                                    metrics_inc_declined(); http_code = 502; http_reason = "Bad Gateway";
-                                    db_participant_destroy(db_ctx); clearing_participant_destroy(clearing_ctx); txn_abort(coordinator, txn);
-                                } else {
-                                    int is_dup = 0; char db_status[32] = {0};
-                                    if (db_participant_insert_transaction(db_ctx, req.request_id, masked, req.amount_text, "APPROVED", &is_dup, db_status, sizeof(db_status)) != 0) {
-                                        snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"db_error\"}\n");
-                                        metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                                        db_participant_destroy(db_ctx); clearing_participant_destroy(clearing_ctx); txn_abort(coordinator, txn);
-                                    } else {
-                                        int commit_result = txn_commit(coordinator, txn);
-                                        db_participant_destroy(db_ctx); clearing_participant_destroy(clearing_ctx);
-                                        if (commit_result == 0) {
-                                            if (is_dup) snprintf(body_json, sizeof(body_json), "{\"status\":\"APPROVED\",\"idempotent\":true,\"txn_id\":\"%s\"}\n", txn_id);
-                                            else snprintf(body_json, sizeof(body_json), "{\"status\":\"APPROVED\",\"txn_id\":\"%s\"}\n", txn_id);
-                                            metrics_inc_approved();
-                                        } else {
-                                            (void)reversal_enqueue(txn_id, masked, req.amount_text, "MERCHANT001");
-                                            snprintf(body_json, sizeof(body_json), "{\"status\":\"DECLINED\",\"reason\":\"commit_failed\"}\n");
-                                            metrics_inc_declined(); http_code = 500; http_reason = "Internal Server Error";
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
+static void payment_follow_done(void *arg, const void *result, size_t size) {
+    HandlerPending *p = (HandlerPending *)arg;
+    memcpy(&p->res, result, size < sizeof(p->res) ? size : sizeof(p->res));
+    follow_gate(p);
+}
 
-                }
+int handler_suspend(HandlerContext *ctx) {
+    HandlerPending *p = ctx->pending;
+    if (!p) return 0;
+    metrics_payment_suspended();
+    if (p->follow) follow_gate(p);
+    else txn_commit_async(p->pt.coordinator, p->pt.txn, payment_async_done, p);
+    return 1;
+}
 
-                // emit HTTP response
-                if (body_json[0] != '\0') {
-                    size_t bl = strlen(body_json);
-                    char hdr[256];
-                    int m = snprintf(hdr, sizeof(hdr),
-                                     "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
-                                     http_code, http_reason, bl);
-                    if (m > 0 && (size_t)m < sizeof(hdr)) {
-                        (void)write_all(fd, hdr, (size_t)m);
-                        (void)write_all(fd, body_json, bl);
-                    }
-                }
+static void handler_resume_job(void *arg) {
+    HandlerPending *p = (HandlerPending *)arg;
+    HandlerContext *ctx = p->ctx;
+    if (p->follow) payment_followed(p->request_id, &p->res);
+    else payment_end(&p->pt, p->rc, &p->res);
+    if (p->lead == 1) singleflight_end(p->request_id, &p->res, sizeof(p->res));
+    ReplyBuf rb;
+    reply_init(&rb, ctx->client_fd);
+    ctx->reply = &rb;
+    write_payment_reply(ctx, &p->to, &p->res);
+    if (reply_flush(&rb) != 0) ctx->want_close = 1;
+    ctx->reply = NULL;
+    ctx->pending = NULL;
+    free(p);
+    metrics_payment_resumed();
+    ctx->resume(ctx);
+}
 
-                // reset http body state
-                http_is_secure_tx = 0; http_body_used = 0; http_content_length = -1; // body_remaining already 0
-                continue;
-            }
+void handler_job(void *arg) {
+    HandlerContext *ctx = (HandlerContext *)arg;
+    if (!ctx) return;
+    int fd = ctx->client_fd;
+
+    // [ANCHOR:HANDLER_TIMEOUTS]
+    // 1) Set simple read/write timeouts to avoid hanging forever (keep-alive friendly)
+    // Control-lane connections (probes) are one-shot: a short read timeout
+    // keeps a reserved control worker from idling on an open socket
+    struct timeval tv;
+    tv.tv_sec = 5; tv.tv_usec = 0;
+    if (ctx->lane == THREADPOOL_LANE_CONTROL) { tv.tv_sec = 0; tv.tv_usec = 200000; }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    // [ANCHOR:HANDLER_BUFFER]
+    // VN: Bộ đệm đọc theo dòng (newline-delimited). 8192 là giới hạn để chống DoS dòng quá dài.
+    char buf[HANDLER_BUF_SIZE];
+    size_t used = 0;
+    int first = 1;
 
-        // [ANCHOR:HANDLER_PARTIAL_REMAINDER]
-        // Move remaining partial data to the front (giữ phần chưa hoàn thành ở đầu buffer)
-        size_t remain = (buf + used) - start;
-        if (remain > 0 && start != buf) memmove(buf, start, remain);
-        used = remain;
-        if (used == sizeof(buf) - 1) {
-            // Too long line; reset buffer to avoid overflow
-            used = 0;
+    // [ANCHOR:HANDLER_READ_LOOP]
+    for (;;) {
+        // Read more data
+        ssize_t n = read(fd, buf + used, sizeof(buf) - 1 - used);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // timeout or error: close connection
+            break;
         }
+        if (n == 0) {
+            // client closed
+            break;
+        }
+        // First batch keeps the accept-time deadline (queue wait counts);
+        // later reads start a fresh budget
+        if (first) first = 0; else handler_mark_received(ctx, threadpool_now_ns());
+        used = handler_consume(ctx, buf, used + (size_t)n);
+        ctx->expired = 0;
+        if (ctx->want_close) break;
     }
-    }
-    
+
     // [ANCHOR:HANDLER_CLOSE] Đóng socket và giải phóng context
     if (fd >= 0) close(fd);
+    metrics_conn_closed();
+    handler_context_release(ctx);
     free(ctx);
-    
+
     // Note: coordinator is thread-local and will be cleaned up when thread exits
 }
+
+void handler_job_expired(void *arg) {
+    HandlerContext *ctx = (HandlerContext *)arg;
+    if (!ctx) return;
+    ctx->expired = 1;
+    handler_job(ctx);
+}
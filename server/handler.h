@@ -1,19 +1,152 @@
 #pragma once
 
+#include <stddef.h>
 #include "db.h"
 
+struct ThreadPool;
+struct ReplyBuf;
+struct HandlerPending;
+
+// Per-connection read buffer size (anti-DoS cap for one line)
+#define HANDLER_BUF_SIZE 8192
+
+/**
+ * Wire protocol of a connection, fixed by the listener that accepted it.
+ */
+typedef enum {
+    HANDLER_PROTO_LINE = 0,    ///< PORT: JSON lines, control lines and HTTP/1.x
+    HANDLER_PROTO_ISO8583 = 1  ///< ISO8583_PORT: length-prefixed binary ISO 8583 (iso8583_wire.h)
+} HandlerProto;
+
 /**
  * Context passed to each connection handler job.
+ *
+ * Besides the socket and shared resources it carries the per-connection
+ * protocol state (HTTP header/body collection), so a connection can be
+ * resumed by any worker: the blocking handler_job() keeps it for the whole
+ * connection, the epoll reactor in net.c keeps it between submitted frames.
  */
 typedef struct HandlerContext {
     int client_fd;        ///< Socket file descriptor
     DBConnection *db;     ///< Shared database connection
     const char *api_token;///< Optional API token for secure endpoints
+    struct ThreadPool *pool; ///< Pool serving this connection (for /metrics)
+    int proto;            ///< HandlerProto (set by the listener after handler_context_init)
+
+    // HTTP/1.x request state (every route; requests may be pipelined)
+    int http_collecting;        ///< inside HTTP header collection
+    int http_route;             ///< route of the request being collected (handler.c HttpRoute)
+    int http_keep_alive;        ///< 1.1 default / "Connection: keep-alive"; 0 → close after the response
+    int http_chunked;           ///< Transfer-Encoding seen (unsupported → 501 + close)
+    char http_target[128];      ///< request target (path + query)
+    char http_authz[256];       ///< Authorization header value
+    long http_content_length;   ///< Content-Length (-1 = none)
+    long http_body_remaining;   ///< remaining bytes to read for body
+    size_t http_body_used;      ///< collected body bytes
+    char *http_body;            ///< body buffer (HANDLER_BUF_SIZE, allocated on first body)
+    int want_close;             ///< last response said "Connection: close": owner closes the socket
+    struct ReplyBuf *reply;     ///< response queue while handler_consume() runs (reply.h)
+
+    // Request deadline (REQUEST_BUDGET_MS / JSON "deadline_ms")
+    int budget_ms;              ///< server budget per received batch (0 = none)
+    long long recv_ns;          ///< when the frames being consumed arrived (threadpool_now_ns)
+    long long deadline_ns;      ///< recv_ns + budget_ms (0 = none)
+    int expired;                ///< set by the pool's expire path: decline payments as timeout
+    int lane;                   ///< ThreadPoolLane the current job was submitted to
+
+    // Batch authorization (handler.c [ANCHOR:HANDLER_BATCH])
+    int batch_max;              ///< most items per batch (BATCH_MAX; 0 = batches declined)
+    int iso_batch;              ///< ISO8583_BATCH: pipelined ISO 8583 requests run as one batch
+
+    // Suspended payment (DB_ASYNC, handler.c [ANCHOR:HANDLER_SUSPEND])
+    void (*resume)(struct HandlerContext *ctx); ///< set by an owner that can wait without a worker (reactor)
+    struct HandlerPending *pending;             ///< payment handler_suspend() is to start, NULL = none
 } HandlerContext;
 
 /**
- * Execute a single connection handler job.
+ * Initialize a context for a freshly accepted connection.
+ */
+void handler_context_init(HandlerContext *ctx, int fd, DBConnection *db,
+                          const char *api_token, struct ThreadPool *pool);
+
+/**
+ * Record that new frames arrived at now_ns (threadpool_now_ns()) and derive
+ * ctx->deadline_ns from ctx->budget_ms.
+ */
+void handler_mark_received(HandlerContext *ctx, long long now_ns);
+
+/**
+ * Release per-connection buffers owned by the context (does not close the fd).
+ */
+void handler_context_release(HandlerContext *ctx);
+
+/**
+ * Return 1 if buf[0..used) holds at least one complete frame for this
+ * connection (a newline-terminated line, the rest of a pending HTTP body, or
+ * a whole length-prefixed ISO 8583 message; an invalid length also counts,
+ * so that handler_consume() rejects it).
+ */
+int handler_has_frame(const HandlerContext *ctx, const char *buf, size_t used);
+
+/**
+ * Cheap priority classification for the acceptor: THREADPOOL_LANE_CONTROL
+ * when buf[0..used) holds only complete control-plane requests (GET /healthz,
+ * /readyz, /metrics, /version, as lines or HTTP requests without a body) and
+ * no HTTP request is in progress, else
+ * THREADPOOL_LANE_DEFAULT. A trailing partial line counts as payment
+ * traffic unless allow_partial is set (the reactor keeps partial tails for
+ * a later job; a blocking connection would process them in this one).
+ */
+int handler_frame_lane(const HandlerContext *ctx, const char *buf, size_t used, int allow_partial);
+
+/// Room handler_busy_reply() needs in out
+#define HANDLER_BUSY_REPLY_MAX 512
+
+/**
+ * Fast-fail reply for a connection the pool cannot take, written to out
+ * (cap >= HANDLER_BUSY_REPLY_MAX): an HTTP 503 (Connection: close) when
+ * buf[0..used) starts an HTTP request or one is in progress, the response to
+ * the first ISO 8583 message with response code 91 on ISO8583_PORT, else the
+ * JSON line {"status":"DECLINED","reason":"server_busy"}.
+ * Returns the reply length (0: no complete ISO 8583 message to answer).
+ */
+size_t handler_busy_reply(const HandlerContext *ctx, const char *buf, size_t used, char *out, size_t cap);
+
+/**
+ * Process every complete frame in buf[0..used) and write the responses to
+ * ctx->client_fd, in request order (pipelined HTTP requests and ISO 8583
+ * messages included), with one writev for all of them while they fit the
+ * reply queue (reply.h). A failed write sets ctx->want_close. The
+ * unprocessed tail is moved to the front of buf. Once a response carried
+ * "Connection: close", ctx->want_close is set, the rest is dropped and the
+ * caller must close the connection.
+ *
+ * @param buf Buffer of HANDLER_BUF_SIZE bytes; buf[used] must be writable
+ * @return Number of bytes left in buf (partial frame)
+ */
+size_t handler_consume(HandlerContext *ctx, char *buf, size_t used);
+
+/**
+ * Call after handler_consume() once the returned length is stored. When
+ * ctx->resume is set (DB_ASYNC), a single payment may have been suspended
+ * instead of answered: its frames are consumed, the frames after it are
+ * left in buf. Then this starts its 2PC and returns 1; the connection
+ * stays with the payment (do not re-arm, read or touch buf) until a pool
+ * worker has written the answer and calls ctx->resume(ctx), whose owner
+ * consumes buf again. Returns 0 when nothing was suspended.
+ */
+int handler_suspend(HandlerContext *ctx);
+
+/**
+ * Execute a single connection handler job (blocking read loop).
  *
  * @param arg Pointer to HandlerContext (cast from void *)
  */
 void handler_job(void *arg);
+
+/**
+ * Expire path of handler_job for threadpool_submit_deadline(): the
+ * connection waited in the queue past its deadline, so payments on the
+ * first batch are declined with reason "timeout" (control routes still answer).
+ */
+void handler_job_expired(void *arg);
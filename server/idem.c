@@ -0,0 +1,197 @@
+/*
+ * Idempotency cache (EN + VN)
+ *
+ *   request_id ──FNV-1a──► shard (64, own mutex) ──► bucket chain ──► slot
+ *                                                   slots[] swept by the CLOCK hand
+ *
+ *  EN: A retry used to cost a whole 2PC: BEGIN, INSERT ... ON CONFLICT DO
+ *      NOTHING, a second SELECT on conflict, PREPARE and COMMIT PREPARED. The
+ *      handler now asks this cache first and fills it after a commit. Each
+ *      shard owns a fixed slot array sized from IDEM_CACHE_KB, so memory never
+ *      grows past the budget. A slot is reused when it expired (IDEM_CACHE_TTL_S)
+ *      or, with CLOCK, when its reference bit is clear: a hit sets the bit, the
+ *      hand clears it on the way, so outcomes that are never retried go first.
+ *  VN: Cache request_id → (status, txn_id) chia 64 shard; mỗi shard có mảng slot
+ *      cố định (không vượt ngân sách bộ nhớ), thay thế theo CLOCK + hết hạn TTL.
+ */
+#include "idem.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IDEM_SHARDS 64
+
+typedef struct {
+    uint64_t hash;
+    int64_t expires_s;       // monotonic seconds
+    int32_t next;            // bucket chain (-1 = end)
+    uint8_t ref;             // CLOCK reference bit
+    char status[15];
+    char key[IDEM_KEY_MAX];
+    char txn_id[IDEM_TXN_MAX];
+} IdemEntry;
+
+typedef struct {
+    pthread_mutex_t mu;
+    IdemEntry *slots;
+    int32_t *heads;          // bucket → first slot (-1 = empty)
+    uint32_t mask;           // buckets - 1
+    uint32_t cap;
+    uint32_t used;           // slots handed out so far (never shrinks)
+    uint32_t hand;
+} __attribute__((aligned(64))) IdemShard;
+
+static IdemShard g_shards[IDEM_SHARDS];
+static int g_enabled = 0;
+static int g_ttl_s = IDEM_DEFAULT_TTL_S;
+
+static volatile unsigned long g_hits = 0;
+static volatile unsigned long g_misses = 0;
+static volatile unsigned long g_inserts = 0;
+static volatile unsigned long g_evictions = 0;
+
+static uint64_t fnv1a(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    return h;
+}
+
+static int64_t now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (int64_t)ts.tv_sec;
+}
+
+int idem_init(size_t budget_bytes, int ttl_s) {
+    idem_shutdown();
+    if (ttl_s > 0) g_ttl_s = ttl_s;
+    if (budget_bytes == 0) return 0;
+    // Worst case the bucket array is twice the slot count (next power of two)
+    size_t per_shard = budget_bytes / IDEM_SHARDS;
+    size_t cap = per_shard / (sizeof(IdemEntry) + 2 * sizeof(int32_t));
+    if (cap < 1) cap = 1;
+    if (cap > (1u << 24)) cap = 1u << 24;
+    uint32_t buckets = 1;
+    while (buckets < cap) buckets <<= 1;
+    for (int s = 0; s < IDEM_SHARDS; ++s) {
+        IdemShard *sh = &g_shards[s];
+        sh->slots = calloc(cap, sizeof(IdemEntry));
+        sh->heads = malloc(buckets * sizeof(int32_t));
+        if (!sh->slots || !sh->heads) {
+            fprintf(stderr, "idem: cannot allocate %zu bytes, cache off\n", budget_bytes);
+            idem_shutdown();
+            return -1;
+        }
+        memset(sh->heads, 0xff, buckets * sizeof(int32_t));
+        pthread_mutex_init(&sh->mu, NULL);
+        sh->mask = buckets - 1;
+        sh->cap = (uint32_t)cap;
+        sh->used = 0;
+        sh->hand = 0;
+    }
+    g_enabled = 1;
+    return 0;
+}
+
+void idem_shutdown(void) {
+    for (int s = 0; s < IDEM_SHARDS; ++s) {
+        IdemShard *sh = &g_shards[s];
+        if (g_enabled) pthread_mutex_destroy(&sh->mu);
+        free(sh->slots);
+        free(sh->heads);
+        memset(sh, 0, sizeof(*sh));
+    }
+    g_enabled = 0;
+}
+
+// Slot holding key in sh, or -1. Caller holds sh->mu.
+static int32_t shard_find(const IdemShard *sh, uint64_t h, const char *key) {
+    for (int32_t i = sh->heads[(h >> 32) & sh->mask]; i >= 0; i = sh->slots[i].next) {
+        if (sh->slots[i].hash == h && strcmp(sh->slots[i].key, key) == 0) return i;
+    }
+    return -1;
+}
+
+static void shard_unlink(IdemShard *sh, int32_t idx) {
+    int32_t *link = &sh->heads[(sh->slots[idx].hash >> 32) & sh->mask];
+    while (*link >= 0 && *link != idx) link = &sh->slots[*link].next;
+    if (*link == idx) *link = sh->slots[idx].next;
+}
+
+// [ANCHOR:IDEM_CLOCK] Free slot, or one reclaimed by the CLOCK hand: expired
+// first come, then the first entry whose reference bit is already clear
+static int32_t shard_victim(IdemShard *sh, int64_t now) {
+    if (sh->used < sh->cap) return (int32_t)sh->used++;
+    for (;;) {
+        int32_t idx = (int32_t)sh->hand;
+        IdemEntry *e = &sh->slots[idx];
+        sh->hand = sh->hand + 1 == sh->cap ? 0 : sh->hand + 1;
+        if (e->expires_s > now && e->ref) {
+            e->ref = 0;
+            continue;
+        }
+        if (e->expires_s > now) __sync_fetch_and_add(&g_evictions, 1);
+        shard_unlink(sh, idx);
+        return idx;
+    }
+}
+
+int idem_get(const char *request_id, char *status, char *txn_id, size_t cap) {
+    if (!g_enabled || !request_id || !request_id[0] || strlen(request_id) >= IDEM_KEY_MAX) return 0;
+    uint64_t h = fnv1a(request_id);
+    IdemShard *sh = &g_shards[h % IDEM_SHARDS];
+    int hit = 0;
+    pthread_mutex_lock(&sh->mu);
+    int32_t idx = shard_find(sh, h, request_id);
+    if (idx >= 0 && sh->slots[idx].expires_s > now_s()) {
+        IdemEntry *e = &sh->slots[idx];
+        e->ref = 1;
+        if (status) snprintf(status, cap, "%s", e->status);
+        if (txn_id) snprintf(txn_id, cap, "%s", e->txn_id);
+        hit = 1;
+    }
+    pthread_mutex_unlock(&sh->mu);
+    __sync_fetch_and_add(hit ? &g_hits : &g_misses, 1);
+    return hit;
+}
+
+void idem_put(const char *request_id, const char *status, const char *txn_id) {
+    if (!g_enabled || !request_id || !request_id[0] || strlen(request_id) >= IDEM_KEY_MAX) return;
+    uint64_t h = fnv1a(request_id);
+    IdemShard *sh = &g_shards[h % IDEM_SHARDS];
+    int64_t now = now_s();
+    pthread_mutex_lock(&sh->mu);
+    int32_t idx = shard_find(sh, h, request_id);
+    if (idx < 0) {
+        idx = shard_victim(sh, now);
+        IdemEntry *e = &sh->slots[idx];
+        e->hash = h;
+        e->ref = 0; // a retry sets it; never-retried outcomes are the first to go
+        snprintf(e->key, sizeof(e->key), "%s", request_id);
+        int32_t *head = &sh->heads[(h >> 32) & sh->mask];
+        e->next = *head;
+        *head = idx;
+    }
+    IdemEntry *e = &sh->slots[idx];
+    e->expires_s = now + g_ttl_s;
+    snprintf(e->status, sizeof(e->status), "%s", status ? status : "");
+    snprintf(e->txn_id, sizeof(e->txn_id), "%s", txn_id ? txn_id : "");
+    pthread_mutex_unlock(&sh->mu);
+    __sync_fetch_and_add(&g_inserts, 1);
+}
+
+void idem_stats(IdemStats *out) {
+    out->hits = g_hits;
+    out->misses = g_misses;
+    out->inserts = g_inserts;
+    out->evictions = g_evictions;
+    out->entries = 0;
+    out->capacity = 0;
+    for (int s = 0; s < IDEM_SHARDS; ++s) {
+        out->entries += __atomic_load_n(&g_shards[s].used, __ATOMIC_RELAXED);
+        out->capacity += g_shards[s].cap;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+// Idempotency cache: final outcome per request_id, in front of the DB
+// VN: Bộ nhớ đệm idempotency theo request_id (chia shard, có TTL, giới hạn bộ
+//     nhớ, thay thế kiểu CLOCK). Yêu cầu lặp lại (retry) được trả lời từ RAM
+//     thay vì đi hết 2PC + INSERT ... ON CONFLICT + SELECT xuống PostgreSQL.
+
+/// Default memory budget (IDEM_CACHE_KB)
+#define IDEM_DEFAULT_KB 8192
+/// Default time an outcome stays cached (IDEM_CACHE_TTL_S)
+#define IDEM_DEFAULT_TTL_S 600
+/// Longest request_id / txn_id that is cached (longer ids always go to the DB)
+#define IDEM_KEY_MAX 64
+#define IDEM_TXN_MAX 64
+
+/// Totals since start (GET /metrics)
+typedef struct {
+    unsigned long hits;      ///< answered from the cache
+    unsigned long misses;    ///< looked up, not cached (or expired)
+    unsigned long inserts;   ///< outcomes stored
+    unsigned long evictions; ///< live entries dropped to make room (CLOCK)
+    unsigned long entries;   ///< entries held now (live or expired, not yet reclaimed)
+    unsigned long capacity;  ///< entries that fit the budget
+} IdemStats;
+
+/**
+ * Size the cache for budget_bytes (entries + index; 0 = off) keeping outcomes
+ * for ttl_s seconds. Call once at startup, before workers run. Returns 0, or
+ * -1 when the memory cannot be allocated (the cache stays off).
+ */
+int idem_init(size_t budget_bytes, int ttl_s);
+
+/**
+ * Look up request_id. On a hit copies the stored status and txn_id (cap bytes
+ * each, NUL-terminated) and returns 1; returns 0 on a miss or when the cache
+ * is off. Thread-safe.
+ */
+int idem_get(const char *request_id, char *status, char *txn_id, size_t cap);
+
+// Store the committed outcome of request_id (replaces an older one). Ids
+// longer than IDEM_KEY_MAX - 1 are not cached. Thread-safe.
+void idem_put(const char *request_id, const char *status, const char *txn_id);
+
+void idem_stats(IdemStats *out);
+
+// Free the cache (at shutdown, after workers stopped)
+void idem_shutdown(void);
@@ -1,62 +1,517 @@
 #include "iso8583.h"
+#include "simdscan.h"
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-// naive JSON "key":"value" or numeric extractor (local copy)
-static int jget(const char *buf, const char *key, char *out, size_t outsz) {
-    char pattern[64];
-    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-    const char *p = strstr(buf, pattern);
-    if (!p) return -1;
-    p = strchr(p + strlen(pattern), ':');
-    if (!p) return -1;
-    p++;
-    while (*p && isspace((unsigned char)*p)) p++;
-    if (*p == '"') {
-        p++;
-        const char *q = strchr(p, '"');
-        if (!q) return -1;
-        size_t len = (size_t)(q - p);
-        if (len >= outsz) len = outsz - 1;
-        memcpy(out, p, len);
-        out[len] = '\0';
-        return 0;
+/*
+ * Single-pass request tokenizer (EN + VN)
+ *
+ *   {"pan":"4111...","amount":"10.00","request_id":"r1"}
+ *    ^key  ^value     ^key     ^value  ...               one left-to-right walk
+ *
+ * EN: The object is walked once, without allocation. Each top-level key is
+ *     dispatched on (length, first char) and confirmed with one memcmp;
+ *     values of unknown keys (including nested objects/arrays) are skipped,
+ *     so "pan" inside another field's string never matches. The first
+ *     occurrence of a duplicated key wins. Fields are recorded as views into
+ *     the line: iso_parse_request_line() copies them into IsoRequest (too-long
+ *     values truncated, as before), iso_parse_request_insitu() terminates them
+ *     in the line itself so the server never copies a field.
+ *     Fast path: simdscan_structural() (AVX2/SSE2) lists the structural
+ *     characters first and parse_indexed() jumps between them; anything it
+ *     does not recognise as well-formed (escapes, odd spacing inside values,
+ *     malformed input) is re-parsed by the byte-wise parse_scalar(), so both
+ *     paths accept exactly the same requests (SIMD_SCAN=scalar: byte-wise only).
+ * VN: Duyệt chuỗi đúng một lần, không cấp phát; chọn trường theo (độ dài key,
+ *     ký tự đầu) thay vì strstr từng key trên cả dòng → O(độ dài dòng) và không
+ *     khớp nhầm key nằm trong giá trị chuỗi.
+ */
+
+enum {
+    ISO_KEY_PAN = 1 << 0,
+    ISO_KEY_AMOUNT = 1 << 1,
+    ISO_KEY_CURRENCY = 1 << 2,
+    ISO_KEY_REQUEST_ID = 1 << 3,
+    ISO_KEY_TYPE = 1 << 4,
+    ISO_KEY_DEADLINE = 1 << 5
+};
+
+static int is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char *skip_ws(const char *p) {
+    while (is_ws(*p)) p++;
+    return p;
+}
+
+// Key → field bit (0 = not ours)
+static int key_id(const char *k, size_t n) {
+    switch (n) {
+    case 3: return (k[0] == 'p' && memcmp(k, "pan", 3) == 0) ? ISO_KEY_PAN : 0;
+    case 4: return (k[0] == 't' && memcmp(k, "type", 4) == 0) ? ISO_KEY_TYPE : 0;
+    case 6: return (k[0] == 'a' && memcmp(k, "amount", 6) == 0) ? ISO_KEY_AMOUNT : 0;
+    case 8: return (k[0] == 'c' && memcmp(k, "currency", 8) == 0) ? ISO_KEY_CURRENCY : 0;
+    case 10: return (k[0] == 'r' && memcmp(k, "request_id", 10) == 0) ? ISO_KEY_REQUEST_ID : 0;
+    case 11: return (k[0] == 'd' && memcmp(k, "deadline_ms", 11) == 0) ? ISO_KEY_DEADLINE : 0;
+    default: return 0;
+    }
+}
+
+// p at the opening quote. Returns the char after the closing quote (NULL if
+// unterminated); the raw contents are [*s, *s + *n), escapes left in place.
+static const char *scan_string(const char *p, const char **s, size_t *n) {
+    const char *q = ++p;
+    for (;;) {
+        if (*q == '"') break;
+        if (*q == '\0') return NULL;
+        if (*q == '\\') {
+            if (q[1] == '\0') return NULL;
+            q++;
+        }
+        q++;
     }
+    *s = p;
+    *n = (size_t)(q - p);
+    return q + 1;
+}
+
+// Scalar (number / true / false / null): up to the next separator
+static const char *scan_scalar(const char *p, const char **s, size_t *n) {
     const char *q = p;
-    while (*q && *q != ',' && *q != '}' && !isspace((unsigned char)*q)) q++;
-    size_t len = (size_t)(q - p);
-    if (len == 0) return -1;
-    if (len >= outsz) len = outsz - 1;
-    memcpy(out, p, len);
-    out[len] = '\0';
+    while (*q && *q != ',' && *q != '}' && *q != ']' && !is_ws(*q)) q++;
+    *s = p;
+    *n = (size_t)(q - p);
+    return q;
+}
+
+// Nested object/array value: skip to its matching bracket (strings respected)
+static const char *skip_nested(const char *p) {
+    int depth = 0;
+    for (;;) {
+        char c = *p;
+        if (c == '\0') return NULL;
+        if (c == '"') {
+            const char *s;
+            size_t n;
+            if ((p = scan_string(p, &s, &n)) == NULL) return NULL;
+            continue;
+        }
+        if (c == '{' || c == '[') depth++;
+        else if ((c == '}' || c == ']') && --depth == 0) return p + 1;
+        p++;
+    }
+}
+
+// Copy a string value, undoing simple escapes (\" \\ \/); others stay raw
+static void copy_string(char *out, size_t outsz, const char *s, size_t n) {
+    size_t o = 0;
+    for (size_t i = 0; i < n && o + 1 < outsz; ++i) {
+        if (s[i] == '\\' && i + 1 < n && (s[i + 1] == '"' || s[i + 1] == '\\' || s[i + 1] == '/')) i++;
+        out[o++] = s[i];
+    }
+    out[o] = '\0';
+}
+
+static void copy_scalar(char *out, size_t outsz, const char *s, size_t n) {
+    if (n >= outsz) n = outsz - 1;
+    memcpy(out, s, n);
+    out[n] = '\0';
+}
+
+static IsoMsgType parse_type(const char *s, size_t n) {
+    switch (n) {
+    case 6: if (memcmp(s, "REFUND", 6) == 0) return ISO_MSG_REFUND; break;
+    case 7: if (memcmp(s, "CAPTURE", 7) == 0) return ISO_MSG_CAPTURE; break;
+    case 8: if (memcmp(s, "REVERSAL", 8) == 0) return ISO_MSG_REVERSAL; break;
+    default: break;
+    }
+    return ISO_MSG_AUTH;
+}
+
+static int parse_fail(char *err_reason, size_t errsz, const char *why) {
+    if (err_reason && errsz) snprintf(err_reason, errsz, "%s", why);
+    return -1;
+}
+
+static const char k_empty[] = "";
+
+static void reset_view(IsoRequestView *out) {
+    out->pan = out->amount = out->currency = out->request_id = (IsoStr){k_empty, 0};
+    out->amount_minor = -1;
+    out->amount_exp = 2;
+    out->type = ISO_MSG_AUTH; // default
+    out->deadline_ms = 0;
+}
+
+static IsoStr *view_field(IsoRequestView *v, int id, size_t *cap) {
+    switch (id) {
+    case ISO_KEY_PAN: *cap = sizeof(((IsoRequest *)0)->pan); return &v->pan;
+    case ISO_KEY_AMOUNT: *cap = sizeof(((IsoRequest *)0)->amount_text); return &v->amount;
+    case ISO_KEY_CURRENCY: *cap = sizeof(((IsoRequest *)0)->currency); return &v->currency;
+    case ISO_KEY_REQUEST_ID: *cap = sizeof(((IsoRequest *)0)->request_id); return &v->request_id;
+    default: return NULL;
+    }
+}
+
+// Record one field value (first occurrence only) as a raw view into the
+// line; quoted string values are marked in *quoted (escapes still in place)
+static void assign_field(IsoRequestView *out, unsigned *seen, unsigned *quoted, int id, int q,
+                         const char *v, size_t vn) {
+    if (!id || (*seen & (unsigned)id)) return;
+    *seen |= (unsigned)id;
+    switch (id) {
+    case ISO_KEY_TYPE:
+        out->type = parse_type(v, vn);
+        break;
+    case ISO_KEY_DEADLINE: {
+        char num[24];
+        copy_scalar(num, sizeof(num), v, vn);
+        long d = strtol(num, NULL, 10);
+        out->deadline_ms = d > 0 ? d : 0;
+        break;
+    }
+    default: {
+        size_t cap;
+        IsoStr *f = view_field(out, id, &cap);
+        if (!f) break;
+        f->p = v;
+        f->n = vn;
+        if (q) *quoted |= (unsigned)id;
+        break;
+    }
+    }
+}
+
+// Byte-wise tokenizer; returns the seen-key mask, -1 on malformed input
+static int parse_scalar(const char *line, IsoRequestView *out, unsigned *quoted) {
+    const char *p = skip_ws(line);
+    if (*p != '{') return -1;
+    p = skip_ws(p + 1);
+    unsigned seen = 0;
+    if (*p != '}') {
+        for (;;) {
+            const char *k, *v;
+            size_t kn, vn;
+            if (*p != '"' || (p = scan_string(p, &k, &kn)) == NULL) return -1;
+            p = skip_ws(p);
+            if (*p != ':') return -1;
+            p = skip_ws(p + 1);
+            int id = key_id(k, kn);
+            int q = *p == '"';
+            if (q) {
+                p = scan_string(p, &v, &vn);
+            } else if (*p == '{' || *p == '[') {
+                p = skip_nested(p);
+                id = 0; // never a field value
+                v = NULL;
+                vn = 0;
+            } else {
+                p = scan_scalar(p, &v, &vn);
+                if (vn == 0) return -1;
+            }
+            if (!p) return -1;
+            assign_field(out, &seen, quoted, id, q, v, vn);
+            p = skip_ws(p);
+            if (*p == ',') {
+                p = skip_ws(p + 1);
+                continue;
+            }
+            if (*p == '}') break;
+            return -1;
+        }
+    }
+    return (int)seen; // anything after the closing brace is ignored
+}
+
+static int all_ws(const char *p, const char *end) {
+    for (; p < end; ++p) {
+        if (!is_ws(*p)) return 0;
+    }
+    return 1;
+}
+
+// Tokenizer over the structural index (see simdscan.h): returns the seen-key
+// mask, or -1 when the request needs parse_scalar()
+static int parse_indexed(const char *s, const uint32_t *ix, size_t nt, IsoRequestView *out) {
+    if (nt == 0 || s[ix[0]] != '{' || !all_ws(s, s + ix[0])) return -1;
+    unsigned seen = 0;
+    size_t t = 1;
+    const char *prev = s + ix[0] + 1; // end of the last token consumed
+    if (t < nt && s[ix[t]] == '}' && all_ws(prev, s + ix[t])) return 0;
+    for (;;) {
+        // "key" :
+        if (t + 2 >= nt) return -1;
+        const char *ko = s + ix[t], *kc = s + ix[t + 1], *colon = s + ix[t + 2];
+        if (*ko != '"' || *colon != ':' || !all_ws(prev, ko) || !all_ws(kc + 1, colon)) return -1;
+        t += 3;
+        int id = key_id(ko + 1, (size_t)(kc - ko - 1));
+        const char *v = colon + 1, *after;
+        size_t vn = 0;
+        if (t >= nt) return -1;
+        const char *tok = s + ix[t];
+        if (*tok == '"') {
+            // opening quote → next index entry is its closing quote (no escapes here)
+            if (t + 1 >= nt || !all_ws(colon + 1, tok)) return -1;
+            v = tok + 1;
+            vn = (size_t)(s + ix[t + 1] - v);
+            after = s + ix[t + 1] + 1;
+            t += 2;
+        } else if (*tok == '{' || *tok == '[') {
+            if (!all_ws(colon + 1, tok)) return -1;
+            int depth = 0;
+            for (; t < nt; ++t) {
+                char d = s[ix[t]];
+                if (d == '{' || d == '[') depth++;
+                else if ((d == '}' || d == ']') && --depth == 0) break;
+            }
+            if (t >= nt) return -1;
+            after = s + ix[t] + 1;
+            t++;
+            id = 0; // never a field value
+        } else if (*tok == ',' || *tok == '}') {
+            // scalar between ':' and the separator: one word, optional spaces around
+            while (v < tok && is_ws(*v)) v++;
+            const char *e = v;
+            while (e < tok && !is_ws(*e)) e++;
+            if (e == v || !all_ws(e, tok)) return -1;
+            vn = (size_t)(e - v);
+            after = tok;
+        } else {
+            return -1;
+        }
+        unsigned none = 0;
+        assign_field(out, &seen, &none, id, 0, v, vn); // no escapes on this path: strings are raw
+        // , or }
+        if (t >= nt) return -1;
+        const char *sep = s + ix[t];
+        if (!all_ws(after, sep)) return -1;
+        t++;
+        prev = sep + 1;
+        if (*sep == '}') return (int)seen;
+        if (*sep != ',') return -1;
+    }
+}
+
+// [ANCHOR:ISO_AMOUNT] Fixed-point amounts (see iso8583.h)
+static const IsoCurrency k_currencies[] = {
+    {840, "USD", 2}, {978, "EUR", 2}, {826, "GBP", 2}, {392, "JPY", 0}, {704, "VND", 0},
+};
+
+const IsoCurrency *iso_currency_by_num(int num) {
+    for (size_t i = 0; i < sizeof(k_currencies) / sizeof(k_currencies[0]); ++i)
+        if (k_currencies[i].num == num) return &k_currencies[i];
+    return NULL;
+}
+
+const IsoCurrency *iso_currency_by_alpha(const char *alpha, size_t n) {
+    if (n != 3) return NULL;
+    for (size_t i = 0; i < sizeof(k_currencies) / sizeof(k_currencies[0]); ++i)
+        if (memcmp(k_currencies[i].alpha, alpha, 3) == 0) return &k_currencies[i];
+    return NULL;
+}
+
+int64_t iso_amount_scale(int exponent) {
+    static const int64_t k_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    return exponent >= 0 && exponent <= 6 ? k_pow10[exponent] : 0;
+}
+
+int iso_amount_parse(const char *p, size_t n, int exponent, int64_t *minor) {
+    int64_t scale = iso_amount_scale(exponent);
+    if (!scale) return -1;
+    size_t i = 0, int_digits = 0;
+    int64_t v = 0;
+    for (; i < n && p[i] >= '0' && p[i] <= '9'; ++i, ++int_digits) {
+        if (int_digits == 12) return -1; // 10^12 * 10^6 still fits in int64
+        v = v * 10 + (p[i] - '0');
+    }
+    int64_t frac = 0;
+    size_t frac_digits = 0;
+    if (i < n && p[i] == '.') {
+        for (++i; i < n && p[i] >= '0' && p[i] <= '9'; ++i, ++frac_digits) {
+            if ((int)frac_digits < exponent) frac = frac * 10 + (p[i] - '0');
+            else if (p[i] != '0') return -1; // finer than the currency's minor unit
+        }
+    }
+    if (i != n || int_digits + frac_digits == 0) return -1;
+    for (size_t k = frac_digits; (int)k < exponent; ++k) frac *= 10;
+    *minor = v * scale + frac;
+    return 0;
+}
+
+int iso_amount_format(int64_t minor, int exponent, char *out, size_t cap) {
+    int64_t scale = iso_amount_scale(exponent);
+    if (!scale) return -1;
+    int64_t a = minor < 0 ? -minor : minor;
+    int n = exponent ? snprintf(out, cap, "%s%lld.%0*lld", minor < 0 ? "-" : "", (long long)(a / scale), exponent,
+                                (long long)(a % scale))
+                     : snprintf(out, cap, "%lld", (long long)minor);
+    return n < 0 || (size_t)n >= cap ? -1 : n;
+}
+
+// Minor units of the parsed amount in the request's currency (once per request)
+static void view_amount(IsoRequestView *v) {
+    const IsoCurrency *c = iso_currency_by_alpha(v->currency.p, v->currency.n);
+    v->amount_exp = c ? c->exponent : 2;
+    if (iso_amount_parse(v->amount.p, v->amount.n, v->amount_exp, &v->amount_minor) != 0) v->amount_minor = -1;
+}
+
+#define ISO_MAX_TOKENS 256
+
+// Raw views of line's fields: 0, or -1 with err_reason set
+static int parse_view(const char *line, IsoRequestView *out, unsigned *quoted, char *err_reason, size_t errsz) {
+    reset_view(out);
+    *quoted = 0;
+    uint32_t ix[ISO_MAX_TOKENS];
+    size_t nt = simdscan_structural(line, strlen(line), ix, ISO_MAX_TOKENS);
+    int seen = nt == SIMDSCAN_FALLBACK ? -1 : parse_indexed(line, ix, nt, out);
+    if (seen < 0) {
+        reset_view(out);
+        seen = parse_scalar(line, out, quoted);
+    }
+    if (seen < 0) return parse_fail(err_reason, errsz, "bad_json");
+    // required fields
+    if (!(seen & ISO_KEY_PAN)) return parse_fail(err_reason, errsz, "missing_pan");
+    if (!(seen & ISO_KEY_AMOUNT)) return parse_fail(err_reason, errsz, "missing_amount");
     return 0;
 }
 
+static void copy_field(char *out, size_t outsz, const IsoStr *f, int quoted) {
+    if (quoted) copy_string(out, outsz, f->p, f->n);
+    else copy_scalar(out, outsz, f->p, f->n);
+}
+
 int iso_parse_request_line(const char *line, IsoRequest *out, char *err_reason, size_t errsz) {
     if (!line || !out) return -1;
-    memset(out, 0, sizeof(*out));
-    // defaults
-    out->type = ISO_MSG_AUTH;
-    // required fields
-    if (jget(line, "pan", out->pan, sizeof(out->pan)) != 0) {
-        if (err_reason && errsz) snprintf(err_reason, errsz, "missing_pan");
-        return -1;
+    IsoRequestView v;
+    unsigned quoted;
+    int rc = parse_view(line, &v, &quoted, err_reason, errsz);
+    copy_field(out->pan, sizeof(out->pan), &v.pan, quoted & ISO_KEY_PAN);
+    copy_field(out->amount_text, sizeof(out->amount_text), &v.amount, quoted & ISO_KEY_AMOUNT);
+    copy_field(out->currency, sizeof(out->currency), &v.currency, quoted & ISO_KEY_CURRENCY);
+    copy_field(out->request_id, sizeof(out->request_id), &v.request_id, quoted & ISO_KEY_REQUEST_ID);
+    // From the copied (unescaped, capped) text, exactly as the in-place parse sees it
+    const IsoCurrency *c = iso_currency_by_alpha(out->currency, strlen(out->currency));
+    out->amount_exp = c ? c->exponent : 2;
+    if (rc != 0 || iso_amount_parse(out->amount_text, strlen(out->amount_text), out->amount_exp, &out->amount_minor) != 0)
+        out->amount_minor = -1;
+    out->type = v.type;
+    out->deadline_ms = v.deadline_ms;
+    return rc;
+}
+
+// Unescape (quoted) and cap one field where it lies, then terminate it. The
+// byte after a value is its closing quote or a separator, never part of
+// another field, so terminating fields one by one cannot clobber a neighbour.
+static void seal_field(char *line, IsoStr *f, int quoted, size_t cap) {
+    if (f->p == k_empty) return;
+    char *w = line + (f->p - line);
+    size_t o = 0;
+    if (quoted) {
+        for (size_t i = 0; i < f->n && o + 1 < cap; ++i) {
+            if (w[i] == '\\' && i + 1 < f->n && (w[i + 1] == '"' || w[i + 1] == '\\' || w[i + 1] == '/')) i++;
+            w[o++] = w[i];
+        }
+    } else {
+        o = f->n < cap ? f->n : cap - 1;
     }
-    if (jget(line, "amount", out->amount_text, sizeof(out->amount_text)) != 0) {
-        if (err_reason && errsz) snprintf(err_reason, errsz, "missing_amount");
+    w[o] = '\0';
+    f->p = w;
+    f->n = o;
+}
+
+int iso_parse_request_insitu(char *line, IsoRequestView *out, char *err_reason, size_t errsz) {
+    if (!line || !out) return -1;
+    unsigned quoted;
+    if (parse_view(line, out, &quoted, err_reason, errsz) != 0) {
+        reset_view(out);
         return -1;
     }
-    // optional
-    (void)jget(line, "currency", out->currency, sizeof(out->currency));
-    (void)jget(line, "request_id", out->request_id, sizeof(out->request_id));
-    char type_buf[32] = {0};
-    if (jget(line, "type", type_buf, sizeof(type_buf)) == 0) {
-        if (strcmp(type_buf, "AUTH") == 0) out->type = ISO_MSG_AUTH;
-        else if (strcmp(type_buf, "CAPTURE") == 0) out->type = ISO_MSG_CAPTURE;
-        else if (strcmp(type_buf, "REFUND") == 0) out->type = ISO_MSG_REFUND;
-        else if (strcmp(type_buf, "REVERSAL") == 0) out->type = ISO_MSG_REVERSAL;
+    static const int k_ids[] = {ISO_KEY_PAN, ISO_KEY_AMOUNT, ISO_KEY_CURRENCY, ISO_KEY_REQUEST_ID};
+    for (size_t i = 0; i < sizeof(k_ids) / sizeof(k_ids[0]); ++i) {
+        size_t cap;
+        IsoStr *f = view_field(out, k_ids[i], &cap);
+        seal_field(line, f, quoted & (unsigned)k_ids[i], cap);
     }
+    view_amount(out);
     return 0;
 }
 
+// [ANCHOR:ISO_BATCH] Batch requests: [{...},{...}] or {"batch":[{...},...]}
+// VN: Một dòng chứa nhiều giao dịch; tách từng object tại chỗ rồi parse như request đơn.
+static const char *batch_array(const char *p) {
+    p = skip_ws(p);
+    if (*p == '{') {
+        p = skip_ws(p + 1);
+        if (strncmp(p, "\"batch\"", 7) != 0) return NULL;
+        p = skip_ws(p + 7);
+        if (*p != ':') return NULL;
+        p = skip_ws(p + 1);
+    }
+    return *p == '[' ? p : NULL;
+}
+
+int iso_is_batch(const char *line) {
+    return line && batch_array(line) != NULL;
+}
+
+// Closing brace of the object starting at p ('{'), or NULL if the line ends first
+static char *object_end(char *p) {
+    int depth = 0, in_str = 0;
+    for (; *p; ++p) {
+        if (in_str) {
+            if (*p == '\\' && p[1]) p++;
+            else if (*p == '"') in_str = 0;
+        } else if (*p == '"') {
+            in_str = 1;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) return p;
+        }
+    }
+    return NULL;
+}
+
+static int batch_fail(char *err, size_t errsz, const char *reason) {
+    if (err && errsz) snprintf(err, errsz, "%s", reason);
+    return -1;
+}
+
+int iso_parse_batch_insitu(char *line, IsoRequestView *items, int *item_rc, size_t cap,
+                           char *err_reason, size_t errsz) {
+    if (!line || !items || !item_rc) return -1;
+    char *p = (char *)batch_array(line);
+    if (!p) return batch_fail(err_reason, errsz, "bad_batch");
+    const int wrapped = *skip_ws(line) == '{';
+    p = (char *)skip_ws(p + 1);
+    size_t n = 0;
+    for (;;) {
+        if (*p != '{') return batch_fail(err_reason, errsz, "bad_batch");
+        char *e = object_end(p);
+        if (!e) return batch_fail(err_reason, errsz, "bad_batch");
+        if (n == cap) return batch_fail(err_reason, errsz, "batch_too_large");
+        // Terminate the item for the single-request parser; its fields are
+        // sealed inside the object, so the separator can be put back after
+        char sep = e[1];
+        e[1] = '\0';
+        item_rc[n] = iso_parse_request_insitu(p, &items[n], NULL, 0);
+        e[1] = sep;
+        n++;
+        p = (char *)skip_ws(e + 1);
+        if (*p == ',') {
+            p = (char *)skip_ws(p + 1);
+            continue;
+        }
+        if (*p != ']') return batch_fail(err_reason, errsz, "bad_batch");
+        break;
+    }
+    p = (char *)skip_ws(p + 1);
+    if (wrapped) {
+        if (*p != '}') return batch_fail(err_reason, errsz, "bad_batch");
+        p = (char *)skip_ws(p + 1);
+    }
+    if (*p) return batch_fail(err_reason, errsz, "bad_batch");
+    return (int)n;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 // Minimal internal representation of an authorization-like request
 typedef enum {
@@ -15,10 +16,85 @@ typedef struct IsoRequest {
     char amount_text[64];
     char currency[8];
     char request_id[128];
+    int64_t amount_minor; // amount in minor units (see iso_amount_parse), -1 = not a valid amount
+    int amount_exp;       // minor-unit exponent of currency (2 unless ISO 4217 says otherwise)
     IsoMsgType type; // derived from processing code or JSON field `type`
+    long deadline_ms; // optional client budget from receipt (JSON `deadline_ms`), 0 = none
 } IsoRequest;
 
+// Amounts are fixed point end to end: integer minor units plus the currency's
+// exponent (10.00 USD = 1000 with exponent 2, 1000 JPY = 1000 with exponent 0).
+// Text only appears at the edges (request parsing, clearing payloads, replies).
+// VN: Số tiền là số nguyên theo đơn vị nhỏ nhất (cent) + số mũ của tiền tệ;
+//     chỉ chuyển sang chuỗi ở biên (gói tin clearing, phản hồi).
+typedef struct IsoCurrency {
+    int num;       // ISO 4217 numeric code (ISO 8583 DE49)
+    char alpha[4]; // ISO 4217 alphabetic code (JSON "currency")
+    int exponent;  // minor-unit digits
+} IsoCurrency;
+
+// Known currencies; NULL when unknown (callers then assume exponent 2)
+const IsoCurrency *iso_currency_by_num(int num);
+const IsoCurrency *iso_currency_by_alpha(const char *alpha, size_t n);
+
+// 10^exponent (exponent 0..6)
+int64_t iso_amount_scale(int exponent);
+
+// Decimal text ("10", "10.5", "10.50") → minor units for exponent. Fraction
+// digits beyond the exponent must be zeros. Returns 0, or -1 for anything
+// else (sign, exponent notation, spaces, more than 12 integer digits).
+int iso_amount_parse(const char *p, size_t n, int exponent, int64_t *minor);
+
+// Minor units → decimal text (1000, 2 → "10.00"); returns the length, or -1
+// when cap is too small
+int iso_amount_format(int64_t minor, int exponent, char *out, size_t cap);
+
+// Borrowed string: n bytes at p, and p[n] == '\0' (usable as a C string)
+typedef struct IsoStr {
+    const char *p;
+    size_t n;
+} IsoStr;
+
+// Zero-copy request: the fields point into the buffer the request arrived in
+// (or into scratch when the wire bytes cannot be terminated in place), so
+// the view is only valid while that buffer holds this request. Anything that
+// must outlive the request (reversal queue, coordinator log) copies.
+// VN: Các trường trỏ thẳng vào buffer đọc của kết nối, không sao chép;
+//     chỉ copy khi dữ liệu phải sống lâu hơn request.
+typedef struct IsoRequestView {
+    IsoStr pan;
+    IsoStr amount;     // amount text as sent ("10.00"; ISO 8583: the DE4 digits)
+    IsoStr currency;
+    IsoStr request_id; // "" when absent
+    int64_t amount_minor; // parsed once: minor units, -1 = not a valid amount
+    int amount_exp;       // minor-unit exponent of currency
+    IsoMsgType type;
+    long deadline_ms;
+    char scratch[80];  // bytes built by the decoder (ISO 8583 amount, DE41-DE11 id)
+} IsoRequestView;
+
 // Parse one newline-delimited JSON line into IsoRequest (subset fields only).
 // Returns 0 on success, non-zero on parse/validation error. On error, err_reason may be set.
 int iso_parse_request_line(const char *line, IsoRequest *out, char *err_reason, size_t errsz);
 
+// Same parser, in place: on success the view's fields point into line, each
+// terminated by overwriting the byte after it (closing quote or separator)
+// and unescaped in place, like a RapidJSON insitu parse; field lengths are
+// capped like IsoRequest's. line is only modified when 0 is returned.
+int iso_parse_request_insitu(char *line, IsoRequestView *out, char *err_reason, size_t errsz);
+
+/// Most items one batch request may carry (BATCH_MAX is capped to this)
+#define ISO_BATCH_MAX 64
+
+// 1 when line (leading whitespace allowed) is a batch request: a JSON array
+// of request objects, or an object whose first key is "batch" holding one
+int iso_is_batch(const char *line);
+
+// Split a batch in place: each item object is parsed with
+// iso_parse_request_insitu() into items[i], item_rc[i] = 0 or -1 (that item
+// is malformed, the others still count). Returns the item count (1..cap), or
+// -1 with err_reason "bad_batch" (empty, not an array of objects, trailing
+// bytes) or "batch_too_large" (more than cap items). line is modified either way.
+int iso_parse_batch_insitu(char *line, IsoRequestView *items, int *item_rc, size_t cap,
+                           char *err_reason, size_t errsz);
+
@@ -0,0 +1,336 @@
+#include "iso8583_wire.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Binary ISO 8583 codec (EN + VN)
+ *
+ *   [len hi][len lo] "0200" [bitmap 8B][bitmap 8B]? DE2 DE3 DE4 ... DE90
+ *    2-byte length    MTI    primary    secondary    fields in number order
+ *
+ * EN: ISO 8583:1987 with ASCII field values and binary bitmaps, framed by a
+ *     2-byte big-endian length (the common TCP layout). k_spec below is the
+ *     compile-time field table (length format, charset, size); the decoder
+ *     walks the bitmap bits with clz, validates each value against its spec
+ *     and records only its offset/length, then builds the IsoRequestView from
+ *     the frame: no JSON, no intermediate strings. A field not in the table
+ *     cannot be skipped (its length is unknown), so the message is rejected.
+ *     Responses (MTI + 10) echo the request's key fields plus DE38/DE39.
+ * VN: Bảng đặc tả trường cố định lúc biên dịch; giải mã duyệt bitmap, kiểm tra
+ *     từng trường theo bảng rồi dựng IsoRequestView từ khung (không qua JSON).
+ *     Phản hồi 0110/0210/0410 lặp lại các trường khoá + DE38 (mã duyệt) + DE39.
+ */
+
+typedef enum { ISO_LEN_FIXED = 0, ISO_LEN_LLVAR, ISO_LEN_LLLVAR } IsoLenFmt;
+typedef enum { ISO_CS_N = 0, ISO_CS_ANS, ISO_CS_B } IsoCharset; // digits / printable / binary
+
+typedef struct {
+    uint8_t fmt;      // IsoLenFmt
+    uint8_t charset;  // IsoCharset
+    uint16_t max;     // fixed size, or the largest LL/LLL value; 0 = field not supported
+} IsoFieldSpec;
+
+// [ANCHOR:ISO_WIRE_SPEC] Fields a card gateway sees on 0100/0200/0400 (others are rejected)
+static const IsoFieldSpec k_spec[ISO_WIRE_MAX_FIELD + 1] = {
+    [2] = {ISO_LEN_LLVAR, ISO_CS_N, 19},    // primary account number
+    [3] = {ISO_LEN_FIXED, ISO_CS_N, 6},     // processing code
+    [4] = {ISO_LEN_FIXED, ISO_CS_N, 12},    // amount, transaction (minor units)
+    [7] = {ISO_LEN_FIXED, ISO_CS_N, 10},    // transmission date & time MMDDhhmmss
+    [11] = {ISO_LEN_FIXED, ISO_CS_N, 6},    // system trace audit number (STAN)
+    [12] = {ISO_LEN_FIXED, ISO_CS_N, 6},    // local time hhmmss
+    [13] = {ISO_LEN_FIXED, ISO_CS_N, 4},    // local date MMDD
+    [14] = {ISO_LEN_FIXED, ISO_CS_N, 4},    // expiration date YYMM
+    [18] = {ISO_LEN_FIXED, ISO_CS_N, 4},    // merchant category code
+    [22] = {ISO_LEN_FIXED, ISO_CS_N, 3},    // POS entry mode
+    [23] = {ISO_LEN_FIXED, ISO_CS_N, 3},    // card sequence number
+    [25] = {ISO_LEN_FIXED, ISO_CS_N, 2},    // POS condition code
+    [32] = {ISO_LEN_LLVAR, ISO_CS_N, 11},   // acquiring institution id
+    [35] = {ISO_LEN_LLVAR, ISO_CS_ANS, 37}, // track 2 data
+    [37] = {ISO_LEN_FIXED, ISO_CS_ANS, 12}, // retrieval reference number (RRN)
+    [38] = {ISO_LEN_FIXED, ISO_CS_ANS, 6},  // authorization id response
+    [39] = {ISO_LEN_FIXED, ISO_CS_ANS, 2},  // response code
+    [41] = {ISO_LEN_FIXED, ISO_CS_ANS, 8},  // card acceptor terminal id
+    [42] = {ISO_LEN_FIXED, ISO_CS_ANS, 15}, // card acceptor id (merchant)
+    [43] = {ISO_LEN_FIXED, ISO_CS_ANS, 40}, // card acceptor name/location
+    [49] = {ISO_LEN_FIXED, ISO_CS_N, 3},    // currency code, transaction
+    [52] = {ISO_LEN_FIXED, ISO_CS_B, 8},    // PIN block
+    [55] = {ISO_LEN_LLLVAR, ISO_CS_B, 255}, // ICC (EMV) data
+    [90] = {ISO_LEN_FIXED, ISO_CS_N, 42},   // original data elements (reversals)
+};
+
+// Request fields echoed in the response, ascending (DE38/DE39 are inserted in order)
+static const uint8_t k_echo[] = {2, 3, 4, 7, 11, 12, 13, 37, 41, 42, 49, 90};
+
+static int wire_fail(char *err, size_t errsz, const char *why) {
+    if (err && errsz) snprintf(err, errsz, "%s", why);
+    return -1;
+}
+
+#define ISO_ONES 0x0101010101010101ULL
+#define ISO_HIGH 0x8080808080808080ULL
+
+// SWAR: non-zero iff some byte of x is outside [lo, hi] (lo <= 128, hi <= 127)
+static inline uint64_t out_of_range8(uint64_t x, unsigned lo, unsigned hi) {
+    uint64_t below = (x - ISO_ONES * lo) & ~x & ISO_HIGH;
+    uint64_t above = ((x + ISO_ONES * (127 - hi)) | x) & ISO_HIGH;
+    return below | above;
+}
+
+// Every byte of p[0..n) within [lo, hi], 8 bytes per step. avail = bytes
+// readable from p (the rest of the message): a short tail is checked with
+// one 8-byte load whose bytes past the field are replaced by lo.
+static int in_range(const unsigned char *p, size_t n, size_t avail, unsigned lo, unsigned hi) {
+    size_t i = 0;
+    uint64_t x;
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&x, p + i, 8);
+        if (out_of_range8(x, lo, hi)) return 0;
+    }
+    if (i == n) return 1;
+    if (avail - i >= 8) {
+        memcpy(&x, p + i, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        uint64_t keep = ~0ULL << (8 * (8 - (n - i)));
+#else
+        uint64_t keep = (1ULL << (8 * (n - i))) - 1;
+#endif
+        return !out_of_range8((x & keep) | (ISO_ONES * lo & ~keep), lo, hi);
+    }
+    for (; i < n; ++i)
+        if (p[i] < lo || p[i] > hi) return 0;
+    return 1;
+}
+
+static int all_digits(const unsigned char *p, size_t n) {
+    return in_range(p, n, n, '0', '9');
+}
+
+static uint64_t load_be64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+static int has_field(const IsoWireMsg *m, int f) {
+    return (int)((m->present[(f - 1) / 64] >> ((f - 1) % 64)) & 1);
+}
+
+// Field f with surrounding spaces trimmed
+static const unsigned char *trimmed(const IsoWireMsg *m, int f, size_t *n) {
+    const unsigned char *v = m->base + m->off[f];
+    size_t k = m->len[f];
+    while (k > 0 && *v == ' ') { v++; k--; }
+    while (k > 0 && v[k - 1] == ' ') k--;
+    *n = k;
+    return v;
+}
+
+// Append n bytes + NUL at *sp (IsoRequestView.scratch) and return them as a view
+static IsoStr scratch_put(char **sp, const void *src, size_t n) {
+    IsoStr v = {*sp, n};
+    memcpy(*sp, src, n);
+    (*sp)[n] = '\0';
+    *sp += n + 1;
+    return v;
+}
+
+long iso_wire_frame_len(const unsigned char *buf, size_t used, size_t max) {
+    if (used < 2) return 0;
+    size_t n = ((size_t)buf[0] << 8) | buf[1];
+    if (n == 0 || n + 2 > max) return -1;
+    return used >= n + 2 ? (long)(n + 2) : 0;
+}
+
+// Fill req from the decoded fields (all validated against k_spec already).
+// Frame fields are packed with no separator to terminate them in place, so
+// the few the pipeline reads are written to req->scratch (at most 53 bytes)
+static int fill_request(const IsoWireMsg *m, IsoRequestView *req, char *err, size_t errsz) {
+    if (!has_field(m, 2) || !has_field(m, 4)) return wire_fail(err, errsz, "missing_field");
+    char *sp = req->scratch;
+    req->pan = scratch_put(&sp, m->base + m->off[2], m->len[2]);
+
+    req->amount_exp = 2;
+    if (has_field(m, 49)) {
+        const unsigned char *c = m->base + m->off[49];
+        const IsoCurrency *cur = iso_currency_by_num((c[0] - '0') * 100 + (c[1] - '0') * 10 + (c[2] - '0'));
+        if (cur) {
+            req->currency = (IsoStr){cur->alpha, 3};
+            req->amount_exp = cur->exponent;
+        } else {
+            req->currency = scratch_put(&sp, c, 3); // unknown codes stay numeric, exponent 2
+        }
+    }
+    // DE4: 12 digits already in minor units, which is what the pipeline uses
+    const unsigned char *a = m->base + m->off[4];
+    int64_t minor = 0;
+    for (int i = 0; i < 12; ++i) minor = minor * 10 + (a[i] - '0');
+    req->amount_minor = minor;
+    req->amount = scratch_put(&sp, a, 12);
+
+    // Idempotency key: RRN, else terminal + STAN
+    size_t rn = 0;
+    const unsigned char *rrn = has_field(m, 37) ? trimmed(m, 37, &rn) : NULL;
+    if (rn > 0) {
+        req->request_id = scratch_put(&sp, rrn, rn);
+    } else {
+        char *id = sp;
+        size_t n = 0;
+        if (has_field(m, 41)) {
+            const unsigned char *t = trimmed(m, 41, &n);
+            memcpy(id, t, n);
+            if (n > 0 && has_field(m, 11)) id[n++] = '-';
+        }
+        if (has_field(m, 11)) {
+            memcpy(id + n, m->base + m->off[11], 6);
+            n += 6;
+        }
+        id[n] = '\0';
+        req->request_id = (IsoStr){id, n};
+    }
+
+    // 01xx authorization, 02xx financial (processing code 20xxxx = refund), 04xx reversal
+    switch (m->mti / 100) {
+    case 1: req->type = ISO_MSG_AUTH; break;
+    case 2:
+        req->type = (has_field(m, 3) && memcmp(m->base + m->off[3], "20", 2) == 0) ? ISO_MSG_REFUND
+                                                                                  : ISO_MSG_CAPTURE;
+        break;
+    default: req->type = ISO_MSG_REVERSAL; break;
+    }
+    return 0;
+}
+
+// [ANCHOR:ISO_WIRE_DECODE]
+int iso_wire_decode(const unsigned char *msg, size_t len, IsoWireMsg *out, IsoRequestView *req,
+                    char *err, size_t errsz) {
+    out->mti = -1;
+    out->base = msg;
+    out->present[0] = out->present[1] = 0;
+    req->pan = req->amount = req->currency = req->request_id = (IsoStr){"", 0};
+    req->amount_minor = -1;
+    req->amount_exp = 2;
+    req->type = ISO_MSG_AUTH;
+    req->deadline_ms = 0;
+
+    if (len < 4 || !all_digits(msg, 4)) return wire_fail(err, errsz, "bad_mti");
+    out->mti = (msg[0] - '0') * 1000 + (msg[1] - '0') * 100 + (msg[2] - '0') * 10 + (msg[3] - '0');
+    if (out->mti != 100 && out->mti != 200 && out->mti != 400) return wire_fail(err, errsz, "unsupported_mti");
+
+    size_t pos = 4;
+    uint64_t bm[2] = {0, 0};
+    if (len - pos < 8) return wire_fail(err, errsz, "truncated");
+    bm[0] = load_be64(msg + pos);
+    pos += 8;
+    if (bm[0] >> 63) { // field 1: secondary bitmap follows
+        if (len - pos < 8) return wire_fail(err, errsz, "truncated");
+        bm[1] = load_be64(msg + pos);
+        pos += 8;
+        if (bm[1] >> 63) return wire_fail(err, errsz, "bad_bitmap"); // field 65 (tertiary bitmap)
+        bm[0] &= ~(1ULL << 63);
+    }
+    if (!bm[0] && !bm[1]) return wire_fail(err, errsz, "bad_bitmap");
+
+    for (int h = 0; h < 2; ++h) {
+        uint64_t w = bm[h];
+        while (w) {
+            int k = __builtin_clzll(w); // MSB first = ascending field numbers
+            w &= ~(1ULL << (63 - k));
+            int f = h * 64 + k + 1;
+            const IsoFieldSpec *s = &k_spec[f];
+            if (!s->max) return wire_fail(err, errsz, "unsupported_field");
+            size_t vlen = s->max;
+            if (s->fmt != ISO_LEN_FIXED) {
+                size_t nd = s->fmt == ISO_LEN_LLVAR ? 2 : 3;
+                if (len - pos < nd) return wire_fail(err, errsz, "truncated");
+                if (!all_digits(msg + pos, nd)) return wire_fail(err, errsz, "bad_length");
+                vlen = 0;
+                for (size_t i = 0; i < nd; ++i) vlen = vlen * 10 + (size_t)(msg[pos + i] - '0');
+                if (vlen > s->max) return wire_fail(err, errsz, "bad_length");
+                pos += nd;
+            }
+            if (len - pos < vlen) return wire_fail(err, errsz, "truncated");
+            if (s->charset == ISO_CS_N && !in_range(msg + pos, vlen, len - pos, '0', '9'))
+                return wire_fail(err, errsz, "bad_numeric");
+            if (s->charset == ISO_CS_ANS && !in_range(msg + pos, vlen, len - pos, 0x20, 0x7e))
+                return wire_fail(err, errsz, "bad_text");
+            out->off[f] = (uint16_t)pos;
+            out->len[f] = (uint16_t)vlen;
+            out->present[(f - 1) / 64] |= 1ULL << ((f - 1) % 64);
+            pos += vlen;
+        }
+    }
+    if (pos != len) return wire_fail(err, errsz, "bad_length"); // bytes after the last field
+    return fill_request(out, req, err, errsz);
+}
+
+static size_t prefix_digits(int f) {
+    return k_spec[f].fmt == ISO_LEN_LLVAR ? 2 : k_spec[f].fmt == ISO_LEN_LLLVAR ? 3 : 0;
+}
+
+static void set_bit(uint64_t *bm, int f) {
+    bm[(f - 1) / 64] |= 1ULL << (63 - (f - 1) % 64);
+}
+
+// Append a fixed-size field of ours (DE38/DE39); -1 when out of room or of the wrong size
+static int put_fixed(unsigned char *out, size_t cap, size_t *pos, uint64_t *bm, int f, const char *v) {
+    size_t n = strlen(v);
+    if (n != k_spec[f].max || cap - *pos < n) return -1;
+    memcpy(out + *pos, v, n);
+    *pos += n;
+    set_bit(bm, f);
+    return 0;
+}
+
+static int copy_run(unsigned char *out, size_t cap, size_t *pos, const unsigned char *run, size_t n) {
+    if (cap - *pos < n) return -1;
+    if (n) memcpy(out + *pos, run, n);
+    *pos += n;
+    return 0;
+}
+
+// [ANCHOR:ISO_WIRE_ENCODE]
+// Echoed fields are copied as raw bytes (LL/LLL prefix included); fields that
+// were adjacent in the request go out with a single memcpy.
+size_t iso_wire_encode_response(const IsoWireMsg *req, const char *resp_code, const char *auth_code,
+                                unsigned char *out, size_t cap) {
+    int mti = ISO_WIRE_RESPONSE_MTI(req->mti);
+    int secondary = req->mti >= 0 && has_field(req, 90);
+    size_t hdr = 2 + 4 + (secondary ? 16 : 8);
+    if (req->mti < 0 || mti > 9999 || cap < hdr) return 0;
+    uint64_t bm[2] = {0, 0};
+    size_t pos = hdr;
+    const unsigned char *run = NULL; // request bytes still to copy
+    size_t run_len = 0;
+    int added = 0;
+    for (size_t i = 0; i < sizeof(k_echo); ++i) {
+        int f = k_echo[i];
+        if (f > 39 && !added) { // DE38/DE39 go in after the echoed fields below 38
+            if (copy_run(out, cap, &pos, run, run_len) != 0) return 0;
+            run_len = 0;
+            if (auth_code && put_fixed(out, cap, &pos, bm, 38, auth_code) != 0) return 0;
+            if (put_fixed(out, cap, &pos, bm, 39, resp_code) != 0) return 0;
+            added = 1;
+        }
+        if (!has_field(req, f)) continue;
+        size_t nd = prefix_digits(f);
+        const unsigned char *raw = req->base + req->off[f] - nd;
+        if (run_len && run + run_len == raw) {
+            run_len += nd + req->len[f];
+        } else {
+            if (copy_run(out, cap, &pos, run, run_len) != 0) return 0;
+            run = raw;
+            run_len = nd + req->len[f];
+        }
+        set_bit(bm, f);
+    }
+    if (copy_run(out, cap, &pos, run, run_len) != 0) return 0;
+    size_t n = pos - 2;
+    if (n > 0xffff) return 0;
+    out[0] = (unsigned char)(n >> 8);
+    out[1] = (unsigned char)n;
+    for (int i = 3; i >= 0; --i, mti /= 10) out[2 + i] = (unsigned char)('0' + mti % 10);
+    if (secondary) bm[0] |= 1ULL << 63;
+    for (int h = 0; h < (secondary ? 2 : 1); ++h)
+        for (int i = 0; i < 8; ++i) out[6 + 8 * h + i] = (unsigned char)(bm[h] >> (56 - 8 * i));
+    return pos;
+}
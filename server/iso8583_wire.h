@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "iso8583.h"
+
+// Binary ISO 8583 wire protocol (ISO8583_PORT listener)
+// VN: Giao thức ISO 8583 nhị phân: khung = 2 byte độ dài (big-endian) + MTI
+//     4 ký tự ASCII + bitmap nhị phân 8/16 byte + các trường theo bảng đặc tả.
+
+/// Largest field number (secondary bitmap)
+#define ISO_WIRE_MAX_FIELD 128
+
+/// Response to a request message: MTI + 10 (0100 → 0110, 0200 → 0210, 0400 → 0410)
+#define ISO_WIRE_RESPONSE_MTI(mti) ((mti) + 10)
+
+/**
+ * One decoded message. Field values are not copied: off/len point into the
+ * frame passed to iso_wire_decode(), which must outlive the IsoWireMsg (the
+ * response echoes them).
+ */
+typedef struct IsoWireMsg {
+    int mti;                                   ///< e.g. 200 for "0200"; -1 when unreadable
+    const unsigned char *base;                 ///< message bytes (after the length prefix)
+    uint64_t present[2];                       ///< decoded fields: bit (i - 1) % 64 of [(i - 1) / 64]
+    uint16_t off[ISO_WIRE_MAX_FIELD + 1];      ///< value of field i: base + off[i] (LL/LLL prefix skipped)
+    uint16_t len[ISO_WIRE_MAX_FIELD + 1];      ///< value length of field i
+} IsoWireMsg;
+
+/**
+ * Size of the first frame in buf[0..used): 2 + message length once it is
+ * complete, 0 while more bytes are needed, -1 for a length of 0 or above
+ * max - 2 (the connection cannot be resynchronised).
+ */
+long iso_wire_frame_len(const unsigned char *buf, size_t used, size_t max);
+
+/**
+ * Decode msg[0..len) (one frame without its length prefix) straight into
+ * req: DE2 → pan, DE4 + DE49 → amount_minor / amount_exp / currency,
+ * DE37 (else DE41-DE11) → request_id, MTI + DE3 → type. req's strings live in
+ * req->scratch or static storage, so req stays valid after msg is gone.
+ * Returns 0, or -1 with err set ("bad_mti", "unsupported_mti",
+ * "bad_bitmap", "unsupported_field", "truncated", "bad_length",
+ * "bad_numeric", "bad_text", "missing_field"). out->mti is -1 only when the MTI itself
+ * could not be read; otherwise out holds every field decoded before the
+ * error and a 0x10 response can still be sent.
+ */
+int iso_wire_decode(const unsigned char *msg, size_t len, IsoWireMsg *out, IsoRequestView *req,
+                    char *err, size_t errsz);
+
+/**
+ * Encode the response to req into out[0..cap), length prefix included:
+ * MTI + 10, the request's DE2/3/4/7/11/12/13/37/41/42/49/90 when present,
+ * DE38 = auth_code (6 characters, NULL = omit) and DE39 = resp_code
+ * (2 characters, e.g. "00" approved, "05" do not honour).
+ * Returns the number of bytes, or 0 when cap is too small.
+ */
+size_t iso_wire_encode_response(const IsoWireMsg *req, const char *resp_code, const char *auth_code,
+                                unsigned char *out, size_t cap);
@@ -20,6 +20,13 @@
 #include "ledger.h"
 #include "clearing.h"
 #include "reversal.h"
+#include "affinity.h"
+#include "simdscan.h"
+#include "arena.h"
+#include "idem.h"
+#include "singleflight.h"
+#include "groupcommit.h"
+#include "dbasync.h"
 #include <stdio.h>
 
 int main(int argc, char *argv[]) {
@@ -27,30 +34,77 @@ int main(int argc, char *argv[]) {
     if (config_init(&cfg, argc, argv) != 0) {
         return 1;
     }
+    // Ghim CPU trước khi tạo bất kỳ luồng nào (reversal, pool, acceptor kế thừa tập CPU)
+    if (affinity_init(cfg.cpu_set, cfg.numa_node, cfg.cpu_pin) != 0) {
+        return 1;
+    }
+    if (simdscan_force(cfg.simd_scan) != 0) {
+        fprintf(stderr, "Error: SIMD_SCAN=%s is not supported on this CPU\n", simdscan_impl_name(cfg.simd_scan));
+        return 1;
+    }
+    arena_configure((size_t)cfg.request_arena_kb * 1024u);
+    (void)idem_init((size_t)cfg.idem_cache_kb * 1024u, cfg.idem_cache_ttl_s);
+    singleflight_configure(cfg.singleflight_wait_ms);
     log_init();
     metrics_init();
     risk_init();
     ledger_init();
     clearing_init();
     reversal_init();
+    db_configure(cfg.db_prepared, cfg.db_pipeline);
     // Kết nối cơ sở dữ liệu (sẽ dùng làm bootstrap cho per-thread DB)
     DBConnection *dbc = db_connect(cfg.db_uri);
     if (!dbc) {
         return 1;
     }
-    // Tạo thread pool: số luồng và sức chứa hàng đợi đọc từ ENV
-    ThreadPool *pool = threadpool_create(cfg.num_threads, cfg.queue_cap);
-    if (!pool) {
+    // Pool kết nối dùng chung (DB_POOL_SIZE > 0) thay cho mỗi worker một kết nối
+    if (db_pool_init(dbc, cfg.db_pool_size, cfg.db_pool_wait_ms, cfg.db_pool_health_idle_s) != 0) {
+        fprintf(stderr, "Error: failed to set up the DB connection pool\n");
         db_disconnect(dbc);
         return 1;
     }
+    // Tầng DB bất đồng bộ (DB_ASYNC=1): luồng epoll + DB_ASYNC_CONNS kết nối non-blocking
+    if (cfg.db_async && dbasync_start(cfg.db_uri, cfg.db_async_conns) != 0) {
+        fprintf(stderr, "Error: failed to start the async DB layer\n");
+        db_pool_shutdown();
+        db_disconnect(dbc);
+        return 1;
+    }
+    // Luồng ghi group commit (GROUP_COMMIT_WINDOW_US > 0), kết nối DB riêng
+    if (groupcommit_start(dbc, cfg.group_commit_window_us, cfg.group_commit_max_rows) != 0) {
+        fprintf(stderr, "Error: failed to start the group commit writer\n");
+        dbasync_shutdown();
+        db_disconnect(dbc);
+        return 1;
+    }
+    // Tạo thread pool: số luồng và sức chứa hàng đợi đọc từ ENV
+    // (ACCEPTOR_POOL_SHARDS=1: net.c tạo một pool con cho mỗi acceptor thay vì pool chung)
+    ThreadPool *pool = NULL;
+    if (!cfg.acceptor_pool_shards) {
+        ThreadPoolOptions popts;
+        config_pool_options(&cfg, &popts);
+        pool = threadpool_create_ex(&popts);
+        if (!pool) {
+            groupcommit_shutdown();
+            dbasync_shutdown();
+            db_disconnect(dbc);
+            return 1;
+        }
+        // Reversal retries run in the pool's background lane (lowest priority)
+        reversal_set_pool(pool);
+    }
     // Bắt đầu server TCP (blocking): accept kết nối và giao việc cho thread pool
     int rc = net_server_run(&cfg, pool, dbc);
     // Dọn tài nguyên (đảm bảo không rò rỉ)
+    reversal_set_pool(NULL);
     threadpool_destroy(pool);
+    groupcommit_shutdown();
+    dbasync_shutdown();
+    db_pool_shutdown();
     db_disconnect(dbc);
     log_close();
     reversal_shutdown();
+    idem_shutdown();
     config_free(&cfg);
     return rc;
 }
@@ -13,11 +13,22 @@ static volatile unsigned long g_cb_short_circuit = 0;
 static volatile unsigned long g_rev_enq = 0;
 static volatile unsigned long g_rev_ok = 0;
 static volatile unsigned long g_rev_fail = 0;
+static volatile unsigned long g_conns_open = 0; // gauge: client sockets owned by the server
+static volatile unsigned long g_deadline_expired = 0;
+static volatile unsigned long g_batches = 0;
+static volatile unsigned long g_db_round_trips = 0;
+static volatile unsigned long g_payments_async = 0;     // gauge: suspended payments
+static volatile unsigned long g_payments_async_max = 0;
 
 void metrics_init(void) {
     g_total = g_approved = g_declined = g_server_busy = g_risk_declined = 0;
     g_2pc_committed = g_2pc_aborted = g_cb_short_circuit = 0;
     g_rev_enq = g_rev_ok = g_rev_fail = 0;
+    g_conns_open = 0;
+    g_deadline_expired = 0;
+    g_batches = 0;
+    g_db_round_trips = 0;
+    g_payments_async = g_payments_async_max = 0;
 }
 
 void metrics_inc_total(void) { __sync_fetch_and_add(&g_total, 1); }
@@ -31,6 +42,18 @@ void metrics_inc_cb_short_circuit(void) { __sync_fetch_and_add(&g_cb_short_circu
 void metrics_inc_reversal_enqueued(void) { __sync_fetch_and_add(&g_rev_enq, 1); }
 void metrics_inc_reversal_succeeded(void) { __sync_fetch_and_add(&g_rev_ok, 1); }
 void metrics_inc_reversal_failed(void) { __sync_fetch_and_add(&g_rev_fail, 1); }
+void metrics_inc_deadline_expired(void) { __sync_fetch_and_add(&g_deadline_expired, 1); }
+void metrics_inc_batch(void) { __sync_fetch_and_add(&g_batches, 1); }
+void metrics_inc_db_round_trip(void) { __sync_fetch_and_add(&g_db_round_trips, 1); }
+void metrics_conn_opened(void) { __sync_fetch_and_add(&g_conns_open, 1); }
+void metrics_conn_closed(void) { __sync_fetch_and_sub(&g_conns_open, 1); }
+
+void metrics_payment_suspended(void) {
+    unsigned long n = __sync_add_and_fetch(&g_payments_async, 1);
+    unsigned long max = g_payments_async_max;
+    while (n > max && !__sync_bool_compare_and_swap(&g_payments_async_max, max, n)) max = g_payments_async_max;
+}
+void metrics_payment_resumed(void) { __sync_fetch_and_sub(&g_payments_async, 1); }
 
 void metrics_snapshot(unsigned long *total,
                       unsigned long *approved,
@@ -49,3 +72,9 @@ unsigned long metrics_get_cb_short_circuit(void) { return g_cb_short_circuit; }
 unsigned long metrics_get_reversal_enqueued(void) { return g_rev_enq; }
 unsigned long metrics_get_reversal_succeeded(void) { return g_rev_ok; }
 unsigned long metrics_get_reversal_failed(void) { return g_rev_fail; }
+unsigned long metrics_get_conns_open(void) { return g_conns_open; }
+unsigned long metrics_get_deadline_expired(void) { return g_deadline_expired; }
+unsigned long metrics_get_batches(void) { return g_batches; }
+unsigned long metrics_get_db_round_trips(void) { return g_db_round_trips; }
+unsigned long metrics_get_payments_async(void) { return g_payments_async; }
+unsigned long metrics_get_payments_async_max(void) { return g_payments_async_max; }
@@ -15,6 +15,18 @@ void metrics_inc_cb_short_circuit(void);
 void metrics_inc_reversal_enqueued(void);
 void metrics_inc_reversal_succeeded(void);
 void metrics_inc_reversal_failed(void);
+// Payments declined with reason "timeout" (deadline passed before 2PC)
+void metrics_inc_deadline_expired(void);
+// Batch requests that reached 2PC (one per batch, items count in total/approved)
+void metrics_inc_batch(void);
+// Statements sent to PostgreSQL (one per PQexec/PQexecParams round trip)
+void metrics_inc_db_round_trip(void);
+// Gauge of open client connections (reactor + blocking model)
+void metrics_conn_opened(void);
+void metrics_conn_closed(void);
+// Gauge of payments waiting on asynchronous 2PC steps without a worker (DB_ASYNC)
+void metrics_payment_suspended(void);
+void metrics_payment_resumed(void);
 
 // Snapshot counters into provided pointers (can be NULL to skip)
 void metrics_snapshot(unsigned long *total,
@@ -30,3 +42,9 @@ unsigned long metrics_get_cb_short_circuit(void);
 unsigned long metrics_get_reversal_enqueued(void);
 unsigned long metrics_get_reversal_succeeded(void);
 unsigned long metrics_get_reversal_failed(void);
+unsigned long metrics_get_conns_open(void);
+unsigned long metrics_get_deadline_expired(void);
+unsigned long metrics_get_batches(void);
+unsigned long metrics_get_db_round_trips(void);
+unsigned long metrics_get_payments_async(void);
+unsigned long metrics_get_payments_async_max(void); // peak of the gauge since start
@@ -1,95 +1,155 @@
 /* [ANCHOR:NET_OVERVIEW]
- * Network Accept Loop — Visual Overview / Sơ đồ tổng quan (EN + VN)
+ * Network Front End — Visual Overview / Sơ đồ tổng quan (EN + VN)
  *
- *  socket/bind/listen(backlog=128)  →  accept(fd)
- *                                        |
- *                                        v
- *                         build HandlerContext (fd, db)
+ *  NET_MODE=epoll (default): one reactor owns every client socket
+ *
+ *  listen (non-blocking)          epoll_wait (EPOLLONESHOT per conn)
+ *        |                               |
+ *        v                               v
+ *   accept4 → NetConn{buf}      read until EAGAIN into conn buffer
  *                                        |
- *                                        v
- *                submit to threadpool (handler_job)
- *                      |                     |
- *        queue full → fast-fail    queue ok → worker handles I/O
- *             send {"server_busy"}           (newline framing, timeouts)
- *             close(fd)
+ *                       complete frame? (newline / HTTP body)
+ *                          |                         |
+ *                         no → re-arm, wait         yes → submit(conn job)
+ *                                                    |            |
+ *                                   queue full → "server_busy"   worker: handler_consume()
+ *                                                close(fd)        then re-arm the conn
+ *                                                 (HTTP → 503)    (HTTP "Connection: close"
+ *                                                                  → shutdown, reactor frees)
+ *
+ *  Priority lanes: the acceptor classifies each submission cheaply (buffer
+ *  holds only GET /healthz|/readyz|/metrics|/version lines → control lane,
+ *  else payment lane). The control lane has its own ring and reserved
+ *  workers (CONTROL_WORKERS), so probes are answered while payments are
+ *  saturated. Blocking mode peeks (MSG_PEEK) at whatever already arrived.
+ *
+ *  DB_ASYNC=1: a worker that reaches a single payment starts its 2PC and
+ *  leaves the conn in flight; the steps complete on the dbasync / timer
+ *  threads and a resume job answers, then consumes the rest and re-arms.
+ *
+ *  REQUEST_BUDGET_MS=N: jobs carry a deadline (frame receipt / accept + N ms).
+ *  A worker that dequeues an expired job runs the expire path instead: the
+ *  connection's payments get DECLINED/timeout without DB or clearing work.
+ *
+ *  NET_MODE=blocking (legacy): accept(fd) → submit handler_job → worker does
+ *  blocking reads with a 5s SO_RCVTIMEO, so an idle keep-alive client pins
+ *  a worker for up to 5 seconds.
+ *
+ *  ACCEPTORS=N (N>1): N listeners bound to the same port with SO_REUSEPORT,
+ *  one accept thread each (a reactor in epoll mode). The kernel hashes every
+ *  incoming connect to one listener, so a connect storm is spread over N
+ *  cores instead of one accept loop.
+ *
+ *     port 9090 ──┬── listener 0 → acceptor thread 0 ──┐
+ *                 ├── listener 1 → acceptor thread 1 ──┼─→ shared ThreadPool
+ *                 └── listener N-1 → ...             ──┘   (or one shard each
+ *                                                          with ACCEPTOR_POOL_SHARDS=1)
  *
  * EN:
  * - Backpressure is enforced by the bounded queue in threadpool. When full,
  *   the server fails fast with a short JSON and closes the connection.
+ * - In epoll mode idle connections cost a NetConn (~8KB buffer) and no worker;
+ *   workers only see connections that have a complete request buffered.
+ * - EPOLLONESHOT guarantees one owner at a time: the reactor (reading) or a
+ *   single worker (processing). Only the reactor closes/frees a connection.
  * - The kernel listen backlog absorbs short bursts of TCP connect storms.
- * - Extensible: SO_REUSEPORT (multi-acceptors), TCP_NODELAY, epoll, TLS.
+ * - Pool shards avoid contention on one queue lock between acceptors, at the
+ *   cost of no load sharing between shards (a busy shard says server_busy
+ *   even if another shard is idle).
+ * - ISO8583_PORT adds a second listener (one per acceptor) for binary ISO 8583;
+ *   its connections share the reactor, the pool and the payment pipeline and
+ *   only differ in framing (HandlerContext.proto).
  *
  * VN:
  * - Chống quá tải nằm ở hàng đợi giới hạn của threadpool. Khi đầy, trả phản hồi
  *   JSON ngắn "server_busy" rồi đóng kết nối (fail fast) thay vì để chờ lâu.
+ * - Chế độ epoll: kết nối rảnh không chiếm worker; reactor tự đọc & tách khung
+ *   (framing), chỉ giao cho thread pool khi đã có đủ một request.
  * - Backlog (listen) giúp hấp thụ các đợt kết nối dồn dập ở mức kernel.
- * - Dễ mở rộng: SO_REUSEPORT (nhiều tiến trình accept), TCP_NODELAY, epoll, TLS.
+ * - ACCEPTORS=N: N socket cùng cổng (SO_REUSEPORT), mỗi socket một luồng accept;
+ *   kernel chia kết nối mới cho các luồng → không nghẽn ở một vòng accept.
+ * - ISO8583_PORT: thêm một cổng nhận ISO 8583 nhị phân, dùng chung reactor và pool.
  */
+#define _GNU_SOURCE // accept4
 #include "net.h"
 #include "config.h"
 #include "threadpool.h"
 #include "handler.h"
 #include "db.h"
 #include "metrics.h"
+#include "affinity.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-/*
- * Minimal network stub.
- *
- * In a complete implementation you would create a TCP socket, bind
- * it to cfg->listen_port, listen for connections, accept them, and
- * enqueue each client socket into the thread pool for handling. This
- * stub simply prints a message and returns immediately.
- */
 // Optional: enable TCP_NODELAY after accept to reduce latency of small writes
 // #define ENABLE_TCP_NODELAY 1
 
-int net_server_run(const Config *cfg, ThreadPool *pool, DBConnection *dbc) {
-    (void)pool; // not used yet
-    // [ANCHOR:NET_SOCKET_SETUP] Tạo socket, cấu hình REUSEADDR (và gợi ý REUSEPORT)
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+#define NET_MAX_EVENTS 256
+#define NET_SWEEP_MS 1000
+
+// [ANCHOR:NET_SOCKET_SETUP] Tạo socket, cấu hình REUSEADDR (và REUSEPORT khi ACCEPTORS>1)
+static int net_listen(const Config *cfg, int port, int nonblock, int reuseport) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0), 0);
     if (listen_fd < 0) {
         perror("socket");
-        return 1;
+        return -1;
     }
 
     int opt = 1;
     // EN: Allow quick restart after close
     // VN: Cho phép khởi động lại nhanh sau khi đóng socket
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    // EN: Optional — distribute accept load across multiple processes
-    // VN: Tuỳ chọn — chia tải accept ở mức kernel cho nhiều tiến trình
-    // setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    // EN: ACCEPTORS>1 — several listeners on one port, kernel load-balances connects
+    // VN: ACCEPTORS>1 — nhiều socket cùng cổng, kernel chia tải accept giữa các luồng
+    if (reuseport && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(listen_fd);
+        return -1;
+    }
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons((uint16_t)cfg->listen_port);
+    addr.sin_port = htons((uint16_t)port);
 
     if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         perror("bind");
         close(listen_fd);
-        return 1;
+        return -1;
     }
 
-    if (listen(listen_fd, 128) < 0) {
+    // Larger backlog: with the reactor accepts are cheap, so let the kernel queue more
+    if (listen(listen_fd, cfg->net_mode == NET_MODE_EPOLL ? 4096 : 128) < 0) {
         perror("listen");
         close(listen_fd);
-        return 1;
+        return -1;
     }
 
-    fprintf(stderr, "Server listening on port %d\n", cfg->listen_port);
+    return listen_fd;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000L;
+}
 
-    // [ANCHOR:NET_ACCEPT_LOOP] Vòng accept: mỗi kết nối TCP tương ứng một request
+// ---------------------------------------------------------------------------
+// NET_MODE=blocking: legacy accept loop, one handler_job per connection
+// ---------------------------------------------------------------------------
+static int net_run_blocking(const Config *cfg, int listen_fd, int proto, ThreadPool *pool, DBConnection *dbc) {
+    // [ANCHOR:NET_ACCEPT_LOOP] Vòng accept: mỗi kết nối TCP tương ứng một job
     for (;;) {
         struct sockaddr_in cli;
         socklen_t clilen = sizeof(cli);
@@ -115,23 +175,435 @@ int net_server_run(const Config *cfg, ThreadPool *pool, DBConnection *dbc) {
             close(fd);
             continue;
         }
-        ctx->client_fd = fd;
-        ctx->db = dbc;
-        ctx->api_token = cfg->api_token;
+        handler_context_init(ctx, fd, dbc, cfg->api_token, pool);
+        ctx->proto = proto;
+        ctx->budget_ms = cfg->request_budget_ms;
+        ctx->batch_max = cfg->batch_max;
+        ctx->iso_batch = cfg->iso8583_batch;
+        handler_mark_received(ctx, threadpool_now_ns());
+        metrics_conn_opened();
+        // [ANCHOR:NET_CLASSIFY] Probe already sent its line? → control lane
+        char peek[64];
+        ssize_t pk = recv(fd, peek, sizeof(peek), MSG_PEEK | MSG_DONTWAIT);
+        if (pk > 0 && (size_t)pk < sizeof(peek)) ctx->lane = handler_frame_lane(ctx, peek, (size_t)pk, 0);
 
         // EN: Submit to thread pool; if queue is full, send an error and drop
         // VN: Đẩy vào threadpool; nếu hàng đợi đầy, trả "server_busy" rồi đóng
-            if (threadpool_submit(pool, handler_job, ctx) != 0) {
-                // [ANCHOR:NET_FAST_FAIL_BUSY] Fast-fail khi backpressure (queue đầy)
-                const char *busy = "{\"status\":\"DECLINED\",\"reason\":\"server_busy\"}\n";
-                (void)send(fd, busy, strlen(busy), 0);
-                metrics_inc_server_busy();
-                close(fd);
-                free(ctx);
-            }
+        if (threadpool_submit_lane(pool, (ThreadPoolLane)ctx->lane, handler_job, handler_job_expired, ctx,
+                                   ctx->deadline_ns) != 0) {
+            // [ANCHOR:NET_FAST_FAIL_BUSY] Fast-fail khi backpressure (queue đầy)
+            char busy[HANDLER_BUSY_REPLY_MAX];
+            size_t bn = handler_busy_reply(ctx, peek, pk > 0 ? (size_t)pk : 0, busy, sizeof(busy));
+            if (bn > 0) (void)send(fd, busy, bn, MSG_NOSIGNAL);
+            metrics_inc_server_busy();
+            close(fd);
+            metrics_conn_closed();
+            free(ctx);
+        }
     }
 
     // [ANCHOR:NET_CLOSE_LISTENER] Đóng socket lắng nghe khi thoát vòng accept
     close(listen_fd);
     return 0;
 }
+
+// ---------------------------------------------------------------------------
+// NET_MODE=epoll: reactor owns sockets, workers only get complete frames
+// ---------------------------------------------------------------------------
+// [ANCHOR:NET_REACTOR]
+typedef struct Reactor Reactor;
+
+typedef struct NetConn {
+    HandlerContext hc;          // fd + protocol state (HTTP collection, ...)
+    Reactor *reactor;
+    size_t used;                // bytes buffered in buf
+    long long last_active_ms;   // for the idle sweep
+    int in_flight;              // 1 while a worker owns the conn (atomic)
+    int closing;                // reactor-only: shutdown() already issued
+    struct NetConn *prev, *next;
+    char buf[HANDLER_BUF_SIZE];
+} NetConn;
+
+struct Reactor {
+    int epfd;
+    int listen_fd;
+    int iso_listen_fd;          // ISO8583_PORT listener, -1 = none
+    int accept_paused;          // EMFILE: listeners disarmed until next sweep
+    ThreadPool *pool;
+    DBConnection *dbc;
+    const Config *cfg;
+    NetConn *conns;             // every open conn (reactor thread only)
+};
+
+// epoll tags: a NULL ptr is the PORT listener, &k_iso_listener_tag the ISO8583_PORT one
+static char k_iso_listener_tag;
+
+// (Re)arm or, with events = 0, disarm a listener (level-triggered, no ONESHOT)
+static int reactor_arm_listener(Reactor *r, int fd, int op, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = fd == r->iso_listen_fd ? &k_iso_listener_tag : NULL;
+    return epoll_ctl(r->epfd, op, fd, &ev);
+}
+
+static int reactor_arm(int epfd, int fd, NetConn *c, int op) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = c;
+    return epoll_ctl(epfd, op, fd, &ev);
+}
+
+static void reactor_close(Reactor *r, NetConn *c) {
+    (void)epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->hc.client_fd, NULL);
+    close(c->hc.client_fd);
+    if (c->prev) c->prev->next = c->next; else r->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    handler_context_release(&c->hc);
+    free(c);
+    metrics_conn_closed();
+}
+
+// Worker side: process buffered frames, then hand the conn back to epoll.
+// After the re-arm the reactor may free the conn, so nothing touches it later.
+static void reactor_conn_run(NetConn *c) {
+    c->used = handler_consume(&c->hc, c->buf, c->used);
+    c->hc.expired = 0;
+    // DB_ASYNC: a payment is waiting on its 2PC; it stays in flight (no idle
+    // sweep, no reads) until reactor_conn_resume() runs on a worker
+    if (handler_suspend(&c->hc)) return;
+    c->last_active_ms = now_ms();
+    int epfd = c->reactor->epfd;
+    int fd = c->hc.client_fd;
+    // HTTP "Connection: close" answered: the reactor sees EOF and frees the conn
+    if (c->hc.want_close) (void)shutdown(fd, SHUT_RDWR);
+    __atomic_store_n(&c->in_flight, 0, __ATOMIC_RELEASE);
+    if (reactor_arm(epfd, fd, c, EPOLL_CTL_MOD) != 0) {
+        // Cannot re-arm: force an error event path by shutting the socket
+        (void)shutdown(fd, SHUT_RDWR);
+    }
+}
+
+static void reactor_conn_job(void *arg) {
+    reactor_conn_run((NetConn *)arg);
+}
+
+// Deadline passed while queued: same processing, payments answer timeout
+static void reactor_conn_expired(void *arg) {
+    NetConn *c = (NetConn *)arg;
+    c->hc.expired = 1;
+    reactor_conn_run(c);
+}
+
+// The suspended payment was answered: go on with the frames behind it
+static void reactor_conn_resume(HandlerContext *hc) {
+    reactor_conn_run((NetConn *)((char *)hc - offsetof(NetConn, hc)));
+}
+
+static void reactor_accept(Reactor *r, int listen_fd, int proto) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // Out of descriptors: stop polling the listener until the next sweep
+                perror("accept4");
+                (void)reactor_arm_listener(r, listen_fd, EPOLL_CTL_MOD, 0);
+                r->accept_paused = 1;
+            }
+            return; // EAGAIN: drained
+        }
+#ifdef ENABLE_TCP_NODELAY
+        int one = 1;
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#endif
+        NetConn *c = (NetConn *)malloc(sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        handler_context_init(&c->hc, fd, r->dbc, r->cfg->api_token, r->pool);
+        c->hc.proto = proto;
+        c->hc.budget_ms = r->cfg->request_budget_ms;
+        c->hc.batch_max = r->cfg->batch_max;
+        c->hc.iso_batch = r->cfg->iso8583_batch;
+        c->hc.resume = reactor_conn_resume;
+        c->reactor = r;
+        c->used = 0;
+        c->last_active_ms = now_ms();
+        c->in_flight = 0;
+        c->closing = 0;
+        c->prev = NULL;
+        c->next = r->conns;
+        if (r->conns) r->conns->prev = c;
+        r->conns = c;
+        metrics_conn_opened();
+        if (reactor_arm(r->epfd, fd, c, EPOLL_CTL_ADD) != 0) {
+            perror("epoll_ctl");
+            reactor_close(r, c);
+        }
+    }
+}
+
+// Reactor side: drain the socket into the conn buffer and decide what to do
+static void reactor_read(Reactor *r, NetConn *c, uint32_t events) {
+    int fd = c->hc.client_fd;
+    int eof = 0;
+    for (;;) {
+        size_t room = HANDLER_BUF_SIZE - 1 - c->used;
+        if (room == 0) break; // rest stays in the kernel until the next round
+        ssize_t n = read(fd, c->buf + c->used, room);
+        if (n > 0) { c->used += (size_t)n; continue; }
+        if (n == 0) { eof = 1; break; }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) eof = 1;
+        break;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) eof = 1;
+
+    // [ANCHOR:NET_REACTOR_FRAMING] Only complete frames go to the thread pool
+    if (handler_has_frame(&c->hc, c->buf, c->used)) {
+        c->last_active_ms = now_ms();
+        handler_mark_received(&c->hc, threadpool_now_ns());
+        // [ANCHOR:NET_CLASSIFY] Only-probe buffers jump to the control lane
+        c->hc.lane = handler_frame_lane(&c->hc, c->buf, c->used, 1);
+        __atomic_store_n(&c->in_flight, 1, __ATOMIC_RELAXED);
+        if (threadpool_submit_lane(r->pool, (ThreadPoolLane)c->hc.lane, reactor_conn_job, reactor_conn_expired, c,
+                                   c->hc.deadline_ns) != 0) {
+            // [ANCHOR:NET_FAST_FAIL_BUSY] Fast-fail khi backpressure (queue đầy)
+            char busy[HANDLER_BUSY_REPLY_MAX];
+            size_t bn = handler_busy_reply(&c->hc, c->buf, c->used, busy, sizeof(busy));
+            if (bn > 0) (void)send(fd, busy, bn, MSG_NOSIGNAL);
+            metrics_inc_server_busy();
+            reactor_close(r, c);
+        }
+        // EOF with a frame pending: the worker re-arms, the next event reads 0
+        return;
+    }
+    if (c->used >= HANDLER_BUF_SIZE - 1) {
+        // Too long line; reset buffer to avoid overflow (same as handler_consume)
+        c->used = 0;
+    }
+    if (eof) {
+        reactor_close(r, c);
+        return;
+    }
+    if (reactor_arm(r->epfd, fd, c, EPOLL_CTL_MOD) != 0) reactor_close(r, c);
+}
+
+// Close keep-alive connections idle for longer than CONN_IDLE_TIMEOUT_MS.
+// shutdown() (not close) so a conn racing with a worker is freed only on its event.
+static void reactor_sweep(Reactor *r, long long now) {
+    if (r->accept_paused) {
+        int ok = reactor_arm_listener(r, r->listen_fd, EPOLL_CTL_MOD, EPOLLIN) == 0;
+        if (r->iso_listen_fd >= 0) ok &= reactor_arm_listener(r, r->iso_listen_fd, EPOLL_CTL_MOD, EPOLLIN) == 0;
+        if (ok) r->accept_paused = 0;
+    }
+    if (r->cfg->idle_timeout_ms <= 0) return;
+    for (NetConn *c = r->conns; c; c = c->next) {
+        if (c->closing || __atomic_load_n(&c->in_flight, __ATOMIC_ACQUIRE)) continue;
+        if (now - c->last_active_ms >= r->cfg->idle_timeout_ms) {
+            (void)shutdown(c->hc.client_fd, SHUT_RDWR);
+            c->closing = 1;
+        }
+    }
+}
+
+static int net_run_epoll(const Config *cfg, int listen_fd, int iso_fd, ThreadPool *pool, DBConnection *dbc) {
+    Reactor r;
+    memset(&r, 0, sizeof(r));
+    r.pool = pool;
+    r.dbc = dbc;
+    r.cfg = cfg;
+    r.listen_fd = listen_fd;
+    r.iso_listen_fd = iso_fd;
+    r.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r.epfd < 0) {
+        perror("epoll_create1");
+        close(r.listen_fd);
+        if (iso_fd >= 0) close(iso_fd);
+        return 1;
+    }
+    // One reactor serves both listeners: the protocol is fixed per connection at accept
+    if (reactor_arm_listener(&r, r.listen_fd, EPOLL_CTL_ADD, EPOLLIN) != 0 ||
+        (iso_fd >= 0 && reactor_arm_listener(&r, iso_fd, EPOLL_CTL_ADD, EPOLLIN) != 0)) {
+        perror("epoll_ctl listen");
+        close(r.epfd);
+        close(r.listen_fd);
+        if (iso_fd >= 0) close(iso_fd);
+        return 1;
+    }
+
+    struct epoll_event events[NET_MAX_EVENTS];
+    long long next_sweep = now_ms() + NET_SWEEP_MS;
+    for (;;) {
+        int n = epoll_wait(r.epfd, events, NET_MAX_EVENTS, NET_SWEEP_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            void *tag = events[i].data.ptr;
+            if (!tag) reactor_accept(&r, r.listen_fd, HANDLER_PROTO_LINE);
+            else if (tag == &k_iso_listener_tag) reactor_accept(&r, r.iso_listen_fd, HANDLER_PROTO_ISO8583);
+            else reactor_read(&r, (NetConn *)tag, events[i].events);
+        }
+        long long now = now_ms();
+        if (now >= next_sweep) {
+            reactor_sweep(&r, now);
+            next_sweep = now + NET_SWEEP_MS;
+        }
+    }
+
+    // [ANCHOR:NET_CLOSE_LISTENER] Đóng socket lắng nghe khi thoát vòng lặp
+    close(r.epfd);
+    close(r.listen_fd);
+    if (iso_fd >= 0) close(iso_fd);
+    return 0;
+}
+
+// NET_MODE=blocking: the ISO8583_PORT listener gets its own accept loop thread
+typedef struct IsoAcceptLoop {
+    const Config *cfg;
+    int listen_fd;
+    ThreadPool *pool;
+    DBConnection *dbc;
+} IsoAcceptLoop;
+
+static void *iso_accept_main(void *arg) {
+    IsoAcceptLoop *l = (IsoAcceptLoop *)arg;
+    (void)net_run_blocking(l->cfg, l->listen_fd, HANDLER_PROTO_ISO8583, l->pool, l->dbc);
+    free(l);
+    return NULL;
+}
+
+// Serve listen_fd (PORT) and, when iso_fd >= 0, the ISO8583_PORT listener
+static int net_run_listener(const Config *cfg, int listen_fd, int iso_fd, ThreadPool *pool, DBConnection *dbc) {
+    if (cfg->net_mode == NET_MODE_EPOLL) return net_run_epoll(cfg, listen_fd, iso_fd, pool, dbc);
+    if (iso_fd >= 0) {
+        IsoAcceptLoop *l = (IsoAcceptLoop *)malloc(sizeof(*l));
+        pthread_t tid;
+        if (l) {
+            l->cfg = cfg; l->listen_fd = iso_fd; l->pool = pool; l->dbc = dbc;
+        }
+        if (!l || pthread_create(&tid, NULL, iso_accept_main, l) != 0) {
+            perror("iso8583 accept thread");
+            free(l);
+            close(iso_fd);
+            close(listen_fd);
+            return 1;
+        }
+        // Accept loops only return on fatal errors; the process exits with the PORT loop
+        pthread_detach(tid);
+    }
+    return net_run_blocking(cfg, listen_fd, HANDLER_PROTO_LINE, pool, dbc);
+}
+
+// ---------------------------------------------------------------------------
+// ACCEPTORS=N: one SO_REUSEPORT listener + accept thread per acceptor
+// ---------------------------------------------------------------------------
+// [ANCHOR:NET_ACCEPTORS]
+typedef struct Acceptor {
+    pthread_t tid;
+    int index;
+    int listen_fd;
+    int iso_fd;         // ISO8583_PORT listener (-1 = none)
+    ThreadPool *pool;   // shared pool, or this acceptor's shard
+    int own_pool;       // 1 = shard created here, destroyed on exit
+    const Config *cfg;
+    DBConnection *dbc;
+    int rc;
+} Acceptor;
+
+static void *acceptor_main(void *arg) {
+    Acceptor *a = (Acceptor *)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_ACCEPTOR, a->index);
+    a->rc = net_run_listener(a->cfg, a->listen_fd, a->iso_fd, a->pool, a->dbc);
+    return NULL;
+}
+
+static const char *net_mode_name(const Config *cfg) {
+    return cfg->net_mode == NET_MODE_EPOLL ? "epoll" : "blocking";
+}
+
+int net_server_run(const Config *cfg, ThreadPool *pool, DBConnection *dbc) {
+    int n = cfg->acceptors > 1 ? cfg->acceptors : 1;
+    int nonblock = cfg->net_mode == NET_MODE_EPOLL;
+    if (n == 1) {
+        int listen_fd = net_listen(cfg, cfg->listen_port, nonblock, 0);
+        if (listen_fd < 0) return 1;
+        int iso_fd = -1;
+        if (cfg->iso8583_port > 0) {
+            iso_fd = net_listen(cfg, cfg->iso8583_port, nonblock, 0);
+            if (iso_fd < 0) { close(listen_fd); return 1; }
+            fprintf(stderr, "ISO 8583 listening on port %d\n", cfg->iso8583_port);
+        }
+        fprintf(stderr, "Server listening on port %d (%s)\n", cfg->listen_port, net_mode_name(cfg));
+        (void)affinity_pin_self(AFFINITY_ROLE_ACCEPTOR, 0); // the main thread is the acceptor
+        return net_run_listener(cfg, listen_fd, iso_fd, pool, dbc);
+    }
+
+    Acceptor *acc = (Acceptor *)calloc((size_t)n, sizeof(*acc));
+    if (!acc) {
+        perror("calloc acceptors");
+        return 1;
+    }
+    int rc = 0, started = 0;
+    // EN: Bind every listener before starting threads so a bind error fails fast
+    // VN: Bind đủ N socket trước khi chạy luồng → lỗi cổng được báo ngay từ đầu
+    for (int i = 0; i < n; ++i) acc[i].iso_fd = -1;
+    for (int i = 0; i < n; ++i) {
+        acc[i].listen_fd = net_listen(cfg, cfg->listen_port, nonblock, 1);
+        if (acc[i].listen_fd < 0) { rc = 1; goto out; }
+        if (cfg->iso8583_port > 0) {
+            acc[i].iso_fd = net_listen(cfg, cfg->iso8583_port, nonblock, 1);
+            if (acc[i].iso_fd < 0) { rc = 1; goto out; }
+        }
+        acc[i].index = i;
+        acc[i].cfg = cfg;
+        acc[i].dbc = dbc;
+        acc[i].pool = pool;
+        if (cfg->acceptor_pool_shards) {
+            // Split THREADS/THREADS_MAX/QUEUE_CAP evenly; the first shards take the remainder
+            int threads = cfg->num_threads / n + (i < cfg->num_threads % n ? 1 : 0);
+            int cap = cfg->queue_cap / n + (i < cfg->queue_cap % n ? 1 : 0);
+            ThreadPoolOptions popts;
+            config_pool_options(cfg, &popts);
+            popts.num_threads = threads > 0 ? threads : 1;
+            if (cfg->max_threads > 0) {
+                int max = cfg->max_threads / n + (i < cfg->max_threads % n ? 1 : 0);
+                popts.max_threads = max > popts.num_threads ? max : 0;
+            }
+            popts.queue_cap = cap > 0 ? cap : 1;
+            acc[i].pool = threadpool_create_ex(&popts);
+            if (!acc[i].pool) { rc = 1; goto out; }
+            acc[i].own_pool = 1;
+        }
+    }
+    if (cfg->iso8583_port > 0) fprintf(stderr, "ISO 8583 listening on port %d (%d acceptors)\n", cfg->iso8583_port, n);
+    fprintf(stderr, "Server listening on port %d (%s, %d acceptors%s)\n", cfg->listen_port,
+            net_mode_name(cfg), n, cfg->acceptor_pool_shards ? ", pool shards" : "");
+    for (; started < n; ++started) {
+        if (pthread_create(&acc[started].tid, NULL, acceptor_main, &acc[started]) != 0) {
+            perror("pthread_create acceptor");
+            rc = 1;
+            break;
+        }
+    }
+    // EN: Acceptor loops only return on fatal errors; the server runs until all exit
+    // VN: Vòng accept chỉ thoát khi lỗi nghiêm trọng; chờ tất cả luồng kết thúc
+    for (int i = 0; i < started; ++i) {
+        pthread_join(acc[i].tid, NULL);
+        if (acc[i].rc != 0) rc = acc[i].rc;
+    }
+out:
+    for (int i = 0; i < n; ++i) {
+        if (i >= started && acc[i].listen_fd > 0) close(acc[i].listen_fd);
+        if (i >= started && acc[i].iso_fd >= 0) close(acc[i].iso_fd);
+        if (acc[i].own_pool) threadpool_destroy(acc[i].pool);
+    }
+    free(acc);
+    return rc;
+}
@@ -0,0 +1,35 @@
+#include "pgnumeric.h"
+
+// Binary NUMERIC (send/recv format) for minor / 10^scale: int16 ndigits,
+// weight, sign, dscale, then base-10000 digits, most significant first,
+// all big-endian. Returns the length.
+// VN: Gửi số tiền dạng NUMERIC nhị phân → PostgreSQL không phải parse chuỗi.
+int numeric_binary(int64_t minor, int scale, unsigned char *out) {
+    uint64_t u = minor < 0 ? 0 - (uint64_t)minor : (uint64_t)minor;
+    uint64_t pow = 1;
+    for (int i = 0; i < scale; ++i) pow *= 10;
+    int pad = (4 - scale % 4) % 4; // align the decimal point to a digit group
+    int frac_groups = (scale + pad) / 4;
+    uint64_t ip = u / pow, fp = u % pow;
+    for (int i = 0; i < pad; ++i) fp *= 10;
+    uint16_t g[8]; // least significant first
+    int k = 0;
+    for (int i = 0; i < frac_groups; ++i, fp /= 10000) g[k++] = (uint16_t)(fp % 10000);
+    for (; ip; ip /= 10000) g[k++] = (uint16_t)(ip % 10000);
+    while (k > 0 && g[k - 1] == 0) k--;  // leading zero groups
+    int lo = 0;
+    while (lo < k && g[lo] == 0) lo++;   // trailing zero groups are implied
+    int ndigits = k - lo;
+    uint16_t hdr[4] = {(uint16_t)ndigits, (uint16_t)(ndigits ? k - 1 - frac_groups : 0),
+                       (uint16_t)(minor < 0 ? 0x4000 : 0), (uint16_t)scale};
+    int n = 0;
+    for (int i = 0; i < 4; ++i, n += 2) {
+        out[n] = (unsigned char)(hdr[i] >> 8);
+        out[n + 1] = (unsigned char)hdr[i];
+    }
+    for (int i = k - 1; i >= lo; --i, n += 2) {
+        out[n] = (unsigned char)(g[i] >> 8);
+        out[n + 1] = (unsigned char)g[i];
+    }
+    return n;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// Amounts as PostgreSQL binary NUMERIC (send/recv format)
+// VN: Mã hoá số tiền (đơn vị nhỏ + số mũ) thành NUMERIC nhị phân để gửi
+//     tham số kiểu binary, PostgreSQL không phải parse chuỗi.
+
+/// Longest encoding of an int64 amount: 8-byte header + at most 7 digit groups
+#define DB_NUMERIC_MAX 24
+
+/**
+ * Encode minor / 10^scale (scale 0..6, as iso_amount_scale()) into out
+ * (DB_NUMERIC_MAX bytes): int16 ndigits, weight, sign, dscale, then the
+ * base-10000 digits, most significant first, all big-endian; no leading or
+ * trailing zero groups. Returns the length.
+ */
+int numeric_binary(int64_t minor, int scale, unsigned char *out);
@@ -0,0 +1,140 @@
+/*
+ * Response builder (EN + VN)
+ *
+ *   iov: [ "{\"status\":\"APPROVED\",\"txn_id\":\"" | visa_r1_1718000000 | "\"}\n" | <next response> ... ]
+ *          static (rodata)                         scratch copy          static
+ *   reply_flush() → one writev for every response of the batch
+ *
+ *  EN: Replies used to be formatted with snprintf into a stack buffer and sent
+ *      with one write() each, so a client pipelining N requests cost N write
+ *      syscalls. The fixed text of the common replies is now static and only
+ *      the variable parts are copied; the handler flushes once per consumed
+ *      batch. A partial write (non-blocking reactor socket) waits for POLLOUT
+ *      with the same 5 s budget the blocking path gets from SO_SNDTIMEO.
+ *  VN: Ghép phản hồi từ mảnh tĩnh + phần thay đổi và gửi cả lô bằng một writev.
+ */
+#include "reply.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+// Flush before a response could run out of fragments (HTTP reply ≈ 7 + body)
+#define REPLY_IOV_RESERVE 16
+
+static volatile unsigned long g_responses = 0;
+static volatile unsigned long g_writes = 0;
+static volatile unsigned long g_bytes = 0;
+
+void reply_init(ReplyBuf *rb, int fd) {
+    rb->fd = fd;
+    rb->failed = 0;
+    rb->iovcnt = 0;
+    rb->responses = 0;
+    rb->used = 0;
+    rb->pending = 0;
+}
+
+// [ANCHOR:REPLY_WRITEV]
+// Write iov[0..cnt) completely, handling partial writes and EINTR; updates
+// the counters. Returns 0 or -1.
+static int writev_all(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+                if (poll(&pfd, 1, 5000) <= 0) return -1;
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) return -1;
+        __sync_fetch_and_add(&g_writes, 1);
+        __sync_fetch_and_add(&g_bytes, (unsigned long)n);
+        size_t left = (size_t)n;
+        while (cnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return 0;
+}
+
+int reply_flush(ReplyBuf *rb) {
+    if (rb->iovcnt > 0 && !rb->failed && writev_all(rb->fd, rb->iov, rb->iovcnt) != 0) rb->failed = 1;
+    if (rb->responses) __sync_fetch_and_add(&g_responses, rb->responses);
+    rb->iovcnt = 0;
+    rb->responses = 0;
+    rb->used = 0;
+    rb->pending = 0;
+    return rb->failed ? -1 : 0;
+}
+
+static void reply_push(ReplyBuf *rb, const char *p, size_t n) {
+    if (n == 0) return;
+    if (rb->iovcnt == REPLY_IOV_MAX) (void)reply_flush(rb);
+    struct iovec *last = rb->iovcnt ? &rb->iov[rb->iovcnt - 1] : NULL;
+    if (last && (const char *)last->iov_base + last->iov_len == p) {
+        last->iov_len += n; // contiguous scratch copies share one fragment
+    } else {
+        rb->iov[rb->iovcnt].iov_base = (void *)p;
+        rb->iov[rb->iovcnt].iov_len = n;
+        rb->iovcnt++;
+    }
+    rb->pending += n;
+}
+
+void reply_static(ReplyBuf *rb, const char *p, size_t n) {
+    reply_push(rb, p, n);
+}
+
+// Scratch space for n bytes and a free fragment: a flush inside reply_push()
+// would rewind the scratch under a copy that is not queued yet
+static int reply_room(ReplyBuf *rb, size_t n) {
+    return n <= REPLY_SCRATCH_BYTES - rb->used && rb->iovcnt < REPLY_IOV_MAX;
+}
+
+void reply_copy(ReplyBuf *rb, const void *p, size_t n) {
+    if (!reply_room(rb, n)) {
+        (void)reply_flush(rb);
+        if (n > REPLY_SCRATCH_BYTES) {
+            struct iovec one = { .iov_base = (void *)p, .iov_len = n };
+            if (!rb->failed && writev_all(rb->fd, &one, 1) != 0) rb->failed = 1;
+            return;
+        }
+    }
+    char *dst = rb->scratch + rb->used;
+    memcpy(dst, p, n);
+    rb->used += n;
+    reply_push(rb, dst, n);
+}
+
+char *reply_reserve(ReplyBuf *rb, size_t cap) {
+    if (cap > REPLY_SCRATCH_BYTES) return NULL;
+    if (!reply_room(rb, cap)) (void)reply_flush(rb);
+    return rb->scratch + rb->used;
+}
+
+void reply_commit(ReplyBuf *rb, size_t n) {
+    char *dst = rb->scratch + rb->used;
+    rb->used += n;
+    reply_push(rb, dst, n);
+}
+
+void reply_end(ReplyBuf *rb) {
+    rb->responses++;
+    if (rb->iovcnt > REPLY_IOV_MAX - REPLY_IOV_RESERVE) (void)reply_flush(rb);
+}
+
+void reply_stats(ReplyStats *out) {
+    out->responses = g_responses;
+    out->writes = g_writes;
+    out->bytes = g_bytes;
+}
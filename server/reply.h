@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Response builder: responses are queued as iovecs and written with writev
+// VN: Phản hồi được ghép từ các mảnh tĩnh (header/JSON dựng sẵn) và phần thay
+//     đổi (txn_id, lý do, Content-Length); mọi phản hồi của một lần đọc (kể cả
+//     pipelining) được gửi bằng một lệnh writev.
+
+/// Fragments queued before a flush is forced
+#define REPLY_IOV_MAX 128
+/// Copy space for the variable parts (and whole dynamic bodies)
+#define REPLY_SCRATCH_BYTES 8192
+
+/// Totals over all connections since start (GET /metrics)
+typedef struct {
+    unsigned long responses; ///< responses completed with reply_end()
+    unsigned long writes;    ///< write/writev syscalls that sent them
+    unsigned long bytes;     ///< bytes sent
+} ReplyStats;
+
+/**
+ * Output queue of one connection for one handler_consume() call (lives on its
+ * stack). Fragments added with reply_static() are referenced, not copied, so
+ * they must outlive the flush: string literals and other static data only.
+ */
+typedef struct ReplyBuf {
+    int fd;
+    int failed;        ///< a write failed: nothing more is sent
+    int iovcnt;
+    unsigned responses; ///< completed, not yet flushed
+    size_t used;       ///< scratch bytes in use
+    size_t pending;    ///< bytes queued
+    struct iovec iov[REPLY_IOV_MAX];
+    char scratch[REPLY_SCRATCH_BYTES];
+} ReplyBuf;
+
+void reply_init(ReplyBuf *rb, int fd);
+
+// Queue n bytes of static data by reference
+void reply_static(ReplyBuf *rb, const char *p, size_t n);
+#define REPLY_LIT(rb, lit) reply_static((rb), (lit), sizeof(lit) - 1)
+
+// Queue a copy of n transient bytes (flushes first when the scratch is full;
+// data larger than the scratch is written straight away)
+void reply_copy(ReplyBuf *rb, const void *p, size_t n);
+
+/**
+ * Reserve up to cap bytes of scratch to build a fragment in place (ISO 8583
+ * encoder); reply_commit() queues the n bytes actually written. Returns NULL
+ * when cap exceeds REPLY_SCRATCH_BYTES.
+ */
+char *reply_reserve(ReplyBuf *rb, size_t cap);
+void reply_commit(ReplyBuf *rb, size_t n);
+
+// Mark the end of one response; flushes early when the queue is nearly full
+void reply_end(ReplyBuf *rb);
+
+// Write everything queued (one writev while the socket takes it all).
+// Returns 0, or -1 once a write failed.
+int reply_flush(ReplyBuf *rb);
+
+void reply_stats(ReplyStats *out);
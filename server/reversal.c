@@ -2,7 +2,10 @@
 #include "clearing_participant.h"
 #include "log.h"
 #include "metrics.h"
+#include "threadpool.h"
+#include "affinity.h"
 #include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -11,8 +14,10 @@
 typedef struct ReversalTask {
     char txn_id[MAX_TRANSACTION_ID_LEN];
     char pan_masked[32];
-    char amount[16];
+    int64_t amount_minor;
+    int amount_exp;
     char merchant_id[32];
+    int item_count;       // > 1: void of a batch hold (amount = its total)
     int attempts;
     time_t next_at;
     struct ReversalTask *next;
@@ -23,6 +28,7 @@ static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t g_cv = PTHREAD_COND_INITIALIZER;
 static ReversalTask *g_head = NULL;
 static int g_shutdown = 0;
+static ThreadPool *g_pool = NULL; // background lane for attempts (guarded by g_mu)
 
 static int max_attempts(void) {
     const char *s = getenv("REVERSAL_MAX_ATTEMPTS");
@@ -61,8 +67,52 @@ static ReversalTask *queue_pop_ready(time_t now) {
     return NULL;
 }
 
+// One best-effort abort/void on clearing; reschedules itself on failure
+static void reversal_attempt(ReversalTask *task) {
+    ClearingParticipantContext *ctx = clearing_participant_init(NULL, 10);
+    if (ctx) {
+        if (task->item_count > 1)
+            (void)clearing_participant_set_batch(ctx, task->txn_id, task->item_count,
+                                                 task->amount_minor, task->amount_exp,
+                                                 task->merchant_id);
+        else
+            (void)clearing_participant_set_transaction(ctx, task->txn_id,
+                                                       task->pan_masked,
+                                                       task->amount_minor,
+                                                       task->amount_exp,
+                                                       task->merchant_id);
+        int rc = clearing_participant_abort(ctx, task->txn_id);
+        clearing_participant_destroy(ctx);
+        if (rc == 0) {
+            log_message_json("INFO", "reversal", task->txn_id, "Reversal success", -1);
+            metrics_inc_reversal_succeeded();
+            free(task);
+            return;
+        }
+    }
+    // schedule retry
+    task->attempts++;
+    if (task->attempts >= max_attempts()) {
+        log_message_json("ERROR", "reversal", task->txn_id, "Reversal failed permanently", -1);
+        metrics_inc_reversal_failed();
+        free(task);
+        return;
+    }
+    int delay = base_delay_ms() * (1 << (task->attempts - 1));
+    task->next_at = time(NULL) + (delay / 1000);
+    pthread_mutex_lock(&g_mu);
+    queue_push(task);
+    pthread_cond_signal(&g_cv); // the loop may be waiting with an empty queue
+    pthread_mutex_unlock(&g_mu);
+}
+
+static void reversal_attempt_job(void *arg) {
+    reversal_attempt((ReversalTask *)arg);
+}
+
 static void *reversal_loop(void *arg) {
     (void)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_BACKGROUND, 0);
     while (1) {
         pthread_mutex_lock(&g_mu);
         while (!g_shutdown && !g_head) {
@@ -81,37 +131,15 @@ static void *reversal_loop(void *arg) {
             pthread_mutex_unlock(&g_mu);
             continue;
         }
-        pthread_mutex_unlock(&g_mu);
-
-        // Perform best-effort abort/void on clearing
-        ClearingParticipantContext *ctx = clearing_participant_init(NULL, 10);
-        if (ctx) {
-            (void)clearing_participant_set_transaction(ctx, task->txn_id,
-                                                       task->pan_masked,
-                                                       task->amount,
-                                                       task->merchant_id);
-            int rc = clearing_participant_abort(ctx, task->txn_id);
-            clearing_participant_destroy(ctx);
-            if (rc == 0) {
-                log_message_json("INFO", "reversal", task->txn_id, "Reversal success", -1);
-                metrics_inc_reversal_succeeded();
-                free(task);
-                continue;
-            }
-        }
-        // schedule retry
-        task->attempts++;
-        if (task->attempts >= max_attempts()) {
-            log_message_json("ERROR", "reversal", task->txn_id, "Reversal failed permanently", -1);
-            metrics_inc_reversal_failed();
-            free(task);
+        // Hand the attempt to the pool's background lane (runs only when
+        // payment work leaves a worker free); lane full → do it here
+        if (g_pool && threadpool_submit_lane(g_pool, THREADPOOL_LANE_BACKGROUND,
+                                             reversal_attempt_job, NULL, task, 0) == 0) {
+            pthread_mutex_unlock(&g_mu);
             continue;
         }
-        int delay = base_delay_ms() * (1 << (task->attempts - 1));
-        task->next_at = time(NULL) + (delay / 1000);
-        pthread_mutex_lock(&g_mu);
-        queue_push(task);
         pthread_mutex_unlock(&g_mu);
+        reversal_attempt(task);
     }
     return NULL;
 }
@@ -124,17 +152,27 @@ int reversal_init(void) {
     return 0;
 }
 
-int reversal_enqueue(const char *txn_id,
-                     const char *pan_masked,
-                     const char *amount,
-                     const char *merchant_id) {
+void reversal_set_pool(ThreadPool *pool) {
+    pthread_mutex_lock(&g_mu);
+    g_pool = pool;
+    pthread_mutex_unlock(&g_mu);
+}
+
+static int enqueue_task(const char *txn_id,
+                        const char *pan_masked,
+                        int item_count,
+                        int64_t amount_minor,
+                        int amount_exp,
+                        const char *merchant_id) {
     if (!txn_id || !*txn_id) return -1;
     ReversalTask *t = (ReversalTask *)malloc(sizeof(ReversalTask));
     if (!t) return -1;
     memset(t, 0, sizeof(*t));
     strncpy(t->txn_id, txn_id, sizeof(t->txn_id) - 1);
     if (pan_masked) strncpy(t->pan_masked, pan_masked, sizeof(t->pan_masked) - 1);
-    if (amount) strncpy(t->amount, amount, sizeof(t->amount) - 1);
+    t->item_count = item_count;
+    t->amount_minor = amount_minor;
+    t->amount_exp = amount_exp;
     if (merchant_id) strncpy(t->merchant_id, merchant_id, sizeof(t->merchant_id) - 1);
     t->attempts = 0;
     t->next_at = time(NULL);
@@ -148,6 +186,23 @@ int reversal_enqueue(const char *txn_id,
     return 0;
 }
 
+int reversal_enqueue(const char *txn_id,
+                     const char *pan_masked,
+                     int64_t amount_minor,
+                     int amount_exp,
+                     const char *merchant_id) {
+    return enqueue_task(txn_id, pan_masked, 1, amount_minor, amount_exp, merchant_id);
+}
+
+int reversal_enqueue_batch(const char *txn_id,
+                           int item_count,
+                           int64_t total_minor,
+                           int amount_exp,
+                           const char *merchant_id) {
+    if (item_count <= 0) return -1;
+    return enqueue_task(txn_id, "", item_count, total_minor, amount_exp, merchant_id);
+}
+
 void reversal_shutdown(void) {
     pthread_mutex_lock(&g_mu);
     g_shutdown = 1;
@@ -1,16 +1,34 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 // Initialize background reversal worker
 int reversal_init(void);
 
-// Enqueue a best-effort reversal/void for a transaction
+// Enqueue a best-effort reversal/void for a transaction (amount in minor
+// units + currency exponent; the task keeps its own copy of everything)
 int reversal_enqueue(const char *txn_id,
                      const char *pan_masked,
-                     const char *amount,
+                     int64_t amount_minor,
+                     int amount_exp,
                      const char *merchant_id);
 
+// Same for the single clearing hold of a batch: item_count payments whose
+// total_minor is in one currency (exponent amount_exp), voided as the batch
+// it was placed as (see clearing_participant_set_batch)
+int reversal_enqueue_batch(const char *txn_id,
+                           int item_count,
+                           int64_t total_minor,
+                           int amount_exp,
+                           const char *merchant_id);
+
+struct ThreadPool;
+
+// Run reversal attempts as background-lane jobs on pool (NULL = run them on
+// the reversal thread itself). Set NULL again before destroying the pool.
+void reversal_set_pool(struct ThreadPool *pool);
+
 // Shutdown and drain worker
 void reversal_shutdown(void);
 
@@ -47,13 +47,13 @@ static VelEntry *vel_get(const char *pan) {
     return &g_vel[idx];
 }
 
-void risk_evaluate(const IsoRequest *req, RiskDecision *out) {
+void risk_evaluate(const IsoRequestView *req, RiskDecision *out) {
     if (!out) return;
     out->allow = 1;
     out->reason[0] = '\0';
     if (!g_risk_enabled || !req) return;
     time_t now = time(NULL);
-    VelEntry *e = vel_get(req->pan);
+    VelEntry *e = vel_get(req->pan.p);
     if (now - e->window_start >= g_vel_window_sec) {
         e->window_start = now;
         e->count = 0;
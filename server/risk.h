@@ -10,5 +10,5 @@ typedef struct RiskDecision {
 void risk_init(void);
 
 // Evaluate a request with simple rules (stub). Always allow for now.
-void risk_evaluate(const IsoRequest *req, RiskDecision *out);
+void risk_evaluate(const IsoRequestView *req, RiskDecision *out);
 
@@ -0,0 +1,186 @@
+/*
+ * Structural scanning (EN + VN)
+ *
+ *   64-byte block ──► bitmasks: quote  backslash  structural  (1 bit per byte)
+ *                       in_string = prefix_xor(quote) ^ carry
+ *                       index    += quote | (structural & ~in_string)
+ *
+ *  EN: Stage 1 of a simdjson-style parser: one pass over the request builds
+ *      the positions of its structural characters, and the tokenizer in
+ *      iso8583.c walks those positions instead of every byte. Escapes are not
+ *      tracked: a backslash anywhere sends the request to the scalar parser
+ *      (card requests essentially never contain one). The implementation is
+ *      picked once from CPUID (AVX2 > SSE2 > scalar); SIMD_SCAN can force one.
+ *      "scalar" builds no index and the tokenizer walks bytes (the only choice
+ *      on non-x86 builds). Framing finds '\n' with memchr for every choice.
+ *  VN: Bước 1 kiểu simdjson: một lượt quét tạo danh sách vị trí ký tự cấu trúc
+ *      (ngoài chuỗi) để bộ tách JSON nhảy thẳng giữa các token. Gặp '\' thì
+ *      dùng bộ tách thường. Chọn AVX2/SSE2/scalar theo CPUID lúc chạy.
+ */
+#include "simdscan.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMDSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static int g_impl = -1; // SimdScanImpl once selected
+
+static int best_impl(void) {
+#ifdef SIMDSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul")) return SIMDSCAN_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMDSCAN_SSE2;
+#endif
+    return SIMDSCAN_SCALAR;
+}
+
+SimdScanImpl simdscan_impl(void) {
+    int impl = __atomic_load_n(&g_impl, __ATOMIC_RELAXED);
+    if (impl < 0) {
+        impl = best_impl();
+        __atomic_store_n(&g_impl, impl, __ATOMIC_RELAXED);
+    }
+    return (SimdScanImpl)impl;
+}
+
+const char *simdscan_impl_name(SimdScanImpl impl) {
+    switch (impl) {
+    case SIMDSCAN_AVX2: return "avx2";
+    case SIMDSCAN_SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+int simdscan_force(SimdScanImpl impl) {
+    if ((int)impl < SIMDSCAN_SCALAR || (int)impl > best_impl()) return -1;
+    __atomic_store_n(&g_impl, (int)impl, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int simdscan_parse_name(const char *name, SimdScanImpl *out) {
+    if (!name || !*name || strcmp(name, "auto") == 0) *out = (SimdScanImpl)best_impl();
+    else if (strcmp(name, "scalar") == 0) *out = SIMDSCAN_SCALAR;
+    else if (strcmp(name, "sse2") == 0) *out = SIMDSCAN_SSE2;
+    else if (strcmp(name, "avx2") == 0) *out = SIMDSCAN_AVX2;
+    else return -1;
+    return 0;
+}
+
+#ifdef SIMDSCAN_X86
+// Bit i set → inside a string at byte i (opening quote included, closing not)
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// '[' | 0x20 == '{' and ']' | 0x20 == '}': four compares cover six characters
+__attribute__((no_sanitize_address))
+static inline void block_sse2(const uint8_t *p, uint64_t *quote, uint64_t *bslash, uint64_t *st) {
+    const __m128i vq = _mm_set1_epi8('"'), vb = _mm_set1_epi8('\\');
+    const __m128i vl = _mm_set1_epi8('{'), vr = _mm_set1_epi8('}');
+    const __m128i vc = _mm_set1_epi8(':'), vm = _mm_set1_epi8(','), v20 = _mm_set1_epi8(0x20);
+    uint64_t q = 0, b = 0, s = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i x = _mm_load_si128((const __m128i *)(p + 16 * k));
+        __m128i lo = _mm_or_si128(x, v20);
+        __m128i sm = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lo, vl), _mm_cmpeq_epi8(lo, vr)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(x, vc), _mm_cmpeq_epi8(x, vm)));
+        q |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, vq)) << (16 * k);
+        b |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, vb)) << (16 * k);
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(sm) << (16 * k);
+    }
+    *quote = q;
+    *bslash = b;
+    *st = s;
+}
+
+// Carry-less multiply by all ones = prefix xor in one instruction (AVX2 CPUs have PCLMUL)
+__attribute__((target("pclmul")))
+static inline uint64_t prefix_xor_clmul(uint64_t x) {
+    return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)x), _mm_set1_epi8((char)0xFF), 0));
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static inline void block_avx2(const uint8_t *p, uint64_t *quote, uint64_t *bslash, uint64_t *st) {
+    const __m256i vq = _mm256_set1_epi8('"'), vb = _mm256_set1_epi8('\\');
+    const __m256i vl = _mm256_set1_epi8('{'), vr = _mm256_set1_epi8('}');
+    const __m256i vc = _mm256_set1_epi8(':'), vm = _mm256_set1_epi8(','), v20 = _mm256_set1_epi8(0x20);
+    uint64_t q = 0, b = 0, s = 0;
+    for (int k = 0; k < 2; ++k) {
+        __m256i x = _mm256_load_si256((const __m256i *)(p + 32 * k));
+        __m256i lo = _mm256_or_si256(x, v20);
+        __m256i sm = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, vl), _mm256_cmpeq_epi8(lo, vr)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(x, vc), _mm256_cmpeq_epi8(x, vm)));
+        q |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, vq)) << (32 * k);
+        b |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, vb)) << (32 * k);
+        s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(sm) << (32 * k);
+    }
+    *quote = q;
+    *bslash = b;
+    *st = s;
+}
+
+// One driver per implementation so the block function inlines into it.
+// Blocks are 64-byte aligned: a block holding any byte of buf lies within
+// one page, so reading all of it cannot fault (the glibc strlen trick; it
+// avoids copying the tail, whose store-forwarding stall cost more than the
+// scan). Bits outside buf are masked off. ASan would flag those reads as
+// out of bounds, hence no_sanitize_address.
+#define SIMDSCAN_DEFINE_STRUCTURAL(NAME, ATTR, BLOCK, PREFIX_XOR)                                         \
+    ATTR __attribute__((no_sanitize_address))                                                 \
+    static size_t NAME(const char *buf, size_t len, uint32_t *idx, size_t cap) {              \
+        size_t n = 0;                                                                         \
+        uint64_t carry = 0; /* all ones while a string continues into the next block */       \
+        const uint8_t *end = (const uint8_t *)buf + len;                                      \
+        const uint8_t *blk = (const uint8_t *)((uintptr_t)buf & ~(uintptr_t)63);              \
+        ptrdiff_t base = blk - (const uint8_t *)buf; /* <= 0 for the first block */           \
+        for (; blk < end; blk += 64, base += 64) {                                            \
+            uint64_t q, b, s;                                                                 \
+            BLOCK(blk, &q, &b, &s);                                                           \
+            uint64_t valid = ~0ULL;                                                           \
+            if (base < 0) valid <<= -base;                                                    \
+            if (end - blk < 64) valid &= (1ULL << (end - blk)) - 1;                           \
+            q &= valid;                                                                       \
+            s &= valid;                                                                       \
+            if (b & valid) return SIMDSCAN_FALLBACK;                                          \
+            uint64_t in_str = PREFIX_XOR(q) ^ carry;                                          \
+            carry = (uint64_t)((int64_t)in_str >> 63);                                        \
+            uint64_t m = q | (s & ~in_str);                                                   \
+            while (m) {                                                                       \
+                if (n == cap) return SIMDSCAN_FALLBACK;                                       \
+                idx[n++] = (uint32_t)(base + __builtin_ctzll(m));                             \
+                m &= m - 1;                                                                   \
+            }                                                                                 \
+        }                                                                                     \
+        return n;                                                                             \
+    }
+
+SIMDSCAN_DEFINE_STRUCTURAL(structural_sse2, , block_sse2, prefix_xor)
+SIMDSCAN_DEFINE_STRUCTURAL(structural_avx2, __attribute__((target("avx2,pclmul"))), block_avx2, prefix_xor_clmul)
+#endif
+
+size_t simdscan_structural(const char *buf, size_t len, uint32_t *idx, size_t cap) {
+    if (len > UINT32_MAX) return SIMDSCAN_FALLBACK;
+    switch (simdscan_impl()) {
+#ifdef SIMDSCAN_X86
+    case SIMDSCAN_AVX2: return structural_avx2(buf, len, idx, cap);
+    case SIMDSCAN_SSE2: return structural_sse2(buf, len, idx, cap);
+#endif
+    default: (void)idx; (void)cap; return SIMDSCAN_FALLBACK; // byte-wise parser is the scalar path
+    }
+}
+
+// glibc's memchr already picks an AVX2/EVEX loop through ifunc and beat
+// hand-written 32/64-byte loops here on request-sized lines (bench_scan), so
+// framing keeps it for every implementation
+const char *simdscan_newline(const char *p, size_t n) {
+    return memchr(p, '\n', n);
+}
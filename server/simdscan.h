@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Structural scanning for request framing and the JSON tokenizer
+// VN: Quét ký tự cấu trúc ('\n', '"', ':', ',', '{', '}', '[', ']') bằng SIMD
+//     (AVX2/SSE2) hoặc vòng lặp thường; chọn lúc chạy theo CPUID.
+
+typedef enum {
+    SIMDSCAN_SCALAR = 0, ///< no index: byte-wise tokenizer + memchr (non-x86 or forced)
+    SIMDSCAN_SSE2 = 1,   ///< 16-byte compares (baseline x86-64)
+    SIMDSCAN_AVX2 = 2    ///< 32-byte compares
+} SimdScanImpl;
+
+/// Return value of simdscan_structural() when the fast path does not apply
+#define SIMDSCAN_FALLBACK ((size_t)-1)
+
+// Implementation in use (the best one the CPU supports unless forced)
+SimdScanImpl simdscan_impl(void);
+
+// "scalar" / "sse2" / "avx2"
+const char *simdscan_impl_name(SimdScanImpl impl);
+
+// Use impl from now on (SIMD_SCAN env, benchmarks). Returns 0, or -1 when the
+// CPU or the build does not support it (the selection is left unchanged).
+int simdscan_force(SimdScanImpl impl);
+
+// Parse "auto" / "scalar" / "sse2" / "avx2" into *out (auto → best supported);
+// -1 on an unknown name
+int simdscan_parse_name(const char *name, SimdScanImpl *out);
+
+// First '\n' in [p, p + n), or NULL (request framing; libc memchr, already vectorized)
+const char *simdscan_newline(const char *p, size_t n);
+
+/*
+ * simdjson-style stage 1: positions of every '"' and of every '{', '}', '[',
+ * ']', ':', ',' outside strings in buf[0..len), ascending, into idx[0..cap).
+ * Quotes are paired from the start of buf, so each opening quote is directly
+ * followed in idx by its closing quote. Returns the count, or
+ * SIMDSCAN_FALLBACK when buf contains a backslash (escapes need the scalar
+ * parser), more than cap positions, or the scalar implementation is in use.
+ */
+size_t simdscan_structural(const char *buf, size_t len, uint32_t *idx, size_t cap);
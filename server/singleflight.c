@@ -0,0 +1,214 @@
+/*
+ * In-flight request coalescing (EN + VN)
+ *
+ *   retry #1 ──► singleflight_join ─ leader ─► 2PC ─► singleflight_end(result) ─┐
+ *   retry #2 ──► singleflight_join ─ waits on the call's condvar ◄──────────────┤ same result
+ *   retry #3 ──► singleflight_join ─ waits ◄────────────────────────────────────┘
+ *
+ *  EN: The idempotency cache (idem.c) only knows committed outcomes. A retry
+ *      that arrives while the first attempt is still in 2PC used to start a
+ *      second transaction with its own txn_id, place a second clearing hold,
+ *      and then wait on the first one's row lock until ON CONFLICT resolved
+ *      it. Now the first arrival leads the call and later arrivals block
+ *      (bounded by SINGLEFLIGHT_WAIT_MS and the request deadline) until its
+ *      result is published. Calls live in 64 mutex-protected shards and exist
+ *      only while in flight. A caller that must not block a worker
+ *      (DB_ASYNC) subscribes instead: singleflight_end() hands it the
+ *      result through its callback.
+ *  VN: Bản đầu tiên của một request_id chạy 2PC; các bản trùng đến sau chờ và
+ *      nhận cùng kết quả, không mở giao dịch / hold clearing thứ hai.
+ */
+#include "singleflight.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SF_SHARDS 64
+#define SF_KEY_MAX 64
+
+typedef struct SfSub {
+    struct SfSub *next;
+    SingleflightFn fn;
+    void *arg;
+} SfSub;
+
+typedef struct SfCall {
+    struct SfCall *next;
+    uint64_t hash;
+    int done;
+    int waiters;
+    SfSub *subs;             // subscribers, answered by singleflight_end()
+    pthread_cond_t cv;       // waits under the shard mutex
+    char key[SF_KEY_MAX];
+    unsigned char result[SINGLEFLIGHT_RESULT_MAX];
+} SfCall;
+
+typedef struct {
+    pthread_mutex_t mu;
+    SfCall *calls;           // in flight (not done)
+} __attribute__((aligned(64))) SfShard;
+
+static SfShard g_shards[SF_SHARDS];
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static int g_wait_ms = 0;
+
+static volatile unsigned long g_leaders = 0;
+static volatile unsigned long g_coalesced = 0;
+static volatile unsigned long g_timeouts = 0;
+
+static void sf_init_shards(void) {
+    for (int s = 0; s < SF_SHARDS; ++s) {
+        pthread_mutex_init(&g_shards[s].mu, NULL);
+        g_shards[s].calls = NULL;
+    }
+}
+
+void singleflight_configure(int wait_ms) {
+    pthread_once(&g_once, sf_init_shards);
+    g_wait_ms = wait_ms > 0 ? wait_ms : 0;
+}
+
+static uint64_t fnv1a(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    return h;
+}
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static SfCall *shard_find(SfShard *sh, uint64_t h, const char *key) {
+    for (SfCall *c = sh->calls; c; c = c->next) {
+        if (c->hash == h && strcmp(c->key, key) == 0) return c;
+    }
+    return NULL;
+}
+
+static SfCall *call_new(uint64_t h, const char *key) {
+    SfCall *c = malloc(sizeof(*c));
+    if (!c) return NULL;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cv, &attr);
+    pthread_condattr_destroy(&attr);
+    c->next = NULL;
+    c->hash = h;
+    c->done = 0;
+    c->waiters = 0;
+    c->subs = NULL;
+    memcpy(c->key, key, strlen(key) + 1);
+    return c;
+}
+
+static void call_free(SfCall *c) {
+    pthread_cond_destroy(&c->cv);
+    free(c);
+}
+
+// No call for key yet: the caller leads a new one (shard locked; NULL = out of memory)
+static SfCall *shard_lead(SfShard *sh, uint64_t h, const char *key) {
+    SfCall *c = call_new(h, key);
+    if (!c) return NULL;
+    c->next = sh->calls;
+    sh->calls = c;
+    __sync_fetch_and_add(&g_leaders, 1);
+    return c;
+}
+
+int singleflight_join(const char *key, void *out, size_t size, long long deadline_ns) {
+    if (g_wait_ms <= 0 || !key || !key[0] || strlen(key) >= SF_KEY_MAX || size > SINGLEFLIGHT_RESULT_MAX) return -1;
+    uint64_t h = fnv1a(key);
+    SfShard *sh = &g_shards[h % SF_SHARDS];
+    pthread_mutex_lock(&sh->mu);
+    SfCall *c = shard_find(sh, h, key);
+    if (!c) {
+        c = shard_lead(sh, h, key);
+        pthread_mutex_unlock(&sh->mu);
+        return c ? 1 : -1;
+    }
+
+    // [ANCHOR:SINGLEFLIGHT_WAIT] Follower: wait for the leader, at most until
+    // the tighter of the configured wait and the request's own deadline
+    long long until = mono_ns() + (long long)g_wait_ms * 1000000LL;
+    if (deadline_ns > 0 && deadline_ns < until) until = deadline_ns;
+    struct timespec ts = { .tv_sec = (time_t)(until / 1000000000LL), .tv_nsec = (long)(until % 1000000000LL) };
+    c->waiters++;
+    while (!c->done) {
+        if (pthread_cond_timedwait(&c->cv, &sh->mu, &ts) == ETIMEDOUT) break;
+    }
+    int rc = -1;
+    if (c->done) {
+        memcpy(out, c->result, size);
+        rc = 0;
+    }
+    // The leader unlinked a done call; the last one out frees it
+    if (--c->waiters == 0 && c->done) call_free(c);
+    pthread_mutex_unlock(&sh->mu);
+    __sync_fetch_and_add(rc == 0 ? &g_coalesced : &g_timeouts, 1);
+    return rc;
+}
+
+int singleflight_subscribe(const char *key, SingleflightFn fn, void *arg) {
+    if (g_wait_ms <= 0 || !fn || !key || !key[0] || strlen(key) >= SF_KEY_MAX) return -1;
+    uint64_t h = fnv1a(key);
+    SfShard *sh = &g_shards[h % SF_SHARDS];
+    pthread_mutex_lock(&sh->mu);
+    SfCall *c = shard_find(sh, h, key);
+    int rc = -1;
+    if (!c) {
+        if (shard_lead(sh, h, key)) rc = 1;
+    } else {
+        SfSub *sub = malloc(sizeof(*sub));
+        if (sub) {
+            sub->fn = fn;
+            sub->arg = arg;
+            sub->next = c->subs;
+            c->subs = sub;
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&sh->mu);
+    return rc;
+}
+
+void singleflight_end(const char *key, const void *result, size_t size) {
+    if (!key || !key[0] || size > SINGLEFLIGHT_RESULT_MAX) return;
+    uint64_t h = fnv1a(key);
+    SfShard *sh = &g_shards[h % SF_SHARDS];
+    SfSub *subs = NULL;
+    pthread_mutex_lock(&sh->mu);
+    SfCall **link = &sh->calls;
+    while (*link && !((*link)->hash == h && strcmp((*link)->key, key) == 0)) link = &(*link)->next;
+    SfCall *c = *link;
+    if (c) {
+        *link = c->next;
+        memcpy(c->result, result, size);
+        c->done = 1;
+        subs = c->subs;
+        c->subs = NULL;
+        if (c->waiters == 0) call_free(c);
+        else pthread_cond_broadcast(&c->cv);
+    }
+    pthread_mutex_unlock(&sh->mu);
+    // Subscribers run unlocked: a callback may join or end other calls
+    while (subs) {
+        SfSub *next = subs->next;
+        subs->fn(subs->arg, result, size);
+        free(subs);
+        __sync_fetch_and_add(&g_coalesced, 1);
+        subs = next;
+    }
+}
+
+void singleflight_stats(SingleflightStats *out) {
+    out->leaders = g_leaders;
+    out->coalesced = g_coalesced;
+    out->timeouts = g_timeouts;
+}
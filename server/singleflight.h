@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+// In-flight request coalescing ("singleflight") keyed by request_id
+// VN: Khi terminal gửi lại (retry) trong lúc lần đầu còn đang chạy 2PC, bản sau
+//     không mở giao dịch thứ hai mà chờ kết quả của bản đầu và trả lời y hệt.
+
+/// Default wait for the first attempt's outcome (SINGLEFLIGHT_WAIT_MS)
+#define SINGLEFLIGHT_DEFAULT_WAIT_MS 2000
+/// Largest result a call can hand to its followers
+#define SINGLEFLIGHT_RESULT_MAX 256
+
+/// Totals since start (GET /metrics)
+typedef struct {
+    unsigned long leaders;   ///< calls run by the first arrival
+    unsigned long coalesced; ///< duplicates answered with a leader's result
+    unsigned long timeouts;  ///< duplicates that stopped waiting and ran on their own
+} SingleflightStats;
+
+// Longest wait for a leader (0 = coalescing off). Call once at startup.
+void singleflight_configure(int wait_ms);
+
+/**
+ * Join the call for key. Returns
+ *   1  the caller leads: run the work, then singleflight_end() with the result;
+ *   0  another thread led it: out holds a copy of its size-byte result;
+ *  -1  run the work without singleflight_end() (coalescing off, empty or too
+ *      long key, or no result by deadline_ns / the configured wait).
+ * deadline_ns is an absolute CLOCK_MONOTONIC time (0 = only the configured
+ * wait). size must be <= SINGLEFLIGHT_RESULT_MAX.
+ */
+int singleflight_join(const char *key, void *out, size_t size, long long deadline_ns);
+
+/// Called once with the leader's result (see singleflight_subscribe)
+typedef void (*SingleflightFn)(void *arg, const void *result, size_t size);
+
+/**
+ * Like singleflight_join() for a caller that must not block (DB_ASYNC): 1 =
+ * lead, -1 = run alone, or 0 = subscribed: fn(arg, result, size) runs once
+ * on the thread that calls singleflight_end(), after the shard is unlocked,
+ * so it should only hand the result on. A subscriber has no timeout; it
+ * waits as long as the leader's own 2PC.
+ */
+int singleflight_subscribe(const char *key, SingleflightFn fn, void *arg);
+
+// Publish the leader's result to every waiter and subscriber, retire the call
+void singleflight_end(const char *key, const void *result, size_t size);
+
+void singleflight_stats(SingleflightStats *out);
@@ -1,174 +1,829 @@
 /*
  * Thread Pool — Visual Overview / Sơ đồ tổng quan (EN + VN)
  *
- *              submit(job)
- *  producers  --------------->  [ LOCK ]  queue (bounded FIFO)  [ UNLOCK ]
- *                                        head ......... tail
- *                                                ^ size<=cap
- *                                                   |
- *                                             condvar signal
- *                                                   v
- *                        [wait cv]  worker ----> pop one ----> run outside lock
- *
- *  EN: Backpressure — when size == cap, submit() returns -1 so caller can
- *      fail fast (e.g., send {"reason":"server_busy"}) instead of queuing
- *      unbounded work which would explode latency (p95/p99).
- *
- *  VN: Chống quá tải — khi hàng đợi đầy (size==cap), submit() trả -1 để bên
- *      gọi (vòng accept) phản hồi "server_busy" ngay, không xếp hàng vô hạn.
- *      Cách này giữ độ trễ (p95/p99) ổn định thay vì phình to khi quá tải.
+ *              submit(job)                       bounded MPMC ring (QUEUE_CAP cells)
+ *  producers  ------------->  CAS enqueue_pos  -> [c0][c1][c2]....[cap-1]
+ *                                                   seq|fn|arg per cell
+ *                                                        |
+ *                             eventcount (futex)  <------+  wake 1 if someone parked
+ *                                    |
+ *                        [park]  worker ----> CAS dequeue_pos ----> run job
+ *
+ *  EN: Backpressure — when every cell is occupied, submit() returns -1 so the
+ *      caller can fail fast (e.g., send {"reason":"server_busy"}) instead of
+ *      queuing unbounded work which would explode latency (p95/p99).
+ *  EN: The ring is preallocated (no malloc per job) and lock-free (Vyukov
+ *      bounded MPMC): each cell carries a sequence number that tells producers
+ *      and consumers whose turn it is, so they never share a lock.
+ *
+ *  VN: Chống quá tải — khi hàng đợi đầy (mọi ô đều bận), submit() trả -1 để
+ *      bên gọi (vòng accept/reactor) phản hồi "server_busy" ngay.
+ *  VN: Ring cấp phát sẵn, không khóa: mỗi ô có số thứ tự (seq) cho biết ô đang
+ *      chờ producer ghi hay consumer đọc. Worker rảnh ngủ trên futex
+ *      (eventcount) và chỉ bị đánh thức khi có job mới.
+ *
+ *  SCHED=steal (work stealing):
+ *
+ *     external submit ──> injector ring (same as above, QUEUE_CAP)
+ *     submit from worker k ──> deque[k] bottom (LIFO, stays on that core)
+ *
+ *     worker k: take deque[k] bottom → injector ring → steal deque[random] top
+ *
+ *  EN: Follow-up jobs spawned by a worker run on the same worker while its
+ *      cache is warm; idle workers steal the oldest job from a random victim.
+ *  VN: Job sinh ra từ một worker được đẩy vào deque riêng của worker đó (giữ
+ *      cache nóng); worker rảnh "trộm" job cũ nhất từ deque của worker khác.
+ *
+ *  CoDel-style admission (codel_target_us > 0):
+ *
+ *     submit: stamp enq time ──> ring ──> dequeue: sojourn = now - enq
+ *                                              |
+ *             sojourn >= target for a whole interval → DROPPING (shed submits)
+ *             sojourn <  target (or ring empty)      → admit again
+ *
+ *  EN: Queue length says little about latency (4096 fast jobs vs 4096 slow
+ *      ones). CoDel watches how long jobs actually waited: a short burst is
+ *      fine, a standing queue (even the best job waited > target for an
+ *      interval) means we are overloaded, so new work is refused with the
+ *      same -1 as a full queue (net.c → server_busy) while queued work drains.
+ *  VN: Đo thời gian chờ thực tế trong hàng đợi (sojourn). Nếu suốt một
+ *      interval mà sojourn vẫn > target (hàng đợi "đứng"), từ chối job mới
+ *      để p99 không phình theo QUEUE_CAP; hết quá tải thì nhận lại.
+ *
+ *  Deadlines (threadpool_submit_deadline):
+ *
+ *     dequeue ──> now >= deadline ? expire_fn(arg) : fn(arg)
+ *
+ *  EN: A job that waited past its deadline is useless to the client (it has
+ *      already timed out), so the worker runs the cheap expire_fn instead of
+ *      the real work (net.c: answer DECLINED/timeout without touching the DB).
+ *  VN: Job đã quá hạn khi tới lượt chạy thì gọi expire_fn (trả timeout ngay)
+ *      thay vì làm 2PC vô ích cho client đã bỏ đi.
+ *
+ *  Priority lanes (one ring each, own capacity):
+ *
+ *     CONTROL    [probe][metrics]      ← served first; + reserved control workers
+ *     DEFAULT    [pay][pay]...[pay]    ← QUEUE_CAP, CoDel
+ *     BACKGROUND [reversal]...         ← every TP_BACKGROUND_EVERY-th pick goes first
+ *
+ *  EN: A saturated payment lane can no longer reject /healthz: the control
+ *      ring has its own cells, and control_workers threads never run payment
+ *      jobs, so a probe waits for at most one other probe, not for a 2PC.
+ *  VN: Mỗi làn một ring riêng nên làn payment đầy không chặn probe; worker
+ *      dành riêng cho control chỉ chạy job control → probe luôn được trả nhanh.
+ *
+ *  Elastic mode (max_threads > num_threads):
+ *
+ *     submit / dequeue: no idle worker && oldest payment job waited >= grow_wait
+ *                       → spawn one worker into a free slot (up to max_threads)
+ *     parked worker:    idle for idle_timeout && live > num_threads → exit
+ *
+ *  EN: Workers block for tens of ms in clearing and PostgreSQL, so the right
+ *      thread count follows the blocking time, not the CPU count. Per-thread
+ *      state (DB connection, coordinator) lives in TLS with destructors, so a
+ *      retired worker closes its DB connection and a new one opens its own.
+ *  VN: Job chờ lâu mà không còn worker rảnh → thêm worker; worker dư rảnh lâu
+ *      → tự thoát (kết nối DB riêng đóng theo). Số luồng nằm trong [min, max].
  */
+#define _GNU_SOURCE // syscall()
 #include "threadpool.h"
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define TP_CACHELINE 64
+#define TP_SPIN_BEFORE_PARK 128
+#define TP_DEQUE_MAX 1024 // per-worker deque cap (power of two); overflow goes to the ring
+#define TP_BACKGROUND_EVERY 16 // weighted dequeue: 1 in N picks tries background first
+#define TP_GROW_BATCH 4 // elastic: at most this many workers spawned per grow check
+
+// Worker slot state (elastic pools reuse slots of retired workers)
+#define TP_WORKER_FREE 0    // no thread
+#define TP_WORKER_LIVE 1    // thread started and not retired
+#define TP_WORKER_EXITED 2  // thread returned, must be joined before reuse
 
-// A single job to be executed by the pool
-// VN: Mỗi công việc là một cặp (hàm, tham số) nối nhau thành hàng đợi FIFO.
-typedef struct Job {
+#if defined(__x86_64__) || defined(__i386__)
+#define tp_cpu_relax() __builtin_ia32_pause()
+#else
+#define tp_cpu_relax() ((void)0)
+#endif
+
+// One ring slot, padded to a cache line so neighbouring producers/consumers
+// do not false-share.
+// VN: Mỗi ô một cache line; seq == pos → trống chờ ghi, seq == pos+1 → có job.
+typedef struct {
     job_fn fn;
+    job_fn expire;      // run instead of fn once deadline_ns has passed (may be NULL)
     void *arg;
-    struct Job *next;
+    long long deadline_ns; // CLOCK_MONOTONIC; 0 = no deadline
 } Job;
 
-// Fixed-size thread pool with a bounded FIFO queue
-// VN: Số worker cố định; queue giới hạn để áp dụng backpressure khi quá tải.
+typedef struct {
+    size_t seq;
+    Job job;
+    long long enq_ns;   // submit time (CLOCK_MONOTONIC), only with CoDel on
+} __attribute__((aligned(TP_CACHELINE))) Cell;
+
+// Chase-Lev deque slot; fields are accessed atomically because a thief may
+// read a slot the owner is about to reuse (its CAS on top then fails).
+typedef struct {
+    Job job;
+} DequeSlot;
+
+// Bounded MPMC ring (one per lane). Hot counters live on separate cache
+// lines (producers vs consumers).
+typedef struct {
+    size_t enqueue_pos __attribute__((aligned(TP_CACHELINE)));
+    size_t dequeue_pos __attribute__((aligned(TP_CACHELINE)));
+    Cell *cells __attribute__((aligned(TP_CACHELINE)));
+    size_t cap;         // bounded queue capacity (== number of cells)
+} Ring;
+
+// Futex eventcount parked workers sleep on
+typedef struct {
+    unsigned int seq __attribute__((aligned(TP_CACHELINE))); // futex word
+    int waiters;        // workers parked (or about to park) on seq
+    int pending;        // a wake is in flight (cleared by woken/parking workers)
+} EventCount;
+
+// Per-worker state. Owner pushes/takes at bottom, thieves steal at top.
+// VN: Mỗi worker một deque: chủ lấy ở đáy (LIFO), kẻ trộm lấy ở đỉnh (FIFO).
+typedef struct Worker {
+    long top __attribute__((aligned(TP_CACHELINE)));
+    long bottom __attribute__((aligned(TP_CACHELINE)));
+    DequeSlot *slots __attribute__((aligned(TP_CACHELINE)));
+    long mask;
+    unsigned int rng;   // xorshift state for victim selection
+    unsigned int picks; // jobs taken, for the weighted background pick
+    int index;
+    int control_only;   // reserved control worker: control lane only, parks on ec_ctl
+    int state;          // TP_WORKER_* (atomic)
+    EventCount *ec;     // where this worker parks
+    void (*on_start)(int index, void *arg); // ThreadPoolOptions.on_thread_start
+    void *on_start_arg;
+    struct ThreadPool *pool;
+    pthread_t tid;
+} Worker;
+
+// Worker of the current thread (NULL outside pools), for local pushes
+static __thread Worker *tls_worker;
+
+// Thread pool (fixed or elastic size) with bounded lock-free rings
+// VN: Số worker cố định (hoặc co giãn trong [min, max]); ring giới hạn để áp dụng backpressure.
 struct ThreadPool {
-    // [ANCHOR:TP_QUEUE_STRUCT] Hàng đợi FIFO có giới hạn (bounded) để áp dụng backpressure
-    pthread_t *threads;
-    int num_threads;
-    Job *head;
-    Job *tail;
-    size_t size;
-    size_t cap; // bounded queue capacity
-    pthread_mutex_t m;
-    pthread_cond_t cv;
+    // [ANCHOR:TP_QUEUE_STRUCT] Ring MPMC có giới hạn (bounded) để áp dụng backpressure
+    Ring lanes[THREADPOOL_LANES];   // indexed by ThreadPoolLane
+    EventCount ec;      // general workers park here
+    EventCount ec_ctl;  // reserved control workers park here
+    ThreadPoolSched sched;
+    Worker *workers;    // general worker slots, then control workers (deques only with SCHED=steal)
+    int num_threads;    // general worker slots (max_threads when elastic)
+    int num_control;    // reserved control workers
+    int slots_used;     // high-water mark of general slots ever started (steal victims, atomic)
+    // [ANCHOR:TP_ELASTIC] Elastic sizing (min_threads == num_threads → fixed pool)
+    int min_threads;
+    int live;           // general workers started and not retired (atomic)
+    int growing;        // 1 while some thread is spawning a worker
+    long long grow_wait_ns;
+    long long idle_timeout_ns;
+    int spin;           // empty-ring polls before parking (0 on a single CPU)
     int shutting_down;
+    int busy; // workers currently running a job (atomic, for utilization)
+    // [ANCHOR:TP_CODEL] Admission state (written rarely: only on state changes)
+    long long codel_target_ns;      // 0 = CoDel off (queue-length fast-fail only)
+    long long codel_interval_ns;
+    long long codel_first_above_ns __attribute__((aligned(TP_CACHELINE)));
+    int codel_dropping;             // 1 = shedding new submits
+    unsigned long shed;             // submits refused by CoDel (atomic)
+    unsigned long expired;          // jobs dequeued past their deadline (atomic)
 };
 
-// Worker loop: wait for a job, pop it, run it outside the lock
-// VN: Chờ tín hiệu có việc, lấy 1 job khỏi queue, nhả khóa rồi thực thi.
-static void *worker_main(void *arg) {
-    ThreadPool *pool = (ThreadPool *)arg;
+long long threadpool_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long tp_futex(unsigned int *addr, int op, unsigned int val, const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+// Wake one parked worker, only if one announced itself, and keep at most one
+// wake in flight: until the woken worker runs, further submits skip the
+// syscall (the woken worker passes the wake on if more jobs are queued).
+// The "workers already busy" case costs a fence and a load, no syscall.
+static void ec_notify(EventCount *ec) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ec->waiters, __ATOMIC_RELAXED) <= 0) return;
+    if (__atomic_exchange_n(&ec->pending, 1, __ATOMIC_SEQ_CST)) return;
+    __atomic_fetch_add(&ec->seq, 1, __ATOMIC_RELEASE);
+    (void)tp_futex(&ec->seq, FUTEX_WAKE_PRIVATE, 1, NULL);
+}
+
+static void ec_wake_all(EventCount *ec) {
+    __atomic_fetch_add(&ec->seq, 1, __ATOMIC_SEQ_CST);
+    (void)tp_futex(&ec->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+}
+
+static int ring_init(Ring *r, size_t cap) {
+    // A one-cell ring cannot tell "free for lap n+1" (seq == pos) from
+    // "published in lap n" (seq == pos): the next push would overwrite the
+    // queued job and the consumer would spin. Two cells is the minimum.
+    if (cap < 2) cap = 2;
+    r->cap = cap;
+    if (posix_memalign((void **)&r->cells, TP_CACHELINE, cap * sizeof(Cell)) != 0) {
+        r->cells = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < cap; ++i) {
+        r->cells[i].seq = i;
+        memset(&r->cells[i].job, 0, sizeof(r->cells[i].job));
+    }
+    return 0;
+}
+
+// [ANCHOR:TP_RING_PUSH] Non-blocking enqueue; 0 = full
+static int ring_push(Ring *r, const Job *job, long long enq_ns) {
+    size_t pos = __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED);
     for (;;) {
-        pthread_mutex_lock(&pool->m);
-        // [ANCHOR:TP_WORKER_WAIT]
-        // EN: Wait until there is work OR shutdown requested
-        // VN: Chờ tới khi có việc HOẶC nhận tín hiệu tắt (shutdown)
-        while (!pool->shutting_down && pool->size == 0) {
-            pthread_cond_wait(&pool->cv, &pool->m);
+        Cell *cell = &r->cells[pos % r->cap];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->job = *job;
+                __atomic_store_n(&cell->enq_ns, enq_ns, __ATOMIC_RELAXED); // read early by ring_oldest_ns
+                __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+            // CAS failed: pos now holds the fresh enqueue_pos, retry
+        } else if (diff < 0) {
+            return 0; // cell still holds a job from the previous lap → full
+        } else {
+            pos = __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// [ANCHOR:TP_RING_POP] Non-blocking dequeue; 0 = empty
+static int ring_pop(Ring *r, Job *job, long long *enq_ns) {
+    size_t pos = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        Cell *cell = &r->cells[pos % r->cap];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *job = cell->job;
+                *enq_ns = cell->enq_ns;
+                // Free the cell for the producer one lap ahead
+                __atomic_store_n(&cell->seq, pos + r->cap, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0; // not published yet → empty (producer will wake us)
+        } else {
+            pos = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int ring_empty(Ring *r) {
+    return __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED) ==
+           __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+}
+
+// Submit time of the job at the head of the ring (0 = empty or not stamped)
+static long long ring_oldest_ns(Ring *r) {
+    size_t pos = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+    Cell *cell = &r->cells[pos % r->cap];
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return 0;
+    return __atomic_load_n(&cell->enq_ns, __ATOMIC_RELAXED);
+}
+
+static size_t ring_size(Ring *r) {
+    size_t deq = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+    size_t enq = __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED);
+    size_t n = enq > deq ? enq - deq : 0;
+    return n > r->cap ? r->cap : n;
+}
+
+// CoDel state machine, driven by the sojourn time of each dequeued job.
+// Shared fields are only written on transitions, so the steady state costs
+// two loads per dequeue.
+static void codel_on_dequeue(ThreadPool *pool, long long enq_ns) {
+    long long now = threadpool_now_ns();
+    long long first_above = __atomic_load_n(&pool->codel_first_above_ns, __ATOMIC_RELAXED);
+    if (now - enq_ns < pool->codel_target_ns) {
+        // Good job seen: queue is not standing, leave dropping state
+        if (first_above) __atomic_store_n(&pool->codel_first_above_ns, 0, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&pool->codel_dropping, __ATOMIC_RELAXED))
+            __atomic_store_n(&pool->codel_dropping, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    if (first_above == 0) {
+        // First bad sojourn: give the queue one interval to drain on its own
+        long long expected = 0;
+        (void)__atomic_compare_exchange_n(&pool->codel_first_above_ns, &expected,
+                                          now + pool->codel_interval_ns, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    } else if (now >= first_above && !__atomic_load_n(&pool->codel_dropping, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&pool->codel_dropping, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Admission check for external submits to the default lane; 0 = shed
+static int codel_admit(ThreadPool *pool) {
+    if (!__atomic_load_n(&pool->codel_dropping, __ATOMIC_RELAXED)) return 1;
+    if (ring_empty(&pool->lanes[THREADPOOL_LANE_DEFAULT])) {
+        // Backlog drained with no dequeue to report it: admit again
+        __atomic_store_n(&pool->codel_dropping, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->codel_first_above_ns, 0, __ATOMIC_RELAXED);
+        return 1;
+    }
+    __sync_fetch_and_add(&pool->shed, 1);
+    return 0;
+}
+
+// Pop from one lane; only the default lane feeds CoDel
+static int lane_pop(ThreadPool *pool, ThreadPoolLane lane, Job *job) {
+    long long enq_ns;
+    if (!ring_pop(&pool->lanes[lane], job, &enq_ns)) return 0;
+    if (lane == THREADPOOL_LANE_DEFAULT && pool->codel_target_ns > 0) codel_on_dequeue(pool, enq_ns);
+    return 1;
+}
+
+// [ANCHOR:TP_DEQUE] Chase-Lev work-stealing deque (fixed size, no growth)
+static int deque_push(Worker *w, const Job *job) {
+    if (!w->slots) return 0; // allocation failed at worker start → ring only
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    if (b - t > w->mask) return 0; // full → caller falls back to the ring
+    DequeSlot *slot = &w->slots[b & w->mask];
+    __atomic_store_n(&slot->job.fn, job->fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->job.expire, job->expire, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->job.arg, job->arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->job.deadline_ns, job->deadline_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void slot_load(DequeSlot *slot, Job *job) {
+    job->fn = __atomic_load_n(&slot->job.fn, __ATOMIC_RELAXED);
+    job->expire = __atomic_load_n(&slot->job.expire, __ATOMIC_RELAXED);
+    job->arg = __atomic_load_n(&slot->job.arg, __ATOMIC_RELAXED);
+    job->deadline_ns = __atomic_load_n(&slot->job.deadline_ns, __ATOMIC_RELAXED);
+}
+
+// Owner only: newest job first (warm cache)
+static int deque_take(Worker *w, Job *job) {
+    if (!w->slots) return 0;
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED); // empty
+        return 0;
+    }
+    slot_load(&w->slots[b & w->mask], job);
+    if (t == b) {
+        // Last element: race against thieves for it
+        int won = __atomic_compare_exchange_n(&w->top, &t, t + 1, 0,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return 1;
+}
+
+// Any thread: oldest job; 0 = empty or lost the race
+static int deque_steal(Worker *w, Job *job) {
+    long t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return 0;
+    Job j;
+    slot_load(&w->slots[t & w->mask], &j);
+    if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    *job = j;
+    return 1;
+}
+
+static long deque_size(Worker *w) {
+    long n = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+    return n > 0 ? n : 0;
+}
+
+// Approximate number of queued jobs per lane (deques count as the default lane)
+static size_t pool_queued_lanes(ThreadPool *pool, size_t out[THREADPOOL_LANES]) {
+    size_t total = 0;
+    for (int l = 0; l < THREADPOOL_LANES; ++l) {
+        out[l] = ring_size(&pool->lanes[l]);
+        if (l == THREADPOOL_LANE_DEFAULT && pool->sched == THREADPOOL_SCHED_STEAL) {
+            int n = __atomic_load_n(&pool->slots_used, __ATOMIC_ACQUIRE);
+            for (int i = 0; i < n; ++i) out[l] += (size_t)deque_size(&pool->workers[i]);
+        }
+        total += out[l];
+    }
+    return total;
+}
+
+// Jobs worker w could run (used to pass a wake on)
+static size_t pool_queued_for(ThreadPool *pool, Worker *w) {
+    size_t lanes[THREADPOOL_LANES];
+    if (w->control_only) return ring_size(&pool->lanes[THREADPOOL_LANE_CONTROL]);
+    return pool_queued_lanes(pool, lanes);
+}
+
+// Find the next job for worker w:
+//   control lane → (1 in TP_BACKGROUND_EVERY: background) → own deque →
+//   default lane → steal → background lane
+// VN: Thứ tự lấy việc: làn control → deque của mình → làn payment → trộm
+//     → làn background (thỉnh thoảng ưu tiên background để không bị bỏ đói).
+static int worker_next(Worker *w, Job *job) {
+    ThreadPool *pool = w->pool;
+    if (lane_pop(pool, THREADPOOL_LANE_CONTROL, job)) return 1;
+    if (w->control_only) return 0;
+    if (++w->picks % TP_BACKGROUND_EVERY == 0 && lane_pop(pool, THREADPOOL_LANE_BACKGROUND, job)) return 1;
+    if (pool->sched == THREADPOOL_SCHED_STEAL && deque_take(w, job)) return 1;
+    if (lane_pop(pool, THREADPOOL_LANE_DEFAULT, job)) return 1;
+    int n = __atomic_load_n(&pool->slots_used, __ATOMIC_ACQUIRE);
+    if (pool->sched == THREADPOOL_SCHED_STEAL && n > 1) {
+        w->rng ^= w->rng << 13; w->rng ^= w->rng >> 17; w->rng ^= w->rng << 5;
+        int start = (int)(w->rng % (unsigned int)n);
+        for (int i = 0; i < n; ++i) {
+            int v = (start + i) % n;
+            if (v == w->index) continue;
+            if (deque_steal(&pool->workers[v], job)) return 1;
         }
-        // [ANCHOR:TP_WORKER_EXIT]
-        // EN: Graceful exit when no more jobs and shutdown flag is set
-        // VN: Thoát êm khi đã yêu cầu shutdown và không còn job trong hàng đợi
-        if (pool->shutting_down && pool->size == 0) {
-            pthread_mutex_unlock(&pool->m);
-            break;
+    }
+    return lane_pop(pool, THREADPOOL_LANE_BACKGROUND, job);
+}
+
+static void *worker_main(void *arg);
+
+// Start a worker in a free (or exited) general slot; caller holds pool->growing
+// or is threadpool_create_ex. 0 = started.
+static int pool_spawn(ThreadPool *pool) {
+    for (int i = 0; i < pool->num_threads; ++i) {
+        Worker *w = &pool->workers[i];
+        int state = __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+        if (state == TP_WORKER_LIVE) continue;
+        if (state == TP_WORKER_EXITED) pthread_join(w->tid, NULL); // reap the retired thread
+        __atomic_store_n(&w->state, TP_WORKER_LIVE, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&pool->live, 1, __ATOMIC_SEQ_CST);
+        if (i >= __atomic_load_n(&pool->slots_used, __ATOMIC_RELAXED))
+            __atomic_store_n(&pool->slots_used, i + 1, __ATOMIC_RELEASE);
+        if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+            perror("pthread_create");
+            __atomic_store_n(&w->state, TP_WORKER_FREE, __ATOMIC_RELEASE);
+            __atomic_fetch_sub(&pool->live, 1, __ATOMIC_SEQ_CST);
+            return -1;
         }
-        Job *job = pool->head;
-        if (job) {
-            pool->head = job->next;
-            if (!pool->head) pool->tail = NULL;
-            pool->size--;
+        return 0;
+    }
+    return -1;
+}
+
+// Elastic grow check (cheap when nothing to do): no parked worker would pick
+// the queue up and its head has waited at least grow_wait → add a worker per
+// queued job, up to TP_GROW_BATCH (a burst ramps up without one check per
+// worker; the queue is standing, so extras retire if they overshoot).
+// VN: Không còn worker rảnh và job đầu hàng đợi đã chờ quá grow_wait → thêm worker
+//     (mỗi job đang chờ một worker, tối đa TP_GROW_BATCH mỗi lần).
+static void elastic_maybe_grow(ThreadPool *pool) {
+    if (__atomic_load_n(&pool->live, __ATOMIC_RELAXED) >= pool->num_threads) return;
+    if (__atomic_load_n(&pool->ec.waiters, __ATOMIC_RELAXED) > 0) return;
+    long long oldest = ring_oldest_ns(&pool->lanes[THREADPOOL_LANE_DEFAULT]);
+    if (!oldest || threadpool_now_ns() - oldest < pool->grow_wait_ns) return;
+    if (__atomic_exchange_n(&pool->growing, 1, __ATOMIC_ACQUIRE)) return; // someone else is on it
+    size_t want = ring_size(&pool->lanes[THREADPOOL_LANE_DEFAULT]);
+    for (size_t i = 0; i < want && i < TP_GROW_BATCH; ++i) {
+        if (__atomic_load_n(&pool->live, __ATOMIC_RELAXED) >= pool->num_threads || pool_spawn(pool) != 0) break;
+    }
+    __atomic_store_n(&pool->growing, 0, __ATOMIC_RELEASE);
+}
+
+// Elastic shrink: leave only while more than min_threads workers are live.
+// A job queued after our last look is passed on to another parked worker.
+static int worker_retire(Worker *w) {
+    ThreadPool *pool = w->pool;
+    int live = __atomic_load_n(&pool->live, __ATOMIC_RELAXED);
+    while (live > pool->min_threads) {
+        if (__atomic_compare_exchange_n(&pool->live, &live, live - 1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            if (pool_queued_for(pool, w) > 0) ec_notify(w->ec);
+            return 1;
         }
-        pthread_mutex_unlock(&pool->m);
+    }
+    return 0;
+}
+
+// Worker loop: pop from the rings, spin briefly when empty, then park on the
+// eventcount. Order matters: read the key, announce as waiter, re-open
+// notifications, re-check the rings, then sleep only if the key is unchanged
+// (no lost wake-ups: a wake flagged before we parked has a newer key).
+// VN: Hết việc → quay vòng ngắn → đăng ký chờ → kiểm tra lại ring → ngủ futex.
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    ThreadPool *pool = w->pool;
+    EventCount *ec = w->ec;
+    // [ANCHOR:TP_WORKER_START]
+    // EN: Pin (or whatever the hook does) before allocating per-worker state:
+    //     the deque is first-touched by its owner, on the owner's NUMA node.
+    //     Thieves only read slots after seeing a bottom published after this.
+    //     The first worker of a slot allocates it; a worker respawned in the
+    //     slot (elastic pool) keeps it, with its top / bottom, until pool_free.
+    // VN: Ghim CPU trước, rồi mới cấp phát deque → bộ nhớ nằm trên node của worker;
+    //     worker sinh lại trong cùng slot dùng lại deque cũ.
+    if (w->on_start) w->on_start(w->index, w->on_start_arg);
+    if (pool->sched == THREADPOOL_SCHED_STEAL && !w->control_only && !w->slots) {
+        w->slots = (DequeSlot *)calloc((size_t)w->mask + 1, sizeof(DequeSlot));
+        if (!w->slots) perror("calloc deque"); // degrade: this worker uses the ring only
+    }
+    tls_worker = w;
+    // Only workers above the minimum may retire, so only elastic general workers time out
+    int elastic = pool->min_threads < pool->num_threads && !w->control_only;
+    struct timespec idle = {
+        (time_t)(pool->idle_timeout_ns / 1000000000LL), (long)(pool->idle_timeout_ns % 1000000000LL)
+    };
+    for (;;) {
+        Job job;
+        int got = worker_next(w, &job);
+        for (int spin = 0; !got && spin < pool->spin; ++spin) {
+            tp_cpu_relax();
+            got = worker_next(w, &job);
+        }
+        if (!got) {
+            // [ANCHOR:TP_WORKER_WAIT]
+            // EN: Park until a submit bumps the eventcount OR shutdown requested
+            // VN: Ngủ tới khi submit tăng eventcount HOẶC nhận tín hiệu tắt
+            unsigned int key = __atomic_load_n(&ec->seq, __ATOMIC_ACQUIRE);
+            __atomic_fetch_add(&ec->waiters, 1, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&ec->pending, 0, __ATOMIC_SEQ_CST);
+            got = worker_next(w, &job);
+            if (!got) {
+                // [ANCHOR:TP_WORKER_EXIT]
+                // EN: Graceful exit when no more jobs and shutdown flag is set
+                // VN: Thoát êm khi đã yêu cầu shutdown và không còn job trong hàng đợi
+                if (__atomic_load_n(&pool->shutting_down, __ATOMIC_ACQUIRE)) {
+                    __atomic_fetch_sub(&ec->waiters, 1, __ATOMIC_SEQ_CST);
+                    break;
+                }
+                long rc = tp_futex(&ec->seq, FUTEX_WAIT_PRIVATE, key, elastic ? &idle : NULL);
+                int timed_out = rc != 0 && errno == ETIMEDOUT;
+                __atomic_fetch_sub(&ec->waiters, 1, __ATOMIC_SEQ_CST);
+                // [ANCHOR:TP_ELASTIC_RETIRE]
+                // EN: Idle for a whole idle_timeout with no wake since we parked
+                //     (key unchanged): give the thread back if above the minimum
+                // VN: Rảnh suốt idle_timeout và không ai đánh thức → thoát nếu còn trên mức tối thiểu
+                if (timed_out && __atomic_load_n(&ec->seq, __ATOMIC_ACQUIRE) == key && worker_retire(w)) break;
+                // Woken (or key already moved): re-open notifications, then pop
+                __atomic_store_n(&ec->pending, 0, __ATOMIC_SEQ_CST);
+                if (!worker_next(w, &job)) continue;
+                // More jobs queued behind this one: pass the wake on
+                if (pool_queued_for(pool, w) > 0) ec_notify(ec);
+            } else {
+                __atomic_fetch_sub(&ec->waiters, 1, __ATOMIC_SEQ_CST);
+            }
+        }
+        // Backlog still waiting behind this job: maybe add a worker
+        if (elastic) elastic_maybe_grow(pool);
         // [ANCHOR:TP_EXECUTE_OUTSIDE_LOCK]
-        // EN: Execute job outside the lock to minimize contention
-        // VN: Chạy job ngoài phạm vi khóa để giảm tranh chấp mutex
-        if (job) {
-            job->fn(job->arg);
-            free(job);
+        // EN: Execute the job; the ring is never locked, other workers keep popping
+        // VN: Chạy job; ring không khóa nên worker khác vẫn lấy việc song song
+        __sync_fetch_and_add(&pool->busy, 1);
+        if (job.deadline_ns && threadpool_now_ns() >= job.deadline_ns) {
+            // [ANCHOR:TP_DEADLINE_EXPIRE]
+            // EN: Waited past its deadline: skip the real work
+            // VN: Job quá hạn: bỏ qua phần việc chính, chỉ gọi expire_fn
+            __sync_fetch_and_add(&pool->expired, 1);
+            if (job.expire) job.expire(job.arg);
+        } else {
+            job.fn(job.arg);
         }
+        __sync_fetch_and_sub(&pool->busy, 1);
     }
+    __atomic_store_n(&w->state, TP_WORKER_EXITED, __ATOMIC_RELEASE);
     return NULL;
 }
 
+void threadpool_options_init(ThreadPoolOptions *opts) {
+    if (!opts) return;
+    memset(opts, 0, sizeof(*opts));
+    opts->num_threads = 4;
+    opts->queue_cap = 1024;
+    opts->sched = THREADPOOL_SCHED_FIFO;
+    opts->codel_target_us = 0;
+    opts->codel_interval_us = 100000;
+    opts->control_queue_cap = 64;
+    opts->background_queue_cap = 256;
+    opts->control_workers = 0;
+    opts->max_threads = 0;
+    opts->grow_wait_us = 2000;
+    opts->idle_timeout_us = 10000000;
+    opts->on_thread_start = NULL;
+    opts->on_thread_start_arg = NULL;
+}
+
 // Create a thread pool with num_threads workers and queue_cap capacity
 // VN: Tạo các worker trước; đây là biện pháp giới hạn song song an toàn.
 ThreadPool *threadpool_create(int num_threads, int queue_cap) {
-    if (num_threads <= 0) num_threads = 4;
-    ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(*pool));
-    if (!pool) {
-        perror("calloc");
+    ThreadPoolOptions opts;
+    threadpool_options_init(&opts);
+    opts.num_threads = num_threads;
+    opts.queue_cap = queue_cap;
+    return threadpool_create_ex(&opts);
+}
+
+static void pool_free(ThreadPool *pool) {
+    if (pool->workers) {
+        for (int i = 0; i < pool->num_threads; ++i) free(pool->workers[i].slots);
+    }
+    free(pool->workers);
+    for (int l = 0; l < THREADPOOL_LANES; ++l) free(pool->lanes[l].cells);
+    free(pool);
+}
+
+ThreadPool *threadpool_create_ex(const ThreadPoolOptions *opts) {
+    if (!opts) return NULL;
+    int num_threads = opts->num_threads > 0 ? opts->num_threads : 4;
+    int max_threads = opts->max_threads > num_threads ? opts->max_threads : num_threads;
+    int num_control = opts->control_workers > 0 ? opts->control_workers : 0;
+    int total = max_threads + num_control; // a slot per possible worker
+    ThreadPool *pool = NULL;
+    if (posix_memalign((void **)&pool, TP_CACHELINE, sizeof(*pool)) != 0) {
+        perror("posix_memalign");
         return NULL;
     }
-    pool->cap = (queue_cap > 0 ? (size_t)queue_cap : 1024); // default bound
-    pthread_mutex_init(&pool->m, NULL);
-    pthread_cond_init(&pool->cv, NULL);
-    pool->threads = (pthread_t *)calloc((size_t)num_threads, sizeof(pthread_t));
-    if (!pool->threads) {
-        perror("calloc threads");
-        pthread_mutex_destroy(&pool->m);
-        pthread_cond_destroy(&pool->cv);
-        free(pool);
+    memset(pool, 0, sizeof(*pool));
+    pool->sched = opts->sched;
+    if (opts->codel_target_us > 0) {
+        pool->codel_target_ns = opts->codel_target_us * 1000LL;
+        pool->codel_interval_ns = (opts->codel_interval_us > 0 ? opts->codel_interval_us : 100000) * 1000LL;
+    }
+    if (max_threads > num_threads) {
+        pool->grow_wait_ns = (opts->grow_wait_us >= 0 ? opts->grow_wait_us : 2000) * 1000LL;
+        pool->idle_timeout_ns = (opts->idle_timeout_us > 0 ? opts->idle_timeout_us : 10000000) * 1000LL;
+    }
+    // Spinning only pays off when the producer runs on another core
+    pool->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? TP_SPIN_BEFORE_PARK : 0;
+    // Each lane reserves its own cells (default bounds when unset)
+    const size_t caps[THREADPOOL_LANES] = {
+        opts->control_queue_cap > 0 ? (size_t)opts->control_queue_cap : 64,
+        opts->queue_cap > 0 ? (size_t)opts->queue_cap : 1024,
+        opts->background_queue_cap > 0 ? (size_t)opts->background_queue_cap : 256,
+    };
+    for (int l = 0; l < THREADPOOL_LANES; ++l) {
+        if (ring_init(&pool->lanes[l], caps[l]) != 0) {
+            perror("posix_memalign cells");
+            pool_free(pool);
+            return NULL;
+        }
+    }
+    if (posix_memalign((void **)&pool->workers, TP_CACHELINE, (size_t)total * sizeof(Worker)) != 0) {
+        perror("posix_memalign workers");
+        pool->workers = NULL;
+        pool_free(pool);
         return NULL;
     }
-    pool->num_threads = num_threads;
+    memset(pool->workers, 0, (size_t)total * sizeof(Worker));
+    // Deque size: QUEUE_CAP rounded up to a power of two, at most TP_DEQUE_MAX
+    long dcap = 1;
+    while (dcap < (long)caps[THREADPOOL_LANE_DEFAULT] && dcap < TP_DEQUE_MAX) dcap <<= 1;
+    pool->num_threads = max_threads;
+    pool->min_threads = num_threads;
+    for (int i = 0; i < total; ++i) {
+        Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->rng = 0x9E3779B9u * (unsigned int)(i + 1);
+        w->mask = dcap - 1;
+        w->control_only = i >= max_threads;
+        w->ec = w->control_only ? &pool->ec_ctl : &pool->ec;
+        w->on_start = opts->on_thread_start;
+        w->on_start_arg = opts->on_thread_start_arg;
+    }
     // [ANCHOR:TP_CREATE_SPAWN]
+    // Start the minimum; elastic pools add the rest on demand
+    pool->num_control = num_control;
     for (int i = 0; i < num_threads; ++i) {
-        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+        if (pool_spawn(pool) != 0) {
+            threadpool_destroy(pool); // joins only what was started
+            return NULL;
+        }
+    }
+    for (int i = max_threads; i < total; ++i) {
+        Worker *w = &pool->workers[i];
+        w->state = TP_WORKER_LIVE;
+        if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
             perror("pthread_create");
-            pool->shutting_down = 1;
-            pthread_cond_broadcast(&pool->cv);
-            for (int j = 0; j < i; ++j) pthread_join(pool->threads[j], NULL);
-            free(pool->threads);
-            pthread_mutex_destroy(&pool->m);
-            pthread_cond_destroy(&pool->cv);
-            free(pool);
+            w->state = TP_WORKER_FREE;
+            threadpool_destroy(pool);
             return NULL;
         }
     }
     return pool;
 }
 
-// Submit a job; if the queue is full, return non-zero so caller can apply backpressure
-// VN: Nếu queue đầy, trả lỗi để phía accept đóng/giảm tải thay vì nhận vô hạn.
+// Submit a job; if the ring is full, return non-zero so caller can apply backpressure
+// VN: Nếu ring đầy, trả lỗi để phía accept đóng/giảm tải thay vì nhận vô hạn.
 int threadpool_submit(ThreadPool *pool, job_fn fn, void *arg) {
-    if (!pool || !fn) return -1;
-    Job *job = (Job *)malloc(sizeof(Job));
-    if (!job) return -1;
-    job->fn = fn;
-    job->arg = arg;
-    job->next = NULL;
-
-    pthread_mutex_lock(&pool->m);
+    return threadpool_submit_lane(pool, THREADPOOL_LANE_DEFAULT, fn, NULL, arg, 0);
+}
+
+// Same, with a deadline checked when a worker picks the job up
+int threadpool_submit_deadline(ThreadPool *pool, job_fn fn, job_fn expire_fn, void *arg,
+                               long long deadline_ns) {
+    return threadpool_submit_lane(pool, THREADPOOL_LANE_DEFAULT, fn, expire_fn, arg, deadline_ns);
+}
+
+int threadpool_submit_lane(ThreadPool *pool, ThreadPoolLane lane, job_fn fn, job_fn expire_fn,
+                           void *arg, long long deadline_ns) {
+    if (!pool || !fn || (int)lane < 0 || lane >= THREADPOOL_LANES) return -1;
+    Job job = {fn, expire_fn, arg, deadline_ns};
+    if (lane == THREADPOOL_LANE_CONTROL) {
+        // Own cells, no CoDel: only fails if the control lane itself is full
+        if (!ring_push(&pool->lanes[lane], &job, 0)) return -1;
+        if (pool->num_control > 0) ec_notify(&pool->ec_ctl);
+        ec_notify(&pool->ec);
+        return 0;
+    }
+    // SCHED=steal: a job spawned by one of our workers stays on that worker
+    Worker *self = tls_worker;
+    if (lane == THREADPOOL_LANE_DEFAULT && self && self->pool == pool &&
+        pool->sched == THREADPOOL_SCHED_STEAL && !self->control_only && deque_push(self, &job)) {
+        ec_notify(&pool->ec); // let an idle worker steal if this one stays busy
+        return 0;
+    }
     // [ANCHOR:TP_SUBMIT_BACKPRESSURE]
-    // EN: Backpressure — refuse when queue is full (non-blocking submit)
-    // VN: Chống quá tải — từ chối khi hàng đợi đã đầy (không chặn tại đây)
-    if (pool->size >= pool->cap) {
-        pthread_mutex_unlock(&pool->m);
-        free(job);
-        return -1; // queue full
-    }
-    if (pool->tail) pool->tail->next = job; else pool->head = job;
-    pool->tail = job;
-    pool->size++;
-    pthread_cond_signal(&pool->cv);
-    pthread_mutex_unlock(&pool->m);
+    // EN: Backpressure — refuse when queue is full (non-blocking submit),
+    //     or earlier when CoDel sees a standing queue
+    // VN: Chống quá tải — từ chối khi hàng đợi đã đầy, hoặc sớm hơn khi CoDel
+    //     thấy thời gian chờ vượt ngưỡng (không chặn tại đây)
+    long long enq_ns = 0;
+    int elastic = lane == THREADPOOL_LANE_DEFAULT && pool->min_threads < pool->num_threads;
+    if (lane == THREADPOOL_LANE_DEFAULT && pool->codel_target_ns > 0) {
+        if (!codel_admit(pool)) return -1; // shed
+        enq_ns = threadpool_now_ns();
+    } else if (elastic) {
+        enq_ns = threadpool_now_ns(); // queue delay drives growth
+    }
+    if (!ring_push(&pool->lanes[lane], &job, enq_ns)) return -1; // queue full
+    // EN: Publish-then-check pairs with the worker's announce-then-recheck:
+    //     either we see the waiter, or the worker sees the job.
+    // VN: Chỉ gọi futex_wake khi thật sự có worker đang ngủ (tránh syscall thừa).
+    ec_notify(&pool->ec);
+    if (elastic) elastic_maybe_grow(pool);
     return 0;
 }
 
-// Graceful shutdown: wait for workers, free queue and resources
-// VN: Ra tín hiệu dừng, chờ worker kết thúc, giải phóng toàn bộ tài nguyên.
+// Snapshot counters; queue depth = ring cursor distances (+ deques with SCHED=steal)
+void threadpool_stats(ThreadPool *pool, ThreadPoolStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!pool) return;
+    out->queued = pool_queued_lanes(pool, out->queued_lane);
+    out->shed = __sync_fetch_and_add(&pool->shed, 0);
+    out->dropping = __atomic_load_n(&pool->codel_dropping, __ATOMIC_RELAXED);
+    out->expired = __sync_fetch_and_add(&pool->expired, 0);
+    out->threads = __atomic_load_n(&pool->live, __ATOMIC_RELAXED) + pool->num_control;
+    out->threads_min = pool->min_threads + pool->num_control;
+    out->threads_max = pool->num_threads + pool->num_control;
+    out->busy = __sync_fetch_and_add(&pool->busy, 0);
+}
+
+// Graceful shutdown: wake everyone, workers drain the rings and exit
+// VN: Ra tín hiệu dừng, chờ worker chạy hết job còn lại rồi giải phóng tài nguyên.
 void threadpool_destroy(ThreadPool *pool) {
     if (!pool) return;
-    pthread_mutex_lock(&pool->m);
-    pool->shutting_down = 1;
+    __atomic_store_n(&pool->shutting_down, 1, __ATOMIC_RELEASE);
+    // Take the grow flag for good: no worker can be spawned into a slot we
+    // already walked past below
+    while (__atomic_exchange_n(&pool->growing, 1, __ATOMIC_ACQUIRE)) sched_yield();
     // [ANCHOR:TP_DESTROY_BROADCAST_JOIN]
     // EN: Wake all workers so they can observe shutdown and exit
     // VN: Đánh thức tất cả worker để thấy cờ shutdown và thoát êm
-    pthread_cond_broadcast(&pool->cv);
-    pthread_mutex_unlock(&pool->m);
-    for (int i = 0; i < pool->num_threads; ++i) pthread_join(pool->threads[i], NULL);
-
-    // EN: Free remaining jobs, if any (dropped on shutdown)
-    // VN: Giải phóng các job còn lại (nếu có) khi tắt dịch vụ
-    Job *j = pool->head;
-    while (j) { Job *n = j->next; free(j); j = n; }
-
-    free(pool->threads);
-    pthread_mutex_destroy(&pool->m);
-    pthread_cond_destroy(&pool->cv);
-    free(pool);
+    ec_wake_all(&pool->ec);
+    ec_wake_all(&pool->ec_ctl);
+    // General workers first: they drain every lane. Slots never started are
+    // FREE; retired (EXITED) threads still need their join.
+    for (int i = 0; i < pool->num_threads + pool->num_control; ++i) {
+        if (__atomic_load_n(&pool->workers[i].state, __ATOMIC_ACQUIRE) != TP_WORKER_FREE)
+            pthread_join(pool->workers[i].tid, NULL);
+    }
+    pool_free(pool);
 }
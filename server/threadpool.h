@@ -12,11 +12,72 @@ typedef struct ThreadPool ThreadPool;
 typedef void (*job_fn)(void *arg);
 /* VN (Phỏng vấn – Thread pool API)
  * - job_fn: hàm công việc dạng void*(arg) → void (tự giải phóng arg nếu cần).
- * - threadpool_create(n, cap): tạo N worker và hàng đợi tối đa cap phần tử.
+ * - threadpool_create(n, cap): tạo N worker và ring (lock-free) đúng cap ô, cấp phát sẵn.
+ * - threadpool_create_ex(&opts): như trên + chọn lịch (FIFO hoặc work-stealing).
  * - threadpool_submit(pool, fn, arg): đẩy công việc vào queue (có thể bị từ chối nếu đầy).
- * - threadpool_destroy(pool): chờ worker kết thúc, giải phóng queue & mutex/cond.
+ * - threadpool_submit_deadline(pool, fn, expire_fn, arg, deadline_ns): như trên, nhưng nếu
+ *   tới lượt chạy mà đã quá hạn thì worker gọi expire_fn (trả timeout) thay cho fn.
+ * - threadpool_submit_lane(pool, lane, ...): chọn làn ưu tiên (control > payment > background);
+ *   mỗi làn có ring riêng (sức chứa riêng) nên probe không bị "server_busy" khi làn payment đầy.
+ * - Elastic (max_threads > num_threads): thêm worker khi job chờ lâu và không còn worker rảnh,
+ *   worker dư (trên mức tối thiểu) rảnh quá idle_timeout thì tự thoát (đóng DB conn riêng).
+ * - threadpool_stats(pool, &st): số worker (hiện tại/min/max), số worker đang bận, độ dài hàng đợi,
+ *   số job bị CoDel từ chối, số job quá hạn (cho /metrics).
+ * - threadpool_destroy(pool): chờ worker chạy hết job còn lại rồi kết thúc, giải phóng ring.
  */
 
+/**
+ * Scheduling policy (SCHED env in the server).
+ */
+typedef enum {
+    THREADPOOL_SCHED_FIFO = 0,  ///< all workers pull from one shared ring (default)
+    THREADPOOL_SCHED_STEAL = 1  ///< per-worker deques + random stealing; jobs submitted
+                                ///< from a worker stay on that worker
+} ThreadPoolSched;
+
+/**
+ * Priority lanes. Each lane has its own bounded ring (reserved capacity), so
+ * a full payment lane never rejects control-plane jobs. Workers dequeue
+ * strictly by priority, except that every few picks they look at the
+ * background lane first so it cannot starve.
+ */
+typedef enum {
+    THREADPOOL_LANE_CONTROL = 0,    ///< probes/metrics: tiny jobs, also served by reserved workers
+    THREADPOOL_LANE_DEFAULT = 1,    ///< payment traffic (threadpool_submit); CoDel applies here only
+    THREADPOOL_LANE_BACKGROUND = 2, ///< reversal retries and other deferrable work
+    THREADPOOL_LANES = 3
+} ThreadPoolLane;
+
+/**
+ * Creation options for threadpool_create_ex(). Always start from
+ * threadpool_options_init() so new fields get their defaults.
+ */
+typedef struct ThreadPoolOptions {
+    int num_threads;        ///< worker threads (default 4)
+    int queue_cap;          ///< shared ring capacity, at least 2; submit fails when full (default 1024)
+    ThreadPoolSched sched;  ///< scheduling policy (default FIFO)
+    long codel_target_us;   ///< CoDel admission: shed when queue wait stays above this (0 = off)
+    long codel_interval_us; ///< ...for at least this long (default 100ms)
+    int control_queue_cap;  ///< control lane capacity (default 64)
+    int background_queue_cap; ///< background lane capacity (default 256)
+    int control_workers;    ///< extra workers that only serve the control lane (default 0)
+    int max_threads;        ///< elastic: grow up to this many workers; num_threads is then the
+                            ///< minimum (default 0 = fixed pool of num_threads)
+    long grow_wait_us;      ///< elastic: spawn a worker when the oldest queued payment job has
+                            ///< waited this long and no worker is idle (default 2ms)
+    long idle_timeout_us;   ///< elastic: workers above the minimum exit after idling this long (default 10s)
+    /// Called first thing in every worker thread (index 0..threads-1, control
+    /// workers last), before the worker allocates its own state; e.g. CPU
+    /// pinning so that state is first-touched on the right NUMA node (NULL = none)
+    void (*on_thread_start)(int index, void *arg);
+    void *on_thread_start_arg;
+} ThreadPoolOptions;
+
+/**
+ * Fill *opts with defaults.
+ */
+void threadpool_options_init(ThreadPoolOptions *opts);
+
 /**
  * Initialize a thread pool with a fixed number of worker threads.
  *
@@ -25,16 +86,72 @@ typedef void (*job_fn)(void *arg);
  */
 ThreadPool *threadpool_create(int num_threads, int queue_cap);
 
+/**
+ * Initialize a thread pool from options (see ThreadPoolOptions).
+ *
+ * @return Pointer to a new ThreadPool or NULL on error
+ */
+ThreadPool *threadpool_create_ex(const ThreadPoolOptions *opts);
+
 /**
  * Submit a job to the thread pool for execution.
  *
  * @param pool The thread pool
  * @param fn Function pointer for the job
  * @param arg User data pointer passed to fn
- * @return 0 on success, non‑zero on error
+ * @return 0 on success, non‑zero when the queue is full or CoDel is shedding
  */
 int threadpool_submit(ThreadPool *pool, job_fn fn, void *arg);
 
+/**
+ * Submit a job that is only worth running before deadline_ns.
+ *
+ * When a worker dequeues the job at or after deadline_ns it calls
+ * expire_fn(arg) instead of fn(arg) (expire_fn may be NULL if arg needs no
+ * cleanup). Admission (queue full / CoDel) is the same as threadpool_submit.
+ *
+ * @param deadline_ns Absolute CLOCK_MONOTONIC time (threadpool_now_ns()); 0 = none
+ * @return 0 on success, non‑zero when the queue is full or CoDel is shedding
+ */
+int threadpool_submit_deadline(ThreadPool *pool, job_fn fn, job_fn expire_fn, void *arg,
+                               long long deadline_ns);
+
+/**
+ * Submit to a specific priority lane (threadpool_submit uses
+ * THREADPOOL_LANE_DEFAULT). Fails only when that lane is full, or for the
+ * default lane when CoDel is shedding.
+ *
+ * @param deadline_ns As for threadpool_submit_deadline (0 = none)
+ * @return 0 on success, non‑zero when the lane is full or CoDel is shedding
+ */
+int threadpool_submit_lane(ThreadPool *pool, ThreadPoolLane lane, job_fn fn, job_fn expire_fn,
+                           void *arg, long long deadline_ns);
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds (the clock deadlines are measured against).
+ */
+long long threadpool_now_ns(void);
+
+/**
+ * Point-in-time pool counters for /metrics (values are approximate snapshots).
+ */
+typedef struct ThreadPoolStats {
+    int threads;    ///< worker threads (including reserved control workers)
+    int threads_min; ///< lower bound of threads (== threads unless elastic)
+    int threads_max; ///< upper bound of threads (== threads unless elastic)
+    int busy;       ///< workers currently executing a job
+    size_t queued;  ///< jobs waiting in the queue (all lanes)
+    size_t queued_lane[THREADPOOL_LANES]; ///< jobs waiting per lane (deques count as default)
+    unsigned long shed; ///< submits refused by CoDel admission (cumulative)
+    int dropping;   ///< 1 while CoDel is shedding
+    unsigned long expired; ///< jobs dequeued past their deadline (cumulative)
+} ThreadPoolStats;
+
+/**
+ * Fill *out with current pool counters. A NULL pool yields zeroes.
+ */
+void threadpool_stats(ThreadPool *pool, ThreadPoolStats *out);
+
 /**
  * Shut down the thread pool and free resources. All queued jobs
  * should finish executing before this returns.
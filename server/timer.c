@@ -0,0 +1,121 @@
+#include "timer.h"
+#include "affinity.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Pending timers in a binary min-heap on their due time (seq keeps FIFO order
+// between equal times)
+typedef struct {
+    long long due_ns;
+    unsigned long seq;
+    TimerFn fn;
+    void *arg;
+} TimerEntry;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cv;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static int g_started = 0;
+static TimerEntry *g_heap = NULL;
+static size_t g_len = 0, g_cap = 0;
+static unsigned long g_seq = 0;
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int before(const TimerEntry *a, const TimerEntry *b) {
+    return a->due_ns < b->due_ns || (a->due_ns == b->due_ns && a->seq < b->seq);
+}
+
+static void heap_swap(size_t i, size_t j) {
+    TimerEntry t = g_heap[i];
+    g_heap[i] = g_heap[j];
+    g_heap[j] = t;
+}
+
+static void heap_pop(void) {
+    g_heap[0] = g_heap[--g_len];
+    for (size_t i = 0;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < g_len && before(&g_heap[l], &g_heap[m])) m = l;
+        if (r < g_len && before(&g_heap[r], &g_heap[m])) m = r;
+        if (m == i) break;
+        heap_swap(i, m);
+        i = m;
+    }
+}
+
+static void *timer_loop(void *arg) {
+    (void)arg;
+    (void)affinity_pin_self(AFFINITY_ROLE_BACKGROUND, 0);
+    pthread_mutex_lock(&g_mu);
+    for (;;) {
+        if (g_len == 0) {
+            pthread_cond_wait(&g_cv, &g_mu);
+            continue;
+        }
+        long long now = mono_ns();
+        if (g_heap[0].due_ns > now) {
+            struct timespec ts = { .tv_sec = g_heap[0].due_ns / 1000000000LL,
+                                   .tv_nsec = g_heap[0].due_ns % 1000000000LL };
+            (void)pthread_cond_timedwait(&g_cv, &g_mu, &ts);
+            continue;
+        }
+        TimerEntry e = g_heap[0];
+        heap_pop();
+        // Unlocked: the callback may schedule the next timer
+        pthread_mutex_unlock(&g_mu);
+        e.fn(e.arg);
+        pthread_mutex_lock(&g_mu);
+    }
+    return NULL;
+}
+
+static void timer_start(void) {
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_cv, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, timer_loop, NULL) != 0) {
+        perror("timer thread");
+        return;
+    }
+    // Runs for the life of the process
+    pthread_detach(tid);
+    g_started = 1;
+}
+
+int timer_after(long long delay_us, TimerFn fn, void *arg) {
+    if (!fn || delay_us < 0) return -1;
+    pthread_once(&g_once, timer_start);
+    if (!g_started) return -1;
+    long long due = mono_ns() + delay_us * 1000LL;
+    pthread_mutex_lock(&g_mu);
+    if (g_len == g_cap) {
+        size_t cap = g_cap ? g_cap * 2 : 256;
+        TimerEntry *h = realloc(g_heap, cap * sizeof(*h));
+        if (!h) {
+            pthread_mutex_unlock(&g_mu);
+            return -1;
+        }
+        g_heap = h;
+        g_cap = cap;
+    }
+    size_t i = g_len++;
+    g_heap[i] = (TimerEntry){ due, g_seq++, fn, arg };
+    while (i > 0 && before(&g_heap[i], &g_heap[(i - 1) / 2])) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    // Only a new earliest timer changes how long the thread sleeps
+    if (i == 0) pthread_cond_signal(&g_cv);
+    pthread_mutex_unlock(&g_mu);
+    return 0;
+}
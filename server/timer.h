@@ -0,0 +1,15 @@
+#pragma once
+
+// One-shot delayed callbacks on a single thread
+// VN: Hẹn giờ gọi lại (một lần) trên một luồng riêng: thay cho usleep() ở
+//     những chỗ worker không được phép đứng chờ (độ trễ clearing mô phỏng).
+
+typedef void (*TimerFn)(void *arg);
+
+/**
+ * Run fn(arg) on the timer thread delay_us (>= 0) from now; the thread is
+ * started on first use. Callbacks run one after the other, so fn must be
+ * short (hand real work to a pool). Returns 0 when scheduled, non-zero
+ * otherwise (fn will not run).
+ */
+int timer_after(long long delay_us, TimerFn fn, void *arg);
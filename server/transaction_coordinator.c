@@ -6,6 +6,7 @@
 #include <time.h>
 #include <pthread.h>
 #include "metrics.h"
+#include "arena.h"
 
 #define MAX_ACTIVE_TRANSACTIONS 1024
 static int DEFAULT_PREPARE_TIMEOUT = 30;  // seconds
@@ -72,7 +73,7 @@ static void remove_transaction(TransactionCoordinator *coordinator,
         if (coordinator->active_transactions[i] && 
             strcmp(coordinator->active_transactions[i]->transaction_id, txn_id) == 0) {
             
-            free(coordinator->active_transactions[i]);
+            arena_release(coordinator->active_transactions[i]);
             
             // Shift remaining transactions down
             for (size_t j = i; j < coordinator->active_count - 1; j++) {
@@ -122,7 +123,7 @@ void txn_coordinator_destroy(TransactionCoordinator *coordinator) {
     // Clean up active transactions
     for (size_t i = 0; i < coordinator->active_count; i++) {
         if (coordinator->active_transactions[i]) {
-            free(coordinator->active_transactions[i]);
+            arena_release(coordinator->active_transactions[i]);
         }
     }
     
@@ -154,8 +155,8 @@ Transaction *txn_begin(TransactionCoordinator *coordinator, const char *txn_id)
         return NULL;
     }
     
-    // Create new transaction
-    Transaction *txn = malloc(sizeof(Transaction));
+    // Create new transaction (request arena when the handler opened a scope)
+    Transaction *txn = arena_alloc(sizeof(Transaction));
     if (!txn) {
         pthread_mutex_unlock(&coordinator->mutex);
         return NULL;
@@ -205,6 +206,9 @@ int txn_register_participant(Transaction *txn,
     p->prepare = prepare;
     p->commit = commit;
     p->abort = abort;
+    p->prepare_async = NULL;
+    p->commit_async = NULL;
+    p->abort_async = NULL;
     
     txn->participant_count++;
     
@@ -301,14 +305,192 @@ int txn_commit(TransactionCoordinator *coordinator, Transaction *txn) {
     pthread_mutex_lock(&coordinator->mutex);
     txn->state = TXN_ABORTED;
     log_transaction_state(coordinator, txn, "ABORTED");
+    // Log before remove_transaction(): txn_id points into txn
+    log_message_json("INFO", "txn_coordinator", txn_id, "Transaction aborted", -1);
     remove_transaction(coordinator, txn_id);
     metrics_inc_2pc_aborted();
     pthread_mutex_unlock(&coordinator->mutex);
+    return -1;
+}
 
-    log_message_json("INFO", "txn_coordinator", txn_id, "Transaction aborted", -1);
+int txn_participant_async(Transaction *txn, const char *name,
+                          TxnAsyncStep prepare, TxnAsyncStep commit, TxnAsyncStep abort) {
+    if (!txn || !name || !prepare || !commit || !abort) return -1;
+    for (size_t i = 0; i < txn->participant_count; i++) {
+        Participant *p = &txn->participants[i];
+        if (strcmp(p->name, name) != 0) continue;
+        p->prepare_async = prepare;
+        p->commit_async = commit;
+        p->abort_async = abort;
+        return 0;
+    }
     return -1;
 }
 
+// [ANCHOR:TXN_COMMIT_ASYNC]
+// EN: txn_commit() as a state machine: txn->state is the phase, txn->step the
+//     participant whose step is in flight. async_advance() starts the next
+//     step and returns; the step's completion (async_step_done) records the
+//     outcome and calls async_advance() again, on its own thread. No thread
+//     waits for a participant, so the number of transactions in flight is
+//     not bounded by threads.
+// VN: 2PC không chặn luồng: mỗi bước của participant xong thì callback của nó
+//     khởi động bước tiếp theo.
+static void async_advance(Transaction *txn);
+
+// Remove the finished transaction, then report rc
+static void async_finish(Transaction *txn, int rc) {
+    TransactionCoordinator *coordinator = txn->coordinator;
+    void (*done)(void *, int) = txn->done;
+    void *arg = txn->done_arg;
+    pthread_mutex_lock(&coordinator->mutex);
+    const char *txn_id = txn->transaction_id;
+    if (rc == 0) {
+        txn->state = TXN_COMMITTED;
+        log_transaction_state(coordinator, txn, "COMMITTED");
+        log_message_json("INFO", "txn_coordinator", txn_id, "Transaction committed successfully", -1);
+        metrics_inc_2pc_committed();
+    } else {
+        txn->state = TXN_ABORTED;
+        log_transaction_state(coordinator, txn, "ABORTED");
+        log_message_json("INFO", "txn_coordinator", txn_id, "Transaction aborted", -1);
+        metrics_inc_2pc_aborted();
+    }
+    remove_transaction(coordinator, txn_id);
+    pthread_mutex_unlock(&coordinator->mutex);
+    done(arg, rc);
+}
+
+static void async_begin_abort(Transaction *txn) {
+    pthread_mutex_lock(&txn->coordinator->mutex);
+    txn->state = TXN_ABORTING;
+    log_transaction_state(txn->coordinator, txn, "ABORT_START");
+    log_message_json("WARN", "txn_coordinator", txn->transaction_id, "Aborting transaction", -1);
+    pthread_mutex_unlock(&txn->coordinator->mutex);
+    txn->step = 0;
+}
+
+static void async_step_done(void *arg, int rc) {
+    Transaction *txn = (Transaction *)arg;
+    Participant *p = &txn->participants[txn->step];
+    const char *txn_id = txn->transaction_id;
+    if (txn->state == TXN_PREPARING) {
+        if (rc != 0) {
+            p->state = PARTICIPANT_FAILED;
+            log_message_json("ERROR", "txn_coordinator", txn_id, "Participant prepare failed", -1);
+            async_begin_abort(txn); // Fail fast
+        } else {
+            p->state = PARTICIPANT_PREPARED;
+            log_message_json("INFO", "txn_coordinator", txn_id, "Participant prepared", -1);
+            txn->step++;
+        }
+    } else if (txn->state == TXN_COMMITTING) {
+        if (rc == 0) {
+            p->state = PARTICIPANT_COMMITTED;
+            log_message_json("INFO", "txn_coordinator", txn_id, "Participant committed", -1);
+        } else {
+            p->state = PARTICIPANT_FAILED;
+            txn->commit_ok = false;
+            log_message_json("ERROR", "txn_coordinator", txn_id, "Participant commit failed", -1);
+        }
+        txn->step++;
+    } else {
+        p->state = PARTICIPANT_ABORTED;
+        log_message_json("INFO", "txn_coordinator", txn_id, "Participant aborted", -1);
+        txn->step++;
+    }
+    async_advance(txn);
+}
+
+static void async_advance(Transaction *txn) {
+    const char *txn_id = txn->transaction_id;
+    for (;;) {
+        if (txn->state == TXN_PREPARING) {
+            if (txn->step < txn->participant_count) {
+                Participant *p = &txn->participants[txn->step];
+                log_message_json("INFO", "txn_coordinator", txn_id, "Preparing participant", -1);
+                // After a started step the transaction belongs to its completion
+                if (p->prepare_async(p->context, txn_id, async_step_done, txn) == 0) return;
+                p->state = PARTICIPANT_FAILED;
+                log_message_json("ERROR", "txn_coordinator", txn_id, "Participant prepare failed", -1);
+                async_begin_abort(txn);
+                continue;
+            }
+            pthread_mutex_lock(&txn->coordinator->mutex);
+            txn->state = TXN_PREPARED;
+            log_transaction_state(txn->coordinator, txn, "PREPARED");
+            txn->state = TXN_COMMITTING;
+            log_transaction_state(txn->coordinator, txn, "COMMIT_START");
+            log_message_json("INFO", "txn_coordinator", txn_id, "Starting COMMIT phase", -1);
+            pthread_mutex_unlock(&txn->coordinator->mutex);
+            txn->step = 0;
+            txn->commit_ok = true;
+            continue;
+        }
+        if (txn->state == TXN_COMMITTING) {
+            if (txn->step < txn->participant_count) {
+                Participant *p = &txn->participants[txn->step];
+                if (p->state != PARTICIPANT_PREPARED) {
+                    txn->step++;
+                    continue;
+                }
+                if (p->commit_async(p->context, txn_id, async_step_done, txn) == 0) return;
+                p->state = PARTICIPANT_FAILED;
+                txn->commit_ok = false;
+                log_message_json("ERROR", "txn_coordinator", txn_id, "Participant commit failed", -1);
+                txn->step++;
+                continue;
+            }
+            if (txn->commit_ok) {
+                async_finish(txn, 0);
+                return;
+            }
+            async_begin_abort(txn);
+            continue;
+        }
+        // TXN_ABORTING: undo what prepared (or failed half way)
+        if (txn->step < txn->participant_count) {
+            Participant *p = &txn->participants[txn->step];
+            if (p->state != PARTICIPANT_PREPARED && p->state != PARTICIPANT_FAILED) {
+                txn->step++;
+                continue;
+            }
+            if (p->abort_async(p->context, txn_id, async_step_done, txn) == 0) return;
+            p->state = PARTICIPANT_ABORTED;
+            log_message_json("WARN", "txn_coordinator", txn_id, "Participant abort not started", -1);
+            txn->step++;
+            continue;
+        }
+        async_finish(txn, -1);
+        return;
+    }
+}
+
+void txn_commit_async(TransactionCoordinator *coordinator, Transaction *txn,
+                      void (*done)(void *arg, int rc), void *arg) {
+    txn->coordinator = coordinator;
+    txn->done = done;
+    txn->done_arg = arg;
+    txn->step = 0;
+    for (size_t i = 0; i < txn->participant_count; i++) {
+        Participant *p = &txn->participants[i];
+        if (!p->prepare_async || !p->commit_async || !p->abort_async) {
+            log_message_json("ERROR", "txn_coordinator", txn->transaction_id,
+                            "Participant has no asynchronous steps", -1);
+            txn->state = TXN_ABORTING; // nothing was prepared: aborts nobody
+            txn->step = txn->participant_count;
+            async_advance(txn);
+            return;
+        }
+    }
+    pthread_mutex_lock(&coordinator->mutex);
+    txn->state = TXN_PREPARING;
+    log_transaction_state(coordinator, txn, "PREPARE_START");
+    log_message_json("INFO", "txn_coordinator", txn->transaction_id, "Starting PREPARE phase", -1);
+    pthread_mutex_unlock(&coordinator->mutex);
+    async_advance(txn);
+}
+
 void txn_abort(TransactionCoordinator *coordinator, Transaction *txn) {
     if (!coordinator || !txn) return;
     
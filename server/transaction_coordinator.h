@@ -35,6 +35,18 @@ typedef enum {
     PARTICIPANT_FAILED
 } ParticipantState;
 
+typedef struct TransactionCoordinator TransactionCoordinator;
+
+/// Completion of an asynchronous participant step (rc 0 = done), from any thread
+typedef void (*TxnStepDone)(void *step_arg, int rc);
+
+/**
+ * Asynchronous participant step: returns 0 once started, and then calls
+ * done(step_arg, rc) exactly once, from any thread, possibly before it
+ * returned; -1 = failed without starting (done is not called)
+ */
+typedef int (*TxnAsyncStep)(void *context, const char *txn_id, TxnStepDone done, void *step_arg);
+
 typedef struct {
     char name[MAX_PARTICIPANT_NAME_LEN];
     ParticipantState state;
@@ -44,6 +56,11 @@ typedef struct {
     int (*prepare)(void *context, const char *txn_id);
     int (*commit)(void *context, const char *txn_id);
     int (*abort)(void *context, const char *txn_id);
+
+    // Same steps for txn_commit_async() (NULL until txn_participant_async())
+    TxnAsyncStep prepare_async;
+    TxnAsyncStep commit_async;
+    TxnAsyncStep abort_async;
 } Participant;
 
 typedef struct {
@@ -57,9 +74,14 @@ typedef struct {
     time_t start_time;
     time_t prepare_timeout;
     time_t commit_timeout;
-} Transaction;
 
-typedef struct TransactionCoordinator TransactionCoordinator;
+    // txn_commit_async() progress
+    TransactionCoordinator *coordinator;
+    size_t step;            // participant whose step is in flight
+    bool commit_ok;         // no commit step failed so far
+    void (*done)(void *arg, int rc);
+    void *done_arg;
+} Transaction;
 
 /**
  * Initialize the transaction coordinator
@@ -76,7 +98,9 @@ void txn_coordinator_destroy(TransactionCoordinator *coordinator);
  * 
  * @param coordinator The transaction coordinator
  * @param txn_id Unique transaction identifier
- * @return Transaction handle or NULL on failure
+ * @return Transaction handle or NULL on failure. Allocated from the request
+ *         arena inside a handler scope: txn_commit()/txn_abort() must run
+ *         before arena_scope_end() (both always remove the transaction).
  */
 Transaction *txn_begin(TransactionCoordinator *coordinator, const char *txn_id);
 
@@ -110,6 +134,27 @@ int txn_register_participant(Transaction *txn,
  */
 int txn_commit(TransactionCoordinator *coordinator, Transaction *txn);
 
+/**
+ * Give the participant registered as name its asynchronous steps (all three
+ * required) for txn_commit_async(); the synchronous ones stay in use for
+ * txn_abort(). Returns 0, or -1 when no participant has that name.
+ */
+int txn_participant_async(Transaction *txn, const char *name,
+                          TxnAsyncStep prepare, TxnAsyncStep commit, TxnAsyncStep abort);
+
+/**
+ * txn_commit() driven by completions instead of a waiting thread: each
+ * participant step is started when the one before it completed, on
+ * whichever thread completed it, in the same order and with the same
+ * decisions, log lines and metrics as txn_commit(). Every participant needs
+ * its asynchronous steps. When the transaction is committed (rc 0) or
+ * aborted (rc -1) it is removed, then done(arg, rc) runs on the thread of
+ * the last completion. txn must not be touched after this call, and must
+ * not come from a request arena (txn_begin() outside a handler scope).
+ */
+void txn_commit_async(TransactionCoordinator *coordinator, Transaction *txn,
+                      void (*done)(void *arg, int rc), void *arg);
+
 /**
  * Abort a transaction (can be called at any time)
  * 
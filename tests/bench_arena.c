@@ -0,0 +1,114 @@
+/*
+ * Heap calls per payment: request arena (REQUEST_ARENA_KB) on vs off
+ *
+ * EN: Runs the allocation path of one payment the way process_request() does
+ *     inside arena_scope_begin/end: txn_begin, a DB participant context, the
+ *     real clearing_participant_init/set_transaction, 2PC commit through mock
+ *     participants, then destroy. malloc/free/aligned_alloc are wrapped at link
+ *     time (-Wl,--wrap) to count real heap calls, and arena_set_hook() reports
+ *     what each request took from the arena. The DB context stands in for
+ *     db_participant_init() (same arena_alloc call, no libpq needed). Time per
+ *     request is dominated by the coordinator's logging, so only counts are shown.
+ * VN: Đếm số lần gọi malloc/free mỗi giao dịch khi bật/tắt arena theo request.
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_arena [requests] 2>/dev/null   (coordinator logs go to stderr)
+ */
+#include "../server/arena.h"
+#include "../server/transaction_coordinator.h"
+#include "../server/clearing_participant.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void *__real_malloc(size_t size);
+void __real_free(void *p);
+void *__real_aligned_alloc(size_t align, size_t size);
+
+static unsigned long g_mallocs, g_frees;
+
+void *__wrap_malloc(size_t size) {
+    g_mallocs++;
+    return __real_malloc(size);
+}
+
+void __wrap_free(void *p) {
+    if (p) g_frees++;
+    __real_free(p);
+}
+
+void *__wrap_aligned_alloc(size_t align, size_t size) {
+    g_mallocs++;
+    return __real_aligned_alloc(align, size);
+}
+
+// What arena_scope_end() reported for the requests of the current run
+static unsigned long g_hook_allocs, g_hook_heap;
+static size_t g_hook_bytes;
+
+static void count_request(unsigned long allocs, unsigned long heap_allocs, size_t bytes) {
+    g_hook_allocs += allocs;
+    g_hook_heap += heap_allocs;
+    if (bytes > g_hook_bytes) g_hook_bytes = bytes;
+}
+
+// Shape of DBParticipantContext (db_participant.h pulls in libpq)
+typedef struct {
+    void *dbc;
+    const char *current_txn_id;
+    bool in_transaction;
+} MockDbContext;
+
+static int mock_ok(void *context, const char *txn_id) {
+    (void)context; (void)txn_id;
+    return 0;
+}
+
+static void one_payment(TransactionCoordinator *coord, long i) {
+    char txn_id[MAX_TRANSACTION_ID_LEN];
+    snprintf(txn_id, sizeof(txn_id), "visa_bench%ld_1718000000", i);
+    arena_scope_begin();
+    Transaction *txn = txn_begin(coord, txn_id);
+    MockDbContext *db_ctx = arena_alloc(sizeof(*db_ctx));
+    ClearingParticipantContext *clearing_ctx = clearing_participant_init(NULL, 30);
+    if (!txn || !db_ctx || !clearing_ctx) abort();
+    db_ctx->dbc = NULL;
+    db_ctx->current_txn_id = txn_id;
+    db_ctx->in_transaction = true;
+    clearing_participant_set_transaction(clearing_ctx, txn_id, "411111******1111", 1000, 2, "MERCHANT001");
+    txn_register_participant(txn, "database", db_ctx, mock_ok, mock_ok, mock_ok);
+    txn_register_participant(txn, "clearing", clearing_ctx, mock_ok, mock_ok, mock_ok);
+    if (txn_commit(coord, txn) != 0) abort();
+    arena_release(db_ctx);
+    clearing_participant_destroy(clearing_ctx);
+    arena_scope_end();
+}
+
+static void run_case(const char *name, size_t arena_bytes, long requests) {
+    arena_configure(arena_bytes);
+    TransactionCoordinator *coord = txn_coordinator_init();
+    if (!coord) abort();
+    one_payment(coord, -1); // first scope of the thread allocates the arena block
+    g_mallocs = g_frees = 0;
+    g_hook_allocs = g_hook_heap = 0;
+    g_hook_bytes = 0;
+    for (long i = 0; i < requests; ++i) one_payment(coord, i);
+    printf("%-6s %12.2f %12.2f %12.2f %12.2f %10zu\n", name,
+           (double)g_mallocs / (double)requests, (double)g_frees / (double)requests,
+           (double)g_hook_allocs / (double)requests, (double)g_hook_heap / (double)requests,
+           g_hook_bytes);
+    txn_coordinator_destroy(coord);
+}
+
+int main(int argc, char **argv) {
+    long requests = argc > 1 ? atol(argv[1]) : 200000;
+    if (requests <= 0) requests = 200000;
+    arena_set_hook(count_request);
+    printf("%-6s %12s %12s %12s %12s %10s\n", "arena", "malloc/req", "free/req",
+           "arena/req", "fallback/req", "bytes");
+    run_case("off", 0, requests);
+    run_case("on", ARENA_DEFAULT_BYTES, requests);
+    return 0;
+}
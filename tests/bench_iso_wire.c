@@ -0,0 +1,94 @@
+/*
+ * Gateway hop codec cost: JSON line vs binary ISO 8583
+ *
+ * EN: The same purchase decoded into IsoRequest and answered, per request:
+ *       json:    iso_parse_request_line() + the {"status":"APPROVED",...} line
+ *       iso8583: iso_wire_decode() + iso_wire_encode_response() (0210, DE39=00)
+ *     The JSON request is what an ISO 8583 front end had to produce for us
+ *     before ISO8583_PORT existed (the translation step it removes is not
+ *     counted here, only our side of the hop).
+ * VN: So sánh chi phí giải mã + mã hoá phản hồi cho cùng một giao dịch:
+ *     JSON (PORT) và ISO 8583 nhị phân (ISO8583_PORT).
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_iso_wire [rounds]
+ */
+#include "../server/iso8583.h"
+#include "../server/iso8583_wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char k_json[] =
+    "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\",\"currency\":\"USD\","
+    "\"request_id\":\"240611000123\",\"type\":\"CAPTURE\"}";
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static volatile unsigned long g_sink;
+
+// 0200 with DE2 3 4 7 11 37 41 49 (what loadgen -I sends), length prefix included
+static size_t build_iso(unsigned char *out) {
+    static const int k_fields[] = {2, 3, 4, 7, 11, 37, 41, 49};
+    static const char k_values[] = "164111111111111111" "000000" "000000001000" "0611120000" "000123"
+                                   "240611000123" "TERM0001" "840";
+    size_t n = 4 + 8 + sizeof(k_values) - 1;
+    out[0] = (unsigned char)(n >> 8);
+    out[1] = (unsigned char)n;
+    memcpy(out + 2, "0200", 4);
+    memset(out + 6, 0, 8);
+    for (size_t k = 0; k < sizeof(k_fields) / sizeof(k_fields[0]); ++k)
+        out[6 + (k_fields[k] - 1) / 8] |= (unsigned char)(0x80 >> ((k_fields[k] - 1) % 8));
+    memcpy(out + 14, k_values, sizeof(k_values) - 1);
+    return n + 2;
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 2000000;
+    if (rounds <= 0) rounds = 2000000;
+    IsoRequest req;
+    IsoWireMsg m;
+    char err[32], line[256];
+    unsigned char msg[256], resp[512];
+    size_t msg_len = build_iso(msg);
+
+    // Same request on both paths
+    if (iso_parse_request_line(k_json, &req, err, sizeof(err)) != 0) return 1;
+    IsoRequestView wire_req;
+    if (iso_wire_decode(msg + 2, msg_len - 2, &m, &wire_req, err, sizeof(err)) != 0 ||
+        strcmp(req.pan, wire_req.pan.p) != 0 || req.amount_minor != wire_req.amount_minor ||
+        strcmp(req.currency, wire_req.currency.p) != 0 || strcmp(req.request_id, wire_req.request_id.p) != 0 ||
+        req.type != wire_req.type) {
+        fprintf(stderr, "decoders disagree (%s)\n", err);
+        return 1;
+    }
+
+    printf("%-8s %10s %12s %12s\n", "path", "req bytes", "resp bytes", "ns/request");
+    double t0 = now_s();
+    int rl = 0;
+    for (long r = 0; r < rounds; ++r) {
+        g_sink += (unsigned long)iso_parse_request_line(k_json, &req, err, sizeof(err));
+        rl = snprintf(line, sizeof(line), "{\"status\":\"APPROVED\",\"txn_id\":\"visa_%s_%ld\"}\n",
+                      req.request_id, 1718000000L + r);
+        g_sink += (unsigned long)rl;
+    }
+    double t1 = now_s();
+    printf("%-8s %10zu %12d %12.1f\n", "json", strlen(k_json) + 1, rl, (t1 - t0) * 1e9 / (double)rounds);
+
+    size_t wl = 0;
+    t0 = now_s();
+    for (long r = 0; r < rounds; ++r) {
+        g_sink += (unsigned long)iso_wire_decode(msg + 2, msg_len - 2, &m, &wire_req, err, sizeof(err));
+        wl = iso_wire_encode_response(&m, "00", "123456", resp, sizeof(resp));
+        g_sink += wl + (unsigned char)wire_req.pan.p[0];
+    }
+    t1 = now_s();
+    printf("%-8s %10zu %12zu %12.1f\n", "iso8583", msg_len, wl, (t1 - t0) * 1e9 / (double)rounds);
+    return 0;
+}
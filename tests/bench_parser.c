@@ -0,0 +1,144 @@
+/*
+ * Request parser microbenchmark: ns per iso_parse_request_line()
+ *
+ * EN: Compares the single-pass tokenizer (server/iso8583.c) with the previous
+ *     parser (embedded below as "strstr": one snprintf + strstr over the whole
+ *     line per key) on realistic payloads: minimal, full (all fields), long
+ *     request_id / extra fields, and keys reordered with spaces. "in-situ" is
+ *     iso_parse_request_insitu(), what the server runs: no field is copied,
+ *     but the timing includes re-copying the line into the buffer each time
+ *     (the parse terminates fields in place), so it is an upper bound.
+ * VN: So sánh bộ tách một lượt với bản cũ (strstr từng key trên cả dòng); kết
+ *     quả là ns/request cho từng loại payload.
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_parser [iterations]
+ */
+#include "../server/iso8583.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ---------------------------------------------------------------------------
+// Baseline: the pre-tokenizer parser (jget per key)
+// ---------------------------------------------------------------------------
+static int jget(const char *buf, const char *key, char *out, size_t outsz) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(buf, pattern);
+    if (!p) return -1;
+    p = strchr(p + strlen(pattern), ':');
+    if (!p) return -1;
+    p++;
+    while (*p && isspace((unsigned char)*p)) p++;
+    if (*p == '"') {
+        p++;
+        const char *q = strchr(p, '"');
+        if (!q) return -1;
+        size_t len = (size_t)(q - p);
+        if (len >= outsz) len = outsz - 1;
+        memcpy(out, p, len);
+        out[len] = '\0';
+        return 0;
+    }
+    const char *q = p;
+    while (*q && *q != ',' && *q != '}' && !isspace((unsigned char)*q)) q++;
+    size_t len = (size_t)(q - p);
+    if (len == 0) return -1;
+    if (len >= outsz) len = outsz - 1;
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return 0;
+}
+
+static int legacy_parse(const char *line, IsoRequest *out) {
+    memset(out, 0, sizeof(*out));
+    out->type = ISO_MSG_AUTH;
+    if (jget(line, "pan", out->pan, sizeof(out->pan)) != 0) return -1;
+    if (jget(line, "amount", out->amount_text, sizeof(out->amount_text)) != 0) return -1;
+    (void)jget(line, "currency", out->currency, sizeof(out->currency));
+    (void)jget(line, "request_id", out->request_id, sizeof(out->request_id));
+    char type_buf[32] = {0};
+    if (jget(line, "type", type_buf, sizeof(type_buf)) == 0) {
+        if (strcmp(type_buf, "AUTH") == 0) out->type = ISO_MSG_AUTH;
+        else if (strcmp(type_buf, "CAPTURE") == 0) out->type = ISO_MSG_CAPTURE;
+        else if (strcmp(type_buf, "REFUND") == 0) out->type = ISO_MSG_REFUND;
+        else if (strcmp(type_buf, "REVERSAL") == 0) out->type = ISO_MSG_REVERSAL;
+    }
+    char deadline_buf[24] = {0};
+    if (jget(line, "deadline_ms", deadline_buf, sizeof(deadline_buf)) == 0) {
+        long v = strtol(deadline_buf, NULL, 10);
+        out->deadline_ms = v > 0 ? v : 0;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+
+static const struct {
+    const char *name;
+    const char *line;
+} k_payloads[] = {
+    {"minimal", "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\"}"},
+    {"full",
+     "{\"pan\":\"4111111111111111\",\"amount\":\"125.50\",\"currency\":\"USD\","
+     "\"request_id\":\"pos-0042-20240611-000123\",\"type\":\"CAPTURE\",\"deadline_ms\":250}"},
+    {"extra_fields",
+     "{\"merchant\":{\"id\":\"M-77812\",\"mcc\":\"5411\",\"name\":\"Corner Grocery\"},"
+     "\"terminal_id\":\"T-0009\",\"pos_entry_mode\":\"051\",\"emv\":\"9F2608A1B2C3D4E5F60718\","
+     "\"request_id\":\"3f2c9a70-8b1e-4c55-a2f1-1d9e2b7c6a40\",\"currency\":\"EUR\","
+     "\"amount\":\"9999.99\",\"pan\":\"5500000000000004\"}"},
+    {"spaced", "{ \"type\" : \"REFUND\" , \"amount\" : 42.1 , \"pan\" : \"4012888888881881\" }"},
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static volatile unsigned long g_sink;
+
+int main(int argc, char **argv) {
+    long iters = argc > 1 ? atol(argv[1]) : 2000000;
+    if (iters <= 0) iters = 2000000;
+    printf("%-14s %7s %14s %14s %14s %8s\n", "payload", "bytes", "strstr ns/req", "single ns/req", "in-situ ns/req",
+           "speedup");
+    char buf[1024];
+    for (size_t i = 0; i < sizeof(k_payloads) / sizeof(k_payloads[0]); ++i) {
+        const char *line = k_payloads[i].line;
+        IsoRequest a, b;
+        char err[32];
+        if (legacy_parse(line, &a) != 0 || iso_parse_request_line(line, &b, err, sizeof(err)) != 0 ||
+            strcmp(a.pan, b.pan) != 0 || strcmp(a.amount_text, b.amount_text) != 0 ||
+            strcmp(a.request_id, b.request_id) != 0 || a.type != b.type) {
+            fprintf(stderr, "mismatch on payload %s\n", k_payloads[i].name);
+            return 1;
+        }
+        double t0 = now_s();
+        for (long n = 0; n < iters; ++n) {
+            g_sink += (unsigned long)legacy_parse(line, &a) + (unsigned char)a.pan[0];
+        }
+        double t1 = now_s();
+        for (long n = 0; n < iters; ++n) {
+            g_sink += (unsigned long)iso_parse_request_line(line, &b, err, sizeof(err)) + (unsigned char)b.pan[0];
+        }
+        double t2 = now_s();
+        size_t len = strlen(line) + 1;
+        IsoRequestView v;
+        for (long n = 0; n < iters; ++n) {
+            memcpy(buf, line, len);
+            g_sink += (unsigned long)iso_parse_request_insitu(buf, &v, err, sizeof(err)) + (unsigned char)v.pan.p[0];
+        }
+        double t3 = now_s();
+        double ns_old = (t1 - t0) * 1e9 / (double)iters;
+        double ns_new = (t2 - t1) * 1e9 / (double)iters;
+        double ns_view = (t3 - t2) * 1e9 / (double)iters;
+        printf("%-14s %7zu %14.1f %14.1f %14.1f %7.2fx\n", k_payloads[i].name, len - 1, ns_old, ns_new, ns_view,
+               ns_new > 0 ? ns_old / ns_new : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Response path: snprintf + write() per response vs templates + one writev
+ *
+ * EN: Sends the approved HTTP reply of a payment over a socketpair whose far
+ *     end is drained by a second thread. "old" formats status line, headers
+ *     and body with snprintf and writes each response, as handler.c did;
+ *     "writev" queues the static fragments plus the txn_id / Content-Length
+ *     copies in a ReplyBuf and flushes once per DEPTH responses, which is what
+ *     handler_consume() does for a client pipelining DEPTH requests.
+ * VN: So sánh số syscall và ns mỗi phản hồi: snprintf+write từng phản hồi và
+ *     ghép mảnh tĩnh + một writev cho cả lô pipelining.
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_reply [responses]
+ */
+#include "../server/reply.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static void *drain(void *arg) {
+    int fd = *(int *)arg;
+    char buf[65536];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int txn_id(char *out, long i) {
+    return snprintf(out, 64, "visa_r%ld_1718000000", i);
+}
+
+static unsigned long run_old(int fd, long responses) {
+    unsigned long writes = 0;
+    for (long i = 0; i < responses; ++i) {
+        char id[64], body[128], out[512];
+        txn_id(id, i);
+        int blen = snprintf(body, sizeof(body), "{\"status\":\"APPROVED\",\"txn_id\":\"%s\"}\n", id);
+        int n = snprintf(out, sizeof(out),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                         "Content-Length: %d\r\nConnection: keep-alive\r\n\r\n%s", blen, body);
+        if (write(fd, out, (size_t)n) != n) abort();
+        writes++;
+    }
+    return writes;
+}
+
+static unsigned long run_writev(int fd, long responses, int depth) {
+    static ReplyBuf rb;
+    static const char k_head[] = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ";
+    static const char k_conn[] = "\r\nConnection: keep-alive\r\n\r\n";
+    static const char k_body[] = "{\"status\":\"APPROVED\",\"txn_id\":\"";
+    static const char k_tail[] = "\"}\n";
+    ReplyStats before, after;
+    reply_stats(&before);
+    reply_init(&rb, fd);
+    for (long i = 0; i < responses; ++i) {
+        char id[64], len[16];
+        int idn = txn_id(id, i);
+        int ln = snprintf(len, sizeof(len), "%d", (int)(sizeof(k_body) - 1 + (size_t)idn + sizeof(k_tail) - 1));
+        REPLY_LIT(&rb, k_head);
+        reply_copy(&rb, len, (size_t)ln);
+        REPLY_LIT(&rb, k_conn);
+        REPLY_LIT(&rb, k_body);
+        reply_copy(&rb, id, (size_t)idn);
+        REPLY_LIT(&rb, k_tail);
+        reply_end(&rb);
+        if ((i + 1) % depth == 0 && reply_flush(&rb) != 0) abort();
+    }
+    if (reply_flush(&rb) != 0) abort();
+    reply_stats(&after);
+    return after.writes - before.writes;
+}
+
+int main(int argc, char **argv) {
+    long responses = argc > 1 ? atol(argv[1]) : 1000000;
+    if (responses <= 0) responses = 1000000;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 1;
+    pthread_t th;
+    pthread_create(&th, NULL, drain, &sv[1]);
+
+    printf("%-8s %6s %14s %14s\n", "path", "depth", "writes/resp", "ns/resp");
+    double t0 = now_ns();
+    unsigned long w = run_old(sv[0], responses);
+    printf("%-8s %6d %14.3f %14.1f\n", "old", 1, (double)w / (double)responses,
+           (now_ns() - t0) / (double)responses);
+    const int depths[] = { 1, 4, 16, 64 };
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+        t0 = now_ns();
+        w = run_writev(sv[0], responses, depths[d]);
+        printf("%-8s %6d %14.3f %14.1f\n", "writev", depths[d], (double)w / (double)responses,
+               (now_ns() - t0) / (double)responses);
+    }
+    close(sv[0]);
+    pthread_join(th, NULL);
+    close(sv[1]);
+    return 0;
+}
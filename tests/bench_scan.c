@@ -0,0 +1,97 @@
+/*
+ * Structural scanning benchmark: framing + JSON parse throughput (GB/s)
+ *
+ * EN: Runs the request mix below through the two places that scan request
+ *     bytes:
+ *       frame: split a pipelined 8 KB buffer into lines (simdscan_newline)
+ *       parse: iso_parse_request_line on every line of the mix, once per
+ *              implementation the CPU supports (SIMD_SCAN values); "scalar"
+ *              is the byte-wise tokenizer, i.e. the pre-SIMD path.
+ * VN: Đo GB/s của bước tách dòng và bước parse JSON cho từng cách quét
+ *     (scalar / sse2 / avx2) trên cùng bộ request mẫu.
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_scan [rounds]
+ */
+#include "../server/iso8583.h"
+#include "../server/simdscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Request mix: mostly terminal authorizations, some with metadata (same shapes as bench_parser)
+static const char *const k_mix[] = {
+    "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\"}",
+    "{\"pan\":\"4111111111111111\",\"amount\":\"125.50\",\"currency\":\"USD\","
+    "\"request_id\":\"pos-0042-20240611-000123\",\"type\":\"CAPTURE\",\"deadline_ms\":250}",
+    "{\"pan\":\"5500000000000004\",\"amount\":\"7.25\",\"currency\":\"EUR\",\"request_id\":\"r-88121\"}",
+    "{\"merchant\":{\"id\":\"M-77812\",\"mcc\":\"5411\",\"name\":\"Corner Grocery\"},"
+    "\"terminal_id\":\"T-0009\",\"pos_entry_mode\":\"051\",\"emv\":\"9F2608A1B2C3D4E5F60718\","
+    "\"request_id\":\"3f2c9a70-8b1e-4c55-a2f1-1d9e2b7c6a40\",\"currency\":\"EUR\","
+    "\"amount\":\"9999.99\",\"pan\":\"5500000000000004\"}",
+    "{ \"type\" : \"REFUND\" , \"amount\" : 42.1 , \"pan\" : \"4012888888881881\" }",
+};
+#define MIX_N (sizeof(k_mix) / sizeof(k_mix[0]))
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static volatile unsigned long g_sink;
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 1000000;
+    if (rounds <= 0) rounds = 1000000;
+    size_t mix_bytes = 0;
+    for (size_t i = 0; i < MIX_N; ++i) mix_bytes += strlen(k_mix[i]);
+
+    // Pipelined buffer for framing: the mix repeated up to ~8 KB (HANDLER_BUF_SIZE)
+    static char frame_buf[8192];
+    size_t fb = 0;
+    for (size_t i = 0;; i = (i + 1) % MIX_N) {
+        size_t l = strlen(k_mix[i]);
+        if (fb + l + 1 >= sizeof(frame_buf)) break;
+        memcpy(frame_buf + fb, k_mix[i], l);
+        fb += l;
+        frame_buf[fb++] = '\n';
+    }
+    long frame_rounds = rounds / 20 > 0 ? rounds / 20 : 1;
+
+    double t0 = now_s();
+    for (long r = 0; r < frame_rounds; ++r) {
+        const char *p = frame_buf, *end = frame_buf + fb;
+        unsigned long lines = 0;
+        for (;;) {
+            const char *nl = simdscan_newline(p, (size_t)(end - p));
+            if (!nl) break;
+            lines++;
+            p = nl + 1;
+        }
+        g_sink += lines;
+    }
+    double t1 = now_s();
+    printf("mix: %zu requests, %zu bytes; framing %zu-byte buffer: %.2f GB/s\n", MIX_N, mix_bytes, fb,
+           (double)fb * (double)frame_rounds / (t1 - t0) / 1e9);
+    printf("%-7s %12s %14s\n", "impl", "parse GB/s", "parse ns/req");
+    for (int impl = SIMDSCAN_SCALAR; impl <= SIMDSCAN_AVX2; ++impl) {
+        if (simdscan_force((SimdScanImpl)impl) != 0) continue;
+        IsoRequest req;
+        char err[32];
+        t0 = now_s();
+        for (long r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < MIX_N; ++i) {
+                g_sink += (unsigned long)iso_parse_request_line(k_mix[i], &req, err, sizeof(err)) +
+                          (unsigned char)req.pan[0];
+            }
+        }
+        t1 = now_s();
+        double parse_gbs = (double)mix_bytes * (double)rounds / (t1 - t0) / 1e9;
+        double ns_req = (t1 - t0) * 1e9 / ((double)rounds * (double)MIX_N);
+        printf("%-7s %12.2f %14.1f\n", simdscan_impl_name((SimdScanImpl)impl), parse_gbs, ns_req);
+    }
+    return 0;
+}
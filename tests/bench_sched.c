@@ -0,0 +1,178 @@
+/*
+ * Scheduler benchmark: SCHED=fifo vs SCHED=steal with 2PC mock participants
+ *
+ * EN: Each root job runs a 2PC transaction through a per-thread coordinator
+ *     with the same mock participants as tests/test_stress.c (10% prepare and
+ *     5% commit failures), fills a per-payment record, then submits a
+ *     follow-up job from inside the worker (clearing on commit, reversal on
+ *     abort) that reads the record back. We report throughput and how often
+ *     the follow-up ran on the same worker as its parent (cache locality).
+ *     Participant work is a short CPU spin instead of usleep so the scheduler
+ *     is what gets measured.
+ * VN: So sánh lịch FIFO và work-stealing: job gốc chạy 2PC (participant giả
+ *     lập như test_stress.c) rồi sinh job tiếp theo từ chính worker đó; đo
+ *     thông lượng và tỉ lệ job con chạy trên cùng worker với job cha.
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_sched [payments] [queue_cap]
+ */
+#define _GNU_SOURCE
+#include "../server/threadpool.h"
+#include "../server/transaction_coordinator.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORD_BYTES 2048   // per-payment state the follow-up re-reads
+#define SPIN_PREPARE_NS 3000
+#define SPIN_COMMIT_NS 1500
+
+typedef struct Payment {
+    ThreadPool *pool;
+    pthread_t parent;       // worker that ran the 2PC part
+    int committed;
+    unsigned int seed;
+    unsigned char record[RECORD_BYTES];
+} Payment;
+
+static long g_followups_done;
+static long g_same_worker;
+static long g_committed;
+static long g_checksum;
+static long g_inline;    // follow-ups run inline because the queue was full
+
+static __thread TransactionCoordinator *tls_coord;
+static __thread unsigned int tls_seed;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void spin_ns(long ns) {
+    long long end = now_ns() + ns;
+    while (now_ns() < end) { }
+}
+
+// Mock participants (failure rates from tests/test_stress.c)
+static int mock_prepare(void *context, const char *txn_id) {
+    (void)context; (void)txn_id;
+    spin_ns(SPIN_PREPARE_NS);
+    return (rand_r(&tls_seed) % 10 == 0) ? -1 : 0;
+}
+
+static int mock_commit(void *context, const char *txn_id) {
+    (void)context; (void)txn_id;
+    spin_ns(SPIN_COMMIT_NS);
+    return (rand_r(&tls_seed) % 20 == 0) ? -1 : 0;
+}
+
+static int mock_abort(void *context, const char *txn_id) {
+    (void)context; (void)txn_id;
+    return 0;
+}
+
+// Follow-up (clearing/reversal stand-in): reads the parent's record
+static void followup_job(void *arg) {
+    Payment *p = (Payment *)arg;
+    long sum = 0;
+    for (int i = 0; i < RECORD_BYTES; i += 8) sum += p->record[i];
+    __atomic_fetch_add(&g_checksum, sum, __ATOMIC_RELAXED);
+    if (pthread_equal(p->parent, pthread_self())) __atomic_fetch_add(&g_same_worker, 1, __ATOMIC_RELAXED);
+    if (p->committed) __atomic_fetch_add(&g_committed, 1, __ATOMIC_RELAXED);
+    free(p);
+    __atomic_fetch_add(&g_followups_done, 1, __ATOMIC_RELEASE);
+}
+
+static void payment_job(void *arg) {
+    Payment *p = (Payment *)arg;
+    if (!tls_coord) {
+        tls_coord = txn_coordinator_init();
+        tls_seed = (unsigned int)(uintptr_t)pthread_self();
+    }
+    char txn_id[64];
+    snprintf(txn_id, sizeof(txn_id), "bench_%u_%p", p->seed, (void *)p);
+    Transaction *txn = txn_begin(tls_coord, txn_id);
+    if (txn &&
+        txn_register_participant(txn, "participant1", p, mock_prepare, mock_commit, mock_abort) == 0 &&
+        txn_register_participant(txn, "participant2", p, mock_prepare, mock_commit, mock_abort) == 0) {
+        p->committed = txn_commit(tls_coord, txn) == 0;
+    } else if (txn) {
+        txn_abort(tls_coord, txn);
+    }
+    memset(p->record, (int)(p->seed & 0xff), sizeof(p->record));
+    p->parent = pthread_self();
+    // Spawned from the worker: stays local with SCHED=steal. Queue full → run
+    // inline (waiting here could deadlock: every worker blocked on a full ring)
+    if (threadpool_submit(p->pool, followup_job, p) != 0) {
+        __atomic_fetch_add(&g_inline, 1, __ATOMIC_RELAXED);
+        followup_job(p);
+    }
+}
+
+static void run_case(ThreadPoolSched sched, int workers, long payments, int cap) {
+    g_followups_done = 0;
+    g_same_worker = 0;
+    g_committed = 0;
+    g_inline = 0;
+    ThreadPoolOptions opts;
+    threadpool_options_init(&opts);
+    opts.num_threads = workers;
+    opts.queue_cap = cap;
+    opts.sched = sched;
+    ThreadPool *pool = threadpool_create_ex(&opts);
+    if (!pool) {
+        fprintf(stderr, "threadpool_create_ex failed\n");
+        return;
+    }
+    long rejects = 0;
+    long long t0 = now_ns();
+    for (long i = 0; i < payments; ++i) {
+        Payment *p = (Payment *)malloc(sizeof(*p));
+        p->pool = pool;
+        p->committed = 0;
+        p->seed = (unsigned int)i;
+        while (threadpool_submit(pool, payment_job, p) != 0) {
+            rejects++;
+            sched_yield();
+        }
+    }
+    while (__atomic_load_n(&g_followups_done, __ATOMIC_ACQUIRE) < payments) usleep(100);
+    double dt = (double)(now_ns() - t0) / 1e9;
+    threadpool_destroy(pool);
+    printf("%-5s workers=%-2d payments=%ld  %9.0f payments/s  same_worker=%5.1f%%  committed=%ld  rejects=%ld  inline=%ld\n",
+           sched == THREADPOOL_SCHED_STEAL ? "steal" : "fifo", workers, payments,
+           (double)payments / dt, 100.0 * (double)g_same_worker / (double)payments, g_committed, rejects, g_inline);
+}
+
+int main(int argc, char **argv) {
+    long payments = argc > 1 ? atol(argv[1]) : 50000;
+    int cap = argc > 2 ? atoi(argv[2]) : 1024;
+    if (payments <= 0) payments = 50000;
+    if (cap <= 0) cap = 1024;
+
+    // Run in an empty temp dir: the coordinator's logs/transactions.log is not
+    // opened there, so file I/O does not drown the scheduler cost.
+    char dir[] = "/tmp/bench_sched.XXXXXX";
+    if (mkdtemp(dir) && chdir(dir) != 0) perror("chdir");
+    // Coordinator init logs one INFO line per thread; keep stderr quiet
+    if (!freopen("/dev/null", "w", stderr)) perror("freopen");
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    const int worker_set[] = {2, 4, 8, 16};
+    printf("bench_sched: payments=%ld queue_cap=%d cpus=%ld\n", payments, cap, sysconf(_SC_NPROCESSORS_ONLN));
+    for (size_t i = 0; i < sizeof(worker_set) / sizeof(worker_set[0]); ++i) {
+        run_case(THREADPOOL_SCHED_FIFO, worker_set[i], payments, cap);
+        run_case(THREADPOOL_SCHED_STEAL, worker_set[i], payments, cap);
+    }
+    (void)g_checksum;
+    if (rmdir(dir) != 0) { /* leave it if something was created */ }
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Thread pool microbenchmark: submit → dequeue → run throughput
+ *
+ * EN: Compares the lock-free ring pool (server/threadpool.c) with the previous
+ *     mutex+condvar linked-list queue (embedded below as "mutex") at 2..32
+ *     threads, half producers and half workers. Jobs are empty (one atomic
+ *     increment), so the numbers measure queue overhead only.
+ * VN: So sánh ring lock-free với hàng đợi mutex+condvar cũ; job rỗng nên kết quả
+ *     phản ánh chi phí hàng đợi (malloc/free, khóa, đánh thức worker).
+ *
+ * Build & run:
+ *   make bench
+ *   ./build/bench_threadpool [jobs_total] [queue_cap]
+ */
+#define _GNU_SOURCE
+#include "../server/threadpool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// Baseline: the pre-ring queue (malloc per job, one mutex, one condvar)
+// ---------------------------------------------------------------------------
+typedef struct MqJob {
+    job_fn fn;
+    void *arg;
+    struct MqJob *next;
+} MqJob;
+
+typedef struct MutexPool {
+    pthread_t *threads;
+    int num_threads;
+    MqJob *head, *tail;
+    size_t size, cap;
+    pthread_mutex_t m;
+    pthread_cond_t cv;
+    int shutting_down;
+} MutexPool;
+
+static void *mq_worker(void *arg) {
+    MutexPool *pool = (MutexPool *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->m);
+        while (!pool->shutting_down && pool->size == 0) pthread_cond_wait(&pool->cv, &pool->m);
+        if (pool->shutting_down && pool->size == 0) {
+            pthread_mutex_unlock(&pool->m);
+            break;
+        }
+        MqJob *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pool->size--;
+        pthread_mutex_unlock(&pool->m);
+        job->fn(job->arg);
+        free(job);
+    }
+    return NULL;
+}
+
+static void *mq_create(int num_threads, int cap) {
+    MutexPool *pool = (MutexPool *)calloc(1, sizeof(*pool));
+    pool->cap = (size_t)cap;
+    pthread_mutex_init(&pool->m, NULL);
+    pthread_cond_init(&pool->cv, NULL);
+    pool->threads = (pthread_t *)calloc((size_t)num_threads, sizeof(pthread_t));
+    pool->num_threads = num_threads;
+    for (int i = 0; i < num_threads; ++i) pthread_create(&pool->threads[i], NULL, mq_worker, pool);
+    return pool;
+}
+
+static int mq_submit(void *p, job_fn fn, void *arg) {
+    MutexPool *pool = (MutexPool *)p;
+    MqJob *job = (MqJob *)malloc(sizeof(*job));
+    if (!job) return -1;
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+    pthread_mutex_lock(&pool->m);
+    if (pool->size >= pool->cap) {
+        pthread_mutex_unlock(&pool->m);
+        free(job);
+        return -1;
+    }
+    if (pool->tail) pool->tail->next = job; else pool->head = job;
+    pool->tail = job;
+    pool->size++;
+    pthread_cond_signal(&pool->cv);
+    pthread_mutex_unlock(&pool->m);
+    return 0;
+}
+
+static void mq_destroy(void *p) {
+    MutexPool *pool = (MutexPool *)p;
+    pthread_mutex_lock(&pool->m);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->cv);
+    pthread_mutex_unlock(&pool->m);
+    for (int i = 0; i < pool->num_threads; ++i) pthread_join(pool->threads[i], NULL);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->m);
+    pthread_cond_destroy(&pool->cv);
+    free(pool);
+}
+
+// Adapters for the pool under test
+static void *ring_create(int num_threads, int cap) { return threadpool_create(num_threads, cap); }
+static int ring_submit(void *p, job_fn fn, void *arg) { return threadpool_submit((ThreadPool *)p, fn, arg); }
+static void ring_destroy(void *p) { threadpool_destroy((ThreadPool *)p); }
+
+typedef struct PoolOps {
+    const char *name;
+    void *(*create)(int, int);
+    int (*submit)(void *, job_fn, void *);
+    void (*destroy)(void *);
+} PoolOps;
+
+static const PoolOps k_pools[] = {
+    {"mutex", mq_create, mq_submit, mq_destroy},
+    {"ring", ring_create, ring_submit, ring_destroy},
+};
+
+// ---------------------------------------------------------------------------
+// Benchmark driver
+// ---------------------------------------------------------------------------
+static long g_done;
+
+static void empty_job(void *arg) {
+    (void)arg;
+    __atomic_fetch_add(&g_done, 1, __ATOMIC_RELAXED);
+}
+
+typedef struct Producer {
+    const PoolOps *ops;
+    void *pool;
+    long jobs;
+    long rejects;
+    pthread_barrier_t *start;
+} Producer;
+
+static void *producer_main(void *arg) {
+    Producer *p = (Producer *)arg;
+    pthread_barrier_wait(p->start);
+    for (long i = 0; i < p->jobs; ++i) {
+        // Full queue: count the rejection (what net.c turns into server_busy) and retry
+        while (p->ops->submit(p->pool, empty_job, NULL) != 0) {
+            p->rejects++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run_case(const PoolOps *ops, int total_threads, long jobs_total, int cap) {
+    int producers = total_threads / 2 > 0 ? total_threads / 2 : 1;
+    int workers = total_threads - producers > 0 ? total_threads - producers : 1;
+    long per_producer = jobs_total / producers;
+    long expected = per_producer * producers;
+
+    g_done = 0;
+    void *pool = ops->create(workers, cap);
+    if (!pool) {
+        fprintf(stderr, "%s: create failed\n", ops->name);
+        return;
+    }
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)producers + 1);
+    pthread_t *tids = (pthread_t *)calloc((size_t)producers, sizeof(pthread_t));
+    Producer *ps = (Producer *)calloc((size_t)producers, sizeof(Producer));
+    for (int i = 0; i < producers; ++i) {
+        ps[i].ops = ops;
+        ps[i].pool = pool;
+        ps[i].jobs = per_producer;
+        ps[i].start = &start;
+        pthread_create(&tids[i], NULL, producer_main, &ps[i]);
+    }
+
+    pthread_barrier_wait(&start);
+    double t0 = now_s();
+    long rejects = 0;
+    for (int i = 0; i < producers; ++i) {
+        pthread_join(tids[i], NULL);
+        rejects += ps[i].rejects;
+    }
+    while (__atomic_load_n(&g_done, __ATOMIC_RELAXED) < expected) usleep(50);
+    double dt = now_s() - t0;
+    ops->destroy(pool);
+
+    printf("%-6s threads=%-3d producers=%-3d workers=%-3d jobs=%ld  %8.3f Mjobs/s  %7.1f ns/job  rejects=%ld\n",
+           ops->name, total_threads, producers, workers, expected,
+           (double)expected / dt / 1e6, dt * 1e9 / (double)expected, rejects);
+    pthread_barrier_destroy(&start);
+    free(tids);
+    free(ps);
+}
+
+int main(int argc, char **argv) {
+    long jobs = argc > 1 ? atol(argv[1]) : 1000000;
+    int cap = argc > 2 ? atoi(argv[2]) : 1024;
+    if (jobs <= 0) jobs = 1000000;
+    if (cap <= 0) cap = 1024;
+    const int thread_set[] = {2, 4, 8, 16, 32};
+
+    printf("bench_threadpool: jobs=%ld queue_cap=%d cpus=%ld\n", jobs, cap, sysconf(_SC_NPROCESSORS_ONLN));
+    for (size_t t = 0; t < sizeof(thread_set) / sizeof(thread_set[0]); ++t) {
+        for (size_t p = 0; p < sizeof(k_pools) / sizeof(k_pools[0]); ++p) {
+            run_case(&k_pools[p], thread_set[t], jobs, cap);
+        }
+    }
+    return 0;
+}
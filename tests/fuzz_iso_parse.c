@@ -0,0 +1,194 @@
+/*
+ * Fuzz harness for iso_parse_request_line()
+ *
+ * EN: libFuzzer entry point plus a standalone driver, so it also runs where
+ *     only gcc is available. Checks that the parser never reads past the NUL,
+ *     always NUL-terminates the IsoRequest strings, that a successful parse
+ *     has a pan and an amount field, that every SIMD_SCAN implementation
+ *     (structural index vs byte-wise tokenizer) gives the same result, and
+ *     that the in-place parse (iso_parse_request_insitu) yields the same
+ *     fields as views into its own copy of the line, and that a batch line
+ *     (iso_parse_batch_insitu) stays within its item cap and gives views into
+ *     the line for every item it accepted.
+ * VN: Harness fuzz cho bộ tách request; chạy với libFuzzer (clang) hoặc bộ
+ *     đột biến ngẫu nhiên tích hợp sẵn (gcc + ASan/UBSan).
+ *
+ * Build & run:
+ *   make fuzz && ./build/fuzz_iso_parse [iterations] [seed]          (gcc, ASan/UBSan)
+ *   clang -g -O1 -fsanitize=fuzzer,address -DISO_FUZZ_LIBFUZZER \
+ *     tests/fuzz_iso_parse.c server/iso8583.c server/simdscan.c -o fuzz && ./fuzz  (libFuzzer)
+ */
+#include "../server/iso8583.h"
+#include "../server/simdscan.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void check_terminated(const char *field, size_t cap) {
+    if (memchr(field, '\0', cap) == NULL) abort();
+}
+
+static int parse_checked(const char *line, IsoRequest *req, char *err, size_t errsz) {
+    memset(req, 0x5a, sizeof(*req)); // stale bytes must never leak into a result
+    err[0] = '\0';
+    int rc = iso_parse_request_line(line, req, err, errsz);
+    check_terminated(req->pan, sizeof(req->pan));
+    check_terminated(req->amount_text, sizeof(req->amount_text));
+    check_terminated(req->currency, sizeof(req->currency));
+    check_terminated(req->request_id, sizeof(req->request_id));
+    if (rc == 0 && (!strstr(line, "\"pan\"") || !strstr(line, "\"amount\""))) abort();
+    if (req->deadline_ms < 0) abort();
+    if (req->amount_minor >= 0) { // must round-trip through the response-edge formatter
+        char txt[40];
+        int64_t back;
+        if (iso_amount_format(req->amount_minor, req->amount_exp, txt, sizeof(txt)) < 0 ||
+            iso_amount_parse(txt, strlen(txt), req->amount_exp, &back) != 0 || back != req->amount_minor)
+            abort();
+    }
+    return rc;
+}
+
+static int same_request(const IsoRequest *a, const IsoRequest *b) {
+    return strcmp(a->pan, b->pan) == 0 && strcmp(a->amount_text, b->amount_text) == 0 &&
+           strcmp(a->currency, b->currency) == 0 && strcmp(a->request_id, b->request_id) == 0 &&
+           a->amount_minor == b->amount_minor && a->amount_exp == b->amount_exp &&
+           a->type == b->type && a->deadline_ms == b->deadline_ms;
+}
+
+// In-place parse of a private copy must agree with the copying parse
+static void check_insitu(const char *line, size_t size, int ref_rc, const IsoRequest *ref) {
+    char *copy = (char *)malloc(size + 1);
+    if (!copy) return;
+    memcpy(copy, line, size + 1);
+    IsoRequestView v;
+    int rc = iso_parse_request_insitu(copy, &v, NULL, 0);
+    if ((rc == 0) != (ref_rc == 0)) abort();
+    if (rc != 0 && memcmp(copy, line, size + 1) != 0) abort(); // untouched on failure
+    if (rc == 0) {
+        const IsoStr *f[] = {&v.pan, &v.amount, &v.currency, &v.request_id};
+        for (size_t i = 0; i < 4; ++i) {
+            if (f[i]->p[f[i]->n] != '\0' || strlen(f[i]->p) != f[i]->n) abort();
+            if (f[i]->n && (f[i]->p < copy || f[i]->p + f[i]->n > copy + size)) abort();
+        }
+        if (strcmp(v.pan.p, ref->pan) != 0 || strcmp(v.amount.p, ref->amount_text) != 0 ||
+            strcmp(v.currency.p, ref->currency) != 0 || strcmp(v.request_id.p, ref->request_id) != 0 ||
+            v.amount_minor != ref->amount_minor || v.amount_exp != ref->amount_exp ||
+            v.type != ref->type || v.deadline_ms != ref->deadline_ms)
+            abort();
+    }
+    free(copy);
+}
+
+// Batch parse of a private copy: bounded count, accepted items point into the copy
+static void check_batch(const char *line, size_t size) {
+    if (!iso_is_batch(line)) return;
+    char *copy = (char *)malloc(size + 1);
+    if (!copy) return;
+    memcpy(copy, line, size + 1);
+    IsoRequestView items[4];
+    int item_rc[4];
+    char err[32] = "";
+    int n = iso_parse_batch_insitu(copy, items, item_rc, 4, err, sizeof(err));
+    if (n > 4 || (n <= 0 && !err[0])) abort();
+    for (int i = 0; i < n; ++i) {
+        if (item_rc[i] != 0) continue;
+        const IsoStr *f[] = {&items[i].pan, &items[i].amount, &items[i].currency, &items[i].request_id};
+        for (size_t k = 0; k < 4; ++k) {
+            if (f[k]->p[f[k]->n] != '\0' || strlen(f[k]->p) != f[k]->n) abort();
+            if (f[k]->n && (f[k]->p < copy || f[k]->p + f[k]->n > copy + size)) abort();
+        }
+    }
+    free(copy);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // Exact-size heap copy: ASan catches any read past the terminator
+    char *line = (char *)malloc(size + 1);
+    if (!line) return 0;
+    memcpy(line, data, size);
+    line[size] = '\0';
+    IsoRequest ref, req;
+    char ref_err[32], err[32];
+    (void)simdscan_force(SIMDSCAN_SCALAR);
+    int ref_rc = parse_checked(line, &ref, ref_err, sizeof(ref_err));
+    for (int impl = SIMDSCAN_SSE2; impl <= SIMDSCAN_AVX2; ++impl) {
+        if (simdscan_force((SimdScanImpl)impl) != 0) continue;
+        int rc = parse_checked(line, &req, err, sizeof(err));
+        if (rc != ref_rc || (rc == 0 && !same_request(&ref, &req)) || (rc != 0 && strcmp(err, ref_err) != 0)) {
+            fprintf(stderr, "%s disagrees with scalar on: %s\n", simdscan_impl_name((SimdScanImpl)impl), line);
+            abort();
+        }
+    }
+    check_insitu(line, size, ref_rc, &ref);
+    check_batch(line, size);
+    free(line);
+    return 0;
+}
+
+#ifndef ISO_FUZZ_LIBFUZZER
+static const char *const k_seeds[] = {
+    "{\"pan\":\"4111111111111111\",\"amount\":\"10.00\"}",
+    "{\"pan\":\"4111111111111111\",\"amount\":1000.5,\"currency\":\"JPY\"}",
+    "{\"pan\":\"4111111111111111\",\"amount\":\"1.00\",\"currency\":\"USD\",\"request_id\":\"r-1\","
+    "\"type\":\"REVERSAL\",\"deadline_ms\":250}",
+    "{\"note\":\"\\\"pan\\\":\\\"1\\\"\",\"m\":{\"a\":[1,{\"b\":\"}\"}]},\"pan\":4111,\"amount\":2}",
+    "{ \"amount\" : 5 , \"pan\" : \"x\\\\y\" }",
+    "{}",
+    "{\"pan\":\"4111111111111111\",\"amount\":\"1.00\",\"request_id\":\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    "aaaaaaaaaaaaaaaaaaaaaaaa\",\"x\":[{\"y\":\":,{\"},2],\"currency\":\"USD\"}",
+    "[{\"pan\":\"4111111111111111\",\"amount\":\"1.00\",\"request_id\":\"a\"},"
+    "{\"pan\":\"4\",\"amount\":2,\"note\":\"}]\"}]",
+    "{\"batch\":[{\"pan\":\"4111111111111111\",\"amount\":\"1.00\"} , {\"amount\":3,\"pan\":\"5\"}]}",
+};
+static const char k_alphabet[] = "{}[]\":,\\ \t\r\n0123456789.-panmoutcrysqidlTAUHREVSJPYD";
+
+static uint64_t g_rng;
+static uint32_t rnd(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)g_rng;
+}
+
+int main(int argc, char **argv) {
+    long iters = argc > 1 ? atol(argv[1]) : 1000000;
+    g_rng = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x9e3779b97f4a7c15ULL;
+    if (g_rng == 0) g_rng = 1;
+    uint8_t buf[512];
+    const size_t nseeds = sizeof(k_seeds) / sizeof(k_seeds[0]);
+    for (long i = 0; i < iters; ++i) {
+        const char *seed = k_seeds[rnd() % nseeds];
+        size_t len = strlen(seed);
+        memcpy(buf, seed, len);
+        int muts = 1 + (int)(rnd() % 8);
+        for (int m = 0; m < muts; ++m) {
+            size_t pos = len ? rnd() % len : 0;
+            switch (rnd() % 4) {
+            case 0: // overwrite
+                if (len) buf[pos] = (uint8_t)k_alphabet[rnd() % (sizeof(k_alphabet) - 1)];
+                break;
+            case 1: // insert
+                if (len + 1 < sizeof(buf)) {
+                    memmove(buf + pos + 1, buf + pos, len - pos);
+                    buf[pos] = rnd() % 4 ? (uint8_t)k_alphabet[rnd() % (sizeof(k_alphabet) - 1)] : (uint8_t)rnd();
+                    len++;
+                }
+                break;
+            case 2: // delete
+                if (len) {
+                    memmove(buf + pos, buf + pos + 1, len - pos - 1);
+                    len--;
+                }
+                break;
+            default: // truncate
+                len = pos;
+                break;
+            }
+        }
+        (void)LLVMFuzzerTestOneInput(buf, len);
+    }
+    printf("fuzz_iso_parse: %ld inputs OK\n", iters);
+    return 0;
+}
+#endif
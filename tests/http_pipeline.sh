@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+# HTTP/1.1 keep-alive + pipelining: several requests in one write on one
+# connection; the server must answer each of them, in order, without closing
+# until the last one says "Connection: close".
+# Usage: API_TOKEN=... ./tests/http_pipeline.sh [port]
+
+set -euo pipefail
+
+PORT="${1:-9090}"
+TOKEN="${API_TOKEN:-}"
+BODY='{"pan":"4111111111111111","amount":"10.00"}'
+
+{
+  printf 'GET /healthz HTTP/1.1\r\nHost: localhost\r\n\r\n'
+  printf 'POST /secure/tx HTTP/1.1\r\nHost: localhost\r\nAuthorization: Bearer %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s' \
+    "$TOKEN" "${#BODY}" "$BODY"
+  printf 'GET /version HTTP/1.1\r\nHost: localhost\r\n\r\n'
+  printf 'GET /metrics HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n'
+  sleep 1
+} | nc 127.0.0.1 "$PORT"
+
+echo
@@ -117,8 +117,8 @@ cleanup() {
 }
 trap cleanup EXIT
 
-# Build once
-make -C "$ROOT_DIR" >/dev/null
+# Build once (server, loadgen and the unit tests)
+make -C "$ROOT_DIR" all test >/dev/null
 
 start_server
 
@@ -271,6 +271,37 @@ test_2pc_unit() {
   fi
 }
 
+# Unit test binary built by `make test`: passes when it exits 0 and prints
+# the pass line (the tests abort on a failed assert)
+run_unit_test() {
+  local name="$1" bin="$ROOT_DIR/build/$1" pass_line="$2"
+  log "Running $name..."
+  local out rc=0
+  out=$("$bin" 2>&1) || rc=$?
+  if (( rc == 0 )) && grep -q "$pass_line" <<<"$out"; then
+    log "$name: PASSED"
+    return 0
+  fi
+  log "$name: FAILED (exit $rc)"
+  logv "$out"
+  return 1
+}
+
+# Idempotency cache: CLOCK eviction, TTL expiry, oversized keys
+test_idem_unit() {
+  run_unit_test test_idem "All idempotency cache tests passed"
+}
+
+# Amounts: parser rejections, binary NUMERIC layout and round trip
+test_amount_unit() {
+  run_unit_test test_amount "All amount tests passed"
+}
+
+# Singleflight: leader + followers, follower timeout, end with no waiters (ASan build)
+test_singleflight_unit() {
+  run_unit_test test_singleflight "All singleflight tests passed"
+}
+
 # 2PC: Integration tests with scenarios
 test_2pc_integration() {
   # Try advanced tests first, fallback to simple
@@ -325,6 +356,9 @@ run_case "M2: partial_read"     test_partial_read
 run_case "M2: metrics"          test_metrics
 run_case "SEC: no_pan_in_logs"  test_no_pan_in_logs
 run_case "2PC: unit_tests"      test_2pc_unit
+run_case "UNIT: idem"           test_idem_unit
+run_case "UNIT: amount"         test_amount_unit
+run_case "UNIT: singleflight"   test_singleflight_unit
 run_case "2PC: integration"     test_2pc_integration
 
 echo
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "../server/iso8583.h"
+#include "../server/pgnumeric.h"
+
+static int parse(const char *s, int exponent, int64_t *minor) {
+    return iso_amount_parse(s, strlen(s), exponent, minor);
+}
+
+static int16_t be16(const unsigned char *p) {
+    return (int16_t)(uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Decode a binary NUMERIC the way numeric_recv reads it and check it is in
+// canonical form; returns the value in minor units of its dscale
+static int64_t numeric_decode(const unsigned char *buf, int len, int *dscale) {
+    assert(len >= 8 && len <= DB_NUMERIC_MAX && len % 2 == 0);
+    int ndigits = be16(buf), weight = be16(buf + 2), sign = (uint16_t)be16(buf + 4);
+    *dscale = be16(buf + 6);
+    assert(len == 8 + 2 * ndigits);
+    assert(sign == 0 || sign == 0x4000);
+    if (ndigits == 0) {
+        assert(weight == 0 && sign == 0);
+        return 0;
+    }
+    uint64_t u = 0;
+    for (int i = 0; i < ndigits; ++i) {
+        int d = be16(buf + 8 + 2 * i);
+        assert(d >= 0 && d < 10000);
+        assert(i > 0 || d != 0);              // no leading zero group
+        assert(i < ndigits - 1 || d != 0);    // no trailing zero group
+        // Group i is worth d * 10000^(weight - i), i.e. 10^exp minor units
+        int exp = 4 * (weight - i) + *dscale;
+        uint64_t v = (uint64_t)d;
+        for (; exp > 0; --exp) v *= 10;
+        for (; exp < 0; ++exp) {
+            assert(v % 10 == 0);              // nothing finer than dscale
+            v /= 10;
+        }
+        u += v;
+    }
+    return sign ? (int64_t)(0 - u) : (int64_t)u;
+}
+
+static void check_numeric(int64_t minor, int scale) {
+    unsigned char buf[DB_NUMERIC_MAX];
+    int dscale = -1;
+    int len = numeric_binary(minor, scale, buf);
+    assert(numeric_decode(buf, len, &dscale) == minor);
+    assert(dscale == scale);
+}
+
+int main() {
+    printf("🧪 Testing Amount Parsing and Binary NUMERIC\n");
+    printf("============================================\n");
+    int64_t m = 0;
+
+    // Test 1: accepted forms
+    printf("\n1. Testing valid amounts...\n");
+    assert(parse("10", 2, &m) == 0 && m == 1000);
+    assert(parse("10.5", 2, &m) == 0 && m == 1050);
+    assert(parse("10.50", 2, &m) == 0 && m == 1050);
+    assert(parse("10.500", 2, &m) == 0 && m == 1050);   // zeros past the minor unit
+    assert(parse("0.01", 2, &m) == 0 && m == 1);
+    assert(parse(".5", 2, &m) == 0 && m == 50);
+    assert(parse("5.", 2, &m) == 0 && m == 500);
+    assert(parse("1500", 0, &m) == 0 && m == 1500);     // JPY
+    assert(parse("1.234", 3, &m) == 0 && m == 1234);    // BHD
+    assert(parse("999999999999.999999", 6, &m) == 0 && m == 999999999999999999LL);
+    printf("✅ Integer, fraction and trailing-zero forms parsed to minor units\n");
+
+    // Test 2: rejections
+    printf("\n2. Testing rejected amounts...\n");
+    const char *sign[] = {"-10.00", "+10.00", "-0"};
+    for (size_t i = 0; i < sizeof(sign) / sizeof(sign[0]); ++i) assert(parse(sign[i], 2, &m) != 0);
+    printf("✅ Signed amounts rejected\n");
+    const char *expo[] = {"1e3", "1E3", "1.5e2", "0x10", "inf", "nan"};
+    for (size_t i = 0; i < sizeof(expo) / sizeof(expo[0]); ++i) assert(parse(expo[i], 2, &m) != 0);
+    printf("✅ Exponent notation and non-decimal text rejected\n");
+    assert(parse("10.505", 2, &m) != 0);
+    assert(parse("10.001", 2, &m) != 0);
+    assert(parse("1.5", 0, &m) != 0);
+    assert(parse("0.0000001", 6, &m) != 0);
+    printf("✅ Precision finer than the currency's minor unit rejected\n");
+    // 12 integer digits is the most: 10^12 * 10^6 still fits in int64
+    assert(parse("999999999999", 6, &m) == 0 && m == 999999999999000000LL);
+    assert(parse("1000000000000", 2, &m) != 0);
+    assert(parse("9223372036854775807", 0, &m) != 0);
+    assert(parse("92233720368547758070", 0, &m) != 0);
+    printf("✅ Amounts that could overflow int64 rejected\n");
+    const char *junk[] = {"", ".", " 10", "10 ", "1,00", "10.0.0", "1_000"};
+    for (size_t i = 0; i < sizeof(junk) / sizeof(junk[0]); ++i) assert(parse(junk[i], 2, &m) != 0);
+    assert(parse("10", 7, &m) != 0 && parse("10", -1, &m) != 0);
+    printf("✅ Empty, spaced, malformed text and unknown exponents rejected\n");
+
+    // Test 3: encoding of known values (as PostgreSQL's numeric_send writes them)
+    printf("\n3. Testing binary NUMERIC layout...\n");
+    unsigned char buf[DB_NUMERIC_MAX];
+    // 10.50: ndigits 2, weight 0, sign +, dscale 2, digits 10 | 5000
+    static const unsigned char k_10_50[] = {0, 2, 0, 0, 0, 0, 0, 2, 0, 10, 0x13, 0x88};
+    assert(numeric_binary(1050, 2, buf) == (int)sizeof(k_10_50) && memcmp(buf, k_10_50, sizeof(k_10_50)) == 0);
+    // 0.01: ndigits 1, weight -1, dscale 2, digit 100
+    static const unsigned char k_0_01[] = {0, 1, 0xff, 0xff, 0, 0, 0, 2, 0, 100};
+    assert(numeric_binary(1, 2, buf) == (int)sizeof(k_0_01) && memcmp(buf, k_0_01, sizeof(k_0_01)) == 0);
+    // 0.00: no digits, dscale kept
+    static const unsigned char k_zero[] = {0, 0, 0, 0, 0, 0, 0, 2};
+    assert(numeric_binary(0, 2, buf) == (int)sizeof(k_zero) && memcmp(buf, k_zero, sizeof(k_zero)) == 0);
+    printf("✅ 10.50, 0.01 and 0.00 encoded byte for byte\n");
+
+    // Test 4: parse → encode → decode round trip over every exponent
+    printf("\n4. Testing round trip...\n");
+    static const int64_t k_minor[] = {0, 1, 9, 10, 99, 100, 9999, 10000, 10001, 123456789, 100000000,
+                                      999999999999999999LL, INT64_MAX, -1, -1050, INT64_MIN + 1};
+    int checked = 0;
+    for (int e = 0; e <= 6; ++e) {
+        for (size_t i = 0; i < sizeof(k_minor) / sizeof(k_minor[0]); ++i, ++checked) check_numeric(k_minor[i], e);
+        // Through the text the handler parses
+        for (int64_t v = 1; v / iso_amount_scale(e) < 1000000000000LL; v = v * 7 + 3, ++checked) {
+            char text[32];
+            assert(iso_amount_format(v, e, text, sizeof(text)) > 0);
+            assert(parse(text, e, &m) == 0 && m == v);
+            check_numeric(m, e);
+        }
+    }
+    printf("✅ %d amounts survived text → minor units → NUMERIC → minor units\n", checked);
+
+    printf("\n🎉 All amount tests passed!\n");
+    return 0;
+}
@@ -17,7 +17,7 @@ int main() {
     // Test 2: Set transaction details
     printf("\n2. Testing transaction setup...\n");
     int result = clearing_participant_set_transaction(ctx, "test_clearing_001",
-                                                    "1234****5678", "150.00", "MERCHANT123");
+                                                    "1234****5678", 15000, 2, "MERCHANT123");
     assert(result == 0);
     printf("✅ Transaction details set successfully\n");
     
@@ -26,12 +26,12 @@ int main() {
     
     int success_count = 0;
     int failure_count = 0;
+    char txn_id[64]; // borrowed by the context until destroy
     
     for (int i = 0; i < 10; i++) {
-        char txn_id[64];
         snprintf(txn_id, sizeof(txn_id), "test_clearing_%03d", i);
         
-        clearing_participant_set_transaction(ctx, txn_id, "4532****9012", "100.00", "MERCHANT001");
+        clearing_participant_set_transaction(ctx, txn_id, "4532****9012", 10000, 2, "MERCHANT001");
         
         // Test prepare
         int prepare_result = clearing_participant_prepare(ctx, txn_id);
@@ -62,7 +62,7 @@ int main() {
     
     // Test 4: Test abort functionality
     printf("\n4. Testing abort functionality...\n");
-    clearing_participant_set_transaction(ctx, "test_abort_001", "5555****1234", "200.00", "MERCHANT999");
+    clearing_participant_set_transaction(ctx, "test_abort_001", "5555****1234", 20000, 2, "MERCHANT999");
     
     result = clearing_participant_prepare(ctx, "test_abort_001");
     if (result == 0) {
@@ -84,7 +84,7 @@ int main() {
     printf("✅ Correctly rejected commit for non-existent transaction\n");
     
     // Test commit without prepare
-    clearing_participant_set_transaction(ctx, "test_no_prepare", "1111****2222", "50.00", "MERCHANT456");
+    clearing_participant_set_transaction(ctx, "test_no_prepare", "1111****2222", 5000, 2, "MERCHANT456");
     result = clearing_participant_commit(ctx, "test_no_prepare");
     assert(result != 0);
     printf("✅ Correctly rejected commit without prepare\n");
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "../server/idem.h"
+
+// Same hash and shard count as server/idem.c: lets the test pick keys that
+// compete for the slots of one shard
+#define TEST_IDEM_SHARDS 64
+
+static unsigned shard_of(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    return (unsigned)(h % TEST_IDEM_SHARDS);
+}
+
+// n keys "<prefix>-<i>" that all land in the shard of the first one
+static void same_shard_keys(const char *prefix, char keys[][32], int n) {
+    unsigned shard = 0;
+    int found = 0;
+    for (int i = 0; found < n; ++i) {
+        char k[32];
+        snprintf(k, sizeof(k), "%s-%d", prefix, i);
+        if (found == 0) shard = shard_of(k);
+        if (shard_of(k) != shard) continue;
+        memcpy(keys[found++], k, sizeof(k));
+    }
+}
+
+int main() {
+    printf("🧪 Testing Idempotency Cache\n");
+    printf("============================\n");
+
+    char status[IDEM_TXN_MAX], txn[IDEM_TXN_MAX];
+    IdemStats st;
+
+    // Test 1: off until sized
+    printf("\n1. Testing disabled cache...\n");
+    assert(idem_init(0, 600) == 0);
+    idem_put("off-1", "APPROVED", "visa_off_1");
+    assert(idem_get("off-1", status, txn, sizeof(status)) == 0);
+    printf("✅ Budget 0 caches nothing\n");
+
+    // Test 2: put / get round trip, replace
+    printf("\n2. Testing put/get...\n");
+    assert(idem_init(IDEM_DEFAULT_KB * 1024, 600) == 0);
+    idem_put("rt-1", "APPROVED", "visa_rt_1");
+    assert(idem_get("rt-1", status, txn, sizeof(status)) == 1);
+    assert(strcmp(status, "APPROVED") == 0 && strcmp(txn, "visa_rt_1") == 0);
+    idem_put("rt-1", "REVERSED", "visa_rt_1b");
+    assert(idem_get("rt-1", status, txn, sizeof(status)) == 1);
+    assert(strcmp(status, "REVERSED") == 0 && strcmp(txn, "visa_rt_1b") == 0);
+    assert(idem_get("rt-2", status, txn, sizeof(status)) == 0);
+    printf("✅ Stored outcome returned, replaced in place, unknown id missed\n");
+
+    // Test 3: ids of IDEM_KEY_MAX bytes or more are never cached
+    printf("\n3. Testing oversized keys...\n");
+    char longest[IDEM_KEY_MAX], oversized[IDEM_KEY_MAX + 1];
+    memset(longest, 'k', sizeof(longest) - 1);
+    longest[sizeof(longest) - 1] = '\0';
+    memset(oversized, 'k', sizeof(oversized) - 1);
+    oversized[sizeof(oversized) - 1] = '\0';
+    idem_stats(&st);
+    unsigned long inserts = st.inserts, misses = st.misses;
+    idem_put(oversized, "APPROVED", "visa_long");
+    assert(idem_get(oversized, status, txn, sizeof(status)) == 0);
+    idem_stats(&st);
+    assert(st.inserts == inserts && st.misses == misses);
+    idem_put(longest, "APPROVED", "visa_longest");
+    assert(idem_get(longest, status, txn, sizeof(status)) == 1);
+    assert(strcmp(txn, "visa_longest") == 0);
+    // Its 64-byte prefix is a different id
+    assert(idem_get(oversized, status, txn, sizeof(status)) == 0);
+    printf("✅ %d-byte id cached, %d-byte id bypassed (no insert, no miss)\n",
+           IDEM_KEY_MAX - 1, IDEM_KEY_MAX);
+
+    // Test 4: CLOCK replacement with two slots per shard
+    printf("\n4. Testing CLOCK eviction...\n");
+    // Entry + index cost per slot is under 256 bytes: 2 slots per shard
+    assert(idem_init(TEST_IDEM_SHARDS * 2 * 256, 600) == 0);
+    idem_stats(&st);
+    assert(st.capacity == TEST_IDEM_SHARDS * 2);
+    unsigned long evictions = st.evictions; // totals survive idem_init()
+    char keys[4][32];
+    same_shard_keys("clk", keys, 4);
+    idem_put(keys[0], "APPROVED", "visa_a");
+    idem_put(keys[1], "APPROVED", "visa_b");
+    assert(idem_get(keys[0], status, txn, sizeof(status)) == 1); // reference bit set
+    // Full shard: the hand clears a's bit, passes it and takes b
+    idem_put(keys[2], "APPROVED", "visa_c");
+    assert(idem_get(keys[1], status, txn, sizeof(status)) == 0);
+    assert(idem_get(keys[0], status, txn, sizeof(status)) == 1 && strcmp(txn, "visa_a") == 0);
+    assert(idem_get(keys[2], status, txn, sizeof(status)) == 1 && strcmp(txn, "visa_c") == 0);
+    idem_stats(&st);
+    assert(st.evictions == evictions + 1);
+    printf("✅ Recently hit entry survived, unreferenced one evicted\n");
+    // a and c were both hit: one full sweep clears them, then a (under the hand) goes
+    idem_put(keys[3], "APPROVED", "visa_d");
+    assert(idem_get(keys[0], status, txn, sizeof(status)) == 0);
+    assert(idem_get(keys[3], status, txn, sizeof(status)) == 1 && strcmp(txn, "visa_d") == 0);
+    idem_stats(&st);
+    assert(st.evictions == evictions + 2);
+    printf("✅ With every bit set the hand sweeps once and evicts in order\n");
+
+    // Test 5: TTL expiry (monotonic seconds)
+    printf("\n5. Testing TTL expiry...\n");
+    assert(idem_init(IDEM_DEFAULT_KB * 1024, 1) == 0);
+    idem_put("ttl-1", "APPROVED", "visa_ttl_1");
+    assert(idem_get("ttl-1", status, txn, sizeof(status)) == 1);
+    sleep(2);
+    assert(idem_get("ttl-1", status, txn, sizeof(status)) == 0);
+    // Replacing it makes it live again
+    idem_put("ttl-1", "APPROVED", "visa_ttl_1b");
+    assert(idem_get("ttl-1", status, txn, sizeof(status)) == 1 && strcmp(txn, "visa_ttl_1b") == 0);
+    printf("✅ Entry expired after its TTL, a new put revived it\n");
+
+    // Test 6: an expired entry is reclaimed even with its reference bit set
+    printf("\n6. Testing expired slot reclaimed...\n");
+    assert(idem_init(TEST_IDEM_SHARDS * 2 * 256, 1) == 0);
+    same_shard_keys("exp", keys, 3);
+    idem_stats(&st);
+    evictions = st.evictions;
+    idem_put(keys[0], "APPROVED", "visa_old");
+    assert(idem_get(keys[0], status, txn, sizeof(status)) == 1); // reference bit set
+    sleep(2);
+    idem_put(keys[1], "APPROVED", "visa_new");
+    idem_put(keys[2], "APPROVED", "visa_newer"); // full: the hand is on the expired one
+    assert(idem_get(keys[0], status, txn, sizeof(status)) == 0);
+    assert(idem_get(keys[1], status, txn, sizeof(status)) == 1);
+    assert(idem_get(keys[2], status, txn, sizeof(status)) == 1);
+    idem_stats(&st);
+    assert(st.evictions == evictions);
+    printf("✅ Expired slot reused without a second chance or an eviction count\n");
+
+    idem_shutdown();
+    printf("\n🎉 All idempotency cache tests passed!\n");
+    return 0;
+}
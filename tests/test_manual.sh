@@ -22,6 +22,7 @@ gcc -Wall -Wextra -O2 -g -pthread \
     -I/usr/include/postgresql \
     tests/test_2pc.c \
     server/transaction_coordinator.c \
+    server/arena.c \
     server/log.c \
     -o build/test_2pc
 
@@ -106,6 +107,7 @@ gcc -Wall -Wextra -O2 -g -pthread \
     -I. -I/usr/include/postgresql \
     /tmp/test_coordinator.c \
     server/transaction_coordinator.c \
+    server/arena.c \
     server/log.c \
     -o build/test_component
 
@@ -159,6 +161,7 @@ gcc -Wall -Wextra -O2 -g -pthread \
     -I. -I/usr/include/postgresql \
     /tmp/test_clearing.c \
     server/clearing_participant.c \
+    server/arena.c \
     server/log.c \
     -o build/test_clearing
 
@@ -238,6 +241,7 @@ gcc -Wall -Wextra -O2 -g -pthread \
     -I. -I/usr/include/postgresql \
     /tmp/test_concurrent.c \
     server/transaction_coordinator.c \
+    server/arena.c \
     server/log.c \
     -o build/test_concurrent
 
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../server/singleflight.h"
+
+#define FOLLOWERS 8
+
+typedef struct {
+    const char *key;
+    long long deadline_ns;   // 0 = only the configured wait
+    int rc;
+    long long waited_ms;
+    char result[32];
+} Follower;
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *follower_main(void *arg) {
+    Follower *f = (Follower *)arg;
+    long long t0 = mono_ns();
+    int rc = singleflight_join(f->key, f->result, sizeof(f->result), f->deadline_ns);
+    f->waited_ms = (mono_ns() - t0) / 1000000LL;
+    __atomic_store_n(&f->rc, rc, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void start_follower(pthread_t *t, Follower *f, const char *key, long long deadline_ns) {
+    memset(f, 0, sizeof(*f));
+    f->key = key;
+    f->deadline_ns = deadline_ns;
+    f->rc = 99;
+    assert(pthread_create(t, NULL, follower_main, f) == 0);
+}
+
+typedef struct {
+    int calls;
+    char result[32];
+} Subscriber;
+
+static Subscriber subs[4];
+
+static void on_result(void *arg, const void *result, size_t size) {
+    Subscriber *s = (Subscriber *)arg;
+    memcpy(s->result, result, size < sizeof(s->result) ? size : sizeof(s->result));
+    s->calls++;
+}
+
+int main() {
+    printf("🧪 Testing Singleflight\n");
+    printf("=======================\n");
+
+    char result[32];
+    SingleflightStats before, after;
+
+    // Test 1: coalescing off, or a call it cannot take
+    printf("\n1. Testing coalescing off...\n");
+    singleflight_configure(0);
+    assert(singleflight_join("sf-off", result, sizeof(result), 0) == -1);
+    singleflight_configure(2000);
+    assert(singleflight_join("", result, sizeof(result), 0) == -1);
+    assert(singleflight_join("sf-big", result, SINGLEFLIGHT_RESULT_MAX + 1, 0) == -1);
+    printf("✅ Wait 0, empty key and oversized result run without coalescing\n");
+
+    // Test 2: singleflight_end with no follower frees the call at once
+    printf("\n2. Testing end with zero waiters...\n");
+    assert(singleflight_join("sf-alone", result, sizeof(result), 0) == 1);
+    singleflight_end("sf-alone", "alone", 6);
+    // Retired: the next arrival leads a new call instead of waiting
+    assert(singleflight_join("sf-alone", result, sizeof(result), 0) == 1);
+    singleflight_end("sf-alone", "alone", 6);
+    // Ending a key that is not in flight is a no-op
+    singleflight_end("sf-unknown", "x", 2);
+    printf("✅ Call retired by its leader, next arrival leads again\n");
+
+    // Test 3: one leader, N followers get its result
+    printf("\n3. Testing leader with %d followers...\n", FOLLOWERS);
+    singleflight_stats(&before);
+    assert(singleflight_join("sf-n", result, sizeof(result), 0) == 1);
+    pthread_t th[FOLLOWERS];
+    Follower fs[FOLLOWERS];
+    for (int i = 0; i < FOLLOWERS; ++i) start_follower(&th[i], &fs[i], "sf-n", 0);
+    usleep(200 * 1000); // let every follower block on the call
+    for (int i = 0; i < FOLLOWERS; ++i) assert(__atomic_load_n(&fs[i].rc, __ATOMIC_ACQUIRE) == 99);
+    char published[32] = "APPROVED:visa_sf_n";
+    singleflight_end("sf-n", published, sizeof(published));
+    for (int i = 0; i < FOLLOWERS; ++i) {
+        pthread_join(th[i], NULL);
+        assert(fs[i].rc == 0);
+        assert(strcmp(fs[i].result, published) == 0);
+    }
+    singleflight_stats(&after);
+    assert(after.leaders == before.leaders + 1);
+    assert(after.coalesced == before.coalesced + FOLLOWERS);
+    assert(after.timeouts == before.timeouts);
+    // The last follower out freed the retired call; the key is free again
+    assert(singleflight_join("sf-n", result, sizeof(result), 0) == 1);
+    singleflight_end("sf-n", published, sizeof(published));
+    printf("✅ Every follower received the leader's result\n");
+
+    // Test 4: a follower whose deadline passes before singleflight_end
+    printf("\n4. Testing follower timeout...\n");
+    singleflight_stats(&before);
+    assert(singleflight_join("sf-t", result, sizeof(result), 0) == 1);
+    pthread_t quick, patient;
+    Follower fq, fp;
+    start_follower(&quick, &fq, "sf-t", mono_ns() + 50 * 1000000LL);
+    start_follower(&patient, &fp, "sf-t", 0);
+    pthread_join(quick, NULL);
+    assert(fq.rc == -1);
+    assert(fq.waited_ms >= 45 && fq.waited_ms < 1000);
+    // The call is still live for the other follower (its leaving did not free it)
+    usleep(50 * 1000);
+    assert(__atomic_load_n(&fp.rc, __ATOMIC_ACQUIRE) == 99);
+    singleflight_end("sf-t", "late", 5);
+    pthread_join(patient, NULL);
+    assert(fp.rc == 0 && strcmp(fp.result, "late") == 0);
+    singleflight_stats(&after);
+    assert(after.timeouts == before.timeouts + 1);
+    assert(after.coalesced == before.coalesced + 1);
+    printf("✅ Follower gave up after %lld ms, the other one still got the result\n", fq.waited_ms);
+
+    // Test 5: every follower timed out, then the leader ends (zero waiters left)
+    printf("\n5. Testing end after all followers left...\n");
+    singleflight_configure(50); // configured wait bounds followers without a deadline
+    assert(singleflight_join("sf-gone", result, sizeof(result), 0) == 1);
+    for (int i = 0; i < 3; ++i) start_follower(&th[i], &fs[i], "sf-gone", 0);
+    for (int i = 0; i < 3; ++i) {
+        pthread_join(th[i], NULL);
+        assert(fs[i].rc == -1);
+    }
+    singleflight_end("sf-gone", "done", 5);
+    assert(singleflight_join("sf-gone", result, sizeof(result), 0) == 1);
+    singleflight_end("sf-gone", "done", 5);
+    printf("✅ Leader freed the call the timed-out followers left behind\n");
+
+    // Test 6: subscribers are answered from singleflight_end, not by waiting
+    printf("\n6. Testing subscribers...\n");
+    singleflight_configure(2000);
+    singleflight_stats(&before);
+    assert(singleflight_subscribe("sf-sub", on_result, &subs[0]) == 1); // leads
+    for (int i = 1; i <= 3; ++i) assert(singleflight_subscribe("sf-sub", on_result, &subs[i]) == 0);
+    start_follower(&th[0], &fs[0], "sf-sub", 0); // a blocking waiter on the same call
+    usleep(50 * 1000);
+    for (int i = 1; i <= 3; ++i) assert(subs[i].calls == 0);
+    singleflight_end("sf-sub", "sub", 4);
+    pthread_join(th[0], NULL);
+    assert(fs[0].rc == 0 && strcmp(fs[0].result, "sub") == 0);
+    assert(subs[0].calls == 0);
+    for (int i = 1; i <= 3; ++i) assert(subs[i].calls == 1 && strcmp(subs[i].result, "sub") == 0);
+    singleflight_stats(&after);
+    assert(after.leaders == before.leaders + 1);
+    assert(after.coalesced == before.coalesced + 4);
+    // Retired: the next subscriber leads a new call
+    assert(singleflight_subscribe("sf-sub", on_result, &subs[0]) == 1);
+    singleflight_end("sf-sub", "sub", 4);
+    assert(subs[0].calls == 0);
+    singleflight_configure(0);
+    assert(singleflight_subscribe("sf-sub", on_result, &subs[0]) == -1);
+    printf("✅ Every subscriber got the leader's result once, without a thread waiting\n");
+
+    printf("\n🎉 All singleflight tests passed!\n");
+    return 0;
+}